@@ -11,6 +11,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE    := libOddTangoUpsample
 LOCAL_SHARED_LIBRARIES := libtango-prebuilt
 LOCAL_CFLAGS    := -std=c++11
+LOCAL_ARM_NEON  := true
 LOCAL_SRC_FILES := jni/TangoUpsampleNative.cpp \
                    jni/Tango.cpp \
 				   jni/GlVideoOverlay.cpp \
@@ -20,6 +21,17 @@ LOCAL_SRC_FILES := jni/TangoUpsampleNative.cpp \
 				   jni/GlQuad.cpp \
 				   jni/GlDepthUpsampler.cpp \
 				   jni/MaterialShaders.cpp \
+				   jni/CpuImagePyramid.cpp \
+				   jni/CpuQuantizedBilateralGrid.cpp \
+				   jni/GridTuner.cpp \
+				   jni/CpuHierarchicalUpsampler.cpp \
+				   jni/CpuBilateralGridBatch.cpp \
+				   jni/CpuBlockBilateralGrid.cpp \
+				   jni/CpuBilateralSolver.cpp \
+				   jni/CpuImageStorage.cpp \
+				   jni/CpuPermutohedralLattice.cpp \
+				   jni/CpuSparseBilateralGrid.cpp \
+				   jni/CpuBilateralGrid.cpp \
 				   jni/GlMaterial.cpp \
                    modules/tango-gl-renderer/ar_ruler.cpp \
                    modules/tango-gl-renderer/axis.cpp \
@@ -34,5 +46,5 @@ LOCAL_C_INCLUDES := $(LOCAL_PATH)/jni \
 					$(LOCAL_PATH)/modules \
 					$(LOCAL_PATH)/third/inc \
                     $(LOCAL_PATH)/third/inc/glm
-LOCAL_LDLIBS    := -llog -lGLESv3 -L$(SYSROOT)/usr/lib
+LOCAL_LDLIBS    := -llog -lGLESv3 -lEGL -L$(SYSROOT)/usr/lib
 include $(BUILD_SHARED_LIBRARY)
@@ -0,0 +1,450 @@
+
+#ifndef BILATERALGRIDPOLICY_H
+#define BILATERALGRIDPOLICY_H
+
+#include "TangoUpsampleUtil.h"
+#include <math.h>
+#include <string>
+
+// The policies the grid engines (CpuBilateralGridT and GlBilateralGridT) are built from.
+//
+// A RangePolicy maps a colour to the two range coordinates of the grid, a LayoutPolicy places
+// the cells of the 4D grid in the 2D raster. Each formula is written once, as a macro argument
+// that is compiled as C++ for the cpu engine and stringized into the GLSL of the gpu engine,
+// so splat, slice and both engines always agree.
+//
+// Policy:
+//	static void inputRange(const float* rgb, const int* gridSize, float* inputRange);
+//	static const char* glsl();	// vec2 createInputRange(in vec3 rgb, in vec4 gridSize)
+//
+// LayoutPolicy:
+//	static void texel(int x, int y, int z, int w, const int* gridSize, int* rasterX, int* rasterY);
+//	static void rasterSize(const int* gridSize, int* width, int* height);
+//	static void axisDelta(int axis, const int* gridSize, int* dx, int* dy);
+//	static GridBounds blurredBounds(const GridBounds& bounds, const int* gridSize);
+//	static void forEachRasterRect(const GridBounds& bounds, const int* gridSize, f(x, y, width, height));
+//	static const char* glsl();	// ivec2 gridCellToTexel(ivec4 cell, ivec4 gridSize), ivec2 gridRasterSize(ivec4 gridSize)
+//
+// BlockLayoutPolicy (cpu only, for CpuBlockBilateralGridT):
+//	static size_t block(int x, int y, const int* gridSize);
+//	static size_t numBlocks(const int* gridSize);
+
+#define BILATERAL_GLSL(...) #__VA_ARGS__
+#define BILATERAL_GLSL_EXPAND(...) BILATERAL_GLSL(__VA_ARGS__)
+
+// cells the three 5-tap blur iterations reach along an axis.
+static const int kBlurRadius = 6;
+
+// the grid blur is a gaussian along each axis, with one sigma for the spatial axes and one for the
+// range axes (blurSigma of the engines, in input units like gridSigma, so gridSigma is one cell).
+// the default spatial sigma is that of the original three iterations of the [e^-2, e^-0.5, 1] taps,
+// and the range axes get one cell.
+inline void defaultBlurSigma(const float* gridSigma, float* blurSigma)
+{
+	blurSigma[0] = sqrtf(3.0f) * gridSigma[0];
+	blurSigma[1] = gridSigma[2];
+}
+
+// the sigma of the blur along an axis, in cells.
+inline float gridBlurCells(const float* blurSigma, const float* gridSigma, int axis)
+{
+	return blurSigma[axis < 2 ? 0 : 1] / gridSigma[axis];
+}
+
+// the outer and inner taps (the center tap is 1) of one of the three 5-tap iterations that blur an
+// axis by sigma cells, each taking a third of the variance. Sigma 0 leaves the axis unchanged.
+// the taps only reach kBlurRadius cells, so past about 2 cells the kernel flattens towards a box.
+inline void gridBlurTaps(float sigmaCells, float* tap1, float* tap2)
+{
+	if (sigmaCells <= 0.0f)
+	{
+		*tap1 = *tap2 = 0.0f;
+		return;
+	}
+	const float variance = sigmaCells * sigmaCells / 3.0f;
+	*tap1 = expf(-0.5f / variance);
+	*tap2 = expf(-2.0f / variance);
+}
+
+// a box of grid cells, [lo, hi) along each of the four axes (x, y, range1, range2).
+// the grids track the box their splats cover, so clear, blur and normalize can skip the empty rest.
+struct GridBounds
+{
+	int lo[4], hi[4];
+
+	GridBounds() { setEmpty(); }
+
+	void setEmpty()
+	{
+		for (int i = 0; i < 4; ++i)
+			lo[i] = hi[i] = 0;
+	}
+
+	void setFull(const int* gridSize)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			lo[i] = 0;
+			hi[i] = gridSize[i];
+		}
+	}
+
+	bool empty() const
+	{
+		return hi[0] <= lo[0] || hi[1] <= lo[1] || hi[2] <= lo[2] || hi[3] <= lo[3];
+	}
+
+	bool contains(const GridBounds& b) const
+	{
+		if (b.empty())
+			return true;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (b.lo[i] < lo[i] || b.hi[i] > hi[i])
+				return false;
+		}
+		return !empty();
+	}
+
+	void include(int x, int y, int z, int w)
+	{
+		GridBounds cell;
+		const int c[4] = { x, y, z, w };
+		for (int i = 0; i < 4; ++i)
+		{
+			cell.lo[i] = c[i];
+			cell.hi[i] = c[i] + 1;
+		}
+		unite(cell);
+	}
+
+	void unite(const GridBounds& b)
+	{
+		if (b.empty())
+			return;
+		if (empty())
+		{
+			*this = b;
+			return;
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			lo[i] = std::min(lo[i], b.lo[i]);
+			hi[i] = std::max(hi[i], b.hi[i]);
+		}
+	}
+
+	// the box grown by radius cells along every axis, clamped to the grid.
+	GridBounds dilated(int radius, const int* gridSize) const
+	{
+		GridBounds b = *this;
+		if (b.empty())
+			return b;
+		for (int i = 0; i < 4; ++i)
+		{
+			b.lo[i] = std::max(0, lo[i] - radius);
+			b.hi[i] = std::min(gridSize[i], hi[i] + radius);
+		}
+		return b;
+	}
+};
+
+// a rectangle of output pixels, [x, x + width) x [y, y + height), for the slices of a region of interest.
+struct SliceRect
+{
+	int x, y, width, height;
+};
+
+//---------------------------------------------------
+// range policies. r, g and b are the colour in [0,1], and each range coordinate is in [0,1]
+// (scaled to the cells of its axis). The second axis only has cells if the grid was set up
+// with inputSize.w > 1, so the one-axis policies give it 0.
+
+#define BILATERAL_RANGE_POLICY(Name, range0, range1) \
+	struct Name \
+	{ \
+		static void inputRange(const float* rgb, const int* gridSize, float* inputRange) \
+		{ \
+			const float r = rgb[0], g = rgb[1], b = rgb[2]; \
+			(void)r; (void)g; (void)b; \
+			inputRange[0] = (range0) * float(gridSize[2] - 1); \
+			inputRange[1] = (range1) * float(gridSize[3] - 1); \
+		} \
+		static const char* glsl() \
+		{ \
+			return \
+				"vec2 createInputRange(in vec3 rgb, in vec4 gridSize)\n" \
+				"{\n" \
+				"	float r = rgb.r, g = rgb.g, b = rgb.b;\n" \
+				"	return vec2(" #range0 ", " #range1 ") * (gridSize.zw - vec2(1.0));\n" \
+				"}\n"; \
+		} \
+	};
+
+// the mean of red and green (the range of the original shaders).
+BILATERAL_RANGE_POLICY(RangeAverageRG, (r + g) / 2.0f, 0.0f)
+// Rec. 709 luma.
+BILATERAL_RANGE_POLICY(RangeLuma, 0.2126f * r + 0.7152f * g + 0.0722f * b, 0.0f)
+// red and green on separate axes.
+BILATERAL_RANGE_POLICY(RangeRedGreen, r, g)
+// the Rec. 709 chroma pair (Cb, Cr), offset to [0,1], so edges of equal brightness still separate.
+BILATERAL_RANGE_POLICY(RangeChroma,
+	(b - (0.2126f * r + 0.7152f * g + 0.0722f * b)) / 1.8556f + 0.5f,
+	(r - (0.2126f * r + 0.7152f * g + 0.0722f * b)) / 1.5748f + 0.5f)
+
+// the knots of a RangeCurve, evenly spaced over [0,1].
+static const int kRangeCurveKnots = 17;
+
+// an adaptive range axis: a monotone curve per range axis from the range coordinate of the policy
+// (in [0,1]) to the one the cells are laid over, piecewise linear between the knots. Equalizing
+// the histogram of a frame's guidance spreads the colours it has over all the range cells, where a
+// linear axis leaves the cells of the colours it lacks empty and crowds the rest, so fewer range
+// cells (a smaller grid and less blur) separate the same edges. The splat and the slice of a grid
+// both map through its curve, so change it only between a clear and the next splat.
+struct RangeCurve
+{
+	bool enabled;	// off is the linear axis of the policy.
+	float knots[2][kRangeCurveKnots];
+
+	RangeCurve() { setIdentity(); }
+
+	void setIdentity()
+	{
+		enabled = false;
+		for (int i = 0; i < 2; ++i)
+		{
+			for (int k = 0; k < kRangeCurveKnots; ++k)
+				knots[i][k] = float(k) / float(kRangeCurveKnots - 1);
+		}
+	}
+
+	// each axis gets the cumulative distribution of its histogram (numBins bins over [0,1]), mixed with
+	// the identity by identityWeight, which keeps the slope at least that so the colours the frame lacks
+	// still get cells when they show up. An axis without a histogram (or with an empty one) stays linear.
+	void equalize(const float* histogram0, const float* histogram1, int numBins, float identityWeight = 0.25f)
+	{
+		setIdentity();
+		enabled = true;
+		const float* histograms[2] = { histogram0, histogram1 };
+		for (int i = 0; i < 2; ++i)
+		{
+			const float* histogram = histograms[i];
+			if (!histogram)
+				continue;
+			float total = 0;
+			for (int bin = 0; bin < numBins; ++bin)
+				total += histogram[bin];
+			if (total <= 0)
+				continue;
+
+			// the distribution is linear within a bin.
+			float below = 0;
+			int bin = 0;
+			for (int k = 1; k < kRangeCurveKnots - 1; ++k)
+			{
+				const float position = float(k) / float(kRangeCurveKnots - 1) * float(numBins);
+				for (; bin < int(position); ++bin)
+					below += histogram[bin];
+				const float cdf = (below + histogram[bin] * (position - float(bin))) / total;
+				knots[i][k] = (1.0f - identityWeight) * std::min(cdf, 1.0f) + identityWeight * float(k) / float(kRangeCurveKnots - 1);
+			}
+		}
+	}
+
+	// maps the inputRange of a policy (in cells, 0 to gridSize - 1) through the curve.
+	void apply(const int* gridSize, float* inputRange) const
+	{
+		if (!enabled)
+			return;
+		for (int i = 0; i < 2; ++i)
+		{
+			const float cells = float(gridSize[2 + i] - 1);
+			const float t = std::min(std::max(inputRange[i] / std::max(cells, 1.0f), 0.0f), 1.0f) * float(kRangeCurveKnots - 1);
+			const int k = std::min(int(t), kRangeCurveKnots - 2);
+			inputRange[i] = (knots[i][k] + (knots[i][k + 1] - knots[i][k]) * (t - float(k))) * cells;
+		}
+	}
+
+	// vec2 applyRangeCurve(in vec2 inputRange, in vec4 gridSize), the same, with the curve in the uniforms
+	// rangeCurveEnabled and rangeCurveKnots (the knots of both axes, as knots).
+	static const char* glsl()
+	{
+		return
+			"uniform bool rangeCurveEnabled;\n"
+			"uniform float rangeCurveKnots[34];\n"
+			"vec2 applyRangeCurve(in vec2 inputRange, in vec4 gridSize)\n"
+			"{\n"
+			"	if (!rangeCurveEnabled)\n"
+			"		return inputRange;\n"
+			"	vec2 cells = gridSize.zw - vec2(1.0);\n"
+			"	vec2 t = clamp(inputRange / max(cells, vec2(1.0)), 0.0, 1.0) * 16.0;\n"
+			"	ivec2 k = min(ivec2(t), ivec2(15));\n"
+			"	float a = rangeCurveKnots[k.x], b = rangeCurveKnots[17 + k.y];\n"
+			"	float c = rangeCurveKnots[k.x + 1], d = rangeCurveKnots[17 + k.y + 1];\n"
+			"	return (vec2(a, b) + (vec2(c, d) - vec2(a, b)) * (t - vec2(k))) * cells;\n"
+			"}\n";
+	}
+};
+static_assert(kRangeCurveKnots == 17, "RangeCurve::glsl has the knots as literals");
+
+//---------------------------------------------------
+// layout policies.
+
+// cell (x, y, z, w) at raster (x + z * gridSize[0], y + w * gridSize[1]): each range slice is a
+// gridSize[0] x gridSize[1] tile, and the spatial neighbours of a cell are its raster neighbours.
+#define BILATERAL_LAYOUT_RANGE_TILES(x, y, z, w, gx, gy, gz, gw) (x) + (z) * (gx), (y) + (w) * (gy)
+
+struct LayoutRangeTiles
+{
+	static void texel(int x, int y, int z, int w, const int* gridSize, int* rasterX, int* rasterY)
+	{
+		const int t[2] = { BILATERAL_LAYOUT_RANGE_TILES(x, y, z, w, gridSize[0], gridSize[1], gridSize[2], gridSize[3]) };
+		*rasterX = t[0];
+		*rasterY = t[1];
+	}
+
+	// the last cell is at the far corner of the raster.
+	static void rasterSize(const int* gridSize, int* width, int* height)
+	{
+		texel(gridSize[0] - 1, gridSize[1] - 1, gridSize[2] - 1, gridSize[3] - 1, gridSize, width, height);
+		*width += 1;
+		*height += 1;
+	}
+
+	// the raster step between neighbouring cells along an axis (the blur pass deltas).
+	static void axisDelta(int axis, const int* gridSize, int* dx, int* dy)
+	{
+		int c[4] = { 0, 0, 0, 0 };
+		c[axis] = 1;
+		texel(c[0], c[1], c[2], c[3], gridSize, dx, dy);
+	}
+
+	// the cells the blur (x, y, then the range axes) spreads a box of cells to.
+	// the spatial passes run along the raster, so they also reach the first and last
+	// columns (or rows) of the neighbouring range slices, or past them into further
+	// slices where a slice is fewer than kBlurRadius cells wide (or high).
+	static GridBounds blurredBounds(const GridBounds& bounds, const int* gridSize)
+	{
+		GridBounds b = bounds;
+		if (b.empty())
+			return b;
+		for (int i = 0; i < 2; ++i)
+		{
+			const int slice = i + 2;
+			const int slices = (kBlurRadius + gridSize[i] - 1) / gridSize[i];
+			if (b.lo[i] - kBlurRadius < 0)
+			{
+				b.hi[i] = gridSize[i];
+				b.lo[slice] = std::max(0, b.lo[slice] - slices);
+			}
+			if (b.hi[i] + kBlurRadius > gridSize[i])
+			{
+				b.lo[i] = 0;
+				b.hi[slice] = std::min(gridSize[slice], b.hi[slice] + slices);
+			}
+			b.lo[i] = std::max(0, b.lo[i] - kBlurRadius);
+			b.hi[i] = std::min(gridSize[i], b.hi[i] + kBlurRadius);
+		}
+		for (int i = 2; i < 4; ++i)
+		{
+			b.lo[i] = std::max(0, b.lo[i] - kBlurRadius);
+			b.hi[i] = std::min(gridSize[i], b.hi[i] + kBlurRadius);
+		}
+		return b;
+	}
+
+	// call f(x, y, width, height) for the raster rectangles of a box, one per range slice,
+	// merged along a range axis where the box spans the whole spatial axis.
+	template <typename Func>
+	static void forEachRasterRect(const GridBounds& b, const int* gridSize, Func f)
+	{
+		if (b.empty())
+			return;
+		const bool fullX = (b.lo[0] == 0 && b.hi[0] == gridSize[0]);
+		const bool fullY = (b.lo[1] == 0 && b.hi[1] == gridSize[1]);
+		const int stepZ = fullX ? b.hi[2] - b.lo[2] : 1;
+		const int stepW = fullY ? b.hi[3] - b.lo[3] : 1;
+
+		for (int w = b.lo[3]; w < b.hi[3]; w += stepW)
+		{
+			for (int z = b.lo[2]; z < b.hi[2]; z += stepZ)
+			{
+				f(b.lo[0] + z * gridSize[0], b.lo[1] + w * gridSize[1],
+					b.hi[0] - b.lo[0] + (stepZ - 1) * gridSize[0], b.hi[1] - b.lo[1] + (stepW - 1) * gridSize[1]);
+			}
+		}
+	}
+
+	static const char* glsl()
+	{
+		return
+			"ivec2 gridCellToTexel(in ivec4 cell, in ivec4 gridSize)\n"
+			"{\n"
+			"	return ivec2(" BILATERAL_GLSL_EXPAND(BILATERAL_LAYOUT_RANGE_TILES(cell.x, cell.y, cell.z, cell.w,
+				gridSize.x, gridSize.y, gridSize.z, gridSize.w)) ");\n"
+			"}\n"
+			"ivec2 gridRasterSize(in ivec4 gridSize)\n"
+			"{\n"
+			"	return gridCellToTexel(gridSize - ivec4(1), gridSize) + ivec2(1);\n"
+			"}\n";
+	}
+};
+
+//---------------------------------------------------
+// block layouts (cpu only). All the range cells of a spatial cell (x, y) are one contiguous block of
+// gridSize[2] * gridSize[3] cells, z innermost, so a range blur pass and the splats of nearby colours
+// stay within a few cache lines. The layout only orders the blocks.
+
+// blocks in row-major order (the range-innermost AoSoA layout): a grid row is one contiguous run.
+struct LayoutRangeBlocks
+{
+	static size_t block(int x, int y, const int* gridSize)
+	{
+		return size_t(y) * gridSize[0] + x;
+	}
+
+	static size_t numBlocks(const int* gridSize)
+	{
+		return size_t(gridSize[0]) * gridSize[1];
+	}
+};
+
+// blocks in Z-order (Morton order) within square bricks of kBrickSize^2 blocks, bricks in row-major order.
+// the spatial neighbours of a cell are close in memory along y as well as x, and the padding of the
+// edge bricks is at most kBrickSize - 1 blocks per row and column.
+struct LayoutMortonBricks
+{
+	static const int kBrickBits = 3;
+	static const int kBrickSize = 1 << kBrickBits;
+
+	// the bits of v spread to the even bits.
+	static unsigned spreadBits(unsigned v)
+	{
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	}
+
+	static size_t block(int x, int y, const int* gridSize)
+	{
+		const int bricksX = (gridSize[0] + kBrickSize - 1) >> kBrickBits;
+		const size_t brick = size_t(y >> kBrickBits) * bricksX + (x >> kBrickBits);
+		return (brick << (2 * kBrickBits)) + (spreadBits(x & (kBrickSize - 1)) | (spreadBits(y & (kBrickSize - 1)) << 1));
+	}
+
+	static size_t numBlocks(const int* gridSize)
+	{
+		const size_t bricksX = (gridSize[0] + kBrickSize - 1) >> kBrickBits;
+		const size_t bricksY = (gridSize[1] + kBrickSize - 1) >> kBrickBits;
+		return (bricksX * bricksY) << (2 * kBrickBits);
+	}
+};
+
+// the GLSL of a policy pair and the range curve, for the shaders of GlBilateralGridT.
+template <class RangePolicy, class LayoutPolicy>
+std::string bilateralGridGlsl()
+{
+	return std::string(RangePolicy::glsl()) + RangeCurve::glsl() + LayoutPolicy::glsl();
+}
+
+#endif  // BILATERALGRIDPOLICY_H
@@ -0,0 +1,1387 @@
+
+#include "CpuBilateralGrid.h"
+#include <math.h>
+#include <string.h>
+
+// cells per side of an occupancy block.
+static const int kOccupancyBlock = 8;
+
+CpuBilateralGridArena::CpuBilateralGridArena()
+{
+	rasterFloats_ = 0;
+	user = 0;
+	dirty[0].setEmpty();
+	dirty[1].setEmpty();
+	for (int i = 0; i < 4; ++i)
+		dirtyGridSize[i] = 0;
+}
+
+void CpuBilateralGridArena::allocate_()
+{
+	// the rasters and blocks start on 64 byte boundaries of the allocation.
+	size_t offset = 2 * rasterFloats_;
+	blockOffsets_.resize(blockFloats_.size());
+	for (size_t i = 0; i < blockFloats_.size(); ++i)
+	{
+		blockOffsets_[i] = offset;
+		offset += (blockFloats_[i] + 15) & ~size_t(15);
+	}
+	memory_.assign(offset, 0.0f);
+	user = 0;
+	dirty[0].setEmpty();
+	dirty[1].setEmpty();
+}
+
+void CpuBilateralGridArena::reserve(size_t rasterFloats)
+{
+	rasterFloats = (rasterFloats + 15) & ~size_t(15);
+	if (rasterFloats <= rasterFloats_ && !memory_.empty())
+		return;
+	rasterFloats_ = std::max(rasterFloats, rasterFloats_);
+	allocate_();
+}
+
+void CpuBilateralGridArena::setBlocks(const std::vector<size_t>& blockFloats)
+{
+	if (blockFloats == blockFloats_ && !memory_.empty())
+		return;
+	blockFloats_ = blockFloats;
+	allocate_();
+}
+
+void CpuBilateralGridArena::release()
+{
+	std::vector<float>().swap(memory_);
+	rasterFloats_ = 0;
+	blockFloats_.clear();
+	blockOffsets_.clear();
+	user = 0;
+	dirty[0].setEmpty();
+	dirty[1].setEmpty();
+}
+
+void CpuBilateralGridArena::markDirty(int i, const GridBounds& bounds, const int* gridSize)
+{
+	for (int a = 0; a < 4; ++a)
+		dirtyGridSize[a] = gridSize[a];
+	dirty[i].unite(bounds);
+}
+
+bool CpuBilateralGridArena::acquire(const void* grid)
+{
+	if (user == grid)
+		return false;
+
+	int rasterWidth, rasterHeight;
+	LayoutRangeTiles::rasterSize(dirtyGridSize, &rasterWidth, &rasterHeight);
+	for (int i = 0; i < 2; ++i)
+	{
+		float* buffer = raster(i);
+		LayoutRangeTiles::forEachRasterRect(dirty[i], dirtyGridSize, [&](int x, int y, int width, int height)
+		{
+			for (int row = y; row < y + height; ++row)
+				memset(buffer + (size_t(row) * rasterWidth + x) * 4, 0, sizeof(float) * 4 * width);
+		});
+		dirty[i].setEmpty();
+	}
+	user = grid;
+	return true;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+CpuBilateralGridT<RangePolicy, LayoutPolicy>::CpuBilateralGridT(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	arena_ = &ownArena_;
+	gridRasterWidth = gridRasterHeight = 0;
+	sliceLinear = true;
+	persistenceTime = 0;
+	maxSplatDepth = 0;
+	trackBounds = true;
+	occupancyTilesX_ = occupancyTilesY_ = 0;
+	splatMode = CPU_SPLAT_AUTO;
+	partialsPending_ = false;
+	lastSplatTime_ = 0;
+	hasHistory_ = false;
+	for (int i = 0; i < 4; ++i)
+	{
+		gridSigma[i] = 1;
+		gridInputSize[i] = gridPadding[i] = gridSize[i] = 0;
+	}
+	defaultBlurSigma(gridSigma, blurSigma);
+	recursiveBlur = false;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+CpuBilateralGridT<RangePolicy, LayoutPolicy>::~CpuBilateralGridT()
+{
+	arena_->releaseUser(this);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	CpuBilateralGridArena* arena)
+{
+	arena_->releaseUser(this);
+	arena_ = arena ? arena : &ownArena_;
+	// an own arena fits the grid, a shared one only grows.
+	ownArena_.release();
+
+	setupGridParams(inputSize, sigma, padding, gridInputSize, gridSigma, gridPadding, gridSize);
+	defaultBlurSigma(gridSigma, blurSigma);
+
+	LayoutPolicy::rasterSize(gridSize, &gridRasterWidth, &gridRasterHeight);
+
+	arena_->reserve(gridFloats());
+	gridBounds_[0].setEmpty();
+	gridBounds_[1].setEmpty();
+	// allocated on the first persistent splat.
+	historyBuffer_.clear();
+	historyBounds_.setEmpty();
+	hasHistory_ = false;
+
+	occupancyTilesX_ = (gridSize[0] + kOccupancyBlock - 1) / kOccupancyBlock;
+	occupancyTilesY_ = (gridSize[1] + kOccupancyBlock - 1) / kOccupancyBlock;
+	occupancy_.assign(size_t(occupancyTilesX_) * gridSize[2] * occupancyTilesY_ * gridSize[3], 0);
+	partials_.clear();
+	partialsPending_ = false;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::clearRegion_(float* buffer, const GridBounds& bounds)
+{
+	const int rasterStride = gridRasterWidth * 4;
+
+	LayoutPolicy::forEachRasterRect(bounds, gridSize, [&](int x, int y, int width, int height)
+	{
+		threadPool_->parallelFor(y, y + height, [&](int y0, int y1)
+		{
+			for (int row = y0; row < y1; ++row)
+				memset(buffer + size_t(row) * rasterStride + x * 4, 0, sizeof(float) * 4 * width);
+		});
+	});
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::acquireArena_()
+{
+	// the last grid's cells were zeroed, along with this grid's if it had been there before.
+	if (arena_->acquire(this))
+	{
+		gridBounds_[0].setEmpty();
+		gridBounds_[1].setEmpty();
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::markArena_()
+{
+	arena_->markDirty(0, gridBounds_[0], gridSize);
+	arena_->markDirty(1, gridBounds_[1], gridSize);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::clear()
+{
+	acquireArena_();
+	clearRegion_(arena_->raster(0), gridBounds_[0]);
+	gridBounds_[0].setEmpty();
+	if (!historyBuffer_.empty())
+		clearRegion_(&historyBuffer_[0], historyBounds_);
+	historyBounds_.setEmpty();
+	std::fill(occupancy_.begin(), occupancy_.end(), 0);
+	hasHistory_ = false;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+GridBounds& CpuBilateralGridT<RangePolicy, LayoutPolicy>::splatTargetBounds_()
+{
+	return (persistenceTime <= 0) ? gridBounds_[0] : historyBounds_;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+bool CpuBilateralGridT<RangePolicy, LayoutPolicy>::occupied_(int rasterX0, int rasterY0, int rasterX1, int rasterY1) const
+{
+	rasterX0 = std::max(rasterX0, 0);
+	rasterY0 = std::max(rasterY0, 0);
+	rasterX1 = std::min(rasterX1, gridRasterWidth);
+	rasterY1 = std::min(rasterY1, gridRasterHeight);
+	if (rasterX0 >= rasterX1 || rasterY0 >= rasterY1)
+		return false;
+
+	// split the raster rectangle at the range slice edges...
+	const int occupancyStride = occupancyTilesX_ * gridSize[2];
+	for (int w = rasterY0 / gridSize[1]; w <= (rasterY1 - 1) / gridSize[1]; ++w)
+	{
+		const int y0 = std::max(rasterY0 - w * gridSize[1], 0) / kOccupancyBlock;
+		const int y1 = (std::min(rasterY1 - w * gridSize[1], gridSize[1]) - 1) / kOccupancyBlock;
+
+		for (int z = rasterX0 / gridSize[0]; z <= (rasterX1 - 1) / gridSize[0]; ++z)
+		{
+			const int x0 = std::max(rasterX0 - z * gridSize[0], 0) / kOccupancyBlock;
+			const int x1 = (std::min(rasterX1 - z * gridSize[0], gridSize[0]) - 1) / kOccupancyBlock;
+
+			for (int ty = y0; ty <= y1; ++ty)
+			{
+				const odd::uint8* row = &occupancy_[size_t(ty + w * occupancyTilesY_) * occupancyStride + z * occupancyTilesX_];
+				for (int tx = x0; tx <= x1; ++tx)
+				{
+					if (row[tx])
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+float* CpuBilateralGridT<RangePolicy, LayoutPolicy>::splatTarget_(float inputTime)
+{
+	if (persistenceTime <= 0)
+		return arena_->raster(0);
+
+	const size_t numFloats = size_t(gridRasterWidth) * gridRasterHeight * 4;
+	if (historyBuffer_.size() != numFloats)
+	{
+		historyBuffer_.assign(numFloats, 0.0f);
+		historyBounds_.setEmpty();
+		hasHistory_ = false;
+	}
+
+	float* history = &historyBuffer_[0];
+	const int rasterStride = gridRasterWidth * 4;
+	float dt = inputTime - lastSplatTime_;
+
+	if (!hasHistory_ || dt < 0)
+	{
+		// nothing to keep (or the clock went backwards).
+		clearRegion_(history, historyBounds_);
+		historyBounds_.setEmpty();
+		std::fill(occupancy_.begin(), occupancy_.end(), 0);
+	}
+	else if (dt > 0)
+	{
+		// fade the older splats in place (as the GL_CONSTANT_COLOR blend of GlBilateralGrid).
+		const Float4 decay = Float4::splat(expf(-dt / persistenceTime));
+		LayoutPolicy::forEachRasterRect(historyBounds_, gridSize, [&](int x, int y, int width, int height)
+		{
+			threadPool_->parallelFor(y, y + height, [&](int y0, int y1)
+			{
+				for (int row = y0; row < y1; ++row)
+				{
+					float* p = history + size_t(row) * rasterStride + x * 4;
+					for (float* end = p + width * 4; p < end; p += 4)
+						(Float4::load(p) * decay).store(p);
+				}
+			});
+		});
+	}
+
+	lastSplatTime_ = inputTime;
+	hasHistory_ = true;
+	return history;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::splatRows_(const SplatSource& source, int yBegin, int yEnd, float* target, int row0, int rows,
+	odd::uint8* occupancy, int tileRow0, int tileRows, GridBounds* bounds)
+{
+	const int inputWidth = gridInputSize[0];
+	const size_t rasterStride = size_t(gridRasterWidth) * 4;
+	const int occupancyStride = occupancyTilesX_ * gridSize[2];
+	const Float4 sampleWeight = Float4::splat(source.weight);
+
+	for (int y = yBegin; y < yEnd; ++y)
+	{
+		const float* srcRow = source.rgbd + size_t(source.srcY[y]) * source.stride;
+		const float* confidenceRow = source.confidence ? source.confidence + size_t(source.srcY[y]) * source.confidenceStride : 0;
+		const int gy = source.cellY[y];
+		if (gy < row0 || gy >= row0 + rows)
+			continue;
+
+		for (int x = 0; x < inputWidth; ++x)
+		{
+			const int sx = source.srcX[x];
+			const float* rgbdSample = srcRow + sx * 4;
+
+			// don't splat invalid pixels.
+			if (rgbdSample[3] <= 0.0f || (maxSplatDepth > 0.0f && rgbdSample[3] >= maxSplatDepth))
+				continue;
+			const float sampleConfidence = confidenceRow ? confidenceRow[sx] : 1.0f;
+			if (sampleConfidence <= 0.0f)
+				continue;
+
+			float inputRange[2];
+			RangePolicy::inputRange(rgbdSample, gridSize, inputRange);
+			rangeCurve.apply(gridSize, inputRange);
+
+			const int gx = source.cellX[x];
+			const int gz = gridInputToGridCell(inputRange[0], source.sigmaInv[2], gridPadding[2]);
+			const int gw = gridInputToGridCell(inputRange[1], source.sigmaInv[3], gridPadding[3]);
+			if (gx < 0 || gx >= gridSize[0] || gz < 0 || gz >= gridSize[2] || gw < 0 || gw >= gridSize[3])
+				continue;
+
+			// encode the grid sample as [red, green, depth, weight]
+			// (the raster texel of the cell, with the rows of the target's grid rows only).
+			float* cell = target + size_t(gy - row0 + gw * rows) * rasterStride + (gx + gz * gridSize[0]) * 4;
+			// the accumulation is additive, so scaling the sample scales its vote in the grid.
+			Float4 value = Float4::set(rgbdSample[0], rgbdSample[1], rgbdSample[3], 1.0f);
+			madd(value, sampleWeight * Float4::splat(sampleConfidence), Float4::load(cell)).store(cell);
+
+			bounds->include(gx, gy, gz, gw);
+			occupancy[size_t(gy / kOccupancyBlock - tileRow0 + gw * tileRows) * occupancyStride +
+				gx / kOccupancyBlock + gz * occupancyTilesX_] = 1;
+		}
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride, float inputTime, float weight,
+	const float* confidence, int confidenceStride)
+{
+	if (srcStride <= 0)
+		srcStride = srcWidth * 4;
+	if (confidenceStride <= 0)
+		confidenceStride = srcWidth;
+
+	const int inputWidth = gridInputSize[0];
+	const int inputHeight = gridInputSize[1];
+	SplatSource source;
+	source.rgbd = srcRgbd;
+	source.stride = srcStride;
+	source.confidence = confidence;
+	source.confidenceStride = confidenceStride;
+	source.weight = weight;
+	for (int i = 0; i < 4; ++i)
+		source.sigmaInv[i] = 1.0f / gridSigma[i];
+
+	// the splat mesh has one point per input texel, which samples the nearest source texel.
+	source.srcX.resize(inputWidth);
+	source.cellX.resize(inputWidth);
+	source.srcY.resize(inputHeight);
+	source.cellY.resize(inputHeight);
+	for (int x = 0; x < inputWidth; ++x)
+	{
+		source.srcX[x] = nearestTexel(x, inputWidth, srcWidth);
+		source.cellX[x] = gridInputToGridCell(float(x), source.sigmaInv[0], gridPadding[0]);
+	}
+	for (int y = 0; y < inputHeight; ++y)
+	{
+		source.srcY[y] = nearestTexel(y, inputHeight, srcHeight);
+		source.cellY[y] = gridInputToGridCell(float(y), source.sigmaInv[1], gridPadding[1]);
+	}
+
+	acquireArena_();
+	float* grid = splatTarget_(inputTime);
+	GridBounds& targetBounds = splatTargetBounds_();
+
+	const int numThreads = threadPool_->numThreads();
+	const bool partial = (splatMode == CPU_SPLAT_PARTIAL_GRIDS) ||
+		(splatMode == CPU_SPLAT_AUTO && numThreads > 1 && occupancyTilesY_ < 2 * numThreads);
+	if (partial)
+	{
+		splatPartials_(source, &targetBounds);
+		// the tiled blur adds the partials as it loads the splats, the recursive one and a
+		// persistent grid (which keeps the splats) take them in a pass of their own.
+		if (recursiveBlur || persistenceTime > 0)
+			mergePartials_(grid);
+	}
+	else
+	{
+		const std::vector<int>& cellY = source.cellY;
+		Mutex boundsMutex;
+
+		// each task owns a band of grid rows, and so every input row whose cells land in them.
+		// the bands never share a raster row or an occupancy block, so the scatter needs no atomics.
+		threadPool_->parallelFor(0, occupancyTilesY_, [&](int t0, int t1)
+		{
+			const int cy0 = t0 * kOccupancyBlock;
+			const int cy1 = std::min(t1 * kOccupancyBlock, gridSize[1]);
+			GridBounds bounds;
+
+			int yBegin = int(std::lower_bound(cellY.begin(), cellY.end(), cy0) - cellY.begin());
+			int yEnd = int(std::lower_bound(cellY.begin(), cellY.end(), cy1) - cellY.begin());
+			splatRows_(source, yBegin, yEnd, grid, 0, gridSize[1], &occupancy_[0], 0, occupancyTilesY_, &bounds);
+
+			ScopedMutex lock(boundsMutex);
+			targetBounds.unite(bounds);
+		}, 1);
+	}
+
+	if (!trackBounds)
+		targetBounds.setFull(gridSize);
+
+	blurAndNormalize_(grid, targetBounds);
+	partialsPending_ = false;
+	markArena_();
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::splatPartials_(const SplatSource& source, GridBounds* targetBounds)
+{
+	// one partial per thread, over an equal share of the input rows. The input rows are in the
+	// order of their grid rows, so a partial only needs the grid rows between its first and last,
+	// and the partials overlap at most in the grid rows that neighbouring shares split.
+	const int inputHeight = gridInputSize[1];
+	const int numPartials = std::max(1, std::min(threadPool_->numThreads(), inputHeight));
+	const size_t rasterStride = size_t(gridRasterWidth) * 4;
+	const int occupancyStride = occupancyTilesX_ * gridSize[2];
+
+	partials_.resize(numPartials);
+	partialsOfRow_.assign(size_t(gridSize[1]) * 2, 0);
+	for (int i = gridSize[1] - 1; i >= 0; --i)
+		partialsOfRow_[i * 2] = numPartials;
+
+	for (int p = 0; p < numPartials; ++p)
+	{
+		SplatPartial& partial = partials_[p];
+		const int yBegin = int(size_t(inputHeight) * p / numPartials);
+		const int yEnd = int(size_t(inputHeight) * (p + 1) / numPartials);
+		const int row0 = std::min(std::max(source.cellY[yBegin], 0), gridSize[1] - 1);
+		const int row1 = std::min(std::max(source.cellY[yEnd - 1], 0), gridSize[1] - 1) + 1;
+
+		// a partial of a new shape starts out zero, one of the same shape is cleared below.
+		if (partial.row0 != row0 || partial.rows != row1 - row0 || partial.cells.size() != size_t(row1 - row0) * gridSize[3] * rasterStride)
+		{
+			partial.row0 = row0;
+			partial.rows = row1 - row0;
+			partial.tileRow0 = row0 / kOccupancyBlock;
+			partial.tileRows = (row1 - 1) / kOccupancyBlock + 1 - partial.tileRow0;
+			partial.cells.assign(size_t(partial.rows) * gridSize[3] * rasterStride, 0.0f);
+			partial.occupancy.assign(size_t(partial.tileRows) * gridSize[3] * occupancyStride, 0);
+			partial.bounds.setEmpty();
+		}
+
+		for (int row = row0; row < row1; ++row)
+		{
+			partialsOfRow_[row * 2] = std::min(partialsOfRow_[row * 2], p);
+			partialsOfRow_[row * 2 + 1] = p + 1;
+		}
+	}
+
+	Mutex boundsMutex;
+	threadPool_->parallelFor(0, numPartials, [&](int p0, int p1)
+	{
+		for (int p = p0; p < p1; ++p)
+		{
+			SplatPartial& partial = partials_[p];
+			const int yBegin = int(size_t(inputHeight) * p / numPartials);
+			const int yEnd = int(size_t(inputHeight) * (p + 1) / numPartials);
+
+			// the thread that splats into a partial clears what its last splat left.
+			LayoutPolicy::forEachRasterRect(partial.bounds, gridSize, [&](int x, int y, int width, int height)
+			{
+				for (int row = y; row < y + height; ++row)
+				{
+					const size_t partialRow = size_t(row % gridSize[1] - partial.row0 + row / gridSize[1] * partial.rows);
+					memset(&partial.cells[partialRow * rasterStride + x * 4], 0, sizeof(float) * 4 * width);
+				}
+			});
+			std::fill(partial.occupancy.begin(), partial.occupancy.end(), 0);
+
+			GridBounds bounds;
+			splatRows_(source, yBegin, yEnd, &partial.cells[0], partial.row0, partial.rows,
+				&partial.occupancy[0], partial.tileRow0, partial.tileRows, &bounds);
+			partial.bounds = bounds;
+
+			ScopedMutex lock(boundsMutex);
+			targetBounds->unite(bounds);
+		}
+	}, 1);
+
+	// the occupancy of the partials goes to the grid's bitmap, which is a few bytes per block row.
+	for (int p = 0; p < numPartials; ++p)
+	{
+		const SplatPartial& partial = partials_[p];
+		if (partial.bounds.empty())
+			continue;
+		for (int w = 0; w < gridSize[3]; ++w)
+		{
+			for (int ty = 0; ty < partial.tileRows; ++ty)
+			{
+				const odd::uint8* in = &partial.occupancy[size_t(ty + w * partial.tileRows) * occupancyStride];
+				odd::uint8* out = &occupancy_[size_t(partial.tileRow0 + ty + w * occupancyTilesY_) * occupancyStride];
+				for (int i = 0; i < occupancyStride; ++i)
+					out[i] |= in[i];
+			}
+		}
+	}
+	partialsPending_ = true;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::addPartials_(float* row, int rasterX, int rasterY, int width) const
+{
+	// the partials that cover the grid row, in order, so the sums don't depend on the threads.
+	const int gy = rasterY % gridSize[1];
+	const int gw = rasterY / gridSize[1];
+	const size_t rasterStride = size_t(gridRasterWidth) * 4;
+
+	for (int p = partialsOfRow_[gy * 2]; p < partialsOfRow_[gy * 2 + 1]; ++p)
+	{
+		const SplatPartial& partial = partials_[p];
+		if (gy < partial.bounds.lo[1] || gy >= partial.bounds.hi[1] || gw < partial.bounds.lo[3] || gw >= partial.bounds.hi[3])
+			continue;
+		const float* in = &partial.cells[size_t(gy - partial.row0 + gw * partial.rows) * rasterStride + rasterX * 4];
+		for (int i = 0; i < width * 4; i += 4)
+			(Float4::load(row + i) + Float4::load(in + i)).store(row + i);
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::mergePartials_(float* target)
+{
+	if (!partialsPending_)
+		return;
+
+	// the partials go in order, as in addPartials_, and the rows of each in parallel.
+	const size_t rasterStride = size_t(gridRasterWidth) * 4;
+	for (size_t p = 0; p < partials_.size(); ++p)
+	{
+		LayoutPolicy::forEachRasterRect(partials_[p].bounds, gridSize, [&](int x, int y, int width, int height)
+		{
+			threadPool_->parallelFor(y, y + height, [&](int y0, int y1)
+			{
+				for (int row = y0; row < y1; ++row)
+				{
+					const size_t partialRow = size_t(row % gridSize[1] - partials_[p].row0 + row / gridSize[1] * partials_[p].rows);
+					const float* in = &partials_[p].cells[partialRow * rasterStride + x * 4];
+					float* out = target + row * rasterStride + x * 4;
+					for (int i = 0; i < width * 4; i += 4)
+						(Float4::load(out + i) + Float4::load(in + i)).store(out + i);
+				}
+			});
+		});
+	}
+	partialsPending_ = false;
+}
+
+// output cells per side of a spatial blur tile, and the halo the three 5-tap iterations read around it.
+// a tile and its ping-pong copy take 2 * 60 * 60 * 16 bytes (115KB), which stays in L2.
+static const int kBlurTileSize = 48;
+static const int kBlurTileHalo = kBlurRadius;
+// cells gathered per range blur block (16 bytes each), split as a run along x times every range slice.
+static const int kRangeBlockCells = 1024;
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::blurSpatial_(const float* src, float* dst, const GridBounds& bounds)
+{
+	const int width = gridRasterWidth;
+	const int height = gridRasterHeight;
+	const int rasterStride = width * 4;
+	const int tilesX = (width + kBlurTileSize - 1) / kBlurTileSize;
+	const int tilesY = (height + kBlurTileSize - 1) / kBlurTileSize;
+	const int span = kBlurTileSize + 2 * kBlurTileHalo;
+	const int spanStride = span * 4;
+	// [tap1, tap2] along x, then along y.
+	Float4 taps[2][2];
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		float tap1, tap2;
+		gridBlurTaps(gridBlurCells(blurSigma, gridSigma, axis), &tap1, &tap2);
+		taps[axis][0] = Float4::splat(tap1);
+		taps[axis][1] = Float4::splat(tap2);
+	}
+
+	threadPool_->parallelFor(0, tilesX * tilesY, [&](int t0, int t1)
+	{
+		std::vector<float> scratch0(size_t(span) * spanStride);
+		std::vector<float> scratch1(size_t(span) * spanStride);
+
+		for (int t = t0; t < t1; ++t)
+		{
+			const int x0 = (t % tilesX) * kBlurTileSize;
+			const int y0 = (t / tilesX) * kBlurTileSize;
+			const int tileWidth = std::min(kBlurTileSize, width - x0);
+			const int tileHeight = std::min(kBlurTileSize, height - y0);
+
+			if (trackBounds)
+			{
+				// leave the tiles outside of the bounds (they stay zero), and zero the ones without splats in reach.
+				bool inBounds = false;
+				LayoutPolicy::forEachRasterRect(bounds, gridSize, [&](int x, int y, int w, int h)
+				{
+					inBounds = inBounds || (x < x0 + tileWidth && x + w > x0 && y < y0 + tileHeight && y + h > y0);
+				});
+				if (!inBounds)
+					continue;
+				if (!occupied_(x0 - kBlurTileHalo, y0 - kBlurTileHalo, x0 + tileWidth + kBlurTileHalo, y0 + tileHeight + kBlurTileHalo))
+				{
+					for (int ly = 0; ly < tileHeight; ++ly)
+						memset(dst + size_t(y0 + ly) * rasterStride + x0 * 4, 0, sizeof(float) * 4 * tileWidth);
+					continue;
+				}
+			}
+
+			// the local origin is at the halo corner.
+			const int originX = x0 - kBlurTileHalo;
+			const int originY = y0 - kBlurTileHalo;
+			// the in-raster columns of the tile.
+			const int insideX0 = std::max(0, -originX);
+			const int insideX1 = std::min(tileWidth + 2 * kBlurTileHalo, width - originX);
+
+			// load the tile and its halo. texels outside of the raster read as zero.
+			int vx0 = 0, vx1 = tileWidth + 2 * kBlurTileHalo;
+			int vy0 = 0, vy1 = tileHeight + 2 * kBlurTileHalo;
+			float* a = &scratch0[0];
+			float* b = &scratch1[0];
+			for (int ly = vy0; ly < vy1; ++ly)
+			{
+				float* row = a + ly * spanStride;
+				const int y = originY + ly;
+				memset(row, 0, sizeof(float) * 4 * vx1);
+				if (y >= 0 && y < height)
+				{
+					memcpy(row + insideX0 * 4, src + size_t(y) * rasterStride + (originX + insideX0) * 4, sizeof(float) * 4 * (insideX1 - insideX0));
+					// the partial grids of the splat are reduced here, tile by tile, rather than in a pass of their own.
+					if (partialsPending_)
+						addPartials_(row + insideX0 * 4, originX + insideX0, y, insideX1 - insideX0);
+				}
+			}
+
+			// one 5-tap iteration over the valid region, shrunk by the kernel radius along the pass.
+			// this reproduces the x / y ping-pong passes of GlBilateralGrid cell for cell.
+			auto pass = [&](const float* in, float* out, int step, const Float4* tap)
+			{
+				const Float4 tap1 = tap[0];
+				const Float4 tap2 = tap[1];
+				for (int ly = vy0; ly < vy1; ++ly)
+				{
+					const int y = originY + ly;
+					const float* inRow = in + ly * spanStride;
+					float* outRow = out + ly * spanStride;
+					const int cx0 = (y >= 0 && y < height) ? std::max(vx0, insideX0) : vx1;
+					const int cx1 = std::max(cx0, std::min(vx1, insideX1));
+
+					for (int lx = vx0; lx < cx0; ++lx)
+						Float4::zero().store(outRow + lx * 4);
+					for (int lx = cx0; lx < cx1; ++lx)
+					{
+						const float* c = inRow + lx * 4;
+						Float4 d0 = Float4::load(c - 2 * step);
+						Float4 d1 = Float4::load(c - step);
+						Float4 d2 = Float4::load(c);
+						Float4 d3 = Float4::load(c + step);
+						Float4 d4 = Float4::load(c + 2 * step);
+						madd(tap2, d0 + d4, madd(tap1, d1 + d3, d2)).store(outRow + lx * 4);
+					}
+					for (int lx = cx1; lx < vx1; ++lx)
+						Float4::zero().store(outRow + lx * 4);
+				}
+			};
+
+			// do passes for spatial gaussian blur
+			for (int p = 0; p < 3; ++p)
+			{
+				vx0 += 2;
+				vx1 -= 2;
+				pass(a, b, 4, taps[0]);
+				std::swap(a, b);
+
+				vy0 += 2;
+				vy1 -= 2;
+				pass(a, b, spanStride, taps[1]);
+				std::swap(a, b);
+			}
+
+			// the valid region is now the tile itself.
+			for (int ly = 0; ly < tileHeight; ++ly)
+			{
+				memcpy(dst + size_t(y0 + ly) * rasterStride + x0 * 4,
+					a + (kBlurTileHalo + ly) * spanStride + kBlurTileHalo * 4, sizeof(float) * 4 * tileWidth);
+			}
+		}
+	});
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::blurRange_(const float* src, float* dst, bool normalize, const GridBounds& bounds)
+{
+	if (bounds.empty())
+		return;
+
+	// the range passes don't move along x or y, so only the columns and rows of the bounds are touched.
+	const int numRange = gridSize[2] * gridSize[3];
+	const int boundsWidth = bounds.hi[0] - bounds.lo[0];
+	const int blockSize = std::min(boundsWidth, std::max(4, kRangeBlockCells / numRange));
+	const int blocksX = (boundsWidth + blockSize - 1) / blockSize;
+	const int zStep = blockSize * 4;
+	const int wStep = gridSize[2] * zStep;
+	// [tap1, tap2] along z, then along w.
+	Float4 taps[2][2];
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		float tap1, tap2;
+		gridBlurTaps(gridBlurCells(blurSigma, gridSigma, 2 + axis), &tap1, &tap2);
+		taps[axis][0] = Float4::splat(tap1);
+		taps[axis][1] = Float4::splat(tap2);
+	}
+
+	// a block is a run of x cells in one grid row, gathered across every range slice.
+	threadPool_->parallelFor(0, (bounds.hi[1] - bounds.lo[1]) * blocksX, [&](int t0, int t1)
+	{
+		std::vector<float> scratch0(size_t(numRange) * zStep);
+		std::vector<float> scratch1(size_t(numRange) * zStep);
+		std::vector<float> zeroBlock(zStep, 0.0f);
+
+		for (int t = t0; t < t1; ++t)
+		{
+			const int gy = bounds.lo[1] + t / blocksX;
+			const int gx = bounds.lo[0] + (t % blocksX) * blockSize;
+			const int n = std::min(blockSize, bounds.hi[0] - gx);
+			float* a = &scratch0[0];
+			float* b = &scratch1[0];
+
+			for (int w = 0; w < gridSize[3]; ++w)
+			{
+				for (int z = 0; z < gridSize[2]; ++z)
+				{
+					memcpy(a + w * wStep + z * zStep,
+						src + cellOffset_(gx, gy, z, w), sizeof(float) * 4 * n);
+				}
+			}
+
+			// one 5-tap iteration along z or w. cells past either end of the axis are zero,
+			// which is where the raster passes of GlBilateralGrid fall off the raster.
+			auto pass = [&](const float* in, float* out, bool alongW)
+			{
+				const int step = alongW ? wStep : zStep;
+				const int length = alongW ? gridSize[3] : gridSize[2];
+				const Float4 tap1 = taps[alongW][0];
+				const Float4 tap2 = taps[alongW][1];
+
+				for (int w = 0; w < gridSize[3]; ++w)
+				{
+					for (int z = 0; z < gridSize[2]; ++z)
+					{
+						const int c = alongW ? w : z;
+						const float* cell = in + w * wStep + z * zStep;
+						float* outCell = out + w * wStep + z * zStep;
+
+						const float* taps[5];
+						for (int k = -2; k <= 2; ++k)
+							taps[k + 2] = (c + k >= 0 && c + k < length) ? cell + k * step : &zeroBlock[0];
+
+						for (int i = 0; i < n * 4; i += 4)
+						{
+							Float4 d0 = Float4::load(taps[0] + i);
+							Float4 d1 = Float4::load(taps[1] + i);
+							Float4 d2 = Float4::load(taps[2] + i);
+							Float4 d3 = Float4::load(taps[3] + i);
+							Float4 d4 = Float4::load(taps[4] + i);
+							madd(tap2, d0 + d4, madd(tap1, d1 + d3, d2)).store(outCell + i);
+						}
+					}
+				}
+			};
+
+			// an axis of one cell has no neighbours, so its passes leave the grid unchanged.
+			for (int p = 0; p < 3; ++p)
+			{
+				if (gridSize[2] > 1)
+				{
+					pass(a, b, false);
+					std::swap(a, b);
+				}
+				if (gridSize[3] > 1)
+				{
+					pass(a, b, true);
+					std::swap(a, b);
+				}
+			}
+
+			// write back, normalizing on the way out unless the slice interpolates the homogeneous grid.
+			for (int w = 0; w < gridSize[3]; ++w)
+			{
+				for (int z = 0; z < gridSize[2]; ++z)
+				{
+					const float* in = a + w * wStep + z * zStep;
+					float* out = dst + cellOffset_(gx, gy, z, w);
+
+					if (!normalize)
+					{
+						memcpy(out, in, sizeof(float) * 4 * n);
+						continue;
+					}
+
+					for (int i = 0; i < n * 4; i += 4)
+					{
+						float weight = in[i + 3];
+						Float4 norm = (weight == 0.0f) ? Float4::zero() : Float4::load(in + i) * Float4::splat(1.0f / weight);
+						norm.store(out + i);
+						// empty cells keep no weight, so the slice can tell them apart.
+						out[i + 3] = (weight == 0.0f) ? 0.0f : 1.0f;
+					}
+				}
+			}
+		}
+	});
+}
+
+// lines filtered side by side by blurRecursiveAxis_. their state takes 3 * 64 * 16 bytes (3KB).
+static const int kRecursiveLanes = 64;
+
+// the recursive gaussian of numLanes lines in place, lane j being the cells line + j * laneStep + i * step
+// for i in [0, length). The causal pass runs on past the end of the line over gaussian.tail zero cells
+// (kept in tail, gaussian.tail * kRecursiveLanes cells), so the anti-causal pass starts from what the
+// causal one carries out of the line rather than from zero. state holds 3 * kRecursiveLanes cells.
+static void recursiveGaussianLanes(float* line, int length, size_t step, int numLanes, size_t laneStep,
+	const RecursiveGaussian& gaussian, Float4* state, Float4* tail)
+{
+	const Float4 b = Float4::splat(gaussian.b);
+	const Float4 a1 = Float4::splat(gaussian.a1);
+	const Float4 a2 = Float4::splat(gaussian.a2);
+	const Float4 a3 = Float4::splat(gaussian.a3);
+	const int numTail = gaussian.tail;
+
+	for (int j0 = 0; j0 < numLanes; j0 += kRecursiveLanes)
+	{
+		const int n = std::min(kRecursiveLanes, numLanes - j0);
+		float* lanes = line + j0 * laneStep;
+
+		for (int backward = 0; backward < 2; ++backward)
+		{
+			// the last three outputs of each lane, in a ring. the one three cells back is replaced by the new one.
+			std::fill(state, state + 3 * kRecursiveLanes, Float4::zero());
+			for (int k = 0; k < length + numTail; ++k)
+			{
+				const Float4* w1 = state + ((k + 2) % 3) * kRecursiveLanes;
+				const Float4* w2 = state + ((k + 1) % 3) * kRecursiveLanes;
+				Float4* w3 = state + (k % 3) * kRecursiveLanes;
+				const int i = backward ? length + numTail - 1 - k : k;
+
+				if (i >= length)
+				{
+					Float4* t = tail + (i - length) * kRecursiveLanes;
+					for (int j = 0; j < n; ++j)
+					{
+						Float4 x = backward ? t[j] : Float4::zero();
+						Float4 w = madd(b, x, madd(a1, w1[j], madd(a2, w2[j], a3 * w3[j])));
+						if (!backward)
+							t[j] = w;
+						w3[j] = w;
+					}
+					continue;
+				}
+
+				float* cells = lanes + i * step;
+				for (int j = 0; j < n; ++j)
+				{
+					float* cell = cells + j * laneStep;
+					Float4 w = madd(b, Float4::load(cell), madd(a1, w1[j], madd(a2, w2[j], a3 * w3[j])));
+					w.store(cell);
+					w3[j] = w;
+				}
+			}
+		}
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::blurRecursiveAxis_(float* grid, int axis, const RecursiveGaussian& gaussian, const GridBounds& bounds)
+{
+	// the float step of a cell along each axis of the raster.
+	size_t axisStep[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		int dx, dy;
+		LayoutPolicy::axisDelta(i, gridSize, &dx, &dy);
+		axisStep[i] = (size_t(dy) * gridRasterWidth + dx) * 4;
+	}
+
+	// the lines run side by side along the contiguous x (along y for the lines along x),
+	// and the cells of the other two axes are split among the threads.
+	const int laneAxis = (axis == 0) ? 1 : 0;
+	int outerAxes[2], numOuter = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (i != axis && i != laneAxis)
+			outerAxes[numOuter++] = i;
+	}
+	int extent[4];
+	for (int i = 0; i < 4; ++i)
+		extent[i] = bounds.hi[i] - bounds.lo[i];
+
+	threadPool_->parallelFor(0, extent[outerAxes[0]] * extent[outerAxes[1]], [&](int t0, int t1)
+	{
+		std::vector<Float4> state(3 * kRecursiveLanes);
+		std::vector<Float4> tail(std::max(gaussian.tail, 1) * kRecursiveLanes);
+
+		for (int t = t0; t < t1; ++t)
+		{
+			int c[4] = { bounds.lo[0], bounds.lo[1], bounds.lo[2], bounds.lo[3] };
+			c[outerAxes[0]] += t % extent[outerAxes[0]];
+			c[outerAxes[1]] += t / extent[outerAxes[0]];
+			recursiveGaussianLanes(grid + cellOffset_(c[0], c[1], c[2], c[3]), extent[axis], axisStep[axis],
+				extent[laneAxis], axisStep[laneAxis], gaussian, &state[0], &tail[0]);
+		}
+	}, 1);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::blurRecursive_(const float* src, const GridBounds& srcBounds)
+{
+	float* grid0 = arena_->raster(0);
+	const int rasterStride = gridRasterWidth * 4;
+	if (srcBounds.empty())
+	{
+		if (src != grid0)
+			clearRegion_(grid0, gridBounds_[0]);
+		gridBounds_[0].setEmpty();
+		return;
+	}
+
+	// the filters run in place on raster 0, over the cells within their tail of the splats.
+	RecursiveGaussian gaussians[4] = {
+		RecursiveGaussian(gridBlurCells(blurSigma, gridSigma, 0)), RecursiveGaussian(gridBlurCells(blurSigma, gridSigma, 1)),
+		RecursiveGaussian(gridBlurCells(blurSigma, gridSigma, 2)), RecursiveGaussian(gridBlurCells(blurSigma, gridSigma, 3)) };
+	GridBounds bounds = srcBounds;
+	for (int axis = 0; axis < 4; ++axis)
+	{
+		bounds.lo[axis] = std::max(bounds.lo[axis] - gaussians[axis].tail, 0);
+		bounds.hi[axis] = std::min(bounds.hi[axis] + gaussians[axis].tail, gridSize[axis]);
+	}
+
+	if (src != grid0)
+	{
+		clearRegion_(grid0, gridBounds_[0]);
+		LayoutPolicy::forEachRasterRect(srcBounds, gridSize, [&](int x, int y, int width, int height)
+		{
+			threadPool_->parallelFor(y, y + height, [&](int y0, int y1)
+			{
+				for (int row = y0; row < y1; ++row)
+				{
+					const size_t offset = size_t(row) * rasterStride + x * 4;
+					memcpy(grid0 + offset, src + offset, sizeof(float) * 4 * width);
+				}
+			});
+		});
+	}
+
+	// an axis of one cell, or a sigma under half a cell, leaves the grid unchanged.
+	for (int axis = 0; axis < 4; ++axis)
+	{
+		if (gridSize[axis] > 1 && !gaussians[axis].identity)
+			blurRecursiveAxis_(grid0, axis, gaussians[axis], bounds);
+	}
+
+	if (!sliceLinear)
+	{
+		LayoutPolicy::forEachRasterRect(bounds, gridSize, [&](int x, int y, int width, int height)
+		{
+			threadPool_->parallelFor(y, y + height, [&](int y0, int y1)
+			{
+				for (int row = y0; row < y1; ++row)
+				{
+					float* cell = grid0 + size_t(row) * rasterStride + x * 4;
+					for (int i = 0; i < width * 4; i += 4)
+					{
+						float weight = cell[i + 3];
+						Float4 norm = (weight == 0.0f) ? Float4::zero() : Float4::load(cell + i) * Float4::splat(1.0f / weight);
+						norm.store(cell + i);
+						cell[i + 3] = (weight == 0.0f) ? 0.0f : 1.0f;
+					}
+				}
+			});
+		});
+	}
+	gridBounds_[0] = bounds;
+
+	if (src == grid0)
+		std::fill(occupancy_.begin(), occupancy_.end(), 1);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::blurAndNormalize_(const float* src, const GridBounds& srcBounds)
+{
+	if (recursiveBlur)
+	{
+		blurRecursive_(src, srcBounds);
+		return;
+	}
+
+	float* grid0 = arena_->raster(0);
+	float* grid1 = arena_->raster(1);
+
+	// the blur only reaches the cells within kBlurRadius of the splats, so the passes only write
+	// those. whatever an earlier splat left outside of them is cleared first.
+	const GridBounds bounds = LayoutPolicy::blurredBounds(srcBounds, gridSize);
+	if (!bounds.contains(gridBounds_[1]))
+		clearRegion_(grid1, gridBounds_[1]);
+	if (src != grid0 && !bounds.contains(gridBounds_[0]))
+		clearRegion_(grid0, gridBounds_[0]);
+
+	// two tiled sweeps replace the twelve blur passes and the normalize pass.
+	// src (the splats) is left untouched and the result ends up in raster 0.
+	blurSpatial_(src, grid1, bounds);
+	gridBounds_[1] = bounds;
+	blurRange_(grid1, grid0, !sliceLinear, bounds);
+	gridBounds_[0] = bounds;
+
+	// a splat target that is also the result no longer matches its occupancy bitmap (until the next clear).
+	if (src == grid0)
+		std::fill(occupancy_.begin(), occupancy_.end(), 1);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+inline void CpuBilateralGridT<RangePolicy, LayoutPolicy>::sliceNearestPixel_(const float* grid, const float* referenceSample,
+	int cellX, int cellY, const float* sigmaInv, float* out) const
+{
+	float inputRange[2];
+	RangePolicy::inputRange(referenceSample, gridSize, inputRange);
+	rangeCurve.apply(gridSize, inputRange);
+
+	int gz = std::min(std::max(gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]), 0), gridSize[2] - 1);
+	int gw = std::min(std::max(gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]), 0), gridSize[3] - 1);
+
+	const float* gridSample = grid + cellOffset_(cellX, cellY, gz, gw);
+
+	if (gridSample[3] == 0.0f)
+	{
+		// there is no data in the grid for this pixel.
+		Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out);
+		return;
+	}
+
+	// decode the grid sample from [red, green, depth, weight]
+	Float4::set(gridSample[0], gridSample[1], 0.0f, gridSample[2]).store(out);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+inline void CpuBilateralGridT<RangePolicy, LayoutPolicy>::sliceLinearPixel_(const float* grid, const float* referenceSample,
+	int cellX0, int cellX1, float fracX, int cellY0, int cellY1, float fracY, const float* sigmaInv, float* out) const
+{
+	float inputRange[2];
+	RangePolicy::inputRange(referenceSample, gridSize, inputRange);
+	rangeCurve.apply(gridSize, inputRange);
+
+	int cz[2], cw[2];
+	float fz, fw;
+	gridCoordToLinearCells(gridInputToGridCoord(inputRange[0], sigmaInv[2], gridPadding[2]), gridSize[2], &cz[0], &cz[1], &fz);
+	gridCoordToLinearCells(gridInputToGridCoord(inputRange[1], sigmaInv[3], gridPadding[3]), gridSize[3], &cw[0], &cw[1], &fw);
+
+	const Float4 fx = Float4::splat(fracX);
+	const Float4 fy = Float4::splat(fracY);
+	const float wz[2] = { 1.0f - fz, fz };
+	const float ww[2] = { 1.0f - fw, fw };
+
+	// one cell is one Float4, so every corner is a 4-wide lerp.
+	Float4 sum = Float4::zero();
+	for (int j = 0; j < 4; ++j)
+	{
+		const float w = wz[j & 1] * ww[j >> 1];
+		if (w == 0.0f)
+			continue;
+
+		const int gz = cz[j & 1];
+		const int gw = cw[j >> 1];
+		Float4 value0 = lerp(Float4::load(grid + cellOffset_(cellX0, cellY0, gz, gw)),
+			Float4::load(grid + cellOffset_(cellX1, cellY0, gz, gw)), fx);
+		Float4 value1 = lerp(Float4::load(grid + cellOffset_(cellX0, cellY1, gz, gw)),
+			Float4::load(grid + cellOffset_(cellX1, cellY1, gz, gw)), fx);
+		sum = madd(lerp(value0, value1, fy), Float4::splat(w), sum);
+	}
+
+	float cell[4];
+	sum.store(cell);
+	if (cell[3] <= 0.0f)
+	{
+		// there is no data in the grid for this pixel.
+		Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out);
+		return;
+	}
+
+	// normalize and decode the grid sample from [red, green, depth, weight]
+	const float norm = 1.0f / cell[3];
+	Float4::set(cell[0] * norm, cell[1] * norm, 0.0f, cell[2] * norm).store(out);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	const SliceRect rect = { 0, 0, dstWidth, dstHeight };
+	sliceRects(refRgba, refWidth, refHeight, refStride, &rect, 1, dstRgbd, dstWidth, dstHeight, dstStride);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::sliceRects(const float* refRgba, int refWidth, int refHeight, int refStride,
+	const SliceRect* rects, int numRects, float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	if (refStride <= 0)
+		refStride = refWidth * 4;
+	if (dstStride <= 0)
+		dstStride = dstWidth * 4;
+
+	for (int i = 0; i < numRects; ++i)
+	{
+		const int x0 = std::max(rects[i].x, 0);
+		const int y0 = std::max(rects[i].y, 0);
+		const int x1 = std::min(rects[i].x + rects[i].width, dstWidth);
+		const int y1 = std::min(rects[i].y + rects[i].height, dstHeight);
+		if (x1 <= x0 || y1 <= y0)
+			continue;
+		if (sliceLinear)
+			sliceLinear_(refRgba, refWidth, refHeight, refStride, dstRgbd, dstWidth, dstHeight, dstStride, x0, y0, x1, y1);
+		else
+			sliceNearest_(refRgba, refWidth, refHeight, refStride, dstRgbd, dstWidth, dstHeight, dstStride, x0, y0, x1, y1);
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::slicePixels(const float* refRgba, int refWidth, int refHeight, int refStride,
+	int dstWidth, int dstHeight, const int* pixels, int numPixels, float* dstRgbd)
+{
+	if (refStride <= 0)
+		refStride = refWidth * 4;
+
+	const float* grid = arena_->raster(0);
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// each pixel takes the lookups the full slice makes for its column and row, so a query costs
+	// a few cells, and only a long list is worth the threads.
+	threadPool_->parallelFor(0, numPixels, [&](int i0, int i1)
+	{
+		for (int i = i0; i < i1; ++i)
+		{
+			const int x = pixels[i * 2];
+			const int y = pixels[i * 2 + 1];
+			float* out = dstRgbd + size_t(i) * 4;
+			if (x < 0 || x >= dstWidth || y < 0 || y >= dstHeight)
+			{
+				Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out);
+				continue;
+			}
+
+			const float* referenceSample = refRgba + size_t(nearestRefTexel(y, dstHeight, refHeight)) * refStride +
+				nearestRefTexel(x, dstWidth, refWidth) * 4;
+			const float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+			const float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+
+			if (sliceLinear)
+			{
+				int cellX0, cellX1, cellY0, cellY1;
+				float fracX, fracY;
+				gridCoordToLinearCells(gridInputToGridCoord(inputX, sigmaInv[0], gridPadding[0]), gridSize[0], &cellX0, &cellX1, &fracX);
+				gridCoordToLinearCells(gridInputToGridCoord(inputY, sigmaInv[1], gridPadding[1]), gridSize[1], &cellY0, &cellY1, &fracY);
+				sliceLinearPixel_(grid, referenceSample, cellX0, cellX1, fracX, cellY0, cellY1, fracY, sigmaInv, out);
+			}
+			else
+			{
+				const int cellX = std::min(std::max(gridInputToGridCell(inputX, sigmaInv[0], gridPadding[0]), 0), gridSize[0] - 1);
+				const int cellY = std::min(std::max(gridInputToGridCell(inputY, sigmaInv[1], gridPadding[1]), 0), gridSize[1] - 1);
+				sliceNearestPixel_(grid, referenceSample, cellX, cellY, sigmaInv, out);
+			}
+		}
+	}, 1024);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::sliceNearest_(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride, int x0, int y0, int x1, int y1)
+{
+	const float* grid = arena_->raster(0);
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the xy part of the lookup only depends on the column or row.
+	std::vector<int> refX(x1 - x0), cellX(x1 - x0);
+	std::vector<int> refY(y1 - y0), cellY(y1 - y0);
+	for (int x = x0; x < x1; ++x)
+	{
+		refX[x - x0] = nearestRefTexel(x, dstWidth, refWidth);
+		float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+		cellX[x - x0] = std::min(std::max(gridInputToGridCell(inputX, sigmaInv[0], gridPadding[0]), 0), gridSize[0] - 1);
+	}
+	for (int y = y0; y < y1; ++y)
+	{
+		refY[y - y0] = nearestRefTexel(y, dstHeight, refHeight);
+		float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+		cellY[y - y0] = std::min(std::max(gridInputToGridCell(inputY, sigmaInv[1], gridPadding[1]), 0), gridSize[1] - 1);
+	}
+
+	threadPool_->parallelFor(0, y1 - y0, [&](int r0, int r1)
+	{
+		for (int r = r0; r < r1; ++r)
+		{
+			const float* refRow = refRgba + size_t(refY[r]) * refStride;
+			float* out = dstRgbd + size_t(y0 + r) * dstStride + x0 * 4;
+
+			for (int c = 0; c < x1 - x0; ++c)
+				sliceNearestPixel_(grid, refRow + refX[c] * 4, cellX[c], cellY[r], sigmaInv, out + c * 4);
+		}
+	}, 4);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::sliceMerge(const float* refRgba, int refWidth, int refHeight, int refStride,
+	const float* prevRgbd, int prevWidth, int prevHeight, int prevStride, const float* sparseRgbd, int sparseStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	if (refStride <= 0)
+		refStride = refWidth * 4;
+	if (prevStride <= 0)
+		prevStride = prevWidth * 4;
+	if (sparseStride <= 0)
+		sparseStride = dstWidth * 4;
+	if (dstStride <= 0)
+		dstStride = dstWidth * 4;
+
+	// the slice leaves [red, green, 0, depth] in dst, or depth 0 where the grid has no data.
+	slice(refRgba, refWidth, refHeight, refStride, dstRgbd, dstWidth, dstHeight, dstStride);
+
+	std::vector<int> refX(dstWidth), prevX(dstWidth);
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		refX[x] = nearestTexel(x, dstWidth, refWidth);
+		prevX[x] = nearestTexel(x, dstWidth, prevWidth);
+	}
+
+	threadPool_->parallelFor(0, dstHeight, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* refRow = refRgba + size_t(nearestTexel(y, dstHeight, refHeight)) * refStride;
+			const float* prevRow = prevRgbd + size_t(nearestTexel(y, dstHeight, prevHeight)) * prevStride;
+			const float* sparseRow = sparseRgbd + size_t(y) * sparseStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+
+			for (int x = 0; x < dstWidth; ++x)
+			{
+				// depth in (0, 1) is valid. the rgbd pyramid marks missing depth with 1, the merge with 0.
+				const float* sparse = sparseRow + x * 4;
+				if (sparse[3] > 0.0f && sparse[3] < 1.0f)
+				{
+					// this pixel has a sample of its own at this level, so keep it.
+					Float4::load(sparse).store(out + x * 4);
+					continue;
+				}
+
+				// otherwise the grid's depth with this level's colour, else the coarser depth (if any).
+				const float* color = refRow + refX[x] * 4;
+				float depth = out[x * 4 + 3];
+				if (depth == 0.0f)
+				{
+					const float prevDepth = prevRow[prevX[x] * 4 + 3];
+					depth = (prevDepth > 0.0f && prevDepth < 1.0f) ? prevDepth : 0.0f;
+				}
+				Float4::set(color[0], color[1], color[2], depth).store(out + x * 4);
+			}
+		}
+	}, 4);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridT<RangePolicy, LayoutPolicy>::sliceLinear_(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride, int x0, int y0, int x1, int y1)
+{
+	// interpolate the homogeneous grid, then normalize (as sampleGridLinear).
+	const float* grid = arena_->raster(0);
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the xy cells and blend factors only depend on the column or row.
+	std::vector<int> refX(x1 - x0), cellX0(x1 - x0), cellX1(x1 - x0);
+	std::vector<int> refY(y1 - y0), cellY0(y1 - y0), cellY1(y1 - y0);
+	std::vector<float> fracX(x1 - x0), fracY(y1 - y0);
+	for (int x = x0; x < x1; ++x)
+	{
+		const int c = x - x0;
+		refX[c] = nearestRefTexel(x, dstWidth, refWidth);
+		float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+		gridCoordToLinearCells(gridInputToGridCoord(inputX, sigmaInv[0], gridPadding[0]), gridSize[0], &cellX0[c], &cellX1[c], &fracX[c]);
+	}
+	for (int y = y0; y < y1; ++y)
+	{
+		const int r = y - y0;
+		refY[r] = nearestRefTexel(y, dstHeight, refHeight);
+		float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+		gridCoordToLinearCells(gridInputToGridCoord(inputY, sigmaInv[1], gridPadding[1]), gridSize[1], &cellY0[r], &cellY1[r], &fracY[r]);
+	}
+
+	threadPool_->parallelFor(0, y1 - y0, [&](int r0, int r1)
+	{
+		for (int r = r0; r < r1; ++r)
+		{
+			const float* refRow = refRgba + size_t(refY[r]) * refStride;
+			float* out = dstRgbd + size_t(y0 + r) * dstStride + x0 * 4;
+
+			for (int c = 0; c < x1 - x0; ++c)
+			{
+				sliceLinearPixel_(grid, refRow + refX[c] * 4, cellX0[c], cellX1[c], fracX[c],
+					cellY0[r], cellY1[r], fracY[r], sigmaInv, out + c * 4);
+			}
+		}
+	}, 4);
+}
+
+template class CpuBilateralGridT<RangeAverageRG, LayoutRangeTiles>;
+template class CpuBilateralGridT<RangeLuma, LayoutRangeTiles>;
+template class CpuBilateralGridT<RangeRedGreen, LayoutRangeTiles>;
+template class CpuBilateralGridT<RangeChroma, LayoutRangeTiles>;
+
+static double timeSplat_(CpuBilateralGrid& grid, const float* srcRgbd, int width, int height, int numFrames)
+{
+	double best = 0;
+	// frame -1 warms up the caches, the partials and the thread pool.
+	for (int frame = -1; frame < numFrames; ++frame)
+	{
+		double t0 = getTimeSeconds();
+		grid.clear();
+		grid.splatRgbd(srcRgbd, width, height);
+		double seconds = getTimeSeconds() - t0;
+		if (frame == 0 || (frame > 0 && seconds < best))
+			best = seconds;
+	}
+	return best;
+}
+
+void benchmarkSplatScaling(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, int maxThreads, int numFrames,
+	SplatScalingTiming* timings)
+{
+	if (maxThreads <= 0)
+		maxThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+	maxThreads = std::max(maxThreads, 1);
+	numFrames = std::max(numFrames, 1);
+
+	const size_t numFloats = size_t(width) * height * 4;
+	std::vector<float> rowBandResult(numFloats), partialResult(numFloats);
+	double singleRowBandSeconds = 0, singlePartialSeconds = 0;
+
+	for (int numThreads = 1; numThreads <= maxThreads; ++numThreads)
+	{
+		ThreadPool threadPool(numThreads);
+		SplatScalingTiming timing;
+		timing.numThreads = numThreads;
+		{
+			CpuBilateralGrid grid(&threadPool);
+			grid.splatMode = CPU_SPLAT_ROW_BANDS;
+			grid.setup(inputSize, sigma, padding);
+			timing.rowBandSeconds = timeSplat_(grid, srcRgbd, width, height, numFrames);
+			grid.slice(refRgba, width, height, 0, &rowBandResult[0], width, height);
+		}
+		{
+			CpuBilateralGrid grid(&threadPool);
+			grid.splatMode = CPU_SPLAT_PARTIAL_GRIDS;
+			grid.setup(inputSize, sigma, padding);
+			timing.partialSeconds = timeSplat_(grid, srcRgbd, width, height, numFrames);
+			grid.slice(refRgba, width, height, 0, &partialResult[0], width, height);
+		}
+
+		timing.depthMax = 0;
+		for (size_t i = 3; i < numFloats; i += 4)
+			timing.depthMax = std::max(timing.depthMax, fabsf(partialResult[i] - rowBandResult[i]));
+		if (numThreads == 1)
+		{
+			singleRowBandSeconds = timing.rowBandSeconds;
+			singlePartialSeconds = timing.partialSeconds;
+		}
+		timing.rowBandSpeedup = singleRowBandSeconds / timing.rowBandSeconds;
+		timing.partialSpeedup = singlePartialSeconds / timing.partialSeconds;
+
+		LOGI("splat on %d threads: row bands %.2f ms (x%.2f), partial grids %.2f ms (x%.2f), depth max diff %g", numThreads,
+			timing.rowBandSeconds * 1000.0, timing.rowBandSpeedup, timing.partialSeconds * 1000.0, timing.partialSpeedup, timing.depthMax);
+		if (timings)
+			timings[numThreads - 1] = timing;
+	}
+}
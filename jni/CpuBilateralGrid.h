@@ -0,0 +1,265 @@
+
+#ifndef CPUBILATERALGRID_H
+#define CPUBILATERALGRID_H
+
+#include "CpuGridUtil.h"
+#include "CpuSimd.h"
+#include <type_traits>
+
+// One allocation for the buffers of CpuBilateralGrids that are used one at a time, as the levels of
+// CpuHierarchicalUpsampler: the pair of rasters every grid blurs through, as large as the largest
+// grid's, followed by blocks the owner carves out for itself (such as the level results). As with
+// GlBilateralGridArena, a grid's cells stay in the rasters until another grid of the arena splats or
+// clears, which first clears the cells the last one may have left (acquire), so slice a grid before
+// splatting the next. A grid set up without an arena has one of its own.
+class CpuBilateralGridArena
+{
+public:
+	CpuBilateralGridArena();
+
+	// grows the rasters to rasterFloats each. reallocates (and drops the cells of every grid) if they grow.
+	void reserve(size_t rasterFloats);
+	// the sizes of the blocks after the rasters, which reallocates if they change.
+	void setBlocks(const std::vector<size_t>& blockFloats);
+	void release();
+
+	float* raster(int i) { return memory_.empty() ? 0 : &memory_[i * rasterFloats_]; }
+	const float* raster(int i) const { return memory_.empty() ? 0 : &memory_[i * rasterFloats_]; }
+	float* block(int i) { return &memory_[blockOffsets_[i]]; }
+	size_t rasterFloats() const { return rasterFloats_; }
+	size_t memoryBytes() const { return memory_.size() * sizeof(float); }
+
+	// makes grid the user of the rasters, and zeroes what the last one may have written. true if the user changed.
+	bool acquire(const void* grid);
+	// a grid that is set up again or deleted is no longer in the rasters.
+	void releaseUser(const void* grid) { if (user == grid) user = 0; }
+	// the cells of raster i that may be non-zero, in the user's grid of gridSize (a LayoutRangeTiles raster).
+	void markDirty(int i, const GridBounds& bounds, const int* gridSize);
+
+public:
+
+	const void* user;		// the grid whose cells are in the rasters.
+	GridBounds dirty[2];
+	int dirtyGridSize[4];
+
+private:
+
+	void allocate_();
+
+	std::vector<float> memory_;
+	size_t rasterFloats_;
+	std::vector<size_t> blockFloats_;
+	std::vector<size_t> blockOffsets_;
+};
+
+// the largest difference of the sliced depth and colour to GlBilateralGrid, see CpuBilateralGridT.
+static const float kCpuGridTolerance = 1e-4f;
+
+// how CpuBilateralGridT::splatRgbd spreads the samples over the threads. Neither needs atomics.
+enum CpuSplatMode
+{
+	CPU_SPLAT_AUTO,				// partial grids when there are too few row bands to go around, otherwise row bands.
+	CPU_SPLAT_ROW_BANDS,		// each task owns a band of grid rows, and splats the input rows whose cells land in it.
+	CPU_SPLAT_PARTIAL_GRIDS,	// each thread splats an equal share of the input rows into a partial grid of its own.
+};
+
+// A native implementation of GlBilateralGrid (splat / blur / normalize / slice).
+// It needs no GL context, so it can run headless and be used as a baseline for the GL path.
+//
+// The grid uses the same 2D raster tiling as the GL textures, i.e. cell (x,y,z,w) lives at
+// raster (x + z*gridSize[0], y + w*gridSize[1]), and every pass reproduces the GL shaders
+// texel for texel (except for recursiveBlur). Each cell is [red, green, depth, weight].
+//
+// Tolerance against GlBilateralGrid:
+// the sliced depth and colour match the GL output to within kCpuGridTolerance (1e-4) absolute for
+// inputs in [0,1], as measureGlCpuGridDifference (GlBilateralGrid.h) checks on a device.
+// The differences come from the order of the blended splat additions, and from the GL blur doing
+// each axis in one pass where the cpu alternates x and y (the same sums, rounded in another order).
+//
+// RangePolicy and LayoutPolicy (see BilateralGridPolicy.h) are compiled into the kernels, so each
+// combination gets its own specialized splat and slice. CpuBilateralGrid is the one that matches
+// the default GlBilateralGrid. The tiled blur kernels walk the raster of LayoutRangeTiles; the cpu-only
+// block layouts, which keep the range cells of a spatial cell together, are CpuBlockBilateralGridT.
+template <class RangePolicy, class LayoutPolicy>
+class CpuBilateralGridT
+{
+	static_assert(std::is_same<LayoutPolicy, LayoutRangeTiles>::value, "the blur kernels need the range tiles raster");
+
+public:
+	CpuBilateralGridT(ThreadPool* threadPool = 0);
+	~CpuBilateralGridT();
+
+	// the grid buffers come from arena, shared with its other grids (which the caller keeps alive as
+	// long as the grid), or without one from an arena of the grid's own.
+	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0),
+		CpuBilateralGridArena* arena = 0);
+
+	// clears the grid, including the history of a persistent grid.
+	void clear();
+	// srcRgbd is an RGBA float image with depth in alpha. Strides are in floats (0 = packed).
+	// confidence, if given, is one float per source pixel that scales the weight of its sample
+	// (samples with confidence <= 0 are dropped), as the confidence texture of GlBilateralGrid::splatRgbd.
+	void splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride = 0, float inputTime=0.0, float weight=1.0,
+		const float* confidence = 0, int confidenceStride = 0);
+	// refRgba is the color-reference image, dstRgbd receives [red, green, 0, depth].
+	// see sliceLinear for the interpolation.
+	void slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride = 0);
+	// the pixels of the rects (clipped to dstWidth x dstHeight) of the slice above, each written in its
+	// place in dstRgbd, which keeps the rest. The cost is that of the pixels in the rects.
+	void sliceRects(const float* refRgba, int refWidth, int refHeight, int refStride, const SliceRect* rects, int numRects,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride = 0);
+	// single pixels of a dstWidth x dstHeight slice, for queries such as hit tests: pixels holds numPixels
+	// (x, y) pairs, and dstRgbd receives [red, green, 0, depth] for each, packed (depth 0 outside the slice).
+	// the grid is already blurred, so a point costs one to sixteen cell reads.
+	void slicePixels(const float* refRgba, int refWidth, int refHeight, int refStride, int dstWidth, int dstHeight,
+		const int* pixels, int numPixels, float* dstRgbd);
+	// one level of coarse-to-fine upsampling, as GlBilateralGrid::sliceMerge: slices against refRgba, then
+	// merges with sparseRgbd (this level's depth samples, dstWidth x dstHeight) and prevRgbd (the coarser
+	// result, at the nearest texel). dstRgbd receives [red, green, blue, depth].
+	void sliceMerge(const float* refRgba, int refWidth, int refHeight, int refStride,
+		const float* prevRgbd, int prevWidth, int prevHeight, int prevStride, const float* sparseRgbd, int sparseStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride = 0);
+
+	// the blurred grid raster (valid after a splat), normalized unless sliceLinear.
+	const float* gridData() const { return arena_->raster(0); }
+	float* gridData() { return arena_->raster(0); }
+	// of a grid raster.
+	size_t gridFloats() const { return size_t(gridRasterWidth) * gridRasterHeight * 4; }
+
+private:
+
+	void blurAndNormalize_(const float* src, const GridBounds& srcBounds);
+	// the source of a splat, with the input texel to source texel and grid cell lookups.
+	struct SplatSource
+	{
+		const float* rgbd;
+		int stride;
+		const float* confidence;
+		int confidenceStride;
+		float weight;
+		std::vector<int> srcX, cellX, srcY, cellY;
+		float sigmaInv[4];
+	};
+	// splats input rows [yBegin, yEnd) into target, which holds the raster rows of grid rows
+	// [row0, row0 + rows) of every range slice, and flags their occupancy blocks in the block rows
+	// from tileRow0 (tileRows of them per range row).
+	void splatRows_(const SplatSource& source, int yBegin, int yEnd, float* target, int row0, int rows,
+		odd::uint8* occupancy, int tileRow0, int tileRows, GridBounds* bounds);
+	// the share of the input rows of each thread splatted into a partial grid, which the first
+	// blur pass (or mergePartials_) adds to the splat target.
+	void splatPartials_(const SplatSource& source, GridBounds* targetBounds);
+	void mergePartials_(float* target);
+	// adds the partials to width cells of a raster row.
+	void addPartials_(float* row, int rasterX, int rasterY, int width) const;
+	// takes over the arena's rasters (an empty grid if another grid was in them), and marks what it wrote.
+	void acquireArena_();
+	void markArena_();
+	float* splatTarget_(float inputTime);
+	GridBounds& splatTargetBounds_();
+	void blurSpatial_(const float* src, float* dst, const GridBounds& bounds);
+	void blurRange_(const float* src, float* dst, bool normalize, const GridBounds& bounds);
+	void blurRecursive_(const float* src, const GridBounds& srcBounds);
+	void blurRecursiveAxis_(float* grid, int axis, const RecursiveGaussian& gaussian, const GridBounds& bounds);
+	void clearRegion_(float* buffer, const GridBounds& bounds);
+	bool occupied_(int rasterX0, int rasterY0, int rasterX1, int rasterY1) const;
+	// the float offset of a cell in a grid buffer.
+	size_t cellOffset_(int x, int y, int z, int w) const
+	{
+		int rasterX, rasterY;
+		LayoutPolicy::texel(x, y, z, w, gridSize, &rasterX, &rasterY);
+		return (size_t(rasterY) * gridRasterWidth + rasterX) * 4;
+	}
+	// slice the pixels [x0, x1) x [y0, y1) of dstRgbd.
+	void sliceNearest_(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride, int x0, int y0, int x1, int y1);
+	void sliceLinear_(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride, int x0, int y0, int x1, int y1);
+	// one pixel of a slice, from its reference colour and the xy cells of its column and row.
+	void sliceNearestPixel_(const float* grid, const float* referenceSample, int cellX, int cellY, const float* sigmaInv, float* out) const;
+	void sliceLinearPixel_(const float* grid, const float* referenceSample, int cellX0, int cellX1, float fracX,
+		int cellY0, int cellY1, float fracY, const float* sigmaInv, float* out) const;
+
+public:
+
+	float gridSigma[4];
+	int gridInputSize[4];
+	int gridPadding[4];
+	int gridSize[4];
+	int gridRasterWidth, gridRasterHeight;
+	// interpolate the grid when slicing (quadrilinear), otherwise take the nearest cell.
+	// this also selects whether the blur normalizes the grid, so set it before splatting.
+	bool sliceLinear;
+	// the sigma of the gaussian blur along the spatial and the range axes, in input units (see
+	// defaultBlurSigma, which setup() applies).
+	float blurSigma[2];
+	// blur with the recursive gaussian, whose cost per cell doesn't grow with blurSigma and which
+	// reaches as far as the gaussian does. Otherwise the three 5-tap iterations of GlBilateralGrid,
+	// which the sliced result matches, but which reach only kBlurRadius cells.
+	bool recursiveBlur;
+	// time constant of the decay of older splats in a persistent grid (see GlBilateralGrid).
+	float persistenceTime;
+	// if > 0, splatRgbd drops the samples with depth at or beyond it, as GlBilateralGrid::maxSplatDepth.
+	float maxSplatDepth;
+	// restrict clear, decay, blur and normalize to the cells the splats can reach, and skip
+	// the blur tiles the occupancy bitmap shows empty. Otherwise every pass covers the whole grid.
+	bool trackBounds;
+	// the split of the splat over the threads. The row bands have as many tasks as occupancy
+	// blocks along y, which at a large sigma leaves threads idle, and bands as uneven as the
+	// depth samples; the partial grids split the input rows evenly, and cost a partial of
+	// about a raster in all, and an add of the rows where neighbouring partials overlap.
+	// The point where AUTO switches comes from those task counts and has not been timed on a
+	// multi-core device; run benchmarkSplatScaling there before relying on it.
+	CpuSplatMode splatMode;
+	// the range axes through an adaptive curve (see RangeCurve), linear unless enabled.
+	RangeCurve rangeCurve;
+
+	// the two grid rasters (ownArena_ without a shared one).
+	CpuBilateralGridArena* arena_;
+	CpuBilateralGridArena ownArena_;
+	std::vector<float> historyBuffer_;	// the decayed splats of a persistent grid.
+	GridBounds gridBounds_[2];		// the cells of each buffer that may be non-zero.
+	GridBounds historyBounds_;
+	// one flag per block of kOccupancyBlock^2 cells of a range slice, set by the splat.
+	// it covers the splat target (the history of a persistent grid) since the last clear.
+	std::vector<odd::uint8> occupancy_;
+	int occupancyTilesX_, occupancyTilesY_;
+	// a partial grid holds the raster rows of grid rows [row0, row0 + rows) of every range slice,
+	// rows * gridSize[3] of them, and the occupancy of its splats from occupancy block row tileRow0.
+	struct SplatPartial
+	{
+		int row0, rows;
+		int tileRow0, tileRows;
+		std::vector<float> cells;
+		std::vector<odd::uint8> occupancy;
+		GridBounds bounds;
+	};
+	std::vector<SplatPartial> partials_;
+	std::vector<int> partialsOfRow_;	// the partials [first, last) that cover each grid row, in pairs.
+	bool partialsPending_;			// the partials have splats that are not in the splat target yet.
+	float lastSplatTime_;
+	bool hasHistory_;
+	ThreadPool* threadPool_;
+};
+
+typedef CpuBilateralGridT<RangeAverageRG, LayoutRangeTiles> CpuBilateralGrid;
+
+struct SplatScalingTiming
+{
+	int numThreads;
+	double rowBandSeconds;		// clear, splat, blur and normalize with CPU_SPLAT_ROW_BANDS, per frame.
+	double partialSeconds;		// and with CPU_SPLAT_PARTIAL_GRIDS.
+	double rowBandSpeedup;		// over one thread.
+	double partialSpeedup;
+	float depthMax;				// the largest difference of the sliced depth between the two.
+};
+
+// splats srcRgbd (depth in alpha, e.g. the depth image of a point cloud) into a CpuBilateralGrid set
+// up with the given grid parameters, on a pool of 1 to maxThreads threads (0 = the cores) with each splat mode,
+// and slices against refRgba. Each time is the best of numFrames frames, after one to warm up.
+// timings (if given) receives maxThreads entries.
+void benchmarkSplatScaling(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, int maxThreads = 0, int numFrames = 5,
+	SplatScalingTiming* timings = 0);
+
+#endif  // CPUBILATERALGRID_H
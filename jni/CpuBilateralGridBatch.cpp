@@ -0,0 +1,90 @@
+
+#include "CpuBilateralGridBatch.h"
+
+template <class RangePolicy, class LayoutPolicy>
+CpuBilateralGridBatchT<RangePolicy, LayoutPolicy>::CpuBilateralGridBatchT(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	sliceLinear = true;
+	blurSigma[0] = blurSigma[1] = 0;
+	recursiveBlur = false;
+	trackBounds = true;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+CpuBilateralGridBatchT<RangePolicy, LayoutPolicy>::~CpuBilateralGridBatchT()
+{
+	for (size_t i = 0; i < grids_.size(); ++i)
+		delete grids_[i];
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridBatchT<RangePolicy, LayoutPolicy>::setup(int maxFrames, const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding)
+{
+	maxFrames = std::max(maxFrames, 0);
+	for (size_t i = maxFrames; i < grids_.size(); ++i)
+		delete grids_[i];
+	const size_t numGrids = grids_.size();
+	grids_.resize(maxFrames);
+	for (size_t i = numGrids; i < grids_.size(); ++i)
+		grids_[i] = new Grid(threadPool_);
+
+	// every grid allocates its buffers here, so the batches don't.
+	threadPool_->parallelFor(0, int(grids_.size()), [&](int i0, int i1)
+	{
+		for (int i = i0; i < i1; ++i)
+			grids_[i]->setup(inputSize, sigma, padding);
+	});
+	if (!grids_.empty())
+	{
+		blurSigma[0] = grids_[0]->blurSigma[0];
+		blurSigma[1] = grids_[0]->blurSigma[1];
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBilateralGridBatchT<RangePolicy, LayoutPolicy>::upsample(const GridBatchFrame* frames, int numFrames, int srcWidth, int srcHeight,
+	int refWidth, int refHeight, int dstWidth, int dstHeight)
+{
+	if (numFrames > maxFrames())
+	{
+		LOGE("CpuBilateralGridBatch: %d frames for %d grids", numFrames, maxFrames());
+		numFrames = maxFrames();
+	}
+
+	auto run = [&](int i)
+	{
+		Grid* grid = grids_[i];
+		const GridBatchFrame& frame = frames[i];
+		grid->sliceLinear = sliceLinear;
+		grid->blurSigma[0] = blurSigma[0];
+		grid->blurSigma[1] = blurSigma[1];
+		grid->recursiveBlur = recursiveBlur;
+		grid->trackBounds = trackBounds;
+		grid->persistenceTime = 0;
+
+		grid->clear();
+		grid->splatRgbd(frame.srcRgbd, srcWidth, srcHeight, frame.srcStride, 0.0f, 1.0f, frame.confidence, frame.confidenceStride);
+		grid->slice(frame.refRgba, refWidth, refHeight, frame.refStride, frame.dstRgbd, dstWidth, dstHeight, frame.dstStride);
+	};
+
+	// the frames go out in small chunks, so the threads that finish early take the frames left.
+	if (numFrames >= threadPool_->numThreads())
+	{
+		threadPool_->parallelFor(0, numFrames, [&](int i0, int i1)
+		{
+			for (int i = i0; i < i1; ++i)
+				run(i);
+		}, 1);
+	}
+	else
+	{
+		for (int i = 0; i < numFrames; ++i)
+			run(i);
+	}
+}
+
+template class CpuBilateralGridBatchT<RangeAverageRG, LayoutRangeTiles>;
+template class CpuBilateralGridBatchT<RangeLuma, LayoutRangeTiles>;
+template class CpuBilateralGridBatchT<RangeRedGreen, LayoutRangeTiles>;
+template class CpuBilateralGridBatchT<RangeChroma, LayoutRangeTiles>;
@@ -0,0 +1,66 @@
+
+#ifndef CPUBILATERALGRIDBATCH_H
+#define CPUBILATERALGRIDBATCH_H
+
+#include "CpuBilateralGrid.h"
+
+// one frame of a CpuBilateralGridBatch, as the arguments of CpuBilateralGrid::splatRgbd and slice.
+struct GridBatchFrame
+{
+	const float* srcRgbd;		// RGBA float image with depth in alpha.
+	int srcStride;
+	const float* confidence;	// optional, one float per source pixel.
+	int confidenceStride;
+	const float* refRgba;		// the color-reference image.
+	int refStride;
+	float* dstRgbd;		// receives [red, green, 0, depth].
+	int dstStride;
+};
+
+// Upsamples a batch of independent frames (e.g. a recorded session) through the bilateral grid, for throughput.
+//
+// The grids of all the frames are set up once and kept between batches. Each thread takes whole
+// frames and runs their clear, splat, blur and slice alone (the engines' own parallelFor calls run
+// serially inside the batch's), so a grid stays in one core's cache from the splat to the slice,
+// and there is no barrier between the passes of a frame. A batch of fewer frames than threads
+// runs the frames one after another instead, each spread over all the threads as usual.
+// Frames don't persist into each other: every frame is splatted into a cleared grid.
+template <class RangePolicy, class LayoutPolicy>
+class CpuBilateralGridBatchT
+{
+public:
+	typedef CpuBilateralGridT<RangePolicy, LayoutPolicy> Grid;
+
+	CpuBilateralGridBatchT(ThreadPool* threadPool = 0);
+	~CpuBilateralGridBatchT();
+
+	// sets up the grids of up to maxFrames frames, as CpuBilateralGrid::setup.
+	void setup(int maxFrames, const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0));
+
+	// upsamples numFrames (<= maxFrames) frames, each a src of srcWidth x srcHeight, a reference of
+	// refWidth x refHeight and a dst of dstWidth x dstHeight. Strides are in floats (0 = packed).
+	void upsample(const GridBatchFrame* frames, int numFrames, int srcWidth, int srcHeight,
+		int refWidth, int refHeight, int dstWidth, int dstHeight);
+
+	int maxFrames() const { return int(grids_.size()); }
+	// the grid of frame i, after upsample (e.g. to read its cells).
+	const Grid& grid(int i) const { return *grids_[i]; }
+
+public:
+
+	// copied into every grid before each batch, see CpuBilateralGrid.
+	bool sliceLinear;
+	float blurSigma[2];
+	bool recursiveBlur;
+	bool trackBounds;
+
+	ThreadPool* threadPool_;
+
+private:
+
+	std::vector<Grid*> grids_;
+};
+
+typedef CpuBilateralGridBatchT<RangeAverageRG, LayoutRangeTiles> CpuBilateralGridBatch;
+
+#endif  // CPUBILATERALGRIDBATCH_H
@@ -0,0 +1,407 @@
+
+#include "CpuBilateralSolver.h"
+#include <math.h>
+#include <string.h>
+
+// vertices per task and per partial sum of a dot product.
+static const int kSolverBlock = 4096;
+
+CpuBilateralSolver::CpuBilateralSolver(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	lambda = 4.0f;
+	numIterations = 25;
+	numBistochasticIterations = 10;
+	numStartIterations = 8;
+	sliceLinear = true;
+	numAxes_ = 0;
+	residual_ = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		gridSigma[i] = 1;
+		gridInputSize[i] = gridPadding[i] = gridSize[i] = 0;
+		axisStride_[i] = 0;
+	}
+}
+
+void CpuBilateralSolver::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding)
+{
+	setupGridParams(inputSize, sigma, padding, gridInputSize, gridSigma, gridPadding, gridSize);
+
+	// the blur only runs along the axes with more than one cell.
+	numAxes_ = 0;
+	int stride = 1;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (gridSize[i] > 1)
+			axisStride_[numAxes_++] = stride;
+		stride *= gridSize[i];
+	}
+
+	cellVertex_.assign(size_t(stride), -1);
+	vertexCells_.clear();
+	pixelVertex_.resize(size_t(gridInputSize[0]) * gridInputSize[1]);
+}
+
+void CpuBilateralSolver::buildVertices_(const float* refRgba, int refStride)
+{
+	// forget the vertices of the previous solve (only their cells are touched).
+	for (size_t v = 0; v < vertexCells_.size(); ++v)
+		cellVertex_[vertexCells_[v]] = -1;
+	vertexCells_.clear();
+	mass_.clear();
+
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+	const int width = gridInputSize[0];
+	const int height = gridInputSize[1];
+
+	// splat the reference image: every pixel makes its cell a vertex and adds to its mass.
+	for (int y = 0; y < height; ++y)
+	{
+		const float* ref = refRgba + size_t(y) * refStride;
+		const int gy = gridInputToGridCell(float(y), sigmaInv[1], gridPadding[1]);
+
+		for (int x = 0; x < width; ++x, ref += 4)
+		{
+			float inputRange[2];
+			createInputRange(ref, gridSize, inputRange);
+
+			int gx = gridInputToGridCell(float(x), sigmaInv[0], gridPadding[0]);
+			int gz = gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]);
+			int gw = gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]);
+			gx = std::min(std::max(gx, 0), gridSize[0] - 1);
+			gz = std::min(std::max(gz, 0), gridSize[2] - 1);
+			gw = std::min(std::max(gw, 0), gridSize[3] - 1);
+
+			const int cell = gx + gridSize[0] * (gy + gridSize[1] * (gz + gridSize[2] * gw));
+			int v = cellVertex_[cell];
+			if (v < 0)
+			{
+				v = int(vertexCells_.size());
+				cellVertex_[cell] = v;
+				vertexCells_.push_back(cell);
+				mass_.push_back(0.0f);
+			}
+			mass_[v] += 1.0f;
+			pixelVertex_[size_t(y) * width + x] = v;
+		}
+	}
+
+	// link the vertices to their neighbours along each axis...
+	const int numVerts = numVertices();
+	const int numCells = int(cellVertex_.size());
+	neighbours_.resize(size_t(numVerts) * 2 * numAxes_);
+
+	threadPool_->parallelFor(0, numVerts, [&](int v0, int v1)
+	{
+		for (int v = v0; v < v1; ++v)
+		{
+			const int cell = vertexCells_[v];
+			int* n = &neighbours_[size_t(v) * 2 * numAxes_];
+			for (int a = 0; a < numAxes_; ++a)
+			{
+				// the axis coordinate of the cell, to stop at the grid edges.
+				const int stride = axisStride_[a];
+				const int size = (a + 1 < numAxes_ ? axisStride_[a + 1] : numCells) / stride;
+				const int coord = (cell / stride) % size;
+				n[a * 2 + 0] = (coord > 0) ? cellVertex_[cell - stride] : -1;
+				n[a * 2 + 1] = (coord < size - 1) ? cellVertex_[cell + stride] : -1;
+			}
+		}
+	}, kSolverBlock);
+}
+
+void CpuBilateralSolver::blur_(const float* src, float* dst)
+{
+	const float center = 2.0f * numAxes_;
+	const int numNeighbours = 2 * numAxes_;
+
+	threadPool_->parallelFor(0, numVertices(), [&](int v0, int v1)
+	{
+		for (int v = v0; v < v1; ++v)
+		{
+			const int* n = &neighbours_[size_t(v) * numNeighbours];
+			float sum = center * src[v];
+			for (int k = 0; k < numNeighbours; ++k)
+				sum += (n[k] >= 0) ? src[n[k]] : 0.0f;
+			dst[v] = sum;
+		}
+	}, kSolverBlock);
+}
+
+double CpuBilateralSolver::dot_(const std::vector<float>& a, const std::vector<float>& b)
+{
+	const int numVerts = numVertices();
+	const int numBlocks = (numVerts + kSolverBlock - 1) / kSolverBlock;
+	partialSums_.resize(numBlocks);
+
+	threadPool_->parallelFor(0, numBlocks, [&](int b0, int b1)
+	{
+		for (int block = b0; block < b1; ++block)
+		{
+			const int end = std::min(numVerts, (block + 1) * kSolverBlock);
+			double sum = 0;
+			for (int v = block * kSolverBlock; v < end; ++v)
+				sum += double(a[v]) * b[v];
+			partialSums_[block] = sum;
+		}
+	}, 1);
+
+	double sum = 0;
+	for (int block = 0; block < numBlocks; ++block)
+		sum += partialSums_[block];
+	return sum;
+}
+
+void CpuBilateralSolver::bistochastize_()
+{
+	// find the scale n so that n * blur(n) equals the pixel mass of every vertex,
+	// i.e. the blur normalized to be doubly stochastic (section 3 of the paper).
+	const int numVerts = numVertices();
+	norm_.assign(numVerts, 1.0f);
+	std::vector<float>& blurred = r_;
+	blurred.resize(numVerts);
+
+	for (int i = 0; i < numBistochasticIterations; ++i)
+	{
+		blur_(&norm_[0], &blurred[0]);
+		for (int v = 0; v < numVerts; ++v)
+			norm_[v] = sqrtf(norm_[v] * mass_[v] / blurred[v]);
+	}
+
+	// the mass the normalized blur actually has.
+	blur_(&norm_[0], &blurred[0]);
+	for (int v = 0; v < numVerts; ++v)
+		mass_[v] = norm_[v] * blurred[v];
+}
+
+void CpuBilateralSolver::splatTargets_(const float* srcRgbd, int srcStride, const float* confidence, int confidenceStride)
+{
+	const int numVerts = numVertices();
+	confidence_.assign(numVerts, 0.0f);
+	target_.assign(numVerts, 0.0f);
+
+	const int width = gridInputSize[0];
+	const int height = gridInputSize[1];
+	for (int y = 0; y < height; ++y)
+	{
+		const float* src = srcRgbd + size_t(y) * srcStride;
+		const float* conf = confidence ? confidence + size_t(y) * confidenceStride : 0;
+		const int* vertex = &pixelVertex_[size_t(y) * width];
+
+		for (int x = 0; x < width; ++x, src += 4)
+		{
+			const float depth = src[3];
+			if (depth <= 0.0f || depth >= 1.0f)
+				continue;
+			const float c = conf ? conf[x] : 1.0f;
+			if (c <= 0.0f)
+				continue;
+			confidence_[vertex[x]] += c;
+			target_[vertex[x]] += c * depth;
+		}
+	}
+}
+
+void CpuBilateralSolver::conjugateGradient_()
+{
+	// A y = b with A = lambda * (Dm - Dn B Dn) + diag(confidence), b = target.
+	const int numVerts = numVertices();
+	const int numNeighbours = 2 * numAxes_;
+	const float center = 2.0f * numAxes_;
+
+	solution_.resize(numVerts);
+	preconditioner_.resize(numVerts);
+	r_.resize(numVerts);
+	z_.resize(numVerts);
+	p_.resize(numVerts);
+	ap_.resize(numVerts);
+
+	// apply A to a vector...
+	auto multiply = [&](const std::vector<float>& x, std::vector<float>& ax)
+	{
+		threadPool_->parallelFor(0, numVerts, [&](int v0, int v1)
+		{
+			for (int v = v0; v < v1; ++v)
+			{
+				const int* n = &neighbours_[size_t(v) * numNeighbours];
+				float blurred = center * norm_[v] * x[v];
+				for (int k = 0; k < numNeighbours; ++k)
+					blurred += (n[k] >= 0) ? norm_[n[k]] * x[n[k]] : 0.0f;
+				ax[v] = lambda * (mass_[v] * x[v] - norm_[v] * blurred) + confidence_[v] * x[v];
+			}
+		}, kSolverBlock);
+	};
+
+	// start from the normalized blur of the samples (the bilateral grid upsampling), spread over
+	// numStartIterations cells, so the solve only has to refine it.
+	std::vector<float>& spreadTarget = z_;
+	std::vector<float>& spreadConfidence = p_;
+	spreadTarget = target_;
+	spreadConfidence = confidence_;
+	for (int i = 0; i < numStartIterations; ++i)
+	{
+		blur_(&spreadTarget[0], &r_[0]);
+		blur_(&r_[0], &spreadTarget[0]);
+		blur_(&spreadConfidence[0], &r_[0]);
+		blur_(&r_[0], &spreadConfidence[0]);
+	}
+
+	// with a Jacobi preconditioner.
+	for (int v = 0; v < numVerts; ++v)
+	{
+		solution_[v] = (spreadConfidence[v] > 0.0f) ? spreadTarget[v] / spreadConfidence[v] : 0.0f;
+		float diagonal = lambda * (mass_[v] - center * norm_[v] * norm_[v]) + confidence_[v];
+		preconditioner_[v] = 1.0f / std::max(diagonal, 1e-6f);
+	}
+
+	multiply(solution_, ap_);
+	for (int v = 0; v < numVerts; ++v)
+	{
+		r_[v] = target_[v] - ap_[v];
+		z_[v] = r_[v] * preconditioner_[v];
+		p_[v] = z_[v];
+	}
+
+	const double targetNorm = std::max(dot_(target_, target_), 1e-30);
+	double rz = dot_(r_, z_);
+
+	for (int i = 0; i < numIterations && rz > 0; ++i)
+	{
+		multiply(p_, ap_);
+		const double pap = dot_(p_, ap_);
+		if (pap <= 0)
+			break;
+		const float alpha = float(rz / pap);
+
+		threadPool_->parallelFor(0, numVerts, [&](int v0, int v1)
+		{
+			for (int v = v0; v < v1; ++v)
+			{
+				solution_[v] += alpha * p_[v];
+				r_[v] -= alpha * ap_[v];
+				z_[v] = r_[v] * preconditioner_[v];
+			}
+		}, kSolverBlock);
+
+		const double rzNext = dot_(r_, z_);
+		const float beta = float(rzNext / rz);
+		rz = rzNext;
+
+		threadPool_->parallelFor(0, numVerts, [&](int v0, int v1)
+		{
+			for (int v = v0; v < v1; ++v)
+				p_[v] = z_[v] + beta * p_[v];
+		}, kSolverBlock);
+	}
+
+	residual_ = float(sqrt(dot_(r_, r_) / targetNorm));
+}
+
+void CpuBilateralSolver::slice_(const float* refRgba, int refStride, float* dstRgbd, int dstStride)
+{
+	// the vertices of regions without any sample keep y = 0 (their rows of A and b are 0).
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+	const int width = gridInputSize[0];
+	const int height = gridInputSize[1];
+	const int cellStride[4] = { 1, gridSize[0], gridSize[0] * gridSize[1], gridSize[0] * gridSize[1] * gridSize[2] };
+	const int numW = (gridSize[3] > 1) ? 2 : 1;
+
+	// the spatial cells and weights of every column and row.
+	std::vector<int> cellX(width * 2), cellY(height * 2);
+	std::vector<float> weightX(width * 2), weightY(height * 2);
+	for (int x = 0; x < width; ++x)
+	{
+		float frac;
+		gridCoordToLinearCells(gridInputToGridCoord(float(x), sigmaInv[0], gridPadding[0]), gridSize[0], &cellX[x * 2], &cellX[x * 2 + 1], &frac);
+		weightX[x * 2] = 1.0f - frac;
+		weightX[x * 2 + 1] = frac;
+	}
+	for (int y = 0; y < height; ++y)
+	{
+		float frac;
+		gridCoordToLinearCells(gridInputToGridCoord(float(y), sigmaInv[1], gridPadding[1]), gridSize[1], &cellY[y * 2], &cellY[y * 2 + 1], &frac);
+		weightY[y * 2] = 1.0f - frac;
+		weightY[y * 2 + 1] = frac;
+	}
+
+	threadPool_->parallelFor(0, height, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* ref = refRgba + size_t(y) * refStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+			const int* vertex = &pixelVertex_[size_t(y) * width];
+			const int rowCell[2] = { cellY[y * 2] * cellStride[1], cellY[y * 2 + 1] * cellStride[1] };
+			const float* wy = &weightY[y * 2];
+
+			for (int x = 0; x < width; ++x, ref += 4, out += 4)
+			{
+				float depth = solution_[vertex[x]];
+
+				if (sliceLinear)
+				{
+					// blend the solved vertices around the pixel, skipping empty cells and unsolved vertices.
+					float inputRange[2];
+					createInputRange(ref, gridSize, inputRange);
+					int cz[2], cw[2];
+					float fz, fw;
+					gridCoordToLinearCells(gridInputToGridCoord(inputRange[0], sigmaInv[2], gridPadding[2]), gridSize[2], &cz[0], &cz[1], &fz);
+					gridCoordToLinearCells(gridInputToGridCoord(inputRange[1], sigmaInv[3], gridPadding[3]), gridSize[3], &cw[0], &cw[1], &fw);
+					const float wz[2] = { 1.0f - fz, fz };
+					const float ww[2] = { 1.0f - fw, fw };
+					const float* wx = &weightX[x * 2];
+
+					float sum = 0, weightSum = 0;
+					for (int iw = 0; iw < numW; ++iw)
+					{
+						for (int iz = 0; iz < 2; ++iz)
+						{
+							const int rangeCell = cz[iz] * cellStride[2] + cw[iw] * cellStride[3];
+							const float rangeWeight = wz[iz] * ww[iw];
+							for (int iy = 0; iy < 2; ++iy)
+							{
+								for (int ix = 0; ix < 2; ++ix)
+								{
+									const int v = cellVertex_[cellX[x * 2 + ix] + rowCell[iy] + rangeCell];
+									if (v >= 0 && solution_[v] > 0.0f)
+									{
+										const float w = wx[ix] * wy[iy] * rangeWeight;
+										sum += w * solution_[v];
+										weightSum += w;
+									}
+								}
+							}
+						}
+					}
+					if (weightSum > 0.0f)
+						depth = sum / weightSum;
+				}
+
+				out[0] = ref[0];
+				out[1] = ref[1];
+				out[2] = 0.0f;
+				out[3] = std::max(depth, 0.0f);
+			}
+		}
+	}, 4);
+}
+
+void CpuBilateralSolver::solve(const float* refRgba, int refStride, const float* srcRgbd, int srcStride,
+	const float* confidence, int confidenceStride, float* dstRgbd, int dstStride)
+{
+	if (refStride <= 0)
+		refStride = gridInputSize[0] * 4;
+	if (srcStride <= 0)
+		srcStride = gridInputSize[0] * 4;
+	if (confidenceStride <= 0)
+		confidenceStride = gridInputSize[0];
+	if (dstStride <= 0)
+		dstStride = gridInputSize[0] * 4;
+
+	buildVertices_(refRgba, refStride);
+	bistochastize_();
+	splatTargets_(srcRgbd, srcStride, confidence, confidenceStride);
+	conjugateGradient_();
+	slice_(refRgba, refStride, dstRgbd, dstStride);
+}
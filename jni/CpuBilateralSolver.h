@@ -0,0 +1,88 @@
+
+#ifndef CPUBILATERALSOLVER_H
+#define CPUBILATERALSOLVER_H
+
+#include "CpuGridUtil.h"
+
+// The fast bilateral solver (Barron and Poole 2016) on the cells of the bilateral grid.
+//
+// Rather than a normalized blur of the splatted depth, it finds the grid values y that minimize
+//   lambda * smoothness(y) + sum_i c_i * (slice(y)_i - t_i)^2
+// where t_i are the depth samples and c_i their confidences, with the smoothness measured by the
+// bistochastized grid blur. The cells are laid out as in CpuBilateralGrid (same setup, same splat
+// coordinates), but only the cells that some reference pixel lands in are solver vertices.
+//
+// The system is solved by preconditioned conjugate gradient for a fixed number of iterations,
+// so the cost is bounded: about (2 * active axes + 10) flops per vertex per iteration.
+// Depth fills in across whole regions of similar colour, so a much coarser grid than the
+// splat/blur/slice upsampling gives the same coverage.
+class CpuBilateralSolver
+{
+public:
+	CpuBilateralSolver(ThreadPool* threadPool = 0);
+
+	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0));
+
+	// refRgba is the colour guide and srcRgbd the depth samples (in alpha), both inputSize images.
+	// a sample's confidence is 1 where 0 < depth < 1 and 0 elsewhere, times confidence[x,y] if given
+	// (one float per pixel). dstRgbd receives [red, green, 0, depth], with depth 0 where no sample
+	// reaches. Strides are in floats (0 = packed).
+	void solve(const float* refRgba, int refStride, const float* srcRgbd, int srcStride,
+		const float* confidence, int confidenceStride, float* dstRgbd, int dstStride = 0);
+
+	int numVertices() const { return int(vertexCells_.size()); }
+	// the relative residual |b - Ay| / |b| after the last solve.
+	float residual() const { return residual_; }
+
+private:
+
+	void buildVertices_(const float* refRgba, int refStride);
+	void bistochastize_();
+	void splatTargets_(const float* srcRgbd, int srcStride, const float* confidence, int confidenceStride);
+	void conjugateGradient_();
+	void slice_(const float* refRgba, int refStride, float* dstRgbd, int dstStride);
+
+	// sum_i a[i] * b[i] over the vertices, in fixed blocks so the result doesn't depend on the threads.
+	double dot_(const std::vector<float>& a, const std::vector<float>& b);
+	// dst = 2 * numAxes * src + the sum of the neighbours of each vertex (the [1 2 1] blur on every axis).
+	void blur_(const float* src, float* dst);
+
+public:
+
+	float gridSigma[4];
+	int gridInputSize[4];
+	int gridPadding[4];
+	int gridSize[4];
+	// the weight of the smoothness against the data term. Larger fills further and flattens more.
+	float lambda;
+	// the conjugate gradient budget. The solve stops early only once the residual vanishes.
+	int numIterations;
+	// iterations of the bistochastization of the blur (the normalization of the vertex masses).
+	int numBistochasticIterations;
+	// the starting guess is the samples blurred 2 * numStartIterations times, then normalized.
+	int numStartIterations;
+	// interpolate the solved vertices when slicing, otherwise take the pixel's own vertex.
+	bool sliceLinear;
+
+	ThreadPool* threadPool_;
+
+private:
+
+	int numAxes_;
+	int axisStride_[4];			// the cell index step of each active axis.
+	std::vector<int> cellVertex_;		// dense, the vertex of each grid cell or -1.
+	std::vector<int> vertexCells_;		// the cell of each vertex.
+	std::vector<int> neighbours_;		// 2 * numAxes_ per vertex, -1 where the neighbour cell is empty.
+	std::vector<int> pixelVertex_;		// the vertex of each reference pixel.
+	std::vector<float> mass_;		// reference pixels per vertex, then the bistochastized mass.
+	std::vector<float> norm_;		// the bistochastization scale per vertex.
+	std::vector<float> confidence_;	// splatted confidence.
+	std::vector<float> target_;		// splatted confidence * depth (the right hand side).
+	std::vector<float> preconditioner_;	// inverse of the diagonal of the system.
+	std::vector<float> solution_;
+	std::vector<float> r_, z_, p_, ap_;
+	std::vector<double> partialSums_;
+	float residual_;
+};
+
+#endif  // CPUBILATERALSOLVER_H
@@ -0,0 +1,626 @@
+
+#include "CpuBlockBilateralGrid.h"
+#include "CpuBilateralGrid.h"
+#include <math.h>
+#include <string.h>
+
+// grid rows per splat task.
+static const int kSplatBandRows = 8;
+// bytes of a step of a strip of the spatial blur. The blur keeps 17 of them.
+static const int kStripBytes = 4 * 1024;
+
+// the cells of a block a box covers, as one run [begin, end) (including the cells between its range rows).
+static void rangeSpan(const GridBounds& bounds, const int* gridSize, int* begin, int* end)
+{
+	*begin = bounds.lo[3] * gridSize[2] + bounds.lo[2];
+	*end = (bounds.hi[3] - 1) * gridSize[2] + bounds.hi[2];
+}
+
+template <class RangePolicy, class LayoutPolicy>
+CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::CpuBlockBilateralGridT(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	sliceLinear = true;
+	trackBounds = true;
+	blockCells_ = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		gridSigma[i] = 1;
+		gridInputSize[i] = gridPadding[i] = gridSize[i] = 0;
+	}
+	defaultBlurSigma(gridSigma, blurSigma);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::~CpuBlockBilateralGridT()
+{
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding)
+{
+	setupGridParams(inputSize, sigma, padding, gridInputSize, gridSigma, gridPadding, gridSize);
+	defaultBlurSigma(gridSigma, blurSigma);
+
+	blockCells_ = gridSize[2] * gridSize[3];
+	const size_t numFloats = LayoutPolicy::numBlocks(gridSize) * blockCells_ * 4;
+	gridBuffers_[0].assign(numFloats, 0.0f);
+	gridBuffers_[1].assign(numFloats, 0.0f);
+	gridBounds_[0].setEmpty();
+	gridBounds_[1].setEmpty();
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::clearRegion_(float* buffer, const GridBounds& bounds)
+{
+	if (bounds.empty())
+		return;
+
+	int spanBegin, spanEnd;
+	rangeSpan(bounds, gridSize, &spanBegin, &spanEnd);
+
+	threadPool_->parallelFor(bounds.lo[1], bounds.hi[1], [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			for (int x = bounds.lo[0]; x < bounds.hi[0]; ++x)
+				memset(buffer + cellOffset_(x, y, 0, 0) + spanBegin * 4, 0, sizeof(float) * 4 * (spanEnd - spanBegin));
+		}
+	});
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::clear()
+{
+	clearRegion_(&gridBuffers_[0][0], gridBounds_[0]);
+	gridBounds_[0].setEmpty();
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride, float /*inputTime*/, float weight,
+	const float* confidence, int confidenceStride)
+{
+	if (srcStride <= 0)
+		srcStride = srcWidth * 4;
+	if (confidenceStride <= 0)
+		confidenceStride = srcWidth;
+
+	const int inputWidth = gridInputSize[0];
+	const int inputHeight = gridInputSize[1];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the splat mesh has one point per input texel, which samples the nearest source texel.
+	std::vector<int> srcX(inputWidth), cellX(inputWidth);
+	std::vector<int> srcY(inputHeight), cellY(inputHeight);
+	for (int x = 0; x < inputWidth; ++x)
+	{
+		srcX[x] = nearestTexel(x, inputWidth, srcWidth);
+		cellX[x] = gridInputToGridCell(float(x), sigmaInv[0], gridPadding[0]);
+	}
+	for (int y = 0; y < inputHeight; ++y)
+	{
+		srcY[y] = nearestTexel(y, inputHeight, srcHeight);
+		cellY[y] = gridInputToGridCell(float(y), sigmaInv[1], gridPadding[1]);
+	}
+
+	float* grid = &gridBuffers_[0][0];
+	const Float4 sampleWeight = Float4::splat(weight);
+	Mutex boundsMutex;
+
+	// each task owns a band of grid rows (a row of Morton bricks), and so every input row whose cells land in them.
+	threadPool_->parallelFor(0, (gridSize[1] + kSplatBandRows - 1) / kSplatBandRows, [&](int t0, int t1)
+	{
+		const int cy0 = t0 * kSplatBandRows;
+		const int cy1 = std::min(t1 * kSplatBandRows, gridSize[1]);
+		GridBounds bounds;
+
+		int yBegin = int(std::lower_bound(cellY.begin(), cellY.end(), cy0) - cellY.begin());
+		int yEnd = int(std::lower_bound(cellY.begin(), cellY.end(), cy1) - cellY.begin());
+
+		for (int y = yBegin; y < yEnd; ++y)
+		{
+			const float* srcRow = srcRgbd + size_t(srcY[y]) * srcStride;
+			const float* confidenceRow = confidence ? confidence + size_t(srcY[y]) * confidenceStride : 0;
+			const int gy = cellY[y];
+
+			for (int x = 0; x < inputWidth; ++x)
+			{
+				const float* rgbdSample = srcRow + srcX[x] * 4;
+
+				// don't splat invalid pixels.
+				if (rgbdSample[3] <= 0.0f)
+					continue;
+				const float sampleConfidence = confidenceRow ? confidenceRow[srcX[x]] : 1.0f;
+				if (sampleConfidence <= 0.0f)
+					continue;
+
+				float inputRange[2];
+				RangePolicy::inputRange(rgbdSample, gridSize, inputRange);
+
+				const int gx = cellX[x];
+				const int gz = gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]);
+				const int gw = gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]);
+				if (gx < 0 || gx >= gridSize[0] || gz < 0 || gz >= gridSize[2] || gw < 0 || gw >= gridSize[3])
+					continue;
+
+				// encode the grid sample as [red, green, depth, weight]
+				float* cell = grid + cellOffset_(gx, gy, gz, gw);
+				Float4 value = Float4::set(rgbdSample[0], rgbdSample[1], rgbdSample[3], 1.0f);
+				madd(value, sampleWeight * Float4::splat(sampleConfidence), Float4::load(cell)).store(cell);
+
+				bounds.include(gx, gy, gz, gw);
+			}
+		}
+
+		ScopedMutex lock(boundsMutex);
+		gridBounds_[0].unite(bounds);
+	}, 1);
+
+	if (!trackBounds)
+		gridBounds_[0].setFull(gridSize);
+
+	blurAndNormalize_(gridBounds_[0]);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::blurSpatial_(const float* src, float* dst, int axis, const GridBounds& bounds)
+{
+	if (bounds.empty())
+		return;
+
+	// a strip of neighbouring rows (or columns) of the box streams along the axis: each of the three
+	// iterations keeps its last five steps in a ring, so every block is read and written once.
+	// a step of the strip takes the range cells of the box from one block of each row, as one run.
+	const int other = 1 - axis;
+	const int lo = std::max(0, bounds.lo[axis] - kBlurRadius);
+	const int hi = std::min(gridSize[axis], bounds.hi[axis] + kBlurRadius);
+	const int numOther = bounds.hi[other] - bounds.lo[other];
+
+	int spanBegin, spanEnd;
+	rangeSpan(bounds, gridSize, &spanBegin, &spanEnd);
+	const int spanFloats = (spanEnd - spanBegin) * 4;
+	const int stripBlocks = std::min(numOther, std::max(1, kStripBytes / (spanFloats * int(sizeof(float)))));
+	const int stepFloats = stripBlocks * spanFloats;
+	float axisTap1, axisTap2;
+	gridBlurTaps(gridBlurCells(blurSigma, gridSigma, axis), &axisTap1, &axisTap2);
+	const Float4 tap1 = Float4::splat(axisTap1);
+	const Float4 tap2 = Float4::splat(axisTap2);
+
+	threadPool_->parallelFor(0, (numOther + stripBlocks - 1) / stripBlocks, [&](int t0, int t1)
+	{
+		// the input ring, the rings of the first two iterations, a zero step and the output step.
+		std::vector<float> rings(size_t(17) * stepFloats, 0.0f);
+		const float* zeroStep = &rings[15 * size_t(stepFloats)];
+		float* outStep = &rings[16 * size_t(stepFloats)];
+		auto ringStep = [&](int stage, int i) -> float*
+		{
+			return &rings[(stage * 5 + i % 5) * size_t(stepFloats)];
+		};
+
+		for (int t = t0; t < t1; ++t)
+		{
+			const int c0 = bounds.lo[other] + t * stripBlocks;
+			const int n = std::min(stripBlocks, bounds.hi[other] - c0);
+			const int floats = n * spanFloats;
+			// the first range cell of the run of strip row j at step i.
+			auto offset = [&](int i, int j) -> size_t
+			{
+				return ((axis == 0) ? cellOffset_(i, c0 + j, 0, 0) : cellOffset_(c0 + j, i, 0, 0)) + spanBegin * 4;
+			};
+
+			// one 5-tap iteration of step i of a stage, from the steps of the stage before it.
+			// cells outside of [lo, hi) are zero at every stage.
+			auto iterate = [&](int stage, int i, float* out)
+			{
+				const float* taps[5];
+				for (int k = -2; k <= 2; ++k)
+					taps[k + 2] = (i + k >= lo && i + k < hi) ? ringStep(stage - 1, i + k) : zeroStep;
+				for (int f = 0; f < floats; f += 4)
+				{
+					Float4 d0 = Float4::load(taps[0] + f);
+					Float4 d1 = Float4::load(taps[1] + f);
+					Float4 d2 = Float4::load(taps[2] + f);
+					Float4 d3 = Float4::load(taps[3] + f);
+					Float4 d4 = Float4::load(taps[4] + f);
+					madd(tap2, d0 + d4, madd(tap1, d1 + d3, d2)).store(out + f);
+				}
+			};
+
+			// reading step i completes step i - 2 of the first iteration, i - 4 of the second and i - 6 of the last.
+			for (int i = lo; i < hi + 6; ++i)
+			{
+				if (i < hi)
+				{
+					float* in = ringStep(0, i);
+					for (int j = 0; j < n; ++j)
+						memcpy(in + j * spanFloats, src + offset(i, j), sizeof(float) * spanFloats);
+				}
+				if (i - 2 >= lo && i - 2 < hi)
+					iterate(1, i - 2, ringStep(1, i - 2));
+				if (i - 4 >= lo && i - 4 < hi)
+					iterate(2, i - 4, ringStep(2, i - 4));
+				if (i - 6 >= lo)
+				{
+					iterate(3, i - 6, outStep);
+					for (int j = 0; j < n; ++j)
+						memcpy(dst + offset(i - 6, j), outStep + j * spanFloats, sizeof(float) * spanFloats);
+				}
+			}
+		}
+	}, 1);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::blurRange_(float* grid, bool normalize, const GridBounds& bounds)
+{
+	if (bounds.empty())
+		return;
+
+	// a block is blurred in place, through a copy with two zero cells of padding around each range axis.
+	const int numZ = gridSize[2];
+	const int numW = gridSize[3];
+	const int rowFloats = (numZ + 4) * 4;
+	const int boundsWidth = bounds.hi[0] - bounds.lo[0];
+	// [tap1, tap2] along z, then along w.
+	Float4 taps[2][2];
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		float tap1, tap2;
+		gridBlurTaps(gridBlurCells(blurSigma, gridSigma, 2 + axis), &tap1, &tap2);
+		taps[axis][0] = Float4::splat(tap1);
+		taps[axis][1] = Float4::splat(tap2);
+	}
+
+	threadPool_->parallelFor(0, boundsWidth * (bounds.hi[1] - bounds.lo[1]), [&](int t0, int t1)
+	{
+		std::vector<float> scratch0(size_t(numW + 4) * rowFloats, 0.0f);
+		std::vector<float> scratch1(size_t(numW + 4) * rowFloats, 0.0f);
+
+		for (int t = t0; t < t1; ++t)
+		{
+			float* block = grid + cellOffset_(bounds.lo[0] + t % boundsWidth, bounds.lo[1] + t / boundsWidth, 0, 0);
+			float* a = &scratch0[0];
+			float* b = &scratch1[0];
+
+			for (int w = 0; w < numW; ++w)
+				memcpy(a + (w + 2) * rowFloats + 8, block + w * numZ * 4, sizeof(float) * 4 * numZ);
+
+			// one 5-tap iteration along z (step one cell) or w (step one row).
+			auto pass = [&](const float* in, float* out, int step, const Float4* tap)
+			{
+				const Float4 tap1 = tap[0];
+				const Float4 tap2 = tap[1];
+				for (int w = 0; w < numW; ++w)
+				{
+					for (int z = 0; z < numZ; ++z)
+					{
+						const int i = (w + 2) * rowFloats + (z + 2) * 4;
+						Float4 d0 = Float4::load(in + i - 2 * step);
+						Float4 d1 = Float4::load(in + i - step);
+						Float4 d2 = Float4::load(in + i);
+						Float4 d3 = Float4::load(in + i + step);
+						Float4 d4 = Float4::load(in + i + 2 * step);
+						madd(tap2, d0 + d4, madd(tap1, d1 + d3, d2)).store(out + i);
+					}
+				}
+			};
+
+			// an axis of one cell has no neighbours, so its passes leave the grid unchanged.
+			for (int p = 0; p < 3; ++p)
+			{
+				if (numZ > 1)
+				{
+					pass(a, b, 4, taps[0]);
+					std::swap(a, b);
+				}
+				if (numW > 1)
+				{
+					pass(a, b, rowFloats, taps[1]);
+					std::swap(a, b);
+				}
+			}
+
+			// write back, normalizing on the way out unless the slice interpolates the homogeneous grid.
+			for (int w = 0; w < numW; ++w)
+			{
+				const float* in = a + (w + 2) * rowFloats + 8;
+				float* out = block + w * numZ * 4;
+
+				if (!normalize)
+				{
+					memcpy(out, in, sizeof(float) * 4 * numZ);
+					continue;
+				}
+
+				for (int i = 0; i < numZ * 4; i += 4)
+				{
+					float weight = in[i + 3];
+					Float4 norm = (weight == 0.0f) ? Float4::zero() : Float4::load(in + i) * Float4::splat(1.0f / weight);
+					norm.store(out + i);
+					// empty cells keep no weight, so the slice can tell them apart.
+					out[i + 3] = (weight == 0.0f) ? 0.0f : 1.0f;
+				}
+			}
+		}
+	}, 16);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::blurAndNormalize_(const GridBounds& srcBounds)
+{
+	if (srcBounds.empty())
+		return;
+
+	float* grid0 = &gridBuffers_[0][0];
+	float* grid1 = &gridBuffers_[1][0];
+
+	// the x pass spreads the splats along their rows into grid1, then the y pass spreads those
+	// back into grid0 and the range passes blur each block in place. Every pass overwrites
+	// all the cells it reaches, so only what an earlier x pass left outside of them is cleared.
+	GridBounds rowBounds = srcBounds;
+	rowBounds.lo[0] = std::max(0, srcBounds.lo[0] - kBlurRadius);
+	rowBounds.hi[0] = std::min(gridSize[0], srcBounds.hi[0] + kBlurRadius);
+	if (!rowBounds.contains(gridBounds_[1]))
+		clearRegion_(grid1, gridBounds_[1]);
+
+	blurSpatial_(grid0, grid1, 0, srcBounds);
+	gridBounds_[1] = rowBounds;
+	blurSpatial_(grid1, grid0, 1, rowBounds);
+
+	const GridBounds bounds = srcBounds.dilated(kBlurRadius, gridSize);
+	blurRange_(grid0, !sliceLinear, bounds);
+	gridBounds_[0] = bounds;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	if (refStride <= 0)
+		refStride = refWidth * 4;
+	if (dstStride <= 0)
+		dstStride = dstWidth * 4;
+
+	if (sliceLinear)
+	{
+		sliceLinear_(refRgba, refWidth, refHeight, refStride, dstRgbd, dstWidth, dstHeight, dstStride);
+		return;
+	}
+
+	const float* grid = &gridBuffers_[0][0];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the xy part of the lookup only depends on the column or row.
+	std::vector<int> refX(dstWidth), cellX(dstWidth);
+	std::vector<int> refY(dstHeight), cellY(dstHeight);
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		refX[x] = nearestRefTexel(x, dstWidth, refWidth);
+		float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+		cellX[x] = std::min(std::max(gridInputToGridCell(inputX, sigmaInv[0], gridPadding[0]), 0), gridSize[0] - 1);
+	}
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		refY[y] = nearestRefTexel(y, dstHeight, refHeight);
+		float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+		cellY[y] = std::min(std::max(gridInputToGridCell(inputY, sigmaInv[1], gridPadding[1]), 0), gridSize[1] - 1);
+	}
+
+	threadPool_->parallelFor(0, dstHeight, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* refRow = refRgba + size_t(refY[y]) * refStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+
+			for (int x = 0; x < dstWidth; ++x)
+			{
+				const float* referenceSample = refRow + refX[x] * 4;
+				float inputRange[2];
+				RangePolicy::inputRange(referenceSample, gridSize, inputRange);
+
+				int gz = std::min(std::max(gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]), 0), gridSize[2] - 1);
+				int gw = std::min(std::max(gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]), 0), gridSize[3] - 1);
+
+				const float* gridSample = grid + cellOffset_(cellX[x], cellY[y], gz, gw);
+
+				if (gridSample[3] == 0.0f)
+				{
+					// there is no data in the grid for this pixel.
+					Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out + x * 4);
+					continue;
+				}
+
+				// decode the grid sample from [red, green, depth, weight]
+				Float4::set(gridSample[0], gridSample[1], 0.0f, gridSample[2]).store(out + x * 4);
+			}
+		}
+	}, 4);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void CpuBlockBilateralGridT<RangePolicy, LayoutPolicy>::sliceLinear_(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	// interpolate the homogeneous grid, then normalize (as sampleGridLinear).
+	const float* grid = &gridBuffers_[0][0];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the xy cells and blend factors only depend on the column or row.
+	std::vector<int> refX(dstWidth), cellX0(dstWidth), cellX1(dstWidth);
+	std::vector<int> refY(dstHeight), cellY0(dstHeight), cellY1(dstHeight);
+	std::vector<float> fracX(dstWidth), fracY(dstHeight);
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		refX[x] = nearestRefTexel(x, dstWidth, refWidth);
+		float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+		gridCoordToLinearCells(gridInputToGridCoord(inputX, sigmaInv[0], gridPadding[0]), gridSize[0], &cellX0[x], &cellX1[x], &fracX[x]);
+	}
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		refY[y] = nearestRefTexel(y, dstHeight, refHeight);
+		float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+		gridCoordToLinearCells(gridInputToGridCoord(inputY, sigmaInv[1], gridPadding[1]), gridSize[1], &cellY0[y], &cellY1[y], &fracY[y]);
+	}
+
+	threadPool_->parallelFor(0, dstHeight, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* refRow = refRgba + size_t(refY[y]) * refStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+			const Float4 fy = Float4::splat(fracY[y]);
+
+			for (int x = 0; x < dstWidth; ++x)
+			{
+				const float* referenceSample = refRow + refX[x] * 4;
+				float inputRange[2];
+				RangePolicy::inputRange(referenceSample, gridSize, inputRange);
+
+				int cz[2], cw[2];
+				float fz, fw;
+				gridCoordToLinearCells(gridInputToGridCoord(inputRange[0], sigmaInv[2], gridPadding[2]), gridSize[2], &cz[0], &cz[1], &fz);
+				gridCoordToLinearCells(gridInputToGridCoord(inputRange[1], sigmaInv[3], gridPadding[3]), gridSize[3], &cw[0], &cw[1], &fw);
+
+				const Float4 fx = Float4::splat(fracX[x]);
+				const float wz[2] = { 1.0f - fz, fz };
+				const float ww[2] = { 1.0f - fw, fw };
+
+				// the range corners are all in the same four blocks.
+				const float* block00 = grid + cellOffset_(cellX0[x], cellY0[y], 0, 0);
+				const float* block10 = grid + cellOffset_(cellX1[x], cellY0[y], 0, 0);
+				const float* block01 = grid + cellOffset_(cellX0[x], cellY1[y], 0, 0);
+				const float* block11 = grid + cellOffset_(cellX1[x], cellY1[y], 0, 0);
+
+				// one cell is one Float4, so every corner is a 4-wide lerp.
+				Float4 sum = Float4::zero();
+				for (int j = 0; j < 4; ++j)
+				{
+					const float w = wz[j & 1] * ww[j >> 1];
+					if (w == 0.0f)
+						continue;
+
+					const int i = (cw[j >> 1] * gridSize[2] + cz[j & 1]) * 4;
+					Float4 value0 = lerp(Float4::load(block00 + i), Float4::load(block10 + i), fx);
+					Float4 value1 = lerp(Float4::load(block01 + i), Float4::load(block11 + i), fx);
+					sum = madd(lerp(value0, value1, fy), Float4::splat(w), sum);
+				}
+
+				float cell[4];
+				sum.store(cell);
+				if (cell[3] <= 0.0f)
+				{
+					// there is no data in the grid for this pixel.
+					Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out + x * 4);
+					continue;
+				}
+
+				// normalize and decode the grid sample from [red, green, depth, weight]
+				const float norm = 1.0f / cell[3];
+				Float4::set(cell[0] * norm, cell[1] * norm, 0.0f, cell[2] * norm).store(out + x * 4);
+			}
+		}
+	}, 4);
+}
+
+template class CpuBlockBilateralGridT<RangeAverageRG, LayoutRangeBlocks>;
+template class CpuBlockBilateralGridT<RangeLuma, LayoutRangeBlocks>;
+template class CpuBlockBilateralGridT<RangeRedGreen, LayoutRangeBlocks>;
+template class CpuBlockBilateralGridT<RangeChroma, LayoutRangeBlocks>;
+template class CpuBlockBilateralGridT<RangeAverageRG, LayoutMortonBricks>;
+template class CpuBlockBilateralGridT<RangeLuma, LayoutMortonBricks>;
+template class CpuBlockBilateralGridT<RangeRedGreen, LayoutMortonBricks>;
+template class CpuBlockBilateralGridT<RangeChroma, LayoutMortonBricks>;
+
+//---------------------------------------------------
+// layout benchmark.
+
+const char* cpuGridLayoutName(CpuGridLayout layout)
+{
+	switch (layout)
+	{
+	case CPU_GRID_RANGE_TILES:
+		return "range tiles";
+	case CPU_GRID_RANGE_BLOCKS:
+		return "range blocks";
+	case CPU_GRID_MORTON_BRICKS:
+		return "morton bricks";
+	default:
+		return "unknown";
+	}
+}
+
+template <class Grid>
+static GridLayoutTiming timeGridLayout_(Grid& grid, const float* srcRgbd, const float* refRgba, int width, int height,
+	int numFrames, float* dstRgbd)
+{
+	GridLayoutTiming timing;
+	timing.splatSeconds = timing.sliceSeconds = 0;
+	timing.depthMax = 0;
+
+	// frame -1 warms up the caches and the thread pool.
+	for (int frame = -1; frame < numFrames; ++frame)
+	{
+		double t0 = getTimeSeconds();
+		grid.clear();
+		grid.splatRgbd(srcRgbd, width, height);
+		double t1 = getTimeSeconds();
+		grid.slice(refRgba, width, height, 0, dstRgbd, width, height);
+		double t2 = getTimeSeconds();
+
+		if (frame == 0 || (frame > 0 && t1 - t0 < timing.splatSeconds))
+			timing.splatSeconds = t1 - t0;
+		if (frame == 0 || (frame > 0 && t2 - t1 < timing.sliceSeconds))
+			timing.sliceSeconds = t2 - t1;
+	}
+	return timing;
+}
+
+CpuGridLayout benchmarkGridLayouts(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, bool sliceLinear, int numFrames,
+	GridLayoutTiming* timings)
+{
+	const size_t numFloats = size_t(width) * height * 4;
+	std::vector<float> results[NUM_CPU_GRID_LAYOUTS];
+	GridLayoutTiming timing[NUM_CPU_GRID_LAYOUTS];
+	numFrames = std::max(numFrames, 1);
+
+	{
+		CpuBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.setup(inputSize, sigma, padding);
+		results[CPU_GRID_RANGE_TILES].resize(numFloats);
+		timing[CPU_GRID_RANGE_TILES] = timeGridLayout_(grid, srcRgbd, refRgba, width, height, numFrames, &results[CPU_GRID_RANGE_TILES][0]);
+	}
+	{
+		CpuRangeBlockBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.setup(inputSize, sigma, padding);
+		results[CPU_GRID_RANGE_BLOCKS].resize(numFloats);
+		timing[CPU_GRID_RANGE_BLOCKS] = timeGridLayout_(grid, srcRgbd, refRgba, width, height, numFrames, &results[CPU_GRID_RANGE_BLOCKS][0]);
+	}
+	{
+		CpuMortonBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.setup(inputSize, sigma, padding);
+		results[CPU_GRID_MORTON_BRICKS].resize(numFloats);
+		timing[CPU_GRID_MORTON_BRICKS] = timeGridLayout_(grid, srcRgbd, refRgba, width, height, numFrames, &results[CPU_GRID_MORTON_BRICKS][0]);
+	}
+
+	CpuGridLayout fastest = CPU_GRID_RANGE_TILES;
+	for (int layout = 0; layout < NUM_CPU_GRID_LAYOUTS; ++layout)
+	{
+		for (size_t i = 3; i < numFloats; i += 4)
+			timing[layout].depthMax = std::max(timing[layout].depthMax, fabsf(results[layout][i] - results[CPU_GRID_RANGE_TILES][i]));
+
+		const double seconds = timing[layout].splatSeconds + timing[layout].sliceSeconds;
+		if (seconds < timing[fastest].splatSeconds + timing[fastest].sliceSeconds)
+			fastest = CpuGridLayout(layout);
+
+		LOGI("grid layout %s: splat %.2f ms, slice %.2f ms, depth max diff %g", cpuGridLayoutName(CpuGridLayout(layout)),
+			timing[layout].splatSeconds * 1000.0, timing[layout].sliceSeconds * 1000.0, timing[layout].depthMax);
+		if (timings)
+			timings[layout] = timing[layout];
+	}
+	return fastest;
+}
@@ -0,0 +1,110 @@
+
+#ifndef CPUBLOCKBILATERALGRID_H
+#define CPUBLOCKBILATERALGRID_H
+
+#include "CpuGridUtil.h"
+#include "CpuSimd.h"
+
+// A native bilateral grid with the range cells innermost (see the block layouts in BilateralGridPolicy.h).
+//
+// The raster tiling of CpuBilateralGrid puts the range neighbours of a cell a whole tile apart, so
+// the range blur and the scatter of a splat (which moves along the range axes with the colour)
+// touch a new cache line per cell. Here each spatial cell keeps its range cells in one block:
+// the range blur runs inside the block, and the spatial blur moves whole blocks, which are long
+// contiguous vectors. LayoutPolicy orders the blocks (row-major AoSoA, or Morton bricks).
+//
+// The blur is done on the 4D grid, so unlike the raster tiling nothing leaks between neighbouring
+// range slices at the spatial edges; elsewhere it matches CpuBilateralGrid to float rounding.
+// There is no persistence (inputTime is ignored), and the splats accumulate until clear().
+// Which layout is fastest depends on the grid shape and the cpu, see benchmarkGridLayouts.
+template <class RangePolicy, class LayoutPolicy>
+class CpuBlockBilateralGridT
+{
+public:
+	CpuBlockBilateralGridT(ThreadPool* threadPool = 0);
+	~CpuBlockBilateralGridT();
+
+	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0));
+
+	void clear();
+	// srcRgbd is an RGBA float image with depth in alpha. Strides are in floats (0 = packed).
+	// confidence is as in CpuBilateralGrid::splatRgbd.
+	void splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride = 0, float inputTime=0.0, float weight=1.0,
+		const float* confidence = 0, int confidenceStride = 0);
+	// refRgba is the color-reference image, dstRgbd receives [red, green, 0, depth].
+	// see sliceLinear for the interpolation.
+	void slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride = 0);
+
+	// the blurred cell (x, y, z, w), normalized unless sliceLinear.
+	const float* cell(int x, int y, int z, int w) const { return &gridBuffers_[0][cellOffset_(x, y, z, w)]; }
+	size_t memoryBytes() const { return (gridBuffers_[0].size() + gridBuffers_[1].size()) * sizeof(float); }
+
+private:
+
+	void blurAndNormalize_(const GridBounds& srcBounds);
+	void blurSpatial_(const float* src, float* dst, int axis, const GridBounds& bounds);
+	void blurRange_(float* grid, bool normalize, const GridBounds& bounds);
+	void clearRegion_(float* buffer, const GridBounds& bounds);
+	// the float offset of a cell in a grid buffer.
+	size_t cellOffset_(int x, int y, int z, int w) const
+	{
+		return (LayoutPolicy::block(x, y, gridSize) * blockCells_ + size_t(w) * gridSize[2] + z) * 4;
+	}
+	void sliceLinear_(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride);
+
+public:
+
+	float gridSigma[4];
+	int gridInputSize[4];
+	int gridPadding[4];
+	int gridSize[4];
+	// interpolate the grid when slicing (quadrilinear), otherwise take the nearest cell.
+	// this also selects whether the blur normalizes the grid, so set it before splatting.
+	bool sliceLinear;
+	// the sigma of the gaussian blur along the spatial and the range axes, as CpuBilateralGrid::blurSigma.
+	float blurSigma[2];
+	// restrict clear, blur and normalize to the cells the splats can reach. Otherwise every pass covers the whole grid.
+	bool trackBounds;
+
+	std::vector<float> gridBuffers_[2];
+	GridBounds gridBounds_[2];		// the cells of each buffer that may be non-zero.
+	ThreadPool* threadPool_;
+
+private:
+
+	int blockCells_;			// gridSize[2] * gridSize[3]
+};
+
+typedef CpuBlockBilateralGridT<RangeAverageRG, LayoutRangeBlocks> CpuRangeBlockBilateralGrid;
+typedef CpuBlockBilateralGridT<RangeAverageRG, LayoutMortonBricks> CpuMortonBilateralGrid;
+
+// the cpu grid layouts, for benchmarkGridLayouts.
+enum CpuGridLayout
+{
+	CPU_GRID_RANGE_TILES,		// CpuBilateralGrid
+	CPU_GRID_RANGE_BLOCKS,		// CpuRangeBlockBilateralGrid
+	CPU_GRID_MORTON_BRICKS,		// CpuMortonBilateralGrid
+	NUM_CPU_GRID_LAYOUTS
+};
+
+const char* cpuGridLayoutName(CpuGridLayout layout);
+
+struct GridLayoutTiming
+{
+	double splatSeconds;	// clear, splat, blur and normalize, per frame.
+	double sliceSeconds;	// per frame.
+	float depthMax;		// the largest difference of the sliced depth to CPU_GRID_RANGE_TILES.
+};
+
+// upsamples srcRgbd (depth in alpha) guided by refRgba, both width x height, with each layout
+// set up with the given grid parameters, and returns the one with the fastest splat + slice.
+// Each time is the best of numFrames frames, after one to warm up. timings (if given) receives
+// NUM_CPU_GRID_LAYOUTS entries. The fastest layout depends on the grid shape (mostly the number
+// of range cells per block), so run this once per shape, e.g. after setup, and keep the pick.
+CpuGridLayout benchmarkGridLayouts(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, bool sliceLinear = true, int numFrames = 5,
+	GridLayoutTiming* timings = 0);
+
+#endif  // CPUBLOCKBILATERALGRID_H
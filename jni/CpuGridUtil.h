@@ -0,0 +1,133 @@
+
+#ifndef CPUGRIDUTIL_H
+#define CPUGRIDUTIL_H
+
+#ifndef GLM_FORCE_RADIANS
+#	define GLM_FORCE_RADIANS
+#endif
+
+#include "BilateralGridPolicy.h"
+#include "glm/glm.hpp"
+#include "oddcore/OddImage.h"
+#include <math.h>
+
+// Helpers shared by the cpu grid engines. These mirror the GLSL functions in GlBilateralGrid.cpp.
+
+// Young and van Vliet's recursive gaussian ("Recursive implementation of the Gaussian filter", 1995):
+// a causal and an anti-causal third order filter, w[n] = b * x[n] + a1 * w[n-1] + a2 * w[n-2] + a3 * w[n-3]
+// and the same backwards over w. Its cost per cell is the same for any sigma, and it is normalized
+// (the cells past the ends of a line are zero). Sigmas under half a cell are out of the range the
+// fit is good for, and leave the line unchanged.
+struct RecursiveGaussian
+{
+	float b, a1, a2, a3;
+	// the cells past a splat the filter still reaches with more than about 3e-4 of its peak (4 sigma).
+	int tail;
+	bool identity;
+
+	explicit RecursiveGaussian(float sigmaCells)
+	{
+		identity = sigmaCells < 0.5f;
+		tail = identity ? 0 : int(ceilf(4.0f * sigmaCells));
+		if (identity)
+		{
+			b = 1.0f;
+			a1 = a2 = a3 = 0.0f;
+			return;
+		}
+
+		const float q = (sigmaCells >= 2.5f) ? 0.98711f * sigmaCells - 0.96330f : 3.97156f - 4.14554f * sqrtf(1.0f - 0.26891f * sigmaCells);
+		const float q2 = q * q;
+		const float q3 = q2 * q;
+		const float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+		a1 = (2.44413f * q + 2.85619f * q2 + 1.26661f * q3) / b0;
+		a2 = -(1.4281f * q2 + 1.26661f * q3) / b0;
+		a3 = 0.422205f * q3 / b0;
+		b = 1.0f - (a1 + a2 + a3);
+	}
+};
+
+// clamp and store the setup() parameters and compute the grid size (as GlBilateralGrid::setup).
+inline void setupGridParams(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	int* gridInputSize, float* gridSigma, int* gridPadding, int* gridSize)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		gridInputSize[i] = std::max(1.f, inputSize[i]);
+		gridPadding[i] = std::max(0.f, padding[i]);
+		gridSigma[i] = std::max(1.f, sigma[i]);
+		gridSize[i] = int((gridInputSize[i] - 1) / gridSigma[i]) + 1 + 2 * gridPadding[i];
+	}
+}
+
+// the bilateral input range of the default RangePolicy, for the engines that aren't templated on one.
+// (0, 0) to (gridSize.z-1, gridSize.w-1) inclusive
+inline void createInputRange(const float* rgb, const int* gridSize, float* inputRange)
+{
+	RangeAverageRG::inputRange(rgb, gridSize, inputRange);
+}
+
+// adds the range coordinates of RangePolicy over every step-th pixel of every step-th row of an RGBA
+// image (stride in floats) to histogram0 and histogram1, numBins bins over [0,1] each, for RangeCurve::equalize.
+template <class RangePolicy>
+void accumulateRangeHistogram(const float* rgba, int width, int height, int stride, int step, int numBins,
+	float* histogram0, float* histogram1)
+{
+	// with two cells per range axis the policies give coordinates in [0,1].
+	static const int unitGridSize[4] = { 1, 1, 2, 2 };
+	if (stride <= 0)
+		stride = width * 4;
+	step = std::max(step, 1);
+	for (int y = 0; y < height; y += step)
+	{
+		const float* row = rgba + size_t(y) * stride;
+		for (int x = 0; x < width; x += step)
+		{
+			float inputRange[2];
+			RangePolicy::inputRange(row + x * 4, unitGridSize, inputRange);
+			histogram0[std::min(std::max(int(inputRange[0] * float(numBins)), 0), numBins - 1)] += 1.0f;
+			histogram1[std::min(std::max(int(inputRange[1] * float(numBins)), 0), numBins - 1)] += 1.0f;
+		}
+	}
+}
+
+// downsample a high-res input-coord into a low-res grid coord.
+inline int gridInputToGridCell(float inputCoord, float sigmaInv, int padding)
+{
+	return int(floorf((inputCoord + 0.5f) * sigmaInv)) + padding;
+}
+
+// the continuous grid coord of a high-res input-coord (cell i spans [i, i+1)).
+inline float gridInputToGridCoord(float inputCoord, float sigmaInv, int padding)
+{
+	return (inputCoord + 0.5f) * sigmaInv + float(padding);
+}
+
+// the two cells and the blend factor for linear interpolation along one grid axis.
+// cell centers are at (i + 0.5), and the coord is clamped to the first and last centers.
+inline void gridCoordToLinearCells(float gridCoord, int gridSize, int* cell0, int* cell1, float* frac)
+{
+	float p = std::min(std::max(gridCoord - 0.5f, 0.0f), float(gridSize - 1));
+	int i = int(p);
+	*cell0 = i;
+	*cell1 = std::min(i + 1, gridSize - 1);
+	*frac = p - float(i);
+}
+
+// nearest texel of a (srcSize) texture sampled at the center of texel i of an (dstSize) target.
+inline int nearestTexel(int i, int dstSize, int srcSize)
+{
+	int s = int(floorf((float(i) + 0.5f) / float(dstSize) * float(srcSize)));
+	return std::min(std::max(s, 0), srcSize - 1);
+}
+
+// the reference texel the gl slice reads for texel i of an (dstSize) target: it samples i / dstSize plus
+// half a reference texel, so it rounds i * refSize / dstSize rather than flooring the texel center.
+// the float steps follow the shader, so exact halves (refSize = dstSize / 2, ...) round as gl does.
+inline int nearestRefTexel(int i, int dstSize, int refSize)
+{
+	int s = int(floorf((float(i) / float(dstSize) + 0.5f / float(refSize)) * float(refSize)));
+	return std::min(std::max(s, 0), refSize - 1);
+}
+
+#endif  // CPUGRIDUTIL_H
@@ -0,0 +1,69 @@
+
+#include "CpuHierarchicalUpsampler.h"
+#include <string.h>
+
+CpuHierarchicalUpsampler::CpuHierarchicalUpsampler(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	width_ = height_ = 0;
+	numLevels_ = 0;
+}
+
+CpuHierarchicalUpsampler::~CpuHierarchicalUpsampler()
+{
+	for (size_t i = 0; i < grids_.size(); ++i)
+		delete grids_[i];
+}
+
+void CpuHierarchicalUpsampler::setup(int width, int height, int numLevels, const glm::vec4& sigma, const glm::vec4& padding, int rangeCells)
+{
+	for (size_t i = 0; i < grids_.size(); ++i)
+		delete grids_[i];
+	grids_.clear();
+
+	width_ = width;
+	height_ = height;
+	numLevels_ = std::max(numLevels, 1);
+
+	// one level runs at a time, so the grids share a pair of rasters (sized by the level-0 grid, which
+	// is set up first), and the results of levels 1 and up follow them in the same allocation.
+	arena_.release();
+	std::vector<size_t> resultFloats;
+	for (int l = 1; l < numLevels_ - 1; ++l)
+		resultFloats.push_back(size_t(levelWidth(l)) * levelHeight(l) * 4);
+	arena_.setBlocks(resultFloats);
+
+	grids_.resize(numLevels_ - 1);
+	for (int l = 0; l < numLevels_ - 1; ++l)
+	{
+		grids_[l] = new CpuBilateralGrid(threadPool_);
+		grids_[l]->setup(glm::vec4(levelWidth(l), levelHeight(l), rangeCells, 1), sigma, padding, &arena_);
+		// the missing depth of the rgbd pyramid is not splatted.
+		grids_[l]->maxSplatDepth = 1.0f;
+	}
+}
+
+void CpuHierarchicalUpsampler::upsample(const float* const* rgbdPyramid, const float* const* colorPyramid, float* dstRgbd)
+{
+	const int coarsest = numLevels_ - 1;
+	if (coarsest == 0)
+	{
+		// a single level has nothing coarser to fill from, so it is only its own samples.
+		memcpy(dstRgbd, rgbdPyramid[0], sizeof(float) * 4 * width_ * height_);
+		return;
+	}
+
+	const float* prev = rgbdPyramid[coarsest];
+	for (int l = coarsest - 1; l >= 0; --l)
+	{
+		float* result = (l == 0) ? dstRgbd : levelResult(l);
+		CpuBilateralGrid* grid = grids_[l];
+
+		grid->clear();
+		grid->splatRgbd(prev, levelWidth(l + 1), levelHeight(l + 1));
+		grid->sliceMerge(colorPyramid[l], levelWidth(l), levelHeight(l), 0,
+			prev, levelWidth(l + 1), levelHeight(l + 1), 0, rgbdPyramid[l], 0,
+			result, levelWidth(l), levelHeight(l));
+		prev = result;
+	}
+}
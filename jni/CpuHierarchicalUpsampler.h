@@ -0,0 +1,48 @@
+
+#ifndef CPUHIERARCHICALUPSAMPLER_H
+#define CPUHIERARCHICALUPSAMPLER_H
+
+#include "CpuBilateralGrid.h"
+
+// The coarse-to-fine upsampling of GlDepthUpsampler (UPSAMPLE_HIERARCHICAL) on the cpu.
+//
+// Level l of the pyramids is (width >> l) x (height >> l). Starting from the coarsest rgbd level,
+// the result of each level is splatted into the grid of the next finer one, which is sliced
+// against that level's colour and merged with its own depth samples (CpuBilateralGrid::sliceMerge).
+// A level's grid only spreads depth by a few of its cells, so all the levels together cost about
+// a third more than the level-0 grid alone, while the depth reaches 2^levels times further.
+// The levels run one after another, and the splat, blur and slice of each is spread over the threads.
+class CpuHierarchicalUpsampler
+{
+public:
+	CpuHierarchicalUpsampler(ThreadPool* threadPool = 0);
+	~CpuHierarchicalUpsampler();
+
+	// the grids match those of GlDepthUpsampler: by default one cell per pixel of their level and 16 range cells.
+	// every level's grid has the same sigma and padding (in cells of its level), and rangeCells of range input.
+	void setup(int width, int height, int numLevels, const glm::vec4& sigma = glm::vec4(1, 1, 1, 1),
+		const glm::vec4& padding = glm::vec4(0), int rangeCells = 16);
+
+	// rgbdPyramid[l] and colorPyramid[l] are packed RGBA float images of level l, with the depth of
+	// rgbd in alpha (missing depth is 0 or 1, as the rgbd pyramid of GlDepthUpsampler leaves it).
+	// dstRgbd (width x height, packed) receives [red, green, blue, depth], with depth 0 where none reaches.
+	void upsample(const float* const* rgbdPyramid, const float* const* colorPyramid, float* dstRgbd);
+
+	int numLevels() const { return numLevels_; }
+	int levelWidth(int level) const { return width_ >> level; }
+	int levelHeight(int level) const { return height_ >> level; }
+	// the result of level 1 and up (levelWidth x levelHeight, packed), valid after an upsample.
+	float* levelResult(int level) { return arena_.block(level - 1); }
+	// of the grid rasters and level results.
+	size_t memoryBytes() const { return arena_.memoryBytes(); }
+
+public:
+
+	int width_, height_;
+	int numLevels_;
+	std::vector<CpuBilateralGrid*> grids_;		// grids_[l] upsamples into level l, for l < numLevels_ - 1.
+	CpuBilateralGridArena arena_;				// the rasters of the grids, then the results of levels 1 and up.
+	ThreadPool* threadPool_;
+};
+
+#endif  // CPUHIERARCHICALUPSAMPLER_H
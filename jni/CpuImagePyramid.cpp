@@ -0,0 +1,182 @@
+
+#include "CpuImagePyramid.h"
+#include <string.h>
+
+// the mean of the 2x2 blocks of rows row0 and row1 (each 2 * width pixels), alpha 1, as fs_reduceColor.
+static void reduceColorRow(const float* row0, const float* row1, float* dst, int width)
+{
+	// the alpha of the sum is dropped and replaced in one madd.
+	const Float4 quarter = Float4::set(0.25f, 0.25f, 0.25f, 0.0f);
+	const Float4 alpha = Float4::set(0.0f, 0.0f, 0.0f, 1.0f);
+	for (int x = 0; x < width; ++x)
+	{
+		const Float4 sum = Float4::load(row0 + x * 8) + Float4::load(row0 + x * 8 + 4) + Float4::load(row1 + x * 8) + Float4::load(row1 + x * 8 + 4);
+		madd(sum, quarter, alpha).store(dst + x * 4);
+	}
+}
+
+// copies a row of width rgbd pixels with depth 1 where it is 0 or less, and returns the pixels with a valid depth.
+static int copyRgbdRow(const float* src, float* dst, int width)
+{
+	const Float4 zero = Float4::zero();
+	const Float4 one = Float4::splat(1.0f);
+	const Mask4 depthLane = zero < Float4::set(0.0f, 0.0f, 0.0f, 1.0f);
+	Float4 count = zero;
+	for (int x = 0; x < width; ++x)
+	{
+		const Float4 p = Float4::load(src + x * 4);
+		const Float4 depth = p.splatW();
+		select((depth <= zero) & depthLane, one, p).store(dst + x * 4);
+		count = count + select((zero < depth) & (depth < one), one, zero);
+	}
+	return int(count.lane(0));
+}
+
+// the pixel with the nearest valid depth of the 2x2 blocks of rows row0 and row1 (each 2 * width pixels),
+// as fs_reduceRgbd, and returns the pixels with a valid depth.
+static int reduceRgbdRow(const float* row0, const float* row1, float* dst, int width)
+{
+	const Float4 zero = Float4::zero();
+	const Float4 one = Float4::splat(1.0f);
+	const Float4 none = Float4::set(0.0f, 0.0f, 0.0f, 1.0f);
+	Float4 count = zero;
+	for (int x = 0; x < width; ++x)
+	{
+		// in the order of fs_reduceRgbd, a later candidate wins a tie.
+		const Float4 candidates[4] = { Float4::load(row0 + x * 8), Float4::load(row0 + x * 8 + 4),
+			Float4::load(row1 + x * 8), Float4::load(row1 + x * 8 + 4) };
+		Float4 result = none;
+		Float4 nearest = one;
+		for (int k = 0; k < 4; ++k)
+		{
+			const Float4 depth = candidates[k].splatW();
+			const Mask4 closer = (depth < one) & (depth <= nearest);
+			result = select(closer, candidates[k], result);
+			nearest = select(closer, depth, nearest);
+		}
+		result.store(dst + x * 4);
+		count = count + select(nearest < one, one, zero);
+	}
+	return int(count.lane(0));
+}
+
+static const float kZero[4] = { 0, 0, 0, 0 };
+
+CpuImagePyramid::CpuImagePyramid(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	width_ = height_ = 0;
+	numLevels_ = 0;
+}
+
+void CpuImagePyramid::setup(int width, int height, int numLevels)
+{
+	width_ = width;
+	height_ = height;
+	numLevels_ = std::max(numLevels, 1);
+
+	pyramid_.resize(width_, height_, numLevels_);
+	levels_.resize(numLevels_);
+	for (int l = 0; l < numLevels_; ++l)
+	{
+		odd::fillImage(level(l), kZero);
+		levels_[l] = level(l).data();
+	}
+}
+
+CpuColorPyramid::CpuColorPyramid(ThreadPool* threadPool)
+	: CpuImagePyramid(threadPool)
+{
+	histogramBins = 0;
+}
+
+void CpuColorPyramid::rowWritten_(int l, int y, float* histogram)
+{
+	if (l == numLevels_ - 1)
+	{
+		if (histogramBins > 0)
+			accumulateRangeHistogram<RangeAverageRG>(level(l).row(y), levelWidth(l), 1, 0, 1,
+				histogramBins, histogram, histogram + histogramBins);
+		return;
+	}
+
+	if (!completesRow_(l, y))
+		return;
+
+	reduceColorRow(level(l).row(y - 1), level(l).row(y), level(l + 1).row(y >> 1), levelWidth(l + 1));
+	rowWritten_(l + 1, y >> 1, histogram);
+}
+
+void CpuColorPyramid::build(const float* srcRgba, int srcStride)
+{
+	const odd::ImageView<const float, 4> src(srcRgba, width_, height_, srcStride);
+
+	const int stripRows = stripRows_();
+	const int numStrips = numStrips_();
+	stripHistograms_.assign(size_t(std::max(numStrips, 1)) * histogramBins * 2, 0.0f);
+
+	threadPool_->parallelFor(0, numStrips, [&](int s0, int s1)
+	{
+		for (int s = s0; s < s1; ++s)
+		{
+			float* histogram = histogramBins > 0 ? &stripHistograms_[size_t(s) * histogramBins * 2] : 0;
+			const int y1 = std::min((s + 1) * stripRows, height_);
+			for (int y = s * stripRows; y < y1; ++y)
+			{
+				memcpy(level(0).row(y), src.row(y), src.rowBytes());
+				rowWritten_(0, y, histogram);
+			}
+		}
+	}, 1);
+
+	histogram_.assign(size_t(histogramBins) * 2, 0.0f);
+	for (int s = 0; s < numStrips; ++s)
+	{
+		for (int i = 0; i < histogramBins * 2; ++i)
+			histogram_[i] += stripHistograms_[size_t(s) * histogramBins * 2 + i];
+	}
+}
+
+CpuRgbdPyramid::CpuRgbdPyramid(ThreadPool* threadPool)
+	: CpuImagePyramid(threadPool)
+{
+}
+
+void CpuRgbdPyramid::rowWritten_(int l, int y, size_t* counts)
+{
+	if (!completesRow_(l, y))
+		return;
+
+	counts[l + 1] += reduceRgbdRow(level(l).row(y - 1), level(l).row(y), level(l + 1).row(y >> 1), levelWidth(l + 1));
+	rowWritten_(l + 1, y >> 1, counts);
+}
+
+void CpuRgbdPyramid::build(const float* srcRgbd, int srcStride)
+{
+	const odd::ImageView<const float, 4> src(srcRgbd, width_, height_, srcStride);
+
+	const int stripRows = stripRows_();
+	const int numStrips = numStrips_();
+	stripCounts_.assign(size_t(std::max(numStrips, 1)) * numLevels_, 0);
+
+	threadPool_->parallelFor(0, numStrips, [&](int s0, int s1)
+	{
+		for (int s = s0; s < s1; ++s)
+		{
+			size_t* counts = &stripCounts_[size_t(s) * numLevels_];
+			const int y1 = std::min((s + 1) * stripRows, height_);
+			for (int y = s * stripRows; y < y1; ++y)
+			{
+				counts[0] += copyRgbdRow(src.row(y), level(0).row(y), width_);
+				rowWritten_(0, y, counts);
+			}
+		}
+	}, 1);
+
+	validCounts_.assign(numLevels_, 0);
+	for (int s = 0; s < numStrips; ++s)
+	{
+		for (int l = 0; l < numLevels_; ++l)
+			validCounts_[l] += stripCounts_[size_t(s) * numLevels_ + l];
+	}
+}
@@ -0,0 +1,105 @@
+
+#ifndef CPUIMAGEPYRAMID_H
+#define CPUIMAGEPYRAMID_H
+
+#include "CpuGridUtil.h"
+#include "CpuSimd.h"
+
+// The pyramids of GlDepthUpsampler on the cpu, for the headless pipeline and for taking them off a
+// busy gpu. Level l is (width >> l) x (height >> l), level 0 the source and each level a reduction
+// of the 2x2 blocks of the one before. All the levels are in one odd::ImagePyramid, whose rows of
+// RGBA floats are packed.
+//
+// The levels are built in one sweep: the source goes down in strips of 2^(numLevels-1) rows, a
+// strip per task, and each pair of rows a level gets is reduced into the next level right away,
+// while both are still in L1. The source is read once and every level written once, and the
+// strips never share a row of any level. The reductions are 4-wide (CpuSimd.h), a pixel per Float4.
+class CpuImagePyramid
+{
+public:
+	CpuImagePyramid(ThreadPool* threadPool = 0);
+
+	void setup(int width, int height, int numLevels);
+
+	int numLevels() const { return numLevels_; }
+	int levelWidth(int level) const { return width_ >> level; }
+	int levelHeight(int level) const { return height_ >> level; }
+	const odd::ImageView<float, 4>& level(int l) const { return pyramid_.level(l); }
+	const odd::ImagePyramid<float, 4>& pyramid() const { return pyramid_; }
+	// the levels, as CpuHierarchicalUpsampler::upsample takes them.
+	const float* const* levels() const { return &levels_[0]; }
+	size_t memoryBytes() const { return pyramid_.memoryBytes(); }
+
+protected:
+
+	// a strip is a row of the coarsest level, and the rows of every level above it.
+	int stripRows_() const { return 1 << (numLevels_ - 1); }
+	int numStrips_() const { return (height_ + stripRows_() - 1) / stripRows_(); }
+	// the second row of a pair completes a row of the next level (an odd last row has no pair).
+	bool completesRow_(int l, int y) const { return l < numLevels_ - 1 && (y & 1) != 0 && (y >> 1) < levelHeight(l + 1); }
+
+	int width_, height_;
+	int numLevels_;
+	odd::ImagePyramid<float, 4> pyramid_;
+	std::vector<const float*> levels_;
+	ThreadPool* threadPool_;
+};
+
+// the colour pyramid of GlDepthUpsampler::updateColorPyramid: level l is the mean colour of the 2x2
+// blocks of level l - 1 (alpha 1), summed in the order of fs_reduceColor.
+class CpuColorPyramid : public CpuImagePyramid
+{
+public:
+	CpuColorPyramid(ThreadPool* threadPool = 0);
+
+	// srcRgba is a width x height RGBA float image (stride in floats, 0 = packed).
+	void build(const float* srcRgba, int srcStride = 0);
+
+	// the histogram of the coarsest level (histogramBins bins over [0,1] for each range axis of
+	// RangeAverageRG, the range of the grids), taken by build as the sweep writes it, for RangeCurve::equalize.
+	// only with histogramBins > 0.
+	const float* rangeHistogram(int axis) const { return &histogram_[axis * histogramBins]; }
+
+public:
+
+	// the bins of rangeHistogram, 0 for none.
+	int histogramBins;
+
+private:
+
+	// after row y of level l is written: reduces it and the row before into the next level (and
+	// so on down the levels), or at the coarsest level takes it into the histogram.
+	void rowWritten_(int l, int y, float* histogram);
+
+	std::vector<float> histogram_;
+	std::vector<float> stripHistograms_;	// of each strip, summed into histogram_.
+};
+
+// the rgbd pyramid of GlDepthUpsampler::updateRgbdPyramid: level 0 is the source with depth (alpha)
+// 1 where it is 0 or less, and level l keeps the pixel of the 2x2 block of level l - 1 with the
+// nearest valid depth (< 1), or (0,0,0,1) where there is none, as fs_reduceRgbd.
+//
+// The reduction has no branches: the depth of each candidate is broadcast, compared into a lane
+// mask against 1 and the nearest so far, and the pixel selected whole, so the colour travels with
+// its depth. The number of valid pixels of each level falls out of the same masks.
+class CpuRgbdPyramid : public CpuImagePyramid
+{
+public:
+	CpuRgbdPyramid(ThreadPool* threadPool = 0);
+
+	// srcRgbd is a width x height RGBA float image with depth in alpha (stride in floats, 0 = packed).
+	void build(const float* srcRgbd, int srcStride = 0);
+
+	// the pixels of a level with a valid depth, counted by build.
+	size_t validCount(int level) const { return validCounts_[level]; }
+
+private:
+
+	// as CpuColorPyramid::rowWritten_, counting the valid pixels of each level into counts.
+	void rowWritten_(int l, int y, size_t* counts);
+
+	std::vector<size_t> validCounts_;
+	std::vector<size_t> stripCounts_;		// numLevels of each strip, summed into validCounts_.
+};
+
+#endif  // CPUIMAGEPYRAMID_H
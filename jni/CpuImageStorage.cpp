@@ -0,0 +1,559 @@
+
+#include "CpuImageStorage.h"
+#include "CpuBilateralGrid.h"
+#include <string.h>
+
+#if defined(__F16C__)
+#	include <immintrin.h>
+#	define CPU_HALF_F16C 1
+#elif defined(__aarch64__)
+#	include <arm_neon.h>
+#	define CPU_HALF_NEON 1
+#endif
+
+static inline odd::uint32 floatBits(float f)
+{
+	odd::uint32 u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static inline float bitsFloat(odd::uint32 u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+odd::uint16 floatToHalf(float f)
+{
+	const odd::uint32 f32Infinity = 255u << 23;
+	const odd::uint32 f16Max = (127u + 16) << 23;
+	const odd::uint32 denormMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+	odd::uint32 u = floatBits(f);
+	const odd::uint32 sign = u & 0x80000000u;
+	u ^= sign;
+
+	odd::uint32 h;
+	if (u >= f16Max)
+	{
+		// overflow to infinity, NaN stays a (quiet) NaN.
+		h = (u > f32Infinity) ? 0x7e00 : 0x7c00;
+	}
+	else if (u < (113u << 23))
+	{
+		// a half denormal (or zero): let the float adder do the rounding.
+		h = floatBits(bitsFloat(u) + bitsFloat(denormMagic)) - denormMagic;
+	}
+	else
+	{
+		// rebias the exponent and round the mantissa to nearest even.
+		const odd::uint32 mantissaOdd = (u >> 13) & 1;
+		u += (odd::uint32(15 - 127) << 23) + 0xfff + mantissaOdd;
+		h = u >> 13;
+	}
+	return odd::uint16(h | (sign >> 16));
+}
+
+float halfToFloat(odd::uint16 h)
+{
+	const odd::uint32 shiftedExp = 0x7c00u << 13;
+	const float magic = bitsFloat(113u << 23);
+
+	odd::uint32 u = odd::uint32(h & 0x7fff) << 13;
+	const odd::uint32 exp = u & shiftedExp;
+	u += odd::uint32(127 - 15) << 23;
+
+	float f;
+	if (exp == shiftedExp)
+	{
+		// infinity or NaN.
+		f = bitsFloat(u + (odd::uint32(128 - 16) << 23));
+	}
+	else if (exp == 0)
+	{
+		// zero or denormal: renormalize.
+		f = bitsFloat(u + (1u << 23)) - magic;
+	}
+	else
+	{
+		f = bitsFloat(u);
+	}
+	return bitsFloat(floatBits(f) | (odd::uint32(h & 0x8000) << 16));
+}
+
+// one RGBA pixel at a time, with the hardware conversions where the target has them.
+static inline void floatToHalf4(const float* src, odd::uint16* dst)
+{
+#if CPU_HALF_F16C
+	_mm_storel_epi64((__m128i*)dst, _mm_cvtps_ph(_mm_loadu_ps(src), _MM_FROUND_TO_NEAREST_INT));
+#elif CPU_HALF_NEON
+	vst1_u16(dst, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src))));
+#else
+	dst[0] = floatToHalf(src[0]);
+	dst[1] = floatToHalf(src[1]);
+	dst[2] = floatToHalf(src[2]);
+	dst[3] = floatToHalf(src[3]);
+#endif
+}
+
+static inline void halfToFloat4(const odd::uint16* src, float* dst)
+{
+#if CPU_HALF_F16C
+	_mm_storeu_ps(dst, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)src)));
+#elif CPU_HALF_NEON
+	vst1q_f32(dst, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src))));
+#else
+	dst[0] = halfToFloat(src[0]);
+	dst[1] = halfToFloat(src[1]);
+	dst[2] = halfToFloat(src[2]);
+	dst[3] = halfToFloat(src[3]);
+#endif
+}
+
+static inline odd::uint8 unitToByte(float v)
+{
+	return odd::uint8(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static inline odd::uint16 depthToUnorm16(float d)
+{
+	// keep the valid range (0,1) strictly inside the 16 bit range.
+	if (!(d > 0.0f))
+		return 0;
+	if (d >= 1.0f)
+		return CpuRgbDepth16Image::kDepthFar;
+	int v = int(d * 65535.0f + 0.5f);
+	return odd::uint16(std::min(std::max(v, 1), CpuRgbDepth16Image::kDepthFar - 1));
+}
+
+void convertFloatToHalf(const odd::ImageView<const float, 4>& src, CpuHalfImage& dst)
+{
+	dst.resize(src.width(), src.height());
+
+	ThreadPool::shared().parallelFor(0, dst.height(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* in = src.row(y);
+			odd::uint16* out = dst.row(y);
+			for (int x = 0; x < dst.width(); ++x, in += 4, out += 4)
+				floatToHalf4(in, out);
+		}
+	}, 8);
+}
+
+void convertHalfToFloat(const odd::ImageView<const odd::uint16, 4>& src, const odd::ImageView<float, 4>& dst)
+{
+	ThreadPool::shared().parallelFor(0, src.height(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const odd::uint16* in = src.row(y);
+			float* out = dst.row(y);
+			for (int x = 0; x < src.width(); ++x, in += 4, out += 4)
+				halfToFloat4(in, out);
+		}
+	}, 8);
+}
+
+void packRgbDepth16(const odd::ImageView<const float, 4>& srcRgbd, CpuRgbDepth16Image& dst)
+{
+	dst.resize(srcRgbd.width(), srcRgbd.height());
+
+	ThreadPool::shared().parallelFor(0, dst.height(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* src = srcRgbd.row(y);
+			odd::uint8* color = dst.color.row(y);
+			odd::uint16* depth = dst.depth.row(y);
+			for (int x = 0; x < dst.width(); ++x, src += 4, color += 4)
+			{
+				color[0] = unitToByte(src[0]);
+				color[1] = unitToByte(src[1]);
+				color[2] = unitToByte(src[2]);
+				color[3] = 255;
+				depth[x] = depthToUnorm16(src[3]);
+			}
+		}
+	}, 8);
+}
+
+void unpackRgbDepth16(const CpuRgbDepth16Image& src, const odd::ImageView<float, 4>& dst)
+{
+	const float byteScale = 1.0f / 255.0f;
+	const float depthScale = 1.0f / 65535.0f;
+	ThreadPool::shared().parallelFor(0, src.height(), [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const odd::uint8* color = src.color.row(y);
+			const odd::uint16* depth = src.depth.row(y);
+			float* out = dst.row(y);
+			for (int x = 0; x < src.width(); ++x, color += 4, out += 4)
+			{
+				out[0] = color[0] * byteScale;
+				out[1] = color[1] * byteScale;
+				out[2] = color[2] * byteScale;
+				out[3] = depth[x] * depthScale;
+			}
+		}
+	}, 8);
+}
+
+void convertRgba8ToFloat(const odd::ImageView<const odd::uint8, 4>& src, const odd::ImageView<float, 4>& dst)
+{
+	ThreadPool::shared().parallelFor(0, src.height(), [&](int y0, int y1)
+	{
+		odd::convertImage(src.roi(0, y0, src.width(), y1 - y0), dst.roi(0, y0, dst.width(), y1 - y0), 1.0f / 255.0f);
+	}, 8);
+}
+
+void quantizeImage(StorageFormat format, bool isColor, const float* src, int width, int height, int srcStride,
+	float* dst, int dstStride)
+{
+	const odd::ImageView<const float, 4> srcView(src, width, height, srcStride);
+	const odd::ImageView<float, 4> dstView(dst, width, height, dstStride);
+
+	if (format == STORAGE_RGBA16F)
+	{
+		CpuHalfImage half;
+		convertFloatToHalf(srcView, half);
+		convertHalfToFloat(half, dstView);
+	}
+	else if (format == STORAGE_RGB8_DEPTH16 && !isColor)
+	{
+		CpuRgbDepth16Image packed;
+		packRgbDepth16(srcView, packed);
+		unpackRgbDepth16(packed, dstView);
+	}
+	else if (format == STORAGE_RGB8_DEPTH16)
+	{
+		odd::Image<odd::uint8, 4> bytes(width, height);
+		for (int y = 0; y < height; ++y)
+		{
+			const float* in = srcView.row(y);
+			odd::uint8* out = bytes.row(y);
+			for (int i = 0; i < width * 4; ++i)
+				out[i] = unitToByte(in[i]);
+		}
+		convertRgba8ToFloat(bytes, dstView);
+	}
+	else if (src != dst || srcView.stride() != dstView.stride())
+		odd::copyImage(srcView, dstView);
+}
+
+static void upsampleForError_(CpuBilateralGrid& grid, bool halfGrid, const float* srcRgbd, const float* refRgba,
+	int width, int height, float* dstRgbd)
+{
+	grid.clear();
+	grid.splatRgbd(srcRgbd, width, height);
+	if (halfGrid)
+	{
+		float* cells = grid.gridData();
+		quantizeImage(STORAGE_RGBA16F, false, cells, int(grid.gridFloats() / 4), 1, 0, cells);
+	}
+	grid.slice(refRgba, width, height, 0, dstRgbd, width, height);
+}
+
+StorageError measureStorageError(StorageFormat format, const float* srcRgbd, const float* refRgba, int width, int height)
+{
+	StorageError error;
+	memset(&error, 0, sizeof(error));
+
+	const size_t numPixels = size_t(width) * height;
+	std::vector<float> rgbd(numPixels * 4), ref(numPixels * 4);
+	quantizeImage(format, false, srcRgbd, width, height, 0, &rgbd[0]);
+	quantizeImage(format, true, refRgba, width, height, 0, &ref[0]);
+
+	// the stored images...
+	double colorSum = 0, depthSum = 0;
+	size_t numDepths = 0;
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			float e = fabsf(ref[i * 4 + c] - refRgba[i * 4 + c]);
+			error.colorMax = std::max(error.colorMax, e);
+			colorSum += e;
+		}
+
+		float d0 = srcRgbd[i * 4 + 3];
+		float d1 = rgbd[i * 4 + 3];
+		bool valid0 = d0 > 0.0f && d0 < 1.0f;
+		bool valid1 = d1 > 0.0f && d1 < 1.0f;
+		if (valid0 != valid1)
+			error.changedSamples++;
+		if (valid0 && valid1)
+		{
+			float e = fabsf(d1 - d0);
+			error.depthMax = std::max(error.depthMax, e);
+			depthSum += e;
+			numDepths++;
+		}
+	}
+	error.colorMean = float(colorSum / std::max<size_t>(1, numPixels * 3));
+	error.depthMean = float(depthSum / std::max<size_t>(1, numDepths));
+
+	// ...and what they do to the upsampled depth.
+	CpuBilateralGrid grid;
+	grid.setup(glm::vec4(width, height, 16, 1), glm::vec4(1, 1, 1, 1), glm::vec4(0));
+	std::vector<float> result0(numPixels * 4), result1(numPixels * 4);
+	upsampleForError_(grid, false, srcRgbd, refRgba, width, height, &result0[0]);
+	upsampleForError_(grid, format != STORAGE_RGBA32F, &rgbd[0], &ref[0], width, height, &result1[0]);
+
+	double upsampledSum = 0;
+	size_t numUpsampled = 0;
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		float d0 = result0[i * 4 + 3];
+		float d1 = result1[i * 4 + 3];
+		if (d0 <= 0.0f || d1 <= 0.0f)
+			continue;
+		float e = fabsf(d1 - d0);
+		error.upsampledMax = std::max(error.upsampledMax, e);
+		upsampledSum += e;
+		numUpsampled++;
+	}
+	error.upsampledMean = float(upsampledSum / std::max<size_t>(1, numUpsampled));
+
+	return error;
+}
+
+// the best time of numFrames runs of run, after one to warm up.
+template <class Run>
+static double bestSeconds_(int numFrames, const Run& run)
+{
+	run();
+	double best = 1e30;
+	for (int i = 0; i < numFrames; ++i)
+	{
+		double t0 = getTimeSeconds();
+		run();
+		best = std::min(best, getTimeSeconds() - t0);
+	}
+	return best;
+}
+
+ImageConversionTiming benchmarkImageConversion(int width, int height, int numFrames)
+{
+	numFrames = std::max(numFrames, 1);
+
+	// colour ramps, and depth over (0,1) with a hole every 7 pixels.
+	odd::Image<float, 4> src(width, height), dst(width, height);
+	odd::Image<odd::uint8, 4> bytes(width, height);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			float* p = src.pixel(x, y);
+			p[0] = float(x) / std::max(width, 1);
+			p[1] = float(y) / std::max(height, 1);
+			p[2] = float((x + y) & 255) / 255.0f;
+			p[3] = (x + y) % 7 == 0 ? 0.0f : 0.5f * (p[0] + p[1]) + 0.001f;
+			for (int c = 0; c < 4; ++c)
+				bytes.at(x, y, c) = unitToByte(p[c]);
+		}
+	}
+
+	ImageConversionTiming timing;
+	CpuHalfImage half;
+	CpuRgbDepth16Image packed;
+	const odd::ImageView<float, 4> srcRoi = src.roi(width / 4, height / 4, width / 2, height / 2);
+	const odd::ImageView<float, 4> dstRoi = dst.roi(width / 4, height / 4, width / 2, height / 2);
+	timing.copySeconds = bestSeconds_(numFrames, [&]() { odd::copyImage(src, dst); });
+	timing.roiCopySeconds = bestSeconds_(numFrames, [&]() { odd::copyImage(srcRoi, dstRoi); });
+	timing.toHalfSeconds = bestSeconds_(numFrames, [&]() { convertFloatToHalf(src, half); });
+	timing.fromHalfSeconds = bestSeconds_(numFrames, [&]() { convertHalfToFloat(half, dst); });
+	timing.packRgbDepth16Seconds = bestSeconds_(numFrames, [&]() { packRgbDepth16(src, packed); });
+	timing.unpackRgbDepth16Seconds = bestSeconds_(numFrames, [&]() { unpackRgbDepth16(packed, dst); });
+	timing.rgba8ToFloatSeconds = bestSeconds_(numFrames, [&]() { convertRgba8ToFloat(bytes, dst); });
+	timing.copyBandwidth = 2.0 * src.rowBytes() * height / std::max(timing.copySeconds, 1e-9);
+
+	LOGI("image conversion of %dx%d: copy %.3f ms (%.2f GB/s), roi copy %.3f ms, to half %.3f ms, from half %.3f ms, "
+		"pack rgb8 depth16 %.3f ms, unpack %.3f ms, rgba8 to float %.3f ms", width, height,
+		timing.copySeconds * 1000.0, timing.copyBandwidth * 1e-9, timing.roiCopySeconds * 1000.0,
+		timing.toHalfSeconds * 1000.0, timing.fromHalfSeconds * 1000.0, timing.packRgbDepth16Seconds * 1000.0,
+		timing.unpackRgbDepth16Seconds * 1000.0, timing.rgba8ToFloatSeconds * 1000.0);
+	return timing;
+}
+
+// a value per pixel and channel, that tells them all apart.
+template <class T, int Channels>
+static void fillPattern_(const odd::ImageView<T, Channels>& image, int seed)
+{
+	for (int y = 0; y < image.height(); ++y)
+		for (int x = 0; x < image.width(); ++x)
+			for (int c = 0; c < Channels; ++c)
+				image.at(x, y, c) = T((seed + y * 37 + x * 5 + c) % 251);
+}
+
+template <class S, class T, int Channels>
+static bool samePixels_(const odd::ImageView<S, Channels>& a, const odd::ImageView<T, Channels>& b)
+{
+	if (a.width() != b.width() || a.height() != b.height())
+		return false;
+	for (int y = 0; y < a.height(); ++y)
+		for (int x = 0; x < a.width() * Channels; ++x)
+			if (a.row(y)[x] != b.row(y)[x])
+				return false;
+	return true;
+}
+
+static bool isAligned_(const void* p, size_t alignment)
+{
+	return size_t(p) % alignment == 0;
+}
+
+bool checkImageContainers()
+{
+	bool passed = true;
+	auto check = [&](bool ok, const char* what)
+	{
+		if (!ok)
+		{
+			LOGE("image containers: %s failed", what);
+			passed = false;
+		}
+	};
+
+	// roi: clipped to the image, and sharing its pixels and stride.
+	{
+		odd::Image<float, 4> image(10, 7);
+		fillPattern_(image.view(), 0);
+		odd::ImageView<float, 4> r = image.roi(-3, -2, 6, 5);
+		check(r.width() == 3 && r.height() == 3 && r.data() == image.pixel(0, 0) && r.stride() == image.stride(), "roi at a negative origin");
+		r = image.roi(7, 5, 10, 10);
+		check(r.width() == 3 && r.height() == 2 && r.data() == image.pixel(7, 5), "roi past the far edges");
+		r = image.roi(-5, -5, 30, 30);
+		check(r.width() == 10 && r.height() == 7 && r.data() == image.data(), "roi around the image");
+		check(image.roi(12, 0, 4, 4).empty() && image.roi(0, 9, 4, 4).empty(), "roi outside the image");
+		check(image.roi(2, 3, -1, 4).empty() && image.roi(2, 3, 4, -2).empty(), "roi of a negative size");
+		r = image.roi(2, 2, 6, 4).roi(4, 1, 5, 5);
+		check(r.width() == 2 && r.height() == 3 && r.data() == image.pixel(6, 3) && r.at(1, 2, 3) == image.at(7, 5, 3), "roi of a roi");
+		r = odd::ImageView<float, 4>().roi(0, 0, 4, 4);
+		check(r.empty() && r.data() == 0, "roi of an empty view");
+	}
+
+	// strides: rows padded to the row alignment, but never to less than a value.
+	{
+		check(odd::imageStride<float, 4>(3) == 12 && odd::imageStride<float, 4>(0) == 0 && odd::imageStride<float, 4>(-2) == 0, "float rgba stride");
+		check(odd::imageStride<odd::uint8, 4>(3) == 16 && odd::imageStride<odd::uint8, 3>(5, 64) == 64, "byte stride");
+		check(odd::imageStride<odd::uint8, 1>(5, 1) == 5 && odd::imageStride<odd::uint16, 1>(5, 1) == 5, "stride of an alignment below a value");
+		check(odd::imageStride<float, 1>(3, 2) == 3 && odd::imageStride<odd::uint16, 3>(3, 4) == 10, "stride of a value-sized alignment");
+
+		odd::Image<odd::uint8, 1> bytes(5, 3);
+		check(bytes.stride() == 16 && !bytes.packed() && bytes.rowBytes() == 5, "padded byte image");
+		check(isAligned_(bytes.data(), odd::kImageAlignment) && isAligned_(bytes.row(1), odd::kImageRowAlignment), "byte image alignment");
+		odd::Image<odd::uint16, 1> shorts(5, 3, 1);
+		check(shorts.stride() == 5 && shorts.packed() && shorts.rowAlignment() == 1, "unpadded short image");
+		odd::Image<float, 4> floats(7, 3);
+		check(floats.packed() && floats.memoryBytes() >= floats.rowBytes() * 3, "float rgba image");
+		floats.resize(5, 4, 64);
+		check(floats.stride() == 32 && !floats.packed() && isAligned_(floats.row(3), 64) && floats.rowAlignment() == 64, "resize to a larger alignment");
+		floats.resize(0, 4);
+		check(floats.empty() && floats.stride() == 0, "resize to no width");
+	}
+
+	// pyramid: level l is (w >> l) x (h >> l), each on its own aligned block, in order.
+	{
+		odd::ImagePyramid<float, 4> pyramid;
+		check(pyramid.resize(37, 21, 6, 64) && pyramid.numLevels() == 6, "pyramid resize");
+		const odd::uint8* end = 0;
+		for (int l = 0; l < pyramid.numLevels(); ++l)
+		{
+			const odd::ImageView<float, 4>& level = pyramid.level(l);
+			check(level.width() == (37 >> l) && level.height() == (21 >> l), "pyramid level size");
+			check(level.stride() == odd::imageStride<float, 4>(37 >> l, 64), "pyramid level stride");
+			check(isAligned_(level.data(), odd::kImageAlignment) && (level.height() < 2 || isAligned_(level.row(1), 64)), "pyramid level alignment");
+			check((const odd::uint8*)level.data() >= end, "pyramid levels apart");
+			end = (const odd::uint8*)(level.data() + size_t(level.stride()) * level.height());
+		}
+		check(end <= (const odd::uint8*)pyramid.level(0).data() + pyramid.memoryBytes(), "pyramid inside its memory");
+		check(pyramid.level(5).width() == 1 && pyramid.level(5).height() == 0 && pyramid.level(5).empty(), "pyramid level of no rows");
+		check(pyramid.resize(4, 4, 4) && pyramid.level(3).empty() && pyramid.level(2).width() == 1 && pyramid.rowAlignment() == odd::kImageRowAlignment, "pyramid past one pixel");
+	}
+
+	// copyImage: one memmove for packed images of one width, a row at a time otherwise, with the same pixels.
+	{
+		odd::Image<float, 4> src(9, 5), packed(9, 5), padded(9, 5, 64), narrow(6, 3);
+		fillPattern_(src.view(), 1);
+		check(src.packed() && packed.packed() && !padded.packed(), "copy images");
+		const float pad = -1.0f;
+		for (int y = 0; y < padded.height(); ++y)
+			for (int i = padded.width() * 4; i < padded.stride(); ++i)
+				padded.row(y)[i] = pad;
+		odd::copyImage(src, packed);
+		odd::copyImage(src, padded);
+		check(samePixels_(src.view(), packed.view()), "packed copy");
+		check(samePixels_(packed.view(), padded.view()), "row copy");
+		bool padKept = true;
+		for (int y = 0; y < padded.height(); ++y)
+			for (int i = padded.width() * 4; i < padded.stride(); ++i)
+				padKept = padKept && padded.row(y)[i] == pad;
+		check(padKept, "row copy keeps the padding");
+		odd::copyImage(src, narrow);
+		check(samePixels_(src.roi(0, 0, 6, 3), narrow.view()), "copy to a smaller image");
+		odd::copyImage(padded.roi(2, 1, 5, 4), narrow);
+		check(samePixels_(src.roi(2, 1, 5, 3), narrow.roi(0, 0, 5, 3)) && narrow.at(5, 0) == src.at(5, 0), "copy of a roi");
+	}
+
+	// convertImage: each value times scale, cast to the destination type, where both images are.
+	{
+		odd::Image<odd::uint8, 4> bytes(7, 3);
+		odd::Image<float, 4> floats(7, 3);
+		odd::Image<odd::uint16, 4> shorts(5, 3, 64);
+		fillPattern_(bytes.view(), 3);
+		odd::convertImage(bytes, floats, 1.0f / 255.0f);
+		bool scaled = true;
+		for (int y = 0; y < 3; ++y)
+			for (int x = 0; x < 7 * 4; ++x)
+				scaled = scaled && floats.row(y)[x] == float(bytes.row(y)[x] * (1.0f / 255.0f));
+		check(scaled, "convert to float");
+		const odd::uint16 sentinel[4] = { 1, 2, 3, 4 };
+		odd::fillImage(shorts.view(), sentinel);
+		floats.at(1, 1, 0) = 0.5f;
+		odd::convertImage(floats.roi(1, 1, 6, 2), shorts, 65535.0f);
+		check(shorts.at(0, 0, 0) == 32767 && shorts.at(4, 1, 3) == odd::uint16(floats.at(5, 2, 3) * 65535.0f), "convert to shorts");
+		check(shorts.at(0, 2, 2) == 3 && shorts.at(4, 2, 3) == 4, "convert only where both are");
+	}
+
+	// copies: the pixels and the row alignment, and self-assignment leaves an image as it was.
+	{
+		odd::Image<odd::uint8, 3> image(5, 3, 64);
+		fillPattern_(image.view(), 4);
+		odd::Image<odd::uint8, 3> copy(image);
+		check(copy.data() != image.data() && copy.stride() == image.stride() && copy.rowAlignment() == 64 && samePixels_(copy.view(), image.view()),
+			"image copy");
+		odd::Image<odd::uint8, 3> assigned(2, 2, 1);
+		assigned = image;
+		check(assigned.stride() == image.stride() && assigned.rowAlignment() == 64 && samePixels_(assigned.view(), image.view()), "image assignment");
+		assigned.assign(image.roi(1, 1, 3, 2));
+		check(assigned.rowAlignment() == 64 && assigned.stride() == 64 && samePixels_(assigned.view(), image.roi(1, 1, 3, 2)), "assign of a roi");
+		odd::Image<odd::uint8, 3>& same = copy;
+		const odd::uint8* data = copy.data();
+		copy = same;
+		check(copy.data() == data && copy.width() == 5 && samePixels_(copy.view(), image.view()), "image self-assignment");
+
+		odd::ImagePyramid<float, 4> pyramid;
+		pyramid.resize(11, 7, 3, 64);
+		for (int l = 0; l < pyramid.numLevels(); ++l)
+			fillPattern_(pyramid.level(l), l);
+		odd::ImagePyramid<float, 4> pyramidCopy(pyramid);
+		bool levelsCopied = pyramidCopy.numLevels() == 3 && pyramidCopy.rowAlignment() == 64;
+		for (int l = 0; levelsCopied && l < 3; ++l)
+			levelsCopied = pyramidCopy.level(l).data() != pyramid.level(l).data() && pyramidCopy.level(l).stride() == pyramid.level(l).stride() &&
+				samePixels_(pyramidCopy.level(l), pyramid.level(l));
+		check(levelsCopied, "pyramid copy");
+		odd::ImagePyramid<float, 4>& samePyramid = pyramidCopy;
+		pyramidCopy = samePyramid;
+		check(pyramidCopy.numLevels() == 3 && samePixels_(pyramidCopy.level(2), pyramid.level(2)), "pyramid self-assignment");
+		pyramidCopy = odd::ImagePyramid<float, 4>();
+		check(pyramidCopy.numLevels() == 0, "assignment of an empty pyramid");
+	}
+
+	LOGI("image containers: %s", passed ? "all checks passed" : "FAILED");
+	return passed;
+}
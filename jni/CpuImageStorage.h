@@ -0,0 +1,86 @@
+
+#ifndef CPUIMAGESTORAGE_H
+#define CPUIMAGESTORAGE_H
+
+#include "CpuGridUtil.h"
+
+// Reduced-precision containers for the rgbd and colour images, and the kernels that convert
+// them to and from the float RGBA images the cpu grid engines take.
+// They hold the same bits as the textures GlDepthUpsampler creates for each StorageFormat,
+// so a cpu stage can work on read-back texture data, or emulate the gpu storage.
+
+// float <-> IEEE 754 half, rounding to nearest even (as the gpu does on a render target write).
+// out of range values become infinity, NaN stays NaN.
+odd::uint16 floatToHalf(float f);
+float halfToFloat(odd::uint16 h);
+
+// an RGBA image of half floats, as a GL_RGBA16F texture.
+typedef odd::Image<odd::uint16, 4> CpuHalfImage;
+
+// an rgbd image as 8 bit colour and 16 bit unsigned normalized depth, in two planes (6 bytes a pixel).
+// depth 0 is 'no sample' and kDepthFar (1.0) the cleared/far value, so in-between depths are kept
+// inside [1, kDepthFar-1] and a pixel never changes between valid and invalid.
+struct CpuRgbDepth16Image
+{
+	static const odd::uint16 kDepthFar = 0xffff;
+
+	odd::Image<odd::uint8, 4> color;		// RGBA8 per pixel (alpha unused, 255).
+	odd::Image<odd::uint16, 1> depth;		// one depth per pixel.
+
+	void resize(int w, int h) { color.resize(w, h); depth.resize(w, h); }
+	int width() const { return depth.width(); }
+	int height() const { return depth.height(); }
+	size_t memoryBytes() const { return color.memoryBytes() + depth.memoryBytes(); }
+};
+
+// conversion kernels, from an image to one of the same size (which they resize, if it is an Image).
+// they run on the shared thread pool, a band of rows per task.
+void convertFloatToHalf(const odd::ImageView<const float, 4>& src, CpuHalfImage& dst);
+void convertHalfToFloat(const odd::ImageView<const odd::uint16, 4>& src, const odd::ImageView<float, 4>& dst);
+void packRgbDepth16(const odd::ImageView<const float, 4>& src, CpuRgbDepth16Image& dst);
+void unpackRgbDepth16(const CpuRgbDepth16Image& src, const odd::ImageView<float, 4>& dst);
+// the read-back of a GL_RGBA8 texture to [0,1] floats.
+void convertRgba8ToFloat(const odd::ImageView<const odd::uint8, 4>& src, const odd::ImageView<float, 4>& dst);
+
+// round-trip an rgbd (or colour, if isColor) image through the storage of a format.
+// STORAGE_RGB8_DEPTH16 keeps colour images as RGBA8 and rgbd images as 8 bit colour + 16 bit depth.
+// src and dst may be the same image.
+void quantizeImage(StorageFormat format, bool isColor, const float* src, int width, int height, int srcStride,
+	float* dst, int dstStride = 0);
+
+// the accuracy lost by a storage format, against STORAGE_RGBA32F.
+struct StorageError
+{
+	float colorMax, colorMean;	// the reference colour image.
+	float depthMax, depthMean;	// the valid depth samples of the rgbd image.
+	int changedSamples;		// pixels that changed between valid and invalid depth (0 by design).
+	float upsampledMax, upsampledMean;	// the depth upsampled by the grid, where both runs have a result.
+};
+
+// stores the images in the format, upsamples them with a CpuBilateralGrid set up as level 0 of
+// GlDepthUpsampler (range 16, sigma 1), and compares with the float run. The 16 bit formats
+// also round the blurred grid to half floats, as the gpu grid textures would.
+// srcRgbd has depth in alpha (valid where 0 < depth < 1), refRgba is the colour guide.
+StorageError measureStorageError(StorageFormat format, const float* srcRgbd, const float* refRgba, int width, int height);
+
+// the time of a copy or conversion of a width x height image, the best of numFrames after one to warm up.
+struct ImageConversionTiming
+{
+	double copySeconds;			// of a packed RGBA float image (copyImage).
+	double roiCopySeconds;			// of the centre half (in x and y) of it, so of strided rows.
+	double toHalfSeconds;			// convertFloatToHalf.
+	double fromHalfSeconds;		// convertHalfToFloat.
+	double packRgbDepth16Seconds;
+	double unpackRgbDepth16Seconds;
+	double rgba8ToFloatSeconds;	// convertRgba8ToFloat.
+	double copyBandwidth;			// bytes read and written per second by the copy.
+};
+
+ImageConversionTiming benchmarkImageConversion(int width, int height, int numFrames = 5);
+
+// checks the image containers and copies of OddImage.h on small odd-sized images: roi clipping, row
+// strides and alignments, the level layout of ImagePyramid, both paths of copyImage, convertImage and
+// the copying of images and pyramids (self-assignment too). Logs each failure, true if all pass.
+bool checkImageContainers();
+
+#endif  // CPUIMAGESTORAGE_H
@@ -0,0 +1,364 @@
+
+#include "CpuPermutohedralLattice.h"
+#include <string.h>
+
+template <int D>
+CpuPermutohedralLattice<D>::CpuPermutohedralLattice(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	width_ = height_ = 0;
+	spatialSigma_ = 8.0f;
+	rangeSigma_ = 0.1f;
+	tableMask_ = 0;
+
+	// the lattice has a blur of unit variance per axis with this scaling of the features.
+	const float invStdDev = sqrtf(2.0f / 3.0f) * (D + 1);
+	for (int i = 0; i < D; ++i)
+		scaleFactor_[i] = invStdDev / sqrtf(float((i + 1) * (i + 2)));
+}
+
+template <int D>
+void CpuPermutohedralLattice<D>::setup(int width, int height, float spatialSigma, float rangeSigma)
+{
+	width_ = std::max(1, width);
+	height_ = std::max(1, height);
+	spatialSigma_ = std::max(1e-3f, spatialSigma);
+	rangeSigma_ = std::max(1e-3f, rangeSigma);
+
+	const size_t numPixels = size_t(width_) * height_;
+	pixelKeys_.resize(numPixels * (D + 1) * D);
+	pixelWeights_.resize(numPixels * (D + 1));
+	pixelVertices_.resize(numPixels * (D + 1));
+
+	// every pixel touches D+1 vertices but neighbours share most of them.
+	int capacity = int(odd::ODD_NEXT_POW2(odd::uint32(numPixels)));
+	table_.assign(capacity, -1);
+	tableMask_ = odd::uint32(capacity - 1);
+}
+
+template <int D>
+odd::uint32 CpuPermutohedralLattice<D>::hashKey_(const short* key)
+{
+	odd::uint32 k = 0;
+	for (int i = 0; i < D; ++i)
+	{
+		k += odd::uint32(key[i]);
+		k *= 2531011;
+	}
+	return k;
+}
+
+template <int D>
+int CpuPermutohedralLattice<D>::findVertex_(const short* key) const
+{
+	for (odd::uint32 h = hashKey_(key) & tableMask_;; h = (h + 1) & tableMask_)
+	{
+		int v = table_[h];
+		if (v < 0)
+			return -1;
+		if (memcmp(&vertexKeys_[size_t(v) * D], key, sizeof(short) * D) == 0)
+			return v;
+	}
+}
+
+template <int D>
+int CpuPermutohedralLattice<D>::insertVertex_(const short* key)
+{
+	if ((numVertices() + 1) * 2 > int(table_.size()))
+	{
+		// grow and re-insert.
+		int capacity = int(table_.size()) * 2;
+		table_.assign(capacity, -1);
+		tableMask_ = odd::uint32(capacity - 1);
+		for (int v = 0; v < numVertices(); ++v)
+		{
+			odd::uint32 h = hashKey_(&vertexKeys_[size_t(v) * D]) & tableMask_;
+			while (table_[h] >= 0)
+				h = (h + 1) & tableMask_;
+			table_[h] = v;
+		}
+	}
+
+	odd::uint32 h = hashKey_(key) & tableMask_;
+	for (; table_[h] >= 0; h = (h + 1) & tableMask_)
+	{
+		int v = table_[h];
+		if (memcmp(&vertexKeys_[size_t(v) * D], key, sizeof(short) * D) == 0)
+			return v;
+	}
+
+	int v = numVertices();
+	vertexKeys_.insert(vertexKeys_.end(), key, key + D);
+	table_[h] = v;
+	return v;
+}
+
+template <int D>
+void CpuPermutohedralLattice<D>::embed_(const float* refRgba, int refStride)
+{
+	const float spatialInv = 1.0f / spatialSigma_;
+	const float rangeInv = 1.0f / rangeSigma_;
+
+	// find the enclosing simplex and barycentric weights of every pixel (independent per pixel).
+	threadPool_->parallelFor(0, height_, [&](int y0, int y1)
+	{
+		float position[D];
+		float elevated[D + 1];
+		float barycentric[D + 2];
+		int greedy[D + 1];
+		int rank[D + 1];
+
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* ref = refRgba + size_t(y) * refStride;
+
+			for (int x = 0; x < width_; ++x, ref += 4)
+			{
+				const size_t pixel = size_t(y) * width_ + x;
+
+				// the feature vector...
+				position[0] = float(x) * spatialInv;
+				position[1] = float(y) * spatialInv;
+				if (D == 3)
+				{
+					position[2] = (ref[0] + ref[1]) * 0.5f * rangeInv;
+				}
+				else
+				{
+					for (int i = 2; i < D; ++i)
+						position[i] = ref[i - 2] * rangeInv;
+				}
+
+				// elevate onto the hyperplane (sum of coordinates is zero)...
+				float sm = 0;
+				for (int i = D; i > 0; --i)
+				{
+					float cf = position[i - 1] * scaleFactor_[i - 1];
+					elevated[i] = sm - i * cf;
+					sm += cf;
+				}
+				elevated[0] = sm;
+
+				// find the closest remainder-0 point...
+				const float downFactor = 1.0f / (D + 1);
+				int sum = 0;
+				for (int i = 0; i <= D; ++i)
+				{
+					float v = elevated[i] * downFactor;
+					int up = int(ceilf(v)) * (D + 1);
+					int down = int(floorf(v)) * (D + 1);
+					greedy[i] = (up - elevated[i] < elevated[i] - down) ? up : down;
+					sum += greedy[i];
+				}
+				sum /= D + 1;
+
+				// rank the differential and fix up the point so it is on the lattice...
+				for (int i = 0; i <= D; ++i)
+					rank[i] = 0;
+				for (int i = 0; i < D; ++i)
+				{
+					for (int j = i + 1; j <= D; ++j)
+					{
+						if (elevated[i] - greedy[i] < elevated[j] - greedy[j])
+							rank[i]++;
+						else
+							rank[j]++;
+					}
+				}
+
+				if (sum > 0)
+				{
+					for (int i = 0; i <= D; ++i)
+					{
+						if (rank[i] >= D + 1 - sum)
+						{
+							greedy[i] -= D + 1;
+							rank[i] += sum - (D + 1);
+						}
+						else
+						{
+							rank[i] += sum;
+						}
+					}
+				}
+				else if (sum < 0)
+				{
+					for (int i = 0; i <= D; ++i)
+					{
+						if (rank[i] < -sum)
+						{
+							greedy[i] += D + 1;
+							rank[i] += (D + 1) + sum;
+						}
+						else
+						{
+							rank[i] += sum;
+						}
+					}
+				}
+
+				// barycentric weights of the simplex vertices...
+				for (int i = 0; i < D + 2; ++i)
+					barycentric[i] = 0;
+				for (int i = 0; i <= D; ++i)
+				{
+					float delta = (elevated[i] - greedy[i]) * downFactor;
+					barycentric[D - rank[i]] += delta;
+					barycentric[D + 1 - rank[i]] -= delta;
+				}
+				barycentric[0] += 1.0f + barycentric[D + 1];
+
+				// the vertex keys: the remainder-0 point plus the canonical simplex offsets.
+				short* keys = &pixelKeys_[pixel * (D + 1) * D];
+				float* weights = &pixelWeights_[pixel * (D + 1)];
+				for (int remainder = 0; remainder <= D; ++remainder)
+				{
+					for (int i = 0; i < D; ++i)
+					{
+						int canonical = (rank[i] <= D - remainder) ? remainder : remainder - (D + 1);
+						keys[remainder * D + i] = short(greedy[i] + canonical);
+					}
+					weights[remainder] = barycentric[remainder];
+				}
+			}
+		}
+	}, 4);
+}
+
+template <int D>
+void CpuPermutohedralLattice<D>::splat_(const float* srcRgbd, int srcStride)
+{
+	// build the lattice from every pixel so the blur reaches the pixels we slice at.
+	vertexKeys_.clear();
+	std::fill(table_.begin(), table_.end(), -1);
+
+	const size_t numPixels = size_t(width_) * height_;
+	for (size_t i = 0; i < numPixels * (D + 1); ++i)
+		pixelVertices_[i] = insertVertex_(&pixelKeys_[i * D]);
+
+	vertexValues_[0].assign(size_t(numVertices()) * 4, 0.0f);
+	vertexValues_[1].assign(size_t(numVertices()) * 4, 0.0f);
+
+	// scatter the valid depth samples...
+	float* values = &vertexValues_[0][0];
+	for (int y = 0; y < height_; ++y)
+	{
+		const float* src = srcRgbd + size_t(y) * srcStride;
+
+		for (int x = 0; x < width_; ++x, src += 4)
+		{
+			if (src[3] <= 0.0f || src[3] >= 1.0f)
+				continue;
+
+			const size_t pixel = size_t(y) * width_ + x;
+			const int* vertices = &pixelVertices_[pixel * (D + 1)];
+			const float* weights = &pixelWeights_[pixel * (D + 1)];
+			Float4 value = Float4::set(src[0], src[1], src[3], 1.0f);
+
+			for (int k = 0; k <= D; ++k)
+			{
+				float* v = values + size_t(vertices[k]) * 4;
+				madd(value, Float4::splat(weights[k]), Float4::load(v)).store(v);
+			}
+		}
+	}
+}
+
+template <int D>
+void CpuPermutohedralLattice<D>::blur_()
+{
+	// a [1 2 1] blur along each of the D+1 lattice directions.
+	for (int j = 0; j <= D; ++j)
+	{
+		const float* src = &vertexValues_[0][0];
+		float* dst = &vertexValues_[1][0];
+
+		threadPool_->parallelFor(0, numVertices(), [&](int v0, int v1)
+		{
+			short neighbour1[D + 1];
+			short neighbour2[D + 1];
+			const Float4 half = Float4::splat(0.5f);
+			const Float4 quarter = Float4::splat(0.25f);
+
+			for (int v = v0; v < v1; ++v)
+			{
+				const short* key = &vertexKeys_[size_t(v) * D];
+				for (int k = 0; k < D; ++k)
+				{
+					neighbour1[k] = key[k] + 1;
+					neighbour2[k] = key[k] - 1;
+				}
+				neighbour1[j] = key[j] - D;
+				neighbour2[j] = key[j] + D;
+
+				int n1 = findVertex_(neighbour1);
+				int n2 = findVertex_(neighbour2);
+				Float4 sum = Float4::zero();
+				if (n1 >= 0)
+					sum = sum + Float4::load(src + size_t(n1) * 4);
+				if (n2 >= 0)
+					sum = sum + Float4::load(src + size_t(n2) * 4);
+				madd(sum, quarter, Float4::load(src + size_t(v) * 4) * half).store(dst + size_t(v) * 4);
+			}
+		}, 256);
+
+		vertexValues_[0].swap(vertexValues_[1]);
+	}
+}
+
+template <int D>
+void CpuPermutohedralLattice<D>::slice_(float* dstRgbd, int dstStride)
+{
+	const float* values = &vertexValues_[0][0];
+
+	threadPool_->parallelFor(0, height_, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			float* out = dstRgbd + size_t(y) * dstStride;
+
+			for (int x = 0; x < width_; ++x, out += 4)
+			{
+				const size_t pixel = size_t(y) * width_ + x;
+				const int* vertices = &pixelVertices_[pixel * (D + 1)];
+				const float* weights = &pixelWeights_[pixel * (D + 1)];
+
+				Float4 sum = Float4::zero();
+				for (int k = 0; k <= D; ++k)
+					sum = madd(Float4::load(values + size_t(vertices[k]) * 4), Float4::splat(weights[k]), sum);
+
+				float cell[4];
+				sum.store(cell);
+				if (cell[3] <= 0.0f)
+				{
+					// no samples reached this pixel.
+					Float4::zero().store(out);
+					continue;
+				}
+
+				// normalize and decode [red, green, depth, weight]
+				float norm = 1.0f / cell[3];
+				Float4::set(cell[0] * norm, cell[1] * norm, 0.0f, cell[2] * norm).store(out);
+			}
+		}
+	}, 4);
+}
+
+template <int D>
+void CpuPermutohedralLattice<D>::upsampleRgbd(const float* srcRgbd, int srcStride, const float* refRgba, int refStride, float* dstRgbd, int dstStride)
+{
+	if (srcStride <= 0)
+		srcStride = width_ * 4;
+	if (refStride <= 0)
+		refStride = width_ * 4;
+	if (dstStride <= 0)
+		dstStride = width_ * 4;
+
+	embed_(refRgba, refStride);
+	splat_(srcRgbd, srcStride);
+	blur_();
+	slice_(dstRgbd, dstStride);
+}
+
+template class CpuPermutohedralLattice<3>;
+template class CpuPermutohedralLattice<5>;
@@ -0,0 +1,65 @@
+
+#ifndef CPUPERMUTOHEDRALLATTICE_H
+#define CPUPERMUTOHEDRALLATTICE_H
+
+#include "CpuGridUtil.h"
+#include "CpuSimd.h"
+
+// Joint bilateral upsampling on a permutohedral lattice (Adams, Baek and Davis 2010).
+//
+// Each pixel is embedded in a D-dimensional feature space (x, y and D-2 colour channels) and
+// splatted onto the D+1 vertices of its enclosing simplex. Only vertices touched by a pixel are
+// stored, in a hash table, so memory and time are linear in D rather than exponential as in a
+// dense D-dimensional grid. D=5 uses full RGB guidance, D=3 uses the (r+g)/2 guidance of
+// the bilateral grid.
+//
+// The values are the grid cell encoding [red, green, depth, weight], so the output format is the
+// same as CpuBilateralGrid::slice. Depth samples are valid where 0 < depth < 1.
+template <int D>
+class CpuPermutohedralLattice
+{
+public:
+	CpuPermutohedralLattice(ThreadPool* threadPool = 0);
+
+	// spatialSigma is in pixels, rangeSigma in colour units ([0,1]).
+	void setup(int width, int height, float spatialSigma = 8.0f, float rangeSigma = 0.1f);
+
+	// srcRgbd (sparse depth in alpha) and refRgba (colour guide) are width x height float RGBA images.
+	// dstRgbd receives [red, green, 0, depth]. Strides are in floats (0 = packed).
+	void upsampleRgbd(const float* srcRgbd, int srcStride, const float* refRgba, int refStride, float* dstRgbd, int dstStride = 0);
+
+	int numVertices() const { return int(vertexKeys_.size() / D); }
+
+private:
+
+	void embed_(const float* refRgba, int refStride);
+	void splat_(const float* srcRgbd, int srcStride);
+	void blur_();
+	void slice_(float* dstRgbd, int dstStride);
+
+	int findVertex_(const short* key) const;
+	int insertVertex_(const short* key);
+	static odd::uint32 hashKey_(const short* key);
+
+public:
+
+	int width_, height_;
+	float spatialSigma_, rangeSigma_;
+	ThreadPool* threadPool_;
+
+private:
+
+	float scaleFactor_[D];
+	std::vector<short> pixelKeys_;		// D+1 vertex keys per pixel.
+	std::vector<float> pixelWeights_;	// D+1 barycentric weights per pixel.
+	std::vector<int> pixelVertices_;	// D+1 vertex indices per pixel.
+	std::vector<short> vertexKeys_;		// D coordinates per vertex (the last is implied).
+	std::vector<float> vertexValues_[2];	// [red, green, depth, weight] per vertex.
+	std::vector<int> table_;
+	odd::uint32 tableMask_;
+};
+
+typedef CpuPermutohedralLattice<5> CpuPermutohedralLatticeRgb;
+typedef CpuPermutohedralLattice<3> CpuPermutohedralLatticeLuma;
+
+#endif  // CPUPERMUTOHEDRALLATTICE_H
@@ -0,0 +1,720 @@
+
+#include "CpuQuantizedBilateralGrid.h"
+#include "CpuBilateralGrid.h"
+#include <math.h>
+#include <string.h>
+
+// cells per side of an occupancy block, which is also the grid rows per splat task.
+static const int kOccupancyBlock = 8;
+// the fixed point one of the blur taps.
+static const int kTapShift = 15;
+static const int kTapOne = 1 << kTapShift;
+
+static inline odd::uint16 quantize(float value, int unit)
+{
+	return odd::uint16(std::min(std::max(value, 0.0f), 1.0f) * float(unit) + 0.5f);
+}
+
+static inline void addSaturate(odd::uint16* lane, odd::uint16 value)
+{
+	*lane = odd::uint16(std::min(int(*lane) + int(value), 65535));
+}
+
+template <class RangePolicy>
+CpuQuantizedBilateralGridT<RangePolicy>::CpuQuantizedBilateralGridT(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	sliceLinear = true;
+	maxSplatDepth = 0;
+	trackBounds = true;
+	weightUnit_ = 0;
+	occupancyTilesX_ = occupancyTilesY_ = 0;
+	gridRasterWidth = gridRasterHeight = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		gridSigma[i] = 1;
+		gridInputSize[i] = gridPadding[i] = gridSize[i] = 0;
+	}
+	defaultBlurSigma(gridSigma, blurSigma);
+}
+
+template <class RangePolicy>
+CpuQuantizedBilateralGridT<RangePolicy>::~CpuQuantizedBilateralGridT()
+{
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding)
+{
+	setupGridParams(inputSize, sigma, padding, gridInputSize, gridSigma, gridPadding, gridSize);
+	defaultBlurSigma(gridSigma, blurSigma);
+	LayoutRangeTiles::rasterSize(gridSize, &gridRasterWidth, &gridRasterHeight);
+
+	// a cell receives at most ceil(sigma) input samples along x and along y, so that many full
+	// weight samples fill the weight lane (and the others, which are at most the weight).
+	const int samplesPerCell = int(ceilf(gridSigma[0])) * int(ceilf(gridSigma[1]));
+	weightUnit_ = std::max(65535 / samplesPerCell, 1);
+
+	const size_t numLanes = size_t(gridRasterWidth) * gridRasterHeight * 4;
+	gridBuffers_[0].assign(numLanes, 0);
+	gridBuffers_[1].assign(numLanes, 0);
+	gridBounds_[0].setEmpty();
+	gridBounds_[1].setEmpty();
+
+	occupancyTilesX_ = (gridSize[0] + kOccupancyBlock - 1) / kOccupancyBlock;
+	occupancyTilesY_ = (gridSize[1] + kOccupancyBlock - 1) / kOccupancyBlock;
+	occupancy_.assign(size_t(occupancyTilesX_) * gridSize[2] * occupancyTilesY_ * gridSize[3], 0);
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::clearRegion_(odd::uint16* buffer, const GridBounds& bounds)
+{
+	LayoutRangeTiles::forEachRasterRect(bounds, gridSize, [&](int x, int y, int width, int height)
+	{
+		for (int row = y; row < y + height; ++row)
+			memset(buffer + (size_t(row) * gridRasterWidth + x) * 4, 0, sizeof(odd::uint16) * 4 * width);
+	});
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::clear()
+{
+	clearRegion_(&gridBuffers_[0][0], gridBounds_[0]);
+	gridBounds_[0].setEmpty();
+	std::fill(occupancy_.begin(), occupancy_.end(), 0);
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride, float /*inputTime*/, float weight,
+	const float* confidence, int confidenceStride)
+{
+	if (srcStride <= 0)
+		srcStride = srcWidth * 4;
+	if (confidenceStride <= 0)
+		confidenceStride = srcWidth;
+
+	const int inputWidth = gridInputSize[0];
+	const int inputHeight = gridInputSize[1];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the splat mesh has one point per input texel, which samples the nearest source texel.
+	std::vector<int> srcX(inputWidth), cellX(inputWidth);
+	std::vector<int> srcY(inputHeight), cellY(inputHeight);
+	for (int x = 0; x < inputWidth; ++x)
+	{
+		srcX[x] = nearestTexel(x, inputWidth, srcWidth);
+		cellX[x] = gridInputToGridCell(float(x), sigmaInv[0], gridPadding[0]);
+	}
+	for (int y = 0; y < inputHeight; ++y)
+	{
+		srcY[y] = nearestTexel(y, inputHeight, srcHeight);
+		cellY[y] = gridInputToGridCell(float(y), sigmaInv[1], gridPadding[1]);
+	}
+
+	odd::uint16* grid = &gridBuffers_[0][0];
+	const int occupancyStride = occupancyTilesX_ * gridSize[2];
+	Mutex boundsMutex;
+
+	// each task owns a band of grid rows, and so every input row whose cells land in them.
+	// the bands never share a raster row or an occupancy block, so the scatter needs no atomics.
+	threadPool_->parallelFor(0, occupancyTilesY_, [&](int t0, int t1)
+	{
+		const int cy0 = t0 * kOccupancyBlock;
+		const int cy1 = std::min(t1 * kOccupancyBlock, gridSize[1]);
+		GridBounds bounds;
+
+		int yBegin = int(std::lower_bound(cellY.begin(), cellY.end(), cy0) - cellY.begin());
+		int yEnd = int(std::lower_bound(cellY.begin(), cellY.end(), cy1) - cellY.begin());
+
+		for (int y = yBegin; y < yEnd; ++y)
+		{
+			const float* srcRow = srcRgbd + size_t(srcY[y]) * srcStride;
+			const float* confidenceRow = confidence ? confidence + size_t(srcY[y]) * confidenceStride : 0;
+			const int gy = cellY[y];
+
+			for (int x = 0; x < inputWidth; ++x)
+			{
+				const float* rgbdSample = srcRow + srcX[x] * 4;
+
+				// don't splat invalid pixels.
+				if (rgbdSample[3] <= 0.0f || (maxSplatDepth > 0.0f && rgbdSample[3] >= maxSplatDepth))
+					continue;
+				const float sampleConfidence = confidenceRow ? confidenceRow[srcX[x]] : 1.0f;
+				if (sampleConfidence <= 0.0f)
+					continue;
+				// a sample too light for a unit of weight has no vote.
+				const int sampleWeight = quantize(weight * sampleConfidence, weightUnit_);
+				if (sampleWeight == 0)
+					continue;
+
+				float inputRange[2];
+				RangePolicy::inputRange(rgbdSample, gridSize, inputRange);
+
+				const int gx = cellX[x];
+				const int gz = gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]);
+				const int gw = gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]);
+				if (gx < 0 || gx >= gridSize[0] || gz < 0 || gz >= gridSize[2] || gw < 0 || gw >= gridSize[3])
+					continue;
+
+				// encode the grid sample as [red, green, depth, weight]
+				odd::uint16* cell = grid + cellOffset_(gx, gy, gz, gw);
+				addSaturate(cell + 0, quantize(rgbdSample[0], sampleWeight));
+				addSaturate(cell + 1, quantize(rgbdSample[1], sampleWeight));
+				addSaturate(cell + 2, quantize(rgbdSample[3], sampleWeight));
+				addSaturate(cell + 3, odd::uint16(sampleWeight));
+
+				bounds.include(gx, gy, gz, gw);
+				occupancy_[size_t(gy / kOccupancyBlock + gw * occupancyTilesY_) * occupancyStride +
+					gx / kOccupancyBlock + gz * occupancyTilesX_] = 1;
+			}
+		}
+
+		ScopedMutex lock(boundsMutex);
+		gridBounds_[0].unite(bounds);
+	}, 1);
+
+	if (!trackBounds)
+		gridBounds_[0].setFull(gridSize);
+
+	blurAndNormalize_(gridBounds_[0]);
+}
+
+// output cells per side of a spatial blur tile, and the halo the three 5-tap iterations read around it.
+// a tile and its ping-pong copy take 2 * 76 * 76 * 8 bytes (92KB), which stays in L2.
+static const int kBlurTileSize = 64;
+static const int kBlurTileHalo = kBlurRadius;
+// cells gathered per range blur block (8 bytes each), split as a run along x times every range slice.
+static const int kRangeBlockCells = 1024;
+
+// the Q15 taps [center, tap1, tap2] of the three 5-tap iterations along an axis, scaled to sum to
+// kTapOne (the rounding is taken up by the center), so the blur keeps the lanes in range.
+static void quantizedBlurTaps(const float* blurSigma, const float* gridSigma, int axis, odd::uint32* taps)
+{
+	float tap1, tap2;
+	gridBlurTaps(gridBlurCells(blurSigma, gridSigma, axis), &tap1, &tap2);
+	const float scale = float(kTapOne) / (1.0f + 2.0f * tap1 + 2.0f * tap2);
+	taps[1] = odd::uint32(tap1 * scale + 0.5f);
+	taps[2] = odd::uint32(tap2 * scale + 0.5f);
+	taps[0] = kTapOne - 2 * (taps[1] + taps[2]);
+}
+
+// one 5-tap iteration over numLanes lanes, neighbour k of lane i being lane i + k * step.
+// the sum fits 32 bits (65535 * kTapOne), and is rounded to nearest.
+static inline void blurLanes(const odd::uint16* in, odd::uint16* out, int numLanes, int step, const odd::uint32* taps)
+{
+	const UShort8 t0 = UShort8::splat(odd::uint16(taps[0]));
+	const UShort8 t1 = UShort8::splat(odd::uint16(taps[1]));
+	const UShort8 t2 = UShort8::splat(odd::uint16(taps[2]));
+	int i = 0;
+	for (; i + 8 <= numLanes; i += 8)
+	{
+		UInt8Sum sum = mulWide(UShort8::load(in + i), t0);
+		sum = maddWide(UShort8::load(in + i - step), t1, sum);
+		sum = maddWide(UShort8::load(in + i + step), t1, sum);
+		sum = maddWide(UShort8::load(in + i - 2 * step), t2, sum);
+		sum = maddWide(UShort8::load(in + i + 2 * step), t2, sum);
+		roundNarrow<kTapShift>(sum).store(out + i);
+	}
+
+	const odd::uint32 tap0 = taps[0], tap1 = taps[1], tap2 = taps[2];
+	for (; i < numLanes; ++i)
+	{
+		const odd::uint32 sum = tap0 * in[i] + tap1 * (odd::uint32(in[i - step]) + in[i + step]) +
+			tap2 * (odd::uint32(in[i - 2 * step]) + in[i + 2 * step]);
+		out[i] = odd::uint16((sum + (kTapOne >> 1)) >> kTapShift);
+	}
+}
+
+template <class RangePolicy>
+bool CpuQuantizedBilateralGridT<RangePolicy>::occupied_(int rasterX0, int rasterY0, int rasterX1, int rasterY1) const
+{
+	rasterX0 = std::max(rasterX0, 0);
+	rasterY0 = std::max(rasterY0, 0);
+	rasterX1 = std::min(rasterX1, gridRasterWidth);
+	rasterY1 = std::min(rasterY1, gridRasterHeight);
+	if (rasterX0 >= rasterX1 || rasterY0 >= rasterY1)
+		return false;
+
+	// split the raster rectangle at the range slice edges...
+	const int occupancyStride = occupancyTilesX_ * gridSize[2];
+	for (int w = rasterY0 / gridSize[1]; w <= (rasterY1 - 1) / gridSize[1]; ++w)
+	{
+		const int y0 = std::max(rasterY0 - w * gridSize[1], 0) / kOccupancyBlock;
+		const int y1 = (std::min(rasterY1 - w * gridSize[1], gridSize[1]) - 1) / kOccupancyBlock;
+
+		for (int z = rasterX0 / gridSize[0]; z <= (rasterX1 - 1) / gridSize[0]; ++z)
+		{
+			const int x0 = std::max(rasterX0 - z * gridSize[0], 0) / kOccupancyBlock;
+			const int x1 = (std::min(rasterX1 - z * gridSize[0], gridSize[0]) - 1) / kOccupancyBlock;
+
+			for (int ty = y0; ty <= y1; ++ty)
+			{
+				const odd::uint8* row = &occupancy_[size_t(ty + w * occupancyTilesY_) * occupancyStride + z * occupancyTilesX_];
+				for (int tx = x0; tx <= x1; ++tx)
+				{
+					if (row[tx])
+						return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::blurSpatial_(const odd::uint16* src, odd::uint16* dst, const GridBounds& bounds)
+{
+	// the tiles of CpuBilateralGrid::blurSpatial_, with twice the cells in the same bytes.
+	const int width = gridRasterWidth;
+	const int height = gridRasterHeight;
+	const int rasterStride = width * 4;
+	const int tilesX = (width + kBlurTileSize - 1) / kBlurTileSize;
+	const int tilesY = (height + kBlurTileSize - 1) / kBlurTileSize;
+	const int span = kBlurTileSize + 2 * kBlurTileHalo;
+	const int spanStride = span * 4;
+	odd::uint32 taps[2][3];
+	quantizedBlurTaps(blurSigma, gridSigma, 0, taps[0]);
+	quantizedBlurTaps(blurSigma, gridSigma, 1, taps[1]);
+
+	threadPool_->parallelFor(0, tilesX * tilesY, [&](int t0, int t1)
+	{
+		std::vector<odd::uint16> scratch0(size_t(span) * spanStride);
+		std::vector<odd::uint16> scratch1(size_t(span) * spanStride);
+
+		for (int t = t0; t < t1; ++t)
+		{
+			const int x0 = (t % tilesX) * kBlurTileSize;
+			const int y0 = (t / tilesX) * kBlurTileSize;
+			const int tileWidth = std::min(kBlurTileSize, width - x0);
+			const int tileHeight = std::min(kBlurTileSize, height - y0);
+
+			if (trackBounds)
+			{
+				// leave the tiles outside of the bounds (they stay zero), and zero the ones without splats in reach.
+				bool inBounds = false;
+				LayoutRangeTiles::forEachRasterRect(bounds, gridSize, [&](int x, int y, int w, int h)
+				{
+					inBounds = inBounds || (x < x0 + tileWidth && x + w > x0 && y < y0 + tileHeight && y + h > y0);
+				});
+				if (!inBounds)
+					continue;
+				if (!occupied_(x0 - kBlurTileHalo, y0 - kBlurTileHalo, x0 + tileWidth + kBlurTileHalo, y0 + tileHeight + kBlurTileHalo))
+				{
+					for (int ly = 0; ly < tileHeight; ++ly)
+						memset(dst + size_t(y0 + ly) * rasterStride + x0 * 4, 0, sizeof(odd::uint16) * 4 * tileWidth);
+					continue;
+				}
+			}
+
+			// the local origin is at the halo corner.
+			const int originX = x0 - kBlurTileHalo;
+			const int originY = y0 - kBlurTileHalo;
+			// the in-raster columns of the tile.
+			const int insideX0 = std::max(0, -originX);
+			const int insideX1 = std::min(tileWidth + 2 * kBlurTileHalo, width - originX);
+
+			// load the tile and its halo. texels outside of the raster read as zero.
+			int vx0 = 0, vx1 = tileWidth + 2 * kBlurTileHalo;
+			int vy0 = 0, vy1 = tileHeight + 2 * kBlurTileHalo;
+			odd::uint16* a = &scratch0[0];
+			odd::uint16* b = &scratch1[0];
+			for (int ly = vy0; ly < vy1; ++ly)
+			{
+				odd::uint16* row = a + ly * spanStride;
+				const int y = originY + ly;
+				memset(row, 0, sizeof(odd::uint16) * 4 * vx1);
+				if (y >= 0 && y < height)
+					memcpy(row + insideX0 * 4, src + size_t(y) * rasterStride + (originX + insideX0) * 4, sizeof(odd::uint16) * 4 * (insideX1 - insideX0));
+			}
+
+			// one 5-tap iteration over the valid region, shrunk by the kernel radius along the pass.
+			// cells outside of the raster stay zero at every stage, as in the passes of GlBilateralGrid.
+			auto pass = [&](const odd::uint16* in, odd::uint16* out, int step, const odd::uint32* tap)
+			{
+				for (int ly = vy0; ly < vy1; ++ly)
+				{
+					const int y = originY + ly;
+					const odd::uint16* inRow = in + ly * spanStride;
+					odd::uint16* outRow = out + ly * spanStride;
+					const int cx0 = (y >= 0 && y < height) ? std::max(vx0, insideX0) : vx1;
+					const int cx1 = std::max(cx0, std::min(vx1, insideX1));
+
+					memset(outRow + vx0 * 4, 0, sizeof(odd::uint16) * 4 * (cx0 - vx0));
+					blurLanes(inRow + cx0 * 4, outRow + cx0 * 4, (cx1 - cx0) * 4, step, tap);
+					memset(outRow + cx1 * 4, 0, sizeof(odd::uint16) * 4 * (vx1 - cx1));
+				}
+			};
+
+			// do passes for spatial gaussian blur
+			for (int p = 0; p < 3; ++p)
+			{
+				vx0 += 2;
+				vx1 -= 2;
+				pass(a, b, 4, taps[0]);
+				std::swap(a, b);
+
+				vy0 += 2;
+				vy1 -= 2;
+				pass(a, b, spanStride, taps[1]);
+				std::swap(a, b);
+			}
+
+			// the valid region is now the tile itself.
+			for (int ly = 0; ly < tileHeight; ++ly)
+			{
+				memcpy(dst + size_t(y0 + ly) * rasterStride + x0 * 4,
+					a + (kBlurTileHalo + ly) * spanStride + kBlurTileHalo * 4, sizeof(odd::uint16) * 4 * tileWidth);
+			}
+		}
+	});
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::blurRange_(const odd::uint16* src, odd::uint16* dst, bool normalize, const GridBounds& bounds)
+{
+	if (bounds.empty())
+		return;
+
+	// as CpuBilateralGrid::blurRange_: a block is a run of x cells in one grid row, gathered across
+	// every range slice with two slices of zeros before and after each range axis.
+	const int numZ = gridSize[2];
+	const int numW = gridSize[3];
+	const int boundsWidth = bounds.hi[0] - bounds.lo[0];
+	const int blockSize = std::min(boundsWidth, std::max(4, kRangeBlockCells / (numZ * numW)));
+	const int blocksX = (boundsWidth + blockSize - 1) / blockSize;
+	const int zStep = blockSize * 4;
+	const int wStep = (numZ + 4) * zStep;
+	odd::uint32 taps[2][3];
+	quantizedBlurTaps(blurSigma, gridSigma, 2, taps[0]);
+	quantizedBlurTaps(blurSigma, gridSigma, 3, taps[1]);
+
+	threadPool_->parallelFor(0, (bounds.hi[1] - bounds.lo[1]) * blocksX, [&](int t0, int t1)
+	{
+		std::vector<odd::uint16> scratch0(size_t(numW + 4) * wStep, 0);
+		std::vector<odd::uint16> scratch1(size_t(numW + 4) * wStep, 0);
+
+		for (int t = t0; t < t1; ++t)
+		{
+			const int gy = bounds.lo[1] + t / blocksX;
+			const int gx = bounds.lo[0] + (t % blocksX) * blockSize;
+			const int n = std::min(blockSize, bounds.hi[0] - gx);
+			odd::uint16* a = &scratch0[0];
+			odd::uint16* b = &scratch1[0];
+			// the first cell of (z, w) in a scratch block.
+			auto scratchCell = [&](odd::uint16* block, int z, int w) -> odd::uint16*
+			{
+				return block + (w + 2) * wStep + (z + 2) * zStep;
+			};
+
+			// a short last block leaves the lanes past n of the previous one, which nothing reads back.
+			for (int w = 0; w < numW; ++w)
+			{
+				for (int z = 0; z < numZ; ++z)
+					memcpy(scratchCell(a, z, w), src + cellOffset_(gx, gy, z, w), sizeof(odd::uint16) * 4 * n);
+			}
+
+			// one 5-tap iteration along z (one row of slices) or w (every row).
+			auto pass = [&](const odd::uint16* in, odd::uint16* out, bool alongW)
+			{
+				for (int w = 0; w < numW; ++w)
+				{
+					const int offset = int(scratchCell(a, 0, w) - a);
+					blurLanes(in + offset, out + offset, numZ * zStep, alongW ? wStep : zStep, taps[alongW]);
+				}
+			};
+
+			// an axis of one cell has no neighbours, so its passes would only round.
+			for (int p = 0; p < 3; ++p)
+			{
+				if (numZ > 1)
+				{
+					pass(a, b, false);
+					std::swap(a, b);
+				}
+				if (numW > 1)
+				{
+					pass(a, b, true);
+					std::swap(a, b);
+				}
+			}
+
+			// write back, normalizing on the way out unless the slice interpolates the homogeneous grid.
+			for (int w = 0; w < numW; ++w)
+			{
+				for (int z = 0; z < numZ; ++z)
+				{
+					const odd::uint16* in = scratchCell(a, z, w);
+					odd::uint16* out = dst + cellOffset_(gx, gy, z, w);
+
+					if (!normalize)
+					{
+						memcpy(out, in, sizeof(odd::uint16) * 4 * n);
+						continue;
+					}
+
+					const Float4 half = Float4::splat(0.5f);
+					for (int i = 0; i < n * 4; i += 4)
+					{
+						// empty cells keep no weight, so the slice can tell them apart.
+						const int weight = in[i + 3];
+						Float4 norm = (weight == 0) ? Float4::zero() : madd(Float4::load(in + i), Float4::splat(65535.0f / float(weight)), half);
+						norm.store(out + i);
+						out[i + 3] = (weight == 0) ? 0 : 65535;
+					}
+				}
+			}
+		}
+	});
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::blurAndNormalize_(const GridBounds& srcBounds)
+{
+	if (srcBounds.empty())
+		return;
+
+	odd::uint16* grid0 = &gridBuffers_[0][0];
+	odd::uint16* grid1 = &gridBuffers_[1][0];
+
+	// as CpuBilateralGrid: the blur only reaches the cells within kBlurRadius of the splats, so the
+	// passes only write those, and whatever an earlier splat left outside of them is cleared first.
+	const GridBounds bounds = LayoutRangeTiles::blurredBounds(srcBounds, gridSize);
+	if (!bounds.contains(gridBounds_[1]))
+		clearRegion_(grid1, gridBounds_[1]);
+
+	blurSpatial_(grid0, grid1, bounds);
+	gridBounds_[1] = bounds;
+	blurRange_(grid1, grid0, !sliceLinear, bounds);
+	gridBounds_[0] = bounds;
+
+	// the splats are now the result, which no longer matches the occupancy bitmap (until the next clear).
+	std::fill(occupancy_.begin(), occupancy_.end(), 1);
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	if (refStride <= 0)
+		refStride = refWidth * 4;
+	if (dstStride <= 0)
+		dstStride = dstWidth * 4;
+
+	if (sliceLinear)
+	{
+		sliceLinear_(refRgba, refWidth, refHeight, refStride, dstRgbd, dstWidth, dstHeight, dstStride);
+		return;
+	}
+
+	const odd::uint16* grid = &gridBuffers_[0][0];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+	const float laneScale = 1.0f / 65535.0f;
+
+	// the xy part of the lookup only depends on the column or row.
+	std::vector<int> refX(dstWidth), cellX(dstWidth);
+	std::vector<int> refY(dstHeight), cellY(dstHeight);
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		refX[x] = nearestRefTexel(x, dstWidth, refWidth);
+		float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+		cellX[x] = std::min(std::max(gridInputToGridCell(inputX, sigmaInv[0], gridPadding[0]), 0), gridSize[0] - 1);
+	}
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		refY[y] = nearestRefTexel(y, dstHeight, refHeight);
+		float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+		cellY[y] = std::min(std::max(gridInputToGridCell(inputY, sigmaInv[1], gridPadding[1]), 0), gridSize[1] - 1);
+	}
+
+	threadPool_->parallelFor(0, dstHeight, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* refRow = refRgba + size_t(refY[y]) * refStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+
+			for (int x = 0; x < dstWidth; ++x)
+			{
+				const float* referenceSample = refRow + refX[x] * 4;
+				float inputRange[2];
+				RangePolicy::inputRange(referenceSample, gridSize, inputRange);
+
+				int gz = std::min(std::max(gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]), 0), gridSize[2] - 1);
+				int gw = std::min(std::max(gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]), 0), gridSize[3] - 1);
+
+				const odd::uint16* gridSample = grid + cellOffset_(cellX[x], cellY[y], gz, gw);
+
+				if (gridSample[3] == 0)
+				{
+					// there is no data in the grid for this pixel.
+					Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out + x * 4);
+					continue;
+				}
+
+				// decode the grid sample from [red, green, depth, weight]
+				Float4::set(gridSample[0] * laneScale, gridSample[1] * laneScale, 0.0f, gridSample[2] * laneScale).store(out + x * 4);
+			}
+		}
+	}, 4);
+}
+
+template <class RangePolicy>
+void CpuQuantizedBilateralGridT<RangePolicy>::sliceLinear_(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	// interpolate the homogeneous grid, then normalize (as sampleGridLinear). The weight unit cancels.
+	const odd::uint16* grid = &gridBuffers_[0][0];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	// the xy cells and blend factors only depend on the column or row.
+	std::vector<int> refX(dstWidth), cellX0(dstWidth), cellX1(dstWidth);
+	std::vector<int> refY(dstHeight), cellY0(dstHeight), cellY1(dstHeight);
+	std::vector<float> fracX(dstWidth), fracY(dstHeight);
+	for (int x = 0; x < dstWidth; ++x)
+	{
+		refX[x] = nearestRefTexel(x, dstWidth, refWidth);
+		float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+		gridCoordToLinearCells(gridInputToGridCoord(inputX, sigmaInv[0], gridPadding[0]), gridSize[0], &cellX0[x], &cellX1[x], &fracX[x]);
+	}
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		refY[y] = nearestRefTexel(y, dstHeight, refHeight);
+		float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+		gridCoordToLinearCells(gridInputToGridCoord(inputY, sigmaInv[1], gridPadding[1]), gridSize[1], &cellY0[y], &cellY1[y], &fracY[y]);
+	}
+
+	threadPool_->parallelFor(0, dstHeight, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* refRow = refRgba + size_t(refY[y]) * refStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+			const Float4 fy = Float4::splat(fracY[y]);
+
+			for (int x = 0; x < dstWidth; ++x)
+			{
+				const float* referenceSample = refRow + refX[x] * 4;
+				float inputRange[2];
+				RangePolicy::inputRange(referenceSample, gridSize, inputRange);
+
+				int cz[2], cw[2];
+				float fz, fw;
+				gridCoordToLinearCells(gridInputToGridCoord(inputRange[0], sigmaInv[2], gridPadding[2]), gridSize[2], &cz[0], &cz[1], &fz);
+				gridCoordToLinearCells(gridInputToGridCoord(inputRange[1], sigmaInv[3], gridPadding[3]), gridSize[3], &cw[0], &cw[1], &fw);
+
+				const Float4 fx = Float4::splat(fracX[x]);
+				const float wz[2] = { 1.0f - fz, fz };
+				const float ww[2] = { 1.0f - fw, fw };
+
+				// one cell widens to one Float4, so every corner is a 4-wide lerp.
+				Float4 sum = Float4::zero();
+				for (int j = 0; j < 4; ++j)
+				{
+					const float w = wz[j & 1] * ww[j >> 1];
+					if (w == 0.0f)
+						continue;
+
+					const int gz = cz[j & 1];
+					const int gw = cw[j >> 1];
+					Float4 value0 = lerp(Float4::load(grid + cellOffset_(cellX0[x], cellY0[y], gz, gw)),
+						Float4::load(grid + cellOffset_(cellX1[x], cellY0[y], gz, gw)), fx);
+					Float4 value1 = lerp(Float4::load(grid + cellOffset_(cellX0[x], cellY1[y], gz, gw)),
+						Float4::load(grid + cellOffset_(cellX1[x], cellY1[y], gz, gw)), fx);
+					sum = madd(lerp(value0, value1, fy), Float4::splat(w), sum);
+				}
+
+				float cell[4];
+				sum.store(cell);
+				if (cell[3] <= 0.0f)
+				{
+					// there is no data in the grid for this pixel.
+					Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out + x * 4);
+					continue;
+				}
+
+				// normalize and decode the grid sample from [red, green, depth, weight]
+				const float norm = 1.0f / cell[3];
+				Float4::set(cell[0] * norm, cell[1] * norm, 0.0f, cell[2] * norm).store(out + x * 4);
+			}
+		}
+	}, 4);
+}
+
+template class CpuQuantizedBilateralGridT<RangeAverageRG>;
+template class CpuQuantizedBilateralGridT<RangeLuma>;
+template class CpuQuantizedBilateralGridT<RangeRedGreen>;
+template class CpuQuantizedBilateralGridT<RangeChroma>;
+
+//---------------------------------------------------
+// accuracy against the float grid.
+
+// the best time of numFrames upsamples of grid, after one to warm up.
+template <class Grid>
+static double timeGrid_(Grid& grid, const float* srcRgbd, const float* refRgba, int width, int height,
+	int numFrames, float* dstRgbd)
+{
+	double best = 0;
+	for (int frame = -1; frame < numFrames; ++frame)
+	{
+		double t0 = getTimeSeconds();
+		grid.clear();
+		grid.splatRgbd(srcRgbd, width, height);
+		grid.slice(refRgba, width, height, 0, dstRgbd, width, height);
+		double seconds = getTimeSeconds() - t0;
+
+		if (frame == 0 || (frame > 0 && seconds < best))
+			best = seconds;
+	}
+	return best;
+}
+
+GridQuantizationError measureGridQuantization(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, bool sliceLinear, int numFrames)
+{
+	const size_t numPixels = size_t(width) * height;
+	std::vector<float> floatResult(numPixels * 4), quantizedResult(numPixels * 4);
+	GridQuantizationError error;
+	numFrames = std::max(numFrames, 1);
+
+	{
+		CpuBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.setup(inputSize, sigma, padding);
+		error.floatSeconds = timeGrid_(grid, srcRgbd, refRgba, width, height, numFrames, &floatResult[0]);
+		error.floatBytes = grid.arena_->memoryBytes();
+	}
+	{
+		CpuQuantizedBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.setup(inputSize, sigma, padding);
+		error.quantizedSeconds = timeGrid_(grid, srcRgbd, refRgba, width, height, numFrames, &quantizedResult[0]);
+		error.quantizedBytes = grid.memoryBytes();
+	}
+
+	// an empty cell slices to depth 0.
+	size_t numFloat = 0, numQuantized = 0, numBoth = 0;
+	double depthSum = 0;
+	error.depthMax = 0;
+	for (size_t i = 3; i < numPixels * 4; i += 4)
+	{
+		const bool hasFloat = floatResult[i] > 0.0f;
+		const bool hasQuantized = quantizedResult[i] > 0.0f;
+		numFloat += hasFloat;
+		numQuantized += hasQuantized;
+		if (!hasFloat || !hasQuantized)
+			continue;
+
+		const float diff = fabsf(quantizedResult[i] - floatResult[i]);
+		error.depthMax = std::max(error.depthMax, diff);
+		depthSum += diff;
+		++numBoth;
+	}
+	error.depthMean = numBoth ? float(depthSum / numBoth) : 0.0f;
+	error.floatCoverage = numPixels ? double(numFloat) / numPixels : 0.0;
+	error.quantizedCoverage = numPixels ? double(numQuantized) / numPixels : 0.0;
+
+	LOGI("quantized grid: %.2f ms (float %.2f ms), %.1f KB (float %.1f KB), depth max diff %g, mean %g, coverage %.4f (float %.4f)",
+		error.quantizedSeconds * 1000.0, error.floatSeconds * 1000.0, error.quantizedBytes / 1024.0, error.floatBytes / 1024.0,
+		error.depthMax, error.depthMean, error.quantizedCoverage, error.floatCoverage);
+	return error;
+}
@@ -0,0 +1,118 @@
+
+#ifndef CPUQUANTIZEDBILATERALGRID_H
+#define CPUQUANTIZEDBILATERALGRID_H
+
+#include "CpuGridUtil.h"
+#include "CpuSimd.h"
+
+// A native bilateral grid with fixed point cells: each cell is one 64-bit word of four 16-bit lanes,
+// [red, green, depth, weight], where CpuBilateralGrid keeps four floats.
+//
+// A splat adds its weight (weight * confidence, clamped to [0,1]) in units of weightUnit(), chosen so
+// the most input samples a cell can receive still fit in a lane, and its colour and depth (in [0,1],
+// as the rgbd pyramid keeps it) times that weight. The sums saturate instead of wrapping. The blur is
+// the same three 5-tap iterations per axis on the same raster as CpuBilateralGrid, in the same tiles
+// and range blocks, with the taps scaled to a gain of one in Q15 so the lanes never grow: each pass
+// is a widening multiply-accumulate of eight lanes (UShort8) and a rounding narrow.
+//
+// Half the bytes of the float grid keep it in L2 at the usual grid sizes, so splat and blur wait on
+// the arithmetic rather than the memory, which on NEON is one vmlal per tap for eight lanes (sse2
+// needs four instructions for the same, so there it only about keeps up with the float grid).
+// The price is precision: the sliced depth is within about 1e-3 of the float grid on average, but
+// cells far from any splat keep only a few units of weight, so their depth is coarse (up to tenths
+// where a cell has 1e-4 of a sample), and the ones whose weight rounds to zero are empty
+// (see measureGridQuantization). There is no persistence (inputTime is ignored) and no recursive
+// blur, and the splats accumulate until clear().
+template <class RangePolicy>
+class CpuQuantizedBilateralGridT
+{
+public:
+	CpuQuantizedBilateralGridT(ThreadPool* threadPool = 0);
+	~CpuQuantizedBilateralGridT();
+
+	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0));
+
+	void clear();
+	// srcRgbd is an RGBA float image with depth in alpha. Strides are in floats (0 = packed).
+	// confidence is as in CpuBilateralGrid::splatRgbd.
+	void splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride = 0, float inputTime=0.0, float weight=1.0,
+		const float* confidence = 0, int confidenceStride = 0);
+	// refRgba is the color-reference image, dstRgbd receives [red, green, 0, depth].
+	// see sliceLinear for the interpolation.
+	void slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride = 0);
+
+	// the lanes of the blurred cell (x, y, z, w), normalized to 65535 unless sliceLinear.
+	const odd::uint16* cell(int x, int y, int z, int w) const { return &gridBuffers_[0][cellOffset_(x, y, z, w)]; }
+	// the weight lane of a full weight sample.
+	int weightUnit() const { return weightUnit_; }
+	size_t memoryBytes() const { return (gridBuffers_[0].size() + gridBuffers_[1].size()) * sizeof(odd::uint16); }
+
+private:
+
+	void blurAndNormalize_(const GridBounds& srcBounds);
+	void blurSpatial_(const odd::uint16* src, odd::uint16* dst, const GridBounds& bounds);
+	void blurRange_(const odd::uint16* src, odd::uint16* dst, bool normalize, const GridBounds& bounds);
+	void clearRegion_(odd::uint16* buffer, const GridBounds& bounds);
+	bool occupied_(int rasterX0, int rasterY0, int rasterX1, int rasterY1) const;
+	// the lane offset of a cell in a grid buffer.
+	size_t cellOffset_(int x, int y, int z, int w) const
+	{
+		int rasterX, rasterY;
+		LayoutRangeTiles::texel(x, y, z, w, gridSize, &rasterX, &rasterY);
+		return (size_t(rasterY) * gridRasterWidth + rasterX) * 4;
+	}
+	void sliceLinear_(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride);
+
+public:
+
+	float gridSigma[4];
+	int gridInputSize[4];
+	int gridPadding[4];
+	int gridSize[4];
+	int gridRasterWidth, gridRasterHeight;
+	// interpolate the grid when slicing (quadrilinear), otherwise take the nearest cell.
+	// this also selects whether the blur normalizes the grid, so set it before splatting.
+	bool sliceLinear;
+	// the sigma of the gaussian blur along the spatial and the range axes, as CpuBilateralGrid::blurSigma.
+	float blurSigma[2];
+	// if > 0, splatRgbd drops the samples with depth at or beyond it, as CpuBilateralGrid::maxSplatDepth.
+	float maxSplatDepth;
+	// restrict clear, blur and normalize to the cells the splats can reach. Otherwise every pass covers the whole grid.
+	bool trackBounds;
+
+	std::vector<odd::uint16> gridBuffers_[2];
+	GridBounds gridBounds_[2];		// the cells of each buffer that may be non-zero.
+	// one flag per block of kOccupancyBlock^2 cells of a range slice, set by the splat, as in CpuBilateralGrid.
+	std::vector<odd::uint8> occupancy_;
+	int occupancyTilesX_, occupancyTilesY_;
+	ThreadPool* threadPool_;
+
+private:
+
+	int weightUnit_;
+};
+
+typedef CpuQuantizedBilateralGridT<RangeAverageRG> CpuQuantizedBilateralGrid;
+
+struct GridQuantizationError
+{
+	float depthMax;		// the largest difference of the sliced depth to the float grid, where both have one.
+	float depthMean;
+	double floatCoverage;		// the fraction of the pixels with a depth from the float grid.
+	double quantizedCoverage;	// and from the quantized one.
+	double floatSeconds;		// clear, splat, blur, normalize and slice, per frame.
+	double quantizedSeconds;
+	size_t floatBytes;			// of the grid buffers.
+	size_t quantizedBytes;
+};
+
+// upsamples srcRgbd (depth in alpha) guided by refRgba, both width x height, with a CpuBilateralGrid and
+// a CpuQuantizedBilateralGrid set up with the given grid parameters, and compares their results.
+// Each time is the best of numFrames frames, after one to warm up. Run it on the grid shapes and the
+// data of the target, since the error grows with the blur reach and the sparsity of the depth.
+GridQuantizationError measureGridQuantization(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, bool sliceLinear = true, int numFrames = 5);
+
+#endif  // CPUQUANTIZEDBILATERALGRID_H
@@ -0,0 +1,381 @@
+
+#ifndef CPUSIMD_H
+#define CPUSIMD_H
+
+// A minimal 4-wide float vector used by the cpu grid kernels.
+// Every grid cell is an RGBA float quad, so one Float4 holds one cell.
+// Loads and stores are unaligned, so any float pointer is valid.
+// UShort8 holds two cells of 16-bit lanes (CpuQuantizedBilateralGrid), with UInt8Sum for their 32-bit products.
+// Mask4 is the result of a comparison, for branchless selects (CpuRgbdPyramid).
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#	include <arm_neon.h>
+#	define CPU_SIMD_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define CPU_SIMD_SSE 1
+#endif
+
+#include "oddcore/OddPlatform.h"
+#include "oddcore/OddTypes.h"
+#include <algorithm>
+
+struct Float4
+{
+#if CPU_SIMD_NEON
+	float32x4_t v;
+#elif CPU_SIMD_SSE
+	__m128 v;
+#else
+	float v[4];
+#endif
+
+	static ODD_FORCE_INLINE Float4 load(const float* p)
+	{
+		Float4 r;
+#if CPU_SIMD_NEON
+		r.v = vld1q_f32(p);
+#elif CPU_SIMD_SSE
+		r.v = _mm_loadu_ps(p);
+#else
+		r.v[0] = p[0]; r.v[1] = p[1]; r.v[2] = p[2]; r.v[3] = p[3];
+#endif
+		return r;
+	}
+
+	// four 16-bit lanes, as floats.
+	static ODD_FORCE_INLINE Float4 load(const odd::uint16* p)
+	{
+		Float4 r;
+#if CPU_SIMD_NEON
+		r.v = vcvtq_f32_u32(vmovl_u16(vld1_u16(p)));
+#elif CPU_SIMD_SSE
+		r.v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()));
+#else
+		r.v[0] = p[0]; r.v[1] = p[1]; r.v[2] = p[2]; r.v[3] = p[3];
+#endif
+		return r;
+	}
+
+	static ODD_FORCE_INLINE Float4 set(float x, float y, float z, float w)
+	{
+		Float4 r;
+#if CPU_SIMD_NEON
+		const float t[4] = { x, y, z, w };
+		r.v = vld1q_f32(t);
+#elif CPU_SIMD_SSE
+		r.v = _mm_setr_ps(x, y, z, w);
+#else
+		r.v[0] = x; r.v[1] = y; r.v[2] = z; r.v[3] = w;
+#endif
+		return r;
+	}
+
+	static ODD_FORCE_INLINE Float4 splat(float s)
+	{
+		Float4 r;
+#if CPU_SIMD_NEON
+		r.v = vdupq_n_f32(s);
+#elif CPU_SIMD_SSE
+		r.v = _mm_set1_ps(s);
+#else
+		r.v[0] = r.v[1] = r.v[2] = r.v[3] = s;
+#endif
+		return r;
+	}
+
+	static ODD_FORCE_INLINE Float4 zero() { return splat(0.f); }
+
+	ODD_FORCE_INLINE void store(float* p) const
+	{
+#if CPU_SIMD_NEON
+		vst1q_f32(p, v);
+#elif CPU_SIMD_SSE
+		_mm_storeu_ps(p, v);
+#else
+		p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3];
+#endif
+	}
+
+	// as four 16-bit lanes, clamped to [0, 65535] and truncated.
+	ODD_FORCE_INLINE void store(odd::uint16* p) const
+	{
+#if CPU_SIMD_NEON
+		const float32x4_t c = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(65535.0f));
+		vst1_u16(p, vmovn_u32(vcvtq_u32_f32(c)));
+#elif CPU_SIMD_SSE
+		// sse2 only packs signed, so the lanes go through [-32768, 32767] and back.
+		const __m128 c = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(65535.0f));
+		const __m128i i = _mm_sub_epi32(_mm_cvttps_epi32(c), _mm_set1_epi32(32768));
+		_mm_storel_epi64((__m128i*)p, _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16(short(0x8000))));
+#else
+		for (int i = 0; i < 4; ++i) p[i] = odd::uint16(std::min(std::max(v[i], 0.0f), 65535.0f));
+#endif
+	}
+
+	ODD_FORCE_INLINE float lane(int i) const
+	{
+		float t[4];
+		store(t);
+		return t[i];
+	}
+
+	// the last lane (the weight of a cell, the depth of an rgbd pixel) in every lane.
+	ODD_FORCE_INLINE Float4 splatW() const
+	{
+		Float4 r;
+#if CPU_SIMD_NEON
+		r.v = vdupq_lane_f32(vget_high_f32(v), 1);
+#elif CPU_SIMD_SSE
+		r.v = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+#else
+		r.v[0] = r.v[1] = r.v[2] = r.v[3] = v[3];
+#endif
+		return r;
+	}
+};
+
+ODD_FORCE_INLINE Float4 operator+(const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if CPU_SIMD_NEON
+	r.v = vaddq_f32(a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_add_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] + b.v[i];
+#endif
+	return r;
+}
+
+ODD_FORCE_INLINE Float4 operator-(const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if CPU_SIMD_NEON
+	r.v = vsubq_f32(a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_sub_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] - b.v[i];
+#endif
+	return r;
+}
+
+ODD_FORCE_INLINE Float4 operator*(const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if CPU_SIMD_NEON
+	r.v = vmulq_f32(a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_mul_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] * b.v[i];
+#endif
+	return r;
+}
+
+// a * b + c
+ODD_FORCE_INLINE Float4 madd(const Float4& a, const Float4& b, const Float4& c)
+{
+#if CPU_SIMD_NEON
+	Float4 r;
+	r.v = vmlaq_f32(c.v, a.v, b.v);
+	return r;
+#else
+	return a * b + c;
+#endif
+}
+
+// linear interpolation a + (b - a) * t
+ODD_FORCE_INLINE Float4 lerp(const Float4& a, const Float4& b, const Float4& t)
+{
+	return madd(b - a, t, a);
+}
+
+// all bits set in the lanes where a comparison holds.
+struct Mask4
+{
+#if CPU_SIMD_NEON
+	uint32x4_t v;
+#elif CPU_SIMD_SSE
+	__m128 v;
+#else
+	bool v[4];
+#endif
+};
+
+ODD_FORCE_INLINE Mask4 operator<(const Float4& a, const Float4& b)
+{
+	Mask4 r;
+#if CPU_SIMD_NEON
+	r.v = vcltq_f32(a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_cmplt_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] < b.v[i];
+#endif
+	return r;
+}
+
+ODD_FORCE_INLINE Mask4 operator<=(const Float4& a, const Float4& b)
+{
+	Mask4 r;
+#if CPU_SIMD_NEON
+	r.v = vcleq_f32(a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_cmple_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] <= b.v[i];
+#endif
+	return r;
+}
+
+ODD_FORCE_INLINE Mask4 operator&(const Mask4& a, const Mask4& b)
+{
+	Mask4 r;
+#if CPU_SIMD_NEON
+	r.v = vandq_u32(a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_and_ps(a.v, b.v);
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = a.v[i] && b.v[i];
+#endif
+	return r;
+}
+
+// the lanes of a where m is set, else of b.
+ODD_FORCE_INLINE Float4 select(const Mask4& m, const Float4& a, const Float4& b)
+{
+	Float4 r;
+#if CPU_SIMD_NEON
+	r.v = vbslq_f32(m.v, a.v, b.v);
+#elif CPU_SIMD_SSE
+	r.v = _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v));
+#else
+	for (int i = 0; i < 4; ++i) r.v[i] = m.v[i] ? a.v[i] : b.v[i];
+#endif
+	return r;
+}
+
+//---------------------------------------------------
+// 16-bit lanes.
+
+struct UShort8
+{
+#if CPU_SIMD_NEON
+	uint16x8_t v;
+#elif CPU_SIMD_SSE
+	__m128i v;
+#else
+	odd::uint16 v[8];
+#endif
+
+	static ODD_FORCE_INLINE UShort8 load(const odd::uint16* p)
+	{
+		UShort8 r;
+#if CPU_SIMD_NEON
+		r.v = vld1q_u16(p);
+#elif CPU_SIMD_SSE
+		r.v = _mm_loadu_si128((const __m128i*)p);
+#else
+		for (int i = 0; i < 8; ++i) r.v[i] = p[i];
+#endif
+		return r;
+	}
+
+	static ODD_FORCE_INLINE UShort8 splat(odd::uint16 s)
+	{
+		UShort8 r;
+#if CPU_SIMD_NEON
+		r.v = vdupq_n_u16(s);
+#elif CPU_SIMD_SSE
+		r.v = _mm_set1_epi16(short(s));
+#else
+		for (int i = 0; i < 8; ++i) r.v[i] = s;
+#endif
+		return r;
+	}
+
+	ODD_FORCE_INLINE void store(odd::uint16* p) const
+	{
+#if CPU_SIMD_NEON
+		vst1q_u16(p, v);
+#elif CPU_SIMD_SSE
+		_mm_storeu_si128((__m128i*)p, v);
+#else
+		for (int i = 0; i < 8; ++i) p[i] = v[i];
+#endif
+	}
+};
+
+// eight 32-bit sums of products of 16-bit lanes, the first four in lo.
+struct UInt8Sum
+{
+#if CPU_SIMD_NEON
+	uint32x4_t lo, hi;
+#elif CPU_SIMD_SSE
+	__m128i lo, hi;
+#else
+	odd::uint32 v[8];
+#endif
+};
+
+// a * b, widened to 32 bits.
+ODD_FORCE_INLINE UInt8Sum mulWide(const UShort8& a, const UShort8& b)
+{
+	UInt8Sum r;
+#if CPU_SIMD_NEON
+	r.lo = vmull_u16(vget_low_u16(a.v), vget_low_u16(b.v));
+	r.hi = vmull_u16(vget_high_u16(a.v), vget_high_u16(b.v));
+#elif CPU_SIMD_SSE
+	const __m128i lo16 = _mm_mullo_epi16(a.v, b.v);
+	const __m128i hi16 = _mm_mulhi_epu16(a.v, b.v);
+	r.lo = _mm_unpacklo_epi16(lo16, hi16);
+	r.hi = _mm_unpackhi_epi16(lo16, hi16);
+#else
+	for (int i = 0; i < 8; ++i) r.v[i] = odd::uint32(a.v[i]) * b.v[i];
+#endif
+	return r;
+}
+
+// a * b + c, widened to 32 bits.
+ODD_FORCE_INLINE UInt8Sum maddWide(const UShort8& a, const UShort8& b, const UInt8Sum& c)
+{
+#if CPU_SIMD_NEON
+	UInt8Sum r;
+	r.lo = vmlal_u16(c.lo, vget_low_u16(a.v), vget_low_u16(b.v));
+	r.hi = vmlal_u16(c.hi, vget_high_u16(a.v), vget_high_u16(b.v));
+	return r;
+#elif CPU_SIMD_SSE
+	UInt8Sum r = mulWide(a, b);
+	r.lo = _mm_add_epi32(r.lo, c.lo);
+	r.hi = _mm_add_epi32(r.hi, c.hi);
+	return r;
+#else
+	UInt8Sum r;
+	for (int i = 0; i < 8; ++i) r.v[i] = odd::uint32(a.v[i]) * b.v[i] + c.v[i];
+	return r;
+#endif
+}
+
+// the sums shifted right by Shift with rounding to nearest, which must fit 16 bits.
+template <int Shift>
+ODD_FORCE_INLINE UShort8 roundNarrow(const UInt8Sum& s)
+{
+	UShort8 r;
+#if CPU_SIMD_NEON
+	r.v = vcombine_u16(vrshrn_n_u32(s.lo, Shift), vrshrn_n_u32(s.hi, Shift));
+#elif CPU_SIMD_SSE
+	// sse2 only packs signed, so the lanes go through [-32768, 32767] and back.
+	const __m128i round = _mm_set1_epi32(1 << (Shift - 1));
+	const __m128i bias = _mm_set1_epi32(32768);
+	const __m128i lo = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(s.lo, round), Shift), bias);
+	const __m128i hi = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(s.hi, round), Shift), bias);
+	r.v = _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16(short(0x8000)));
+#else
+	for (int i = 0; i < 8; ++i) r.v[i] = odd::uint16((s.v[i] + (1u << (Shift - 1))) >> Shift);
+#endif
+	return r;
+}
+
+#endif  // CPUSIMD_H
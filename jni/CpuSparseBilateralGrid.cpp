@@ -0,0 +1,315 @@
+
+#include "CpuSparseBilateralGrid.h"
+#include <string.h>
+
+const CpuSparseGridTable::Key CpuSparseGridTable::kEmptyKey;
+
+CpuSparseGridTable::CpuSparseGridTable()
+{
+	mask_ = 0;
+	rehash_(1024);
+}
+
+int CpuSparseGridTable::find(Key key) const
+{
+	for (odd::uint32 slot = hash_(key) & mask_;; slot = (slot + 1) & mask_)
+	{
+		if (keys_[slot] == key)
+			return int(slot);
+		if (keys_[slot] == kEmptyKey)
+			return -1;
+	}
+}
+
+int CpuSparseGridTable::insert(Key key)
+{
+	// keep the load factor under 1/2 so probe chains stay short.
+	if ((live_.size() + 1) * 2 > keys_.size())
+		rehash_(int(keys_.size()) * 2);
+
+	odd::uint32 slot = hash_(key) & mask_;
+	for (; keys_[slot] != kEmptyKey; slot = (slot + 1) & mask_)
+	{
+		if (keys_[slot] == key)
+			return int(slot);
+	}
+
+	keys_[slot] = key;
+	live_.push_back(int(slot));
+	return int(slot);
+}
+
+void CpuSparseGridTable::reserve(int n)
+{
+	int capacity = int(keys_.size());
+	while (capacity < n * 2)
+		capacity *= 2;
+	if (capacity != int(keys_.size()))
+		rehash_(capacity);
+}
+
+void CpuSparseGridTable::clear()
+{
+	for (size_t i = 0; i < live_.size(); ++i)
+	{
+		int slot = live_[i];
+		keys_[slot] = kEmptyKey;
+		memset(&values_[size_t(slot) * 4], 0, sizeof(float) * 4);
+	}
+	live_.clear();
+}
+
+size_t CpuSparseGridTable::memoryBytes() const
+{
+	return keys_.capacity() * sizeof(Key) + values_.capacity() * sizeof(float) + live_.capacity() * sizeof(int);
+}
+
+void CpuSparseGridTable::rehash_(int capacity)
+{
+	capacity = int(odd::ODD_NEXT_POW2(odd::uint32(capacity)));
+
+	std::vector<Key> oldKeys;
+	std::vector<float> oldValues;
+	std::vector<int> oldLive;
+	oldKeys.swap(keys_);
+	oldValues.swap(values_);
+	oldLive.swap(live_);
+
+	keys_.assign(capacity, kEmptyKey);
+	values_.assign(size_t(capacity) * 4, 0.0f);
+	live_.reserve(capacity / 2);
+	mask_ = odd::uint32(capacity - 1);
+
+	for (size_t i = 0; i < oldLive.size(); ++i)
+	{
+		int oldSlot = oldLive[i];
+		int slot = insert(oldKeys[oldSlot]);
+		memcpy(&values_[size_t(slot) * 4], &oldValues[size_t(oldSlot) * 4], sizeof(float) * 4);
+	}
+}
+
+CpuSparseBilateralGrid::CpuSparseBilateralGrid(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	current_ = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		gridSigma[i] = 1;
+		gridInputSize[i] = gridPadding[i] = gridSize[i] = 0;
+	}
+	defaultBlurSigma(gridSigma, blurSigma);
+}
+
+CpuSparseBilateralGrid::~CpuSparseBilateralGrid()
+{
+}
+
+void CpuSparseBilateralGrid::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding)
+{
+	setupGridParams(inputSize, sigma, padding, gridInputSize, gridSigma, gridPadding, gridSize);
+	defaultBlurSigma(gridSigma, blurSigma);
+
+	// cell coordinates are packed into 16 bits per axis.
+	for (int i = 0; i < 4; ++i)
+	{
+		if (gridSize[i] > 0xffff)
+		{
+			LOGE("CpuSparseBilateralGrid: grid axis %d is too large (%d)", i, gridSize[i]);
+			gridSize[i] = 0xffff;
+		}
+	}
+
+	clear();
+}
+
+void CpuSparseBilateralGrid::clear()
+{
+	grids_[0].clear();
+	grids_[1].clear();
+	current_ = 0;
+}
+
+void CpuSparseBilateralGrid::splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride, float /*inputTime*/, float weight,
+	const float* confidence, int confidenceStride)
+{
+	if (srcStride <= 0)
+		srcStride = srcWidth * 4;
+	if (confidenceStride <= 0)
+		confidenceStride = srcWidth;
+
+	const int inputWidth = gridInputSize[0];
+	const int inputHeight = gridInputSize[1];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	CpuSparseGridTable& grid = grids_[current_];
+	const Float4 sampleWeight = Float4::splat(weight);
+
+	// the scatter is serial: it only visits valid samples, and inserts are cheap compared to the blur.
+	for (int y = 0; y < inputHeight; ++y)
+	{
+		const int sy = nearestTexel(y, inputHeight, srcHeight);
+		const float* srcRow = srcRgbd + size_t(sy) * srcStride;
+		const float* confidenceRow = confidence ? confidence + size_t(sy) * confidenceStride : 0;
+		const int gy = gridInputToGridCell(float(y), sigmaInv[1], gridPadding[1]);
+		if (gy < 0 || gy >= gridSize[1])
+			continue;
+
+		for (int x = 0; x < inputWidth; ++x)
+		{
+			const int sx = nearestTexel(x, inputWidth, srcWidth);
+			const float* rgbdSample = srcRow + sx * 4;
+
+			// don't splat invalid pixels.
+			if (rgbdSample[3] <= 0.0f)
+				continue;
+			const float sampleConfidence = confidenceRow ? confidenceRow[sx] : 1.0f;
+			if (sampleConfidence <= 0.0f)
+				continue;
+
+			float inputRange[2];
+			createInputRange(rgbdSample, gridSize, inputRange);
+
+			const int gx = gridInputToGridCell(float(x), sigmaInv[0], gridPadding[0]);
+			const int gz = gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]);
+			const int gw = gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]);
+			if (gx < 0 || gx >= gridSize[0] || gz < 0 || gz >= gridSize[2] || gw < 0 || gw >= gridSize[3])
+				continue;
+
+			// encode the grid sample as [red, green, depth, weight]
+			float* cell = grid.cell(grid.insert(CpuSparseGridTable::packKey(gx, gy, gz, gw)));
+			Float4 value = Float4::set(rgbdSample[0], rgbdSample[1], rgbdSample[3], 1.0f);
+			madd(value, sampleWeight * Float4::splat(sampleConfidence), Float4::load(cell)).store(cell);
+		}
+	}
+
+	blurAndNormalize_();
+}
+
+void CpuSparseBilateralGrid::blurPass_(const CpuSparseGridTable& src, CpuSparseGridTable& dst, int axis)
+{
+	float axisTap1, axisTap2;
+	gridBlurTaps(gridBlurCells(blurSigma, gridSigma, axis), &axisTap1, &axisTap2);
+	const Float4 tap1 = Float4::splat(axisTap1);
+	const Float4 tap2 = Float4::splat(axisTap2);
+	const CpuSparseGridTable::Key axisStep = CpuSparseGridTable::Key(1) << (16 * axis);
+
+	// the output support is the input support dilated by the kernel radius along the axis.
+	dst.clear();
+	dst.reserve(src.numCells());
+	for (int i = 0; i < src.numCells(); ++i)
+	{
+		CpuSparseGridTable::Key key = src.keyOfSlot(src.slotOfCell(i));
+		int coord[4];
+		CpuSparseGridTable::unpackKey(key, coord);
+
+		int begin = std::max(coord[axis] - 2, 0);
+		int end = std::min(coord[axis] + 2, gridSize[axis] - 1);
+		CpuSparseGridTable::Key k = key - CpuSparseGridTable::Key(coord[axis] - begin) * axisStep;
+		for (int c = begin; c <= end; ++c, k += axisStep)
+			dst.insert(k);
+	}
+
+	// gather: each output cell reads its (up to) five neighbours from the read-only input.
+	threadPool_->parallelFor(0, dst.numCells(), [&](int i0, int i1)
+	{
+		for (int i = i0; i < i1; ++i)
+		{
+			int slot = dst.slotOfCell(i);
+			CpuSparseGridTable::Key key = dst.keyOfSlot(slot);
+			int coord[4];
+			CpuSparseGridTable::unpackKey(key, coord);
+
+			Float4 taps[5];
+			for (int t = -2; t <= 2; ++t)
+			{
+				int c = coord[axis] + t;
+				int s = (c >= 0 && c < gridSize[axis]) ? src.find(key + CpuSparseGridTable::Key(c - coord[axis]) * axisStep) : -1;
+				taps[t + 2] = (s >= 0) ? Float4::load(src.cell(s)) : Float4::zero();
+			}
+			madd(tap2, taps[0] + taps[4], madd(tap1, taps[1] + taps[3], taps[2])).store(dst.cell(slot));
+		}
+	}, 256);
+}
+
+void CpuSparseBilateralGrid::normalize_(CpuSparseGridTable& grid)
+{
+	threadPool_->parallelFor(0, grid.numCells(), [&](int i0, int i1)
+	{
+		for (int i = i0; i < i1; ++i)
+		{
+			float* cell = grid.cell(grid.slotOfCell(i));
+			float a = cell[3];
+			Float4 norm = (a == 0.0f) ? Float4::zero() : Float4::load(cell) * Float4::splat(1.0f / a);
+			norm.store(cell);
+			// empty cells keep no weight, as in the dense grid.
+			cell[3] = (a == 0.0f) ? 0.0f : 1.0f;
+		}
+	}, 256);
+}
+
+void CpuSparseBilateralGrid::blurAndNormalize_()
+{
+	// do passes for spatial gaussian blur
+	for (int p = 0; p < 3; ++p)
+	{
+		blurPass_(grids_[current_], grids_[1 - current_], 0);
+		blurPass_(grids_[1 - current_], grids_[current_], 1);
+	}
+
+	// then across intensity, by blurSigma[1].
+	for (int p = 0; p < 3; ++p)
+	{
+		blurPass_(grids_[current_], grids_[1 - current_], 2);
+		blurPass_(grids_[1 - current_], grids_[current_], 3);
+	}
+
+	// normalize in place...
+	normalize_(grids_[current_]);
+}
+
+void CpuSparseBilateralGrid::slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+	float* dstRgbd, int dstWidth, int dstHeight, int dstStride)
+{
+	if (refStride <= 0)
+		refStride = refWidth * 4;
+	if (dstStride <= 0)
+		dstStride = dstWidth * 4;
+
+	const CpuSparseGridTable& grid = grids_[current_];
+	const float sigmaInv[4] = { 1.0f / gridSigma[0], 1.0f / gridSigma[1], 1.0f / gridSigma[2], 1.0f / gridSigma[3] };
+
+	threadPool_->parallelFor(0, dstHeight, [&](int y0, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const float* refRow = refRgba + size_t(nearestRefTexel(y, dstHeight, refHeight)) * refStride;
+			float* out = dstRgbd + size_t(y) * dstStride;
+			float inputY = float(y) / float(dstHeight) * float(gridInputSize[1]);
+			int gy = std::min(std::max(gridInputToGridCell(inputY, sigmaInv[1], gridPadding[1]), 0), gridSize[1] - 1);
+
+			for (int x = 0; x < dstWidth; ++x)
+			{
+				const float* referenceSample = refRow + nearestRefTexel(x, dstWidth, refWidth) * 4;
+				float inputRange[2];
+				createInputRange(referenceSample, gridSize, inputRange);
+
+				float inputX = float(x) / float(dstWidth) * float(gridInputSize[0]);
+				int gx = std::min(std::max(gridInputToGridCell(inputX, sigmaInv[0], gridPadding[0]), 0), gridSize[0] - 1);
+				int gz = std::min(std::max(gridInputToGridCell(inputRange[0], sigmaInv[2], gridPadding[2]), 0), gridSize[2] - 1);
+				int gw = std::min(std::max(gridInputToGridCell(inputRange[1], sigmaInv[3], gridPadding[3]), 0), gridSize[3] - 1);
+
+				int slot = grid.find(CpuSparseGridTable::packKey(gx, gy, gz, gw));
+				const float* gridSample = (slot < 0) ? 0 : grid.cell(slot);
+				if (!gridSample || gridSample[3] == 0.0f)
+				{
+					// there is no data in the grid for this pixel (as the dense grid).
+					Float4::set(1.0f, 0.0f, 0.0f, 0.0f).store(out + x * 4);
+					continue;
+				}
+
+				// decode the grid sample from [red, green, depth, weight]
+				Float4::set(gridSample[0], gridSample[1], 0.0f, gridSample[2]).store(out + x * 4);
+			}
+		}
+	}, 4);
+}
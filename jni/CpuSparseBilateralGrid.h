@@ -0,0 +1,110 @@
+
+#ifndef CPUSPARSEBILATERALGRID_H
+#define CPUSPARSEBILATERALGRID_H
+
+#include "CpuGridUtil.h"
+#include "CpuSimd.h"
+
+// An open-addressing hash of grid cells keyed by their packed 4D coordinate.
+// Only occupied cells are stored, and clear() only touches those.
+class CpuSparseGridTable
+{
+public:
+	typedef odd::uint64 Key;
+	static const Key kEmptyKey = ~Key(0);
+
+	CpuSparseGridTable();
+
+	static Key packKey(int x, int y, int z, int w)
+	{
+		return Key(x) | (Key(y) << 16) | (Key(z) << 32) | (Key(w) << 48);
+	}
+	static void unpackKey(Key key, int* coord)
+	{
+		coord[0] = int(key & 0xffff);
+		coord[1] = int((key >> 16) & 0xffff);
+		coord[2] = int((key >> 32) & 0xffff);
+		coord[3] = int((key >> 48) & 0xffff);
+	}
+
+	// the slot of key, or -1 if it isn't occupied.
+	int find(Key key) const;
+	// the slot of key, inserting a zero cell if needed. May rehash, which moves slots.
+	int insert(Key key);
+	// ensure n cells fit without a rehash.
+	void reserve(int n);
+	// empty all occupied cells.
+	void clear();
+
+	int numCells() const { return int(live_.size()); }
+	int slotOfCell(int i) const { return live_[i]; }
+	Key keyOfSlot(int slot) const { return keys_[slot]; }
+	float* cell(int slot) { return &values_[size_t(slot) * 4]; }
+	const float* cell(int slot) const { return &values_[size_t(slot) * 4]; }
+
+	size_t memoryBytes() const;
+
+private:
+
+	static odd::uint32 hash_(Key key)
+	{
+		return odd::uint32((key * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+	void rehash_(int capacity);
+
+	std::vector<Key> keys_;
+	std::vector<float> values_;	// [red, green, depth, weight] per slot.
+	std::vector<int> live_;		// occupied slots in insertion order.
+	odd::uint32 mask_;
+};
+
+// A bilateral grid that stores only the cells touched by the splat and the blur footprint around them.
+// It runs the same passes as CpuBilateralGrid, so clear, blur and normalize cost scales with the number
+// of valid depth samples rather than the grid volume.
+// A cell costs about 48 bytes (key, value and the empty half of the table) against 16 dense, so
+// this mode pays off once under about a third of the grid is live, e.g. at high range resolution.
+//
+// The blur is done on the 4D grid, so unlike the raster tiling of GlBilateralGrid nothing leaks between
+// neighbouring range slices at the tile edges; elsewhere it matches CpuBilateralGrid to float rounding.
+// There is no persistence (inputTime is ignored), and the splats accumulate until clear().
+class CpuSparseBilateralGrid
+{
+public:
+	CpuSparseBilateralGrid(ThreadPool* threadPool = 0);
+	~CpuSparseBilateralGrid();
+
+	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0));
+
+	void clear();
+	// srcRgbd is an RGBA float image with depth in alpha. Strides are in floats (0 = packed).
+	// confidence is as in CpuBilateralGrid::splatRgbd.
+	void splatRgbd(const float* srcRgbd, int srcWidth, int srcHeight, int srcStride = 0, float inputTime=0.0, float weight=1.0,
+		const float* confidence = 0, int confidenceStride = 0);
+	// refRgba is the color-reference image, dstRgbd receives [red, green, 0, depth].
+	void slice(const float* refRgba, int refWidth, int refHeight, int refStride,
+		float* dstRgbd, int dstWidth, int dstHeight, int dstStride = 0);
+
+	int numCells() const { return grids_[current_].numCells(); }
+	size_t memoryBytes() const { return grids_[0].memoryBytes() + grids_[1].memoryBytes(); }
+
+private:
+
+	void blurAndNormalize_();
+	void blurPass_(const CpuSparseGridTable& src, CpuSparseGridTable& dst, int axis);
+	void normalize_(CpuSparseGridTable& grid);
+
+public:
+
+	float gridSigma[4];
+	int gridInputSize[4];
+	int gridPadding[4];
+	int gridSize[4];
+	// the sigma of the gaussian blur along the spatial and the range axes, as CpuBilateralGrid::blurSigma.
+	float blurSigma[2];
+
+	CpuSparseGridTable grids_[2];
+	int current_;
+	ThreadPool* threadPool_;
+};
+
+#endif  // CPUSPARSEBILATERALGRID_H
@@ -1,39 +1,24 @@
 
 #include "GlBilateralGrid.h"
+#include "CpuBilateralGrid.h"
 
-const char* vs_bilateralSplatRgbd =
-"#version 300 es \n"
-"precision highp float;\n"
-"precision highp int;\n"
-STRINGIFY(
-in vec4 vPosition;
-out vec4 fInputValue;
-
-uniform sampler2D texture0; // src RGBD image
-uniform vec2 inputSize;
-uniform vec4 gridSize;
-uniform vec4 gridPadding;
-uniform vec4 sigma;
-uniform float inputTime;
+// cells per side of an occupancy texel. the read-back of a 640x480 grid with 16 range slices is 77KB.
+static const int kOccupancyTile = 16;
 
-vec4 sigmaInv = vec4(1.0) / sigma;
-
-//---------------------------------------------------
-// splat and slice must match the functions that determine bilateral input range.
-// (0, 0) to (inputSize.z-1, inputSize.w-1) inclusive
-vec2 createInputRange(in vec3 rgbSample, float t)
-{
-	vec2 inputRange = vec2((rgbSample.r+rgbSample.g)/2.0, 0.0);
-	//vec2 inputRange = vec2((0.2126*rgbSample.r + 0.7152*rgbSample.g + 0.0722*rgbSample.b), 0.0);
-	//return inputRange * (inputSize.zw - vec2(1.0));
-	return inputRange * (gridSize.zw - vec2(1.0));
-}
-//---------------------------------------------------
+// the fixed point of the compute splat: 16 fractional bits, so a cell holds 65536 samples of weight 1
+// before it wraps, and each sample is rounded to 1.5e-5 (finer than a half float grid keeps anyway).
+static const float kSplatFixedScale = 65536.0f;
+// the workgroup side of the compute passes (their local_size), in input pixels or raster texels.
+static const int kComputeGroupSize = 8;
 
+// the grid functions shared by the splat and slice shaders. they go after the policy functions
+// (createInputRange, gridCellToTexel and gridRasterSize), so they hold for every layout.
+const char* glsl_gridFunctions =
+STRINGIFY(
 vec4 encodeGridSample(vec4 gridSample)
 {
-	// encode the grid sample as [red, green, depth, weight]	
-	// weight has to be alpha as we are using glBlend.	
+	// encode the grid sample as [red, green, depth, weight]
+	// weight has to be alpha as we are using glBlend.
 	return vec4(gridSample.r, gridSample.g, gridSample.a, 1.0);
 }
 
@@ -42,36 +27,109 @@ vec4 decodeGridSample(vec4 gridSample)
 	return vec4(gridSample.r, gridSample.g, 0.0, gridSample.b);
 }
 
-// downsample high-res input-coord into low-res grid coords.
+// downsample high-res input-coord into low-res grid coords (cell i spans [i, i+1)).
 vec4 gridInputToGridCoord(in vec4 inputCoord, in vec4 sigmaInv, in vec4 gridPadding)
 {
-	return floor((inputCoord + vec4(0.5)) * sigmaInv) + gridPadding;
+	return ((inputCoord + vec4(0.5)) * sigmaInv) + gridPadding;
 }
 
-// project grid coordinate into 2D space.
+// project a grid cell into 2D space (the uv of the texel center).
 vec2 gridCoordToRaster(in vec4 gridCoord, in vec4 gridSize)
 {
-	vec2 invGridRasterSize = vec2(1.0) / vec2(gridSize.x*gridSize.z, gridSize.y*gridSize.w);
-	return (gridCoord.xy + vec2(0.5) + vec2(gridCoord.z * gridSize.x, 0.0) + vec2(0.0, gridCoord.w * gridSize.y)) * invGridRasterSize;
+	ivec4 size = ivec4(gridSize);
+	return (vec2(gridCellToTexel(ivec4(gridCoord), size)) + vec2(0.5)) / vec2(gridRasterSize(size));
+}
+
+// fetch a cell of the grid.
+vec4 fetchGrid(in sampler2D gridTexture, in ivec4 cell, in vec4 gridSize)
+{
+	return texelFetch(gridTexture, gridCellToTexel(cell, ivec4(gridSize)), 0);
 }
 
+// the cell the coord lies in, clamped on each grid axis.
+vec4 sampleGrid(in sampler2D gridTexture, in vec4 gridCoord, in vec4 gridSize)
+{
+	ivec4 cell = clamp(ivec4(floor(gridCoord)), ivec4(0), ivec4(gridSize) - ivec4(1));
+	return fetchGrid(gridTexture, cell, gridSize);
+}
+
+// quadrilinear interpolation of the homogeneous grid, normalized afterwards.
+// cell centers are at (i + 0.5), and empty cells carry zero weight so they don't pull the result to zero.
+vec4 sampleGridLinear(in sampler2D gridTexture, in vec4 gridCoord, in vec4 gridSize)
+{
+	vec4 p = clamp(gridCoord - vec4(0.5), vec4(0.0), gridSize - vec4(1.0));
+	vec4 icoord = floor(p);		// the integer component
+	vec4 fcoord = p - icoord;	// the fractional component
+
+	ivec4 c0 = ivec4(icoord);
+	ivec4 c1 = min(c0 + ivec4(1), ivec4(gridSize) - ivec4(1));
+
+	vec4 result = vec4(0.0);
+	for (int i = 0; i < 4; ++i)
+	{
+		// the four range corners...
+		ivec2 zw = ivec2((i & 1) == 0 ? c0.z : c1.z, (i & 2) == 0 ? c0.w : c1.w);
+		float wz = (i & 1) == 0 ? 1.0 - fcoord.z : fcoord.z;
+		float ww = (i & 2) == 0 ? 1.0 - fcoord.w : fcoord.w;
+		if (wz * ww == 0.0)
+			continue;
+
+		// ...each with a bilinear lookup in xy.
+		vec4 value00 = fetchGrid(gridTexture, ivec4(c0.x, c0.y, zw), gridSize);
+		vec4 value10 = fetchGrid(gridTexture, ivec4(c1.x, c0.y, zw), gridSize);
+		vec4 value01 = fetchGrid(gridTexture, ivec4(c0.x, c1.y, zw), gridSize);
+		vec4 value11 = fetchGrid(gridTexture, ivec4(c1.x, c1.y, zw), gridSize);
+		result += (wz * ww) * mix(mix(value00, value10, fcoord.x), mix(value01, value11, fcoord.x), fcoord.y);
+	}
+
+	if (result.a <= 0.0)
+		return vec4(0.0);
+	return vec4(result.rgb / result.a, 1.0);
+}
+);
+
+const char* vs_bilateralSplatRgbd =
+"#version 300 es \n"
+"precision highp float;\n"
+"precision highp sampler2D;\n"
+"precision highp int;\n"
+STRINGIFY(
+out vec4 fInputValue;
+out float fInputWeight;
+
+uniform sampler2D texture0; // src RGBD image
+uniform sampler2D texture1; // per-pixel confidence in alpha (if hasConfidence)
+uniform bool hasConfidence;
+uniform float inputWeight;
+uniform vec2 inputSize;
+uniform vec4 gridSize;
+uniform vec4 gridPadding;
+uniform vec4 sigma;
+uniform float inputTime;
+
+vec4 sigmaInv = vec4(1.0) / sigma;
+
+// createInputRange and the grid functions are prepended from the policies (see gridShader_).
+
 void main()
 {
 	// NB:
-	// vPosition is at pixel centers of a unit point mesh, i.e. (0.5/inputSize.x, 0.5/inputSize.y) to (1-0.5/inputSize.x, 1-0.5/inputSize.y)
+	// a point per input pixel, in rows of inputSize.x: the point mesh is shared by the grids of an
+	// arena and may be larger than the input, so its vertices only count the points.
 	
 	// get unit uvCoord of input (i.e. not the pixel centers)
 	vec2 inputHalfPixel = vec2(0.5)/inputSize.xy;
-	vec2 inputUvPos = vec2(vPosition.x, vPosition.y) - inputHalfPixel.xy;
+	int inputWidth = int(inputSize.x);
+	vec2 inputUvPos = vec2(float(gl_VertexID % inputWidth), float(gl_VertexID / inputWidth)) / inputSize.xy;
 	
 	// get input position and value from the sample...
 	vec4 rgbdSample = texture2D(texture0, inputUvPos + inputHalfPixel.xy);
-	vec2 inputRange = createInputRange(rgbdSample.rgb, 0.0); // (0, 0) to (gridSize.z-1, gridSize.w-1)
+	vec2 inputRange = applyRangeCurve(createInputRange(rgbdSample.rgb, gridSize), gridSize); // (0, 0) to (gridSize.z-1, gridSize.w-1)
 
 	// find position in grid and get raster coords...
 	vec2 xyCoord = inputUvPos.xy * inputSize.xy; // (0, 0) to (inputSize.x-1, inputSize.y-1)
 	vec4 inputCoord = vec4(xyCoord.xy, inputRange); // (0) to (inputSize-1) inclusive
-	vec4 gridCoord = gridInputToGridCoord(inputCoord, sigmaInv, gridPadding); // (0) to (gridSize-1) inclusive
+	vec4 gridCoord = floor(gridInputToGridCoord(inputCoord, sigmaInv, gridPadding)); // (0) to (gridSize-1) inclusive
 	vec2 gridRasterCoord = gridCoordToRaster(gridCoord, gridSize); // (0) to (0.999...)
 
 	// debug:
@@ -79,43 +137,77 @@ void main()
 	//vec4 debugValue = vec4(inputRange.xy, 0.0,1.0);
 	//fInputValue = debugValue;	
 	fInputValue = rgbdSample;
+	fInputWeight = inputWeight;
+	if (hasConfidence)
+		fInputWeight *= texture2D(texture1, inputUvPos + inputHalfPixel.xy).a;
 	
 	// project grid into uv-space...
 	gl_Position = vec4(gridRasterCoord.xy * vec2(2.0) - vec2(1.0), 0.0, 1.0);
 	gl_PointSize = 1.0;
 	/*
 	// debug:
-	gl_Position = vec4((vPosition.xy*2.0-vec2(1.0)), 0.5, 1.0);
+	gl_Position = vec4((inputUvPos.xy*2.0-vec2(1.0)), 0.5, 1.0);
 	gl_PointSize = 2.0;
 	fInputValue = vec4(inputUvPos.xy,0.0,1.0);
 	*/
 }
 );
 
-const char* fs_bilateralSplat =
+// the occupancy pass of the splat: a point per input pixel, into the texel of the block of cells it lands in.
+const char* vs_bilateralOccupancyRgbd =
 "#version 300 es \n"
 "precision highp float;\n"
+"precision highp sampler2D;\n"
 "precision highp int;\n"
 STRINGIFY(
-in vec4 fInputValue;
-uniform float inputWeight;
+uniform sampler2D texture0; // src RGBD image
+uniform vec2 inputSize;
+uniform vec4 gridSize;
+uniform vec4 gridPadding;
+uniform vec4 sigma;
+uniform vec2 occupancySize;	// tiles per range slice * range slices
+uniform float occupancyTile;	// cells per side of a tile
 
-vec4 encodeGridSample(vec4 gridSample)
-{
-	// encode the grid sample as [red, green, depth, weight]	
-	// weight has to be alpha as we are using glBlend.	
-	return vec4(gridSample.r, gridSample.g, gridSample.a, 1.0);
-}
+vec4 sigmaInv = vec4(1.0) / sigma;
 
-vec4 decodeGridSample(vec4 gridSample)
+// createInputRange and the grid functions are prepended from the policies (see gridShader_).
+
+void main()
 {
-	return vec4(gridSample.r, gridSample.g, 0.0, gridSample.b);
+	// a point per input pixel, as in the splat.
+	vec2 inputHalfPixel = vec2(0.5)/inputSize.xy;
+	int inputWidth = int(inputSize.x);
+	vec2 inputUvPos = vec2(float(gl_VertexID % inputWidth), float(gl_VertexID / inputWidth)) / inputSize.xy;
+
+	vec4 rgbdSample = texture2D(texture0, inputUvPos + inputHalfPixel.xy);
+	vec2 inputRange = applyRangeCurve(createInputRange(rgbdSample.rgb, gridSize), gridSize);
+	vec4 gridCoord = floor(gridInputToGridCoord(vec4(inputUvPos.xy * inputSize.xy, inputRange), sigmaInv, gridPadding));
+
+	vec2 tilesPerSlice = ceil(gridSize.xy / vec2(occupancyTile));
+	vec2 tile = floor(gridCoord.xy / vec2(occupancyTile)) + gridCoord.zw * tilesPerSlice;
+	gl_Position = vec4((tile + vec2(0.5)) / occupancySize * vec2(2.0) - vec2(1.0), 0.0, 1.0);
+
+	// the splat drops invalid pixels, so put them outside of the viewport.
+	if (rgbdSample.a <= 0.0)
+		gl_Position = vec4(-2.0, -2.0, 0.0, 1.0);
+	gl_PointSize = 1.0;
 }
+);
+
+const char* fs_bilateralSplat =
+"#version 300 es \n"
+"precision highp float;\n"
+"precision highp int;\n"
+STRINGIFY(
+in vec4 fInputValue;
+in float fInputWeight;
+
+uniform float maxDepth;	// if > 0, depth at or beyond it is invalid too.
 
 //---------------------------------------------------
 void main()
 {	
-	if (fInputValue.a <= 0.0)// || fInputValue.a >= 1.0) // don't splat invalid pixels.
+	if (fInputValue.a <= 0.0 || fInputWeight <= 0.0 || (maxDepth > 0.0 && fInputValue.a >= maxDepth)) // don't splat invalid pixels.
 	{
 		// debug:
 		//gl_FragColor = vec4(1.0,0.0,0.0,0.0);
@@ -126,120 +218,152 @@ void main()
 		return;
 	}
 	
-	gl_FragColor = encodeGridSample(fInputValue);
+	// the blend (GL_SRC_ALPHA, GL_ONE) scales the sample by its weight and adds the weight to alpha,
+	// so a low-confidence sample has a smaller vote in its cell.
+	gl_FragColor = vec4(encodeGridSample(fInputValue).rgb, fInputWeight);
 	return;
 }
 );
 
-
-const char* fs_bilateralSlice =
-"#version 300 es \n"
-"#extension GL_EXT_gpu_shader4 : enable \n"
+// the compute splat: an invocation per input pixel, which adds its weighted sample to the fixed point
+// cell with atomics. gridCells is indexed as the raster, so the resolve writes it out texel for texel.
+const char* cs_bilateralSplatRgbd =
+"#version 310 es \n"
 "precision highp float;\n"
+"precision highp sampler2D;\n"
 "precision highp int;\n"
 STRINGIFY(
+layout(local_size_x = 8, local_size_y = 8) in;
 
-uniform ivec2 resolution;
-uniform sampler2D texture0; // color-reference image
-uniform sampler2D texture1; // bilateral-grid 
-
+layout(std430, binding = 0) buffer GridCells { uint gridCells[]; };
+layout(std430, binding = 1) buffer SplatBounds { int boundsLo[4]; int boundsHi[4]; };
 
+uniform sampler2D texture0; // src RGBD image
+uniform sampler2D texture1; // per-pixel confidence in alpha (if hasConfidence)
+uniform bool hasConfidence;
+uniform bool trackBounds;
+uniform float inputWeight;
+uniform float maxDepth;
+uniform float fixedScale;
 uniform vec2 inputSize;
 uniform vec4 gridSize;
 uniform vec4 gridPadding;
 uniform vec4 sigma;
 
-vec4 sigmaInv = vec4(1.0) / sigma;
+// the bounds of the workgroup, so only one invocation per group touches the global ones.
+shared int groupLo[4];
+shared int groupHi[4];
 
-//---------------------------------------------------
-// splat and slice must match the functions that determine bilateral input range.
-// (0, 0) to (inputSize.z-1, inputSize.w-1) inclusive
-vec2 createInputRange(in vec3 rgbSample, float t)
-{
-	vec2 inputRange = vec2((rgbSample.r+rgbSample.g)/2.0, rgbSample.g);
-	//vec2 inputRange = vec2((0.2126*rgbSample.r + 0.7152*rgbSample.g + 0.0722*rgbSample.b), 0.0);
-	//return inputRange * (inputSize.zw - vec2(1.0));
-	return inputRange * (gridSize.zw - vec2(1.0));
-}
-//---------------------------------------------------
+// createInputRange and the grid functions are prepended from the policies (see gridShader_).
 
-vec4 encodeGridSample(vec4 gridSample)
+void main()
 {
-	// encode the grid sample as [red, green, depth, weight]	
-	// weight has to be alpha as we are using glBlend.	
-	return vec4(gridSample.r, gridSample.g, gridSample.a, 1.0);
-}
+	uint localIndex = gl_LocalInvocationIndex;
+	if (localIndex < 4u)
+	{
+		groupLo[localIndex] = 0x7fffffff;
+		groupHi[localIndex] = 0;
+	}
+	memoryBarrierShared();
+	barrier();
+
+	// the sample at the pixel center, as the point of the vertex splat takes it.
+	ivec2 xy = ivec2(gl_GlobalInvocationID.xy);
+	vec2 uv = (vec2(xy) + vec2(0.5)) / inputSize;
+	vec4 rgbdSample = textureLod(texture0, uv, 0.0);
+	float weight = inputWeight;
+	if (hasConfidence)
+		weight *= textureLod(texture1, uv, 0.0).a;
+
+	ivec4 size = ivec4(gridSize);
+	vec2 inputRange = applyRangeCurve(createInputRange(rgbdSample.rgb, gridSize), gridSize);
+	ivec4 cell = ivec4(floor(gridInputToGridCoord(vec4(vec2(xy), inputRange), vec4(1.0) / sigma, gridPadding)));
+
+	bool valid = all(lessThan(vec2(xy), inputSize)) && rgbdSample.a > 0.0 && weight > 0.0 && !(maxDepth > 0.0 && rgbdSample.a >= maxDepth);
+	valid = valid && all(greaterThanEqual(cell, ivec4(0))) && all(lessThan(cell, size));
+	if (valid)
+	{
+		// the cell gets [rgb * weight, weight] added, as the blend of the vertex splat does.
+		ivec2 texel = gridCellToTexel(cell, size);
+		int i = (texel.y * gridRasterSize(size).x + texel.x) * 4;
+		vec4 value = max(vec4(encodeGridSample(rgbdSample).rgb * weight, weight), vec4(0.0)) * fixedScale + vec4(0.5);
+		atomicAdd(gridCells[i], uint(value.r));
+		atomicAdd(gridCells[i + 1], uint(value.g));
+		atomicAdd(gridCells[i + 2], uint(value.b));
+		atomicAdd(gridCells[i + 3], uint(value.a));
+
+		if (trackBounds)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				atomicMin(groupLo[k], cell[k]);
+				atomicMax(groupHi[k], cell[k] + 1);
+			}
+		}
+	}
 
-vec4 decodeGridSample(vec4 gridSample)
-{
-	return vec4(gridSample.r, gridSample.g, 0.0, gridSample.b);
+	memoryBarrierShared();
+	barrier();
+	if (localIndex < 4u && groupHi[localIndex] > 0)
+	{
+		atomicMin(boundsLo[localIndex], groupLo[localIndex]);
+		atomicMax(boundsHi[localIndex], groupHi[localIndex]);
+	}
 }
+);
 
-// downsample high-res input-coord into low-res grid coords.
-vec4 gridInputToGridCoord(in vec4 inputCoord, in vec4 sigmaInv, in vec4 gridPadding)
-{
-	return ((inputCoord + vec4(0.5)) * sigmaInv) + gridPadding;
-}
+// writes a raster rectangle of the compute splat's cells into the grid image as floats, and zeroes them
+// for the next splat. GRID_IMAGE_FORMAT is defined to the format of the grid textures.
+const char* cs_bilateralSplatResolve =
+STRINGIFY(
+layout(local_size_x = 8, local_size_y = 8) in;
 
-// project grid coordinate into 2D space.
-vec2 gridCoordToRaster(in vec4 gridCoord, in vec4 gridSize)
-{
-	vec2 invGridRasterSize = vec2(1.0) / vec2(gridSize.x*gridSize.z, gridSize.y*gridSize.w);
-	return (gridCoord.xy + vec2(0.5) + vec2(gridCoord.z * gridSize.x, 0.0) + vec2(0.0, gridCoord.w * gridSize.y)) * invGridRasterSize;
-}
+layout(std430, binding = 0) buffer GridCells { uint gridCells[]; };
+layout(GRID_IMAGE_FORMAT, binding = 0) writeonly uniform highp image2D gridImage;
 
-// project grid coordinate into 2D space. alternative layout with dimensionsZW as rasterXY
-vec2 gridCoordToRaster2(in vec4 gridCoord, in vec4 gridSize)
-{
-	vec2 invGridRasterSize = vec2(1.0) / vec2(gridSize.x*gridSize.z, gridSize.y*gridSize.w);
-	return (vec2(0.5) + gridCoord.zw + vec2(gridCoord.x * gridSize.z, 0.0) + vec2(0.0, gridCoord.y * gridSize.w)) * invGridRasterSize;
-}
+uniform ivec4 rect;	// x, y, width, height
+uniform int rasterWidth;
+uniform float fixedScale;
 
-vec4 sampleGrid(in sampler2D gridTexture, in vec4 gridCoord, in vec4 gridSize)
+void main()
 {
-	vec2 gridRasterCoord = gridCoordToRaster((vec4(gridCoord.xy-vec2(0.5),floor(gridCoord.zw))), gridSize);
-	return texture2D(gridTexture, gridRasterCoord);
+	ivec2 offset = ivec2(gl_GlobalInvocationID.xy);
+	if (offset.x >= rect.z || offset.y >= rect.w)
+		return;
+
+	ivec2 texel = rect.xy + offset;
+	int i = (texel.y * rasterWidth + texel.x) * 4;
+	vec4 value = vec4(float(gridCells[i]), float(gridCells[i + 1]), float(gridCells[i + 2]), float(gridCells[i + 3])) / fixedScale;
+	gridCells[i] = 0u;
+	gridCells[i + 1] = 0u;
+	gridCells[i + 2] = 0u;
+	gridCells[i + 3] = 0u;
+	imageStore(gridImage, texel, value);
 }
+);
 
-// doesn't work yet. still need to debug.
-vec4 sampleGridLinear(in sampler2D gridTexture, in vec4 gridCoord, in vec4 gridSize)
-{
-	vec2 invGridRasterSize = vec2(1.0) / vec2(gridSize.x*gridSize.z, gridSize.y*gridSize.w);
 
-	vec2 icoord = floor(gridCoord.zw);		// the integer component
-	vec2 fcoord = fract(gridCoord.zw);		// the fractional component
+const char* fs_bilateralSlice =
+"#version 300 es \n"
+"precision highp float;\n"
+"precision highp sampler2D;\n"
+"precision highp int;\n"
+STRINGIFY(
+
+uniform ivec2 resolution;
+uniform sampler2D texture0; // color-reference image
+uniform sampler2D texture1; // bilateral-grid (homogeneous if sliceLinear, otherwise normalized)
 
-	vec2 xyCoord00 = gridCoord.xy + vec2(gridSize.x * icoord[0], gridSize.y * icoord[1]);
-	vec2 xyCoord10 = xyCoord00 + vec2(gridSize.x, 0.0);
-	vec2 xyCoord01 = xyCoord00 + vec2(0.0, gridSize.y);
-	vec2 xyCoord11 = xyCoord00 + vec2(gridSize.x, gridSize.y);
 
-	vec4 value00 = texture2D(gridTexture, (xyCoord00) * invGridRasterSize);
-	vec4 value10 = texture2D(gridTexture, (xyCoord10) * invGridRasterSize);
-	vec4 value01 = texture2D(gridTexture, (xyCoord01) * invGridRasterSize);
-	vec4 value11 = texture2D(gridTexture, (xyCoord11) * invGridRasterSize);
-/*
-	vec4 result = vec4(0.0);
-	if (value00.a > 0.0)
-		result += vec4(value00.rgb, 1.0);
-	if (value01.a > 0.0)
-		result += vec4(value01.rgb, 1.0);
-	if (value10.a > 0.0)
-		result += vec4(value10.rgb, 1.0);
-	if (value11.a > 0.0)
-		result += vec4(value11.rgb, 1.0);	
-	if (result.a > 0.0)
-		result /= result.a;
-	return result;
-	*/
-	//return mix(value00, value10, fcoord[0]);
-	//return value10;
-	return value00;
-	//return vec4(icoord, fcoord);
-	//return mix(value00, value10, fcoord[0]);
-	//return mix(value00, value01, fcoord[1]);
-	return mix(mix(value00, value01, fcoord[1]), mix(value10, value11, fcoord[1]), fcoord[0]);
-}
+uniform vec2 inputSize;
+uniform vec4 gridSize;
+uniform vec4 gridPadding;
+uniform vec4 sigma;
+uniform int sliceLinear;
+
+vec4 sigmaInv = vec4(1.0) / sigma;
+
+// createInputRange and the grid functions are prepended from the policies (see gridShader_).
 
 void main()
 {
@@ -247,10 +371,10 @@ void main()
 	vec2 inputUvPos = vec2(ivec2(gl_FragCoord.xy))/vec2(resolution);
 
 	// bilateral-position is color intensity
-	vec2 referenceSize = vec2(textureSize2D(texture0, 0));
+	vec2 referenceSize = vec2(textureSize(texture0, 0));
 	vec4 referenceSample = texture2D(texture0, inputUvPos.xy + vec2(0.5)/referenceSize);
 	//vec4 referenceSample = textureLod(texture0, inputUvPos.xy + vec2(0.5)/referenceSize, 4.0);
-	vec2 inputRange = createInputRange(referenceSample.rgb, 0.0);  // (0, 0) to (gridSize.z-1, gridSize.w-1)
+	vec2 inputRange = applyRangeCurve(createInputRange(referenceSample.rgb, gridSize), gridSize);  // (0, 0) to (gridSize.z-1, gridSize.w-1)
 
 	
 	vec2 xyCoord = inputUvPos.xy * inputSize.xy; // (0, 0) to (inputSize.x-1, inputSize.y-1)
@@ -258,8 +382,10 @@ void main()
 	vec4 gridCoord = gridInputToGridCoord(inputCoord, sigmaInv, gridPadding);
 
 	vec4 gridSample;
-	gridSample = sampleGrid(texture1, gridCoord, gridSize);
-	//gridSample = sampleGridLinear(texture1, gridCoord, gridSize);
+	if (sliceLinear != 0)
+		gridSample = sampleGridLinear(texture1, gridCoord, gridSize);
+	else
+		gridSample = sampleGrid(texture1, gridCoord, gridSize);
 
 	//debug:
 	vec4 debugValue = vec4(inputRange.xy,0.0,0.0);
@@ -285,194 +411,328 @@ void main()
 const char* fs_bilateralSliceMerge =
 "#version 300 es \n"
 "precision highp float;\n"
+"precision highp sampler2D;\n"
 "precision highp int;\n"
 STRINGIFY(
 in vec2 fTexCoords;
 
-uniform sampler2D texture1; // bilateral-grid 
+uniform sampler2D texture1; // bilateral-grid (homogeneous if sliceLinear, otherwise normalized)
 uniform sampler2D texture0; // color-reference image
 uniform sampler2D texture2; // this level's rgbd image
 uniform sampler2D texture3; // previous upsampled image
-uniform vec4 inputSize;
+uniform vec2 inputSize;
 uniform vec4 gridSize;
 uniform vec4 gridPadding;
-uniform vec4 sigmaInv;
-
-//-----------------------------------------
-// splat and slice must match the functions that determine bilateral input range.
-// (0, 0) to (inputSize.z-1, inputSize.w-1) inclusive
-vec2 createInputRange(in vec3 rgb, float t)
-{
-	//vec2 inputRange = vec2((0.2126*rgb.r + 0.7152*rgb.g + 0.0722*rgb.b), 0.0);
-	//vec2 inputRange = vec2((rgb.r + rgb.g + rgb.b)/3.0, 0.0);
-	vec2 inputRange = vec2(clamp(rgb.r*1.0, 0.0, 1.0), clamp(rgb.g*1.0, 0.0, 1.0));
-	return inputRange * (inputSize.zw - vec2(1.0));
-}
-//-----------------------------------------
-
-vec4 gridInputToGridCoord(in vec4 inputCoord, in vec4 sigmaInv, in vec4 gridPadding)
-{
-	return ((inputCoord + vec4(0.5)) * sigmaInv) + gridPadding;
-}
-
-// project grid coordinate into 2D space.
-vec2 gridCoordToRaster(in vec4 gridCoord, in vec4 gridSize)
-{
-	vec2 invGridRasterSize = vec2(1.0) / vec2(gridSize.x*gridSize.z, gridSize.y*gridSize.w);
-	return (gridCoord.xy + vec2(0.5) + vec2(gridCoord.z * gridSize.x, gridCoord.w * gridSize.y)) * invGridRasterSize;
-}
-
-vec4 sampleGrid(in sampler2D gridTexture, in vec4 gridCoord, in vec4 gridSize)
-{
-	vec2 gridRasterCoord = gridCoordToRaster(floor(gridCoord), gridSize);
-	return texture2D(gridTexture, gridRasterCoord);
-}
-
-vec4 sampleGridLinear(in sampler2D gridTexture, in vec4 gridCoord, in vec4 gridSize)
-{
-	vec2 invGridRasterSize = vec2(1.0) / vec2(gridSize.x*gridSize.z, gridSize.y*gridSize.w);
-
-	vec2 icoord = floor(gridCoord.zw);		// the integer component
-	vec2 fcoord = fract(gridCoord.zw);		// the fractional component
+uniform vec4 sigma;
+uniform int sliceLinear;
 
-	vec2 xyCoord00 = gridCoord.xy + vec2(0.5) + vec2(gridSize.x * icoord[0], gridSize.y * icoord[1]);
-	vec2 xyCoord10 = xyCoord00 + vec2(gridSize.x, 0.0);
-	vec2 xyCoord01 = xyCoord00 + vec2(0.0, gridSize.y);
-	vec2 xyCoord11 = xyCoord00 + vec2(gridSize.x, gridSize.y);
+vec4 sigmaInv = vec4(1.0) / sigma;
 
-	vec4 value00 = texture2D(gridTexture, xyCoord00 * invGridRasterSize);
-	vec4 value10 = texture2D(gridTexture, xyCoord10 * invGridRasterSize);
-	vec4 value01 = texture2D(gridTexture, xyCoord01 * invGridRasterSize);
-	vec4 value11 = texture2D(gridTexture, xyCoord11 * invGridRasterSize);
-
-	return value00;
-	//return mix(value00, value10, fcoord[0]);
-	//return mix(value00, value01, fcoord[1]);
-	//return mix(mix(value00, value01, fcoord[1]), mix(value10, value11, fcoord[1]), fcoord[0]);
-}
+// createInputRange and the grid functions are prepended from the policies (see gridShader_).
 
 void main()
 {
-	vec2 xyCoord = fTexCoords.xy * inputSize.xy; // (0, 0) to (inputSize.x-1, inputSize.y-1)
+	vec2 xyCoord = floor(fTexCoords.xy * inputSize.xy); // (0, 0) to (inputSize.x-1, inputSize.y-1), as the slice
 
 	// get bilateral-position from color.
 	vec4 colorSample = texture2D(texture0, fTexCoords.xy);
 	//vec4 colorSample = textureLod(texture0, fTexCoords.xy, 4.0);
-	vec2 inputRange = createInputRange(colorSample.rgb, 0.0);  // (0, 0) to (inputSize.z-1, inputSize.w-1)
+	vec2 inputRange = applyRangeCurve(createInputRange(colorSample.rgb, gridSize), gridSize);  // (0, 0) to (inputSize.z-1, inputSize.w-1)
 
 	vec4 inputCoord = vec4(xyCoord.xy, inputRange);
 	vec4 gridCoord = gridInputToGridCoord(inputCoord, sigmaInv, gridPadding);
-	vec4 gridValue = sampleGrid(texture1, gridCoord, gridSize);
-	//vec4 gridValue = sampleGridLinear(texture1, gridCoord, gridSize);
+	vec4 gridValue;
+	if (sliceLinear != 0)
+		gridValue = sampleGridLinear(texture1, gridCoord, gridSize);
+	else
+		gridValue = sampleGrid(texture1, gridCoord, gridSize);
 
 	vec4 prevUpsampledRgbd = texture2D(texture3, fTexCoords.xy);
 	vec4 sparseRgbd = texture2D(texture2, fTexCoords.xy);
 
-	if (gridValue.a == 0.0)
+	// depth in (0, 1) is valid. the rgbd pyramid marks missing depth with 1, the merge with 0.
+	if (sparseRgbd.a > 0.0 && sparseRgbd.a < 1.0)
 	{
-		// there are no samples at this position in the grid.
-		//gl_FragColor = vec4(1.0);
-		gl_FragColor = prevUpsampledRgbd;
+		// this pixel has a sample of its own at this level, so keep it.
+		gl_FragColor = sparseRgbd;
 		return;
 	}
-	/*
-	if (gridValue.r >= 1.0)
-	{
-		// make sure that the depth isn't out of range.
-		gridValue.r = 0.99;
-	}
-	*/
-	vec4 newCol;
 
-	if (prevUpsampledRgbd.a >= 1.0)
+	if (gridValue.a != 0.0)
 	{
-		// the parent image (lower res) has invalid depth.
-		// this color shows up on the edges of the AR image.
-		gl_FragColor = prevUpsampledRgbd;//vec4(0.0,0.0,0.0,1.1);
-		//discard;
+		// otherwise take the depth the grid spreads from the coarser level, with this level's colour.
+		gl_FragColor = vec4(colorSample.rgb, decodeGridSample(gridValue).a);
 		return;
 	}
 
-	
-	if (sparseRgbd.a < 1.0)
-	{
-		// this pixel has a valid color from the pointcloud, so we should use it.
-		newCol = sparseRgbd.rgba;
-	}
-	else
-	{
-		// otherwise it is a new pixel, so we take the color from the reference color image.
-		newCol = vec4(colorSample.rgb, gridValue.r);
-	}
-
-	// debug:
-	//if (newCol.a >= 0.95)
-	//	newCol = vec4(1.0, 1.0, 0.0, 1.1);
-
-	gl_FragColor = newCol;
+	// there are no samples at this position in the grid, so keep the coarser result (if any).
+	bool prevValid = prevUpsampledRgbd.a > 0.0 && prevUpsampledRgbd.a < 1.0;
+	gl_FragColor = vec4(colorSample.rgb, prevValid ? prevUpsampledRgbd.a : 0.0);
 }
 );
 
 const char* fs_gaussianBlur =
 "#version 300 es \n"
 "precision highp float;\n"
+"precision highp sampler2D;\n"
 "precision highp int;\n"
 STRINGIFY(
 
 uniform sampler2D texture0; // bilateral-grid
 uniform ivec2 delta;		// delta of blur
-uniform float weight;		// blurring weight (this can be used to show confidence in these values)
+uniform vec2 taps;		// the inner and outer taps of the axis (see gridBlurTaps)
+uniform int normalizeOutput;	// fold the unpremultiply into this pass
+uniform ivec2 rasterSize;	// of the grid, which may be smaller than its texture (see GlBilateralGridArena)
+
+// texels outside of the grid raster are zero (texelFetch would be undefined).
+bool insideGrid(in ivec2 coord, in ivec2 size)
+{
+	return all(greaterThanEqual(coord, ivec2(0))) && all(lessThan(coord, size));
+}
 
+vec4 blur5(in vec4 d0, in vec4 d1, in vec4 d2, in vec4 d3, in vec4 d4)
+{
+	return taps.y * (d0 + d4) + (taps.x * (d1 + d3) + d2);
+}
+
+// three iterations of the 5-tap blur along delta in one pass.
+// each iteration only keeps the texels inside the raster, exactly as three separate passes would.
 void main()
 {
+	ivec2 size = rasterSize;
 	ivec2 coord = ivec2(gl_FragCoord.xy);
-	vec4 d0 = texelFetch(texture0, coord -delta * 2, 0);
-	vec4 d1 = texelFetch(texture0, coord -delta, 0);
-	vec4 d2 = texelFetch(texture0, coord, 0);
-	vec4 d3 = texelFetch(texture0, coord + delta, 0);
-	vec4 d4 = texelFetch(texture0, coord + delta * 2, 0);
-	gl_FragColor = vec4(weight * (0.13533528323661 * (d0 + d4) + 0.60653065971263 * (d1 + d3)) + d2);
+
+	vec4 d[13];
+	for (int i = 0; i < 13; ++i)
+	{
+		ivec2 c = coord + delta * (i - 6);
+		d[i] = insideGrid(c, size) ? texelFetch(texture0, c, 0) : vec4(0.0);
+	}
+
+	vec4 e[9];
+	for (int i = 0; i < 9; ++i)
+		e[i] = insideGrid(coord + delta * (i - 4), size) ? blur5(d[i], d[i + 1], d[i + 2], d[i + 3], d[i + 4]) : vec4(0.0);
+
+	vec4 f[5];
+	for (int i = 0; i < 5; ++i)
+		f[i] = insideGrid(coord + delta * (i - 2), size) ? blur5(e[i], e[i + 1], e[i + 2], e[i + 3], e[i + 4]) : vec4(0.0);
+
+	vec4 col = blur5(f[0], f[1], f[2], f[3], f[4]);
+
+	if (normalizeOutput != 0)
+	{
+		// empty cells keep no weight, so the slice can tell them apart.
+		vec3 normRgb = (col.a == 0.0) ? vec3(0.0, 0.0, 0.0) : col.rgb / col.a;
+		col = vec4(normRgb, (col.a == 0.0) ? 0.0 : 1.0);
+	}
+	gl_FragColor = col;
 }
 
 );
 
-const char* fs_unpremultiplyAlpha =
+// adds a texture to the one bound to the framebuffer, texel for texel (the textures may be larger than the grid).
+const char* fs_accumulateCells =
 "#version 300 es \n"
 "precision highp float;\n"
+"precision highp sampler2D;\n"
 "precision highp int;\n"
 STRINGIFY(
-in vec2 fTexCoords;
 
 uniform sampler2D texture0;
 
 void main()
 {
-	vec4 col = texelFetch(texture0, ivec2(gl_FragCoord.xy), 0);
-	vec3 normRgb = (col.a == 0.0) ? vec3(0.0, 0.0, 0.0) : col.rgb / col.a;
-	gl_FragColor = vec4(normRgb, 1.0);
+	gl_FragColor = texelFetch(texture0, ivec2(gl_FragCoord.xy), 0);
 }
+
 );
 
+GlBilateralGridArena::GlBilateralGridArena()
+{
+	internalFormat = GL_RGBA32F;
+	quad = 0;
+	pointMesh = 0;
+	splatCellsBuffer = splatBoundsBuffer = 0;
+	splatCellsTexels = 0;
+	user = 0;
+	dirty[0].setEmpty();
+	dirty[1].setEmpty();
+}
+
+GlBilateralGridArena::~GlBilateralGridArena()
+{
+	release();
+}
+
+void GlBilateralGridArena::release()
+{
+	gridTextures[0] = gridTextures[1] = GlTexturePtr();
+	fbo = GlFramebufferPtr();
+	delete quad;
+	delete pointMesh;
+	quad = 0;
+	pointMesh = 0;
+	glDeleteBuffers(1, &splatCellsBuffer);
+	glDeleteBuffers(1, &splatBoundsBuffer);
+	splatCellsBuffer = splatBoundsBuffer = 0;
+	splatCellsTexels = 0;
+	user = 0;
+	dirty[0].setEmpty();
+	dirty[1].setEmpty();
+}
+
+void GlBilateralGridArena::reserve(int rasterWidth, int rasterHeight, GLenum format, int inputWidth, int inputHeight)
+{
+	if (!fbo.valid())
+		fbo = GlFramebufferPtr::create();
+	if (!quad)
+		quad = new GlQuad();
+	if (!pointMesh || pointMesh->width() * pointMesh->height() < inputWidth * inputHeight)
+	{
+		delete pointMesh;
+		pointMesh = new GlPlaneMesh(inputWidth, inputHeight);
+	}
+
+	if (gridTextures[0].valid() && internalFormat == format &&
+		gridTextures[0]->width >= rasterWidth && gridTextures[0]->height >= rasterHeight)
+		return;
+
+	// grow to cover the old textures too, so the grids that were set up before still fit.
+	if (gridTextures[0].valid() && internalFormat == format)
+	{
+		rasterWidth = std::max(rasterWidth, gridTextures[0]->width);
+		rasterHeight = std::max(rasterHeight, gridTextures[0]->height);
+	}
+	internalFormat = format;
+
+	// new textures are undefined, so they start out cleared, and no grid is in them.
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo->id);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+	glClearColor(0, 0, 0, 0);
+	for (int i = 0; i < 2; ++i)
+	{
+		gridTextures[i] = GlTexturePtr::create(GL_TEXTURE_2D, rasterWidth, rasterHeight, internalFormat);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures[i]->id, 0);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	user = 0;
+	dirty[0].setEmpty();
+	dirty[1].setEmpty();
+}
+
+void GlBilateralGridArena::reserveSplatCells(size_t numTexels)
+{
+	if (splatCellsBuffer && splatCellsTexels >= numTexels)
+		return;
+
+	// the cells start at zero, and each resolve leaves the ones it read at zero.
+	std::vector<GLuint> zeros(numTexels * 4, 0);
+	glDeleteBuffers(1, &splatCellsBuffer);
+	glGenBuffers(1, &splatCellsBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, splatCellsBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, zeros.size() * sizeof(GLuint), &zeros[0], GL_DYNAMIC_COPY);
+	if (!splatBoundsBuffer)
+	{
+		glGenBuffers(1, &splatBoundsBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, splatBoundsBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(GLint), 0, GL_DYNAMIC_READ);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	splatCellsTexels = numTexels;
+}
 
-GlBilateralGrid::GlBilateralGrid()
+bool GlBilateralGridArena::acquire(const void* grid)
+{
+	if (user == grid)
+		return false;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo->id);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+	glClearColor(0, 0, 0, 0);
+	glEnable(GL_SCISSOR_TEST);
+	for (int i = 0; i < 2; ++i)
+	{
+		if (dirty[i].empty())
+			continue;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures[i]->id, 0);
+		glScissor(dirty[i].x0, dirty[i].y0, dirty[i].x1 - dirty[i].x0, dirty[i].y1 - dirty[i].y0);
+		glClear(GL_COLOR_BUFFER_BIT);
+		dirty[i].setEmpty();
+	}
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	user = grid;
+	return true;
+}
+
+size_t GlBilateralGridArena::memoryBytes() const
+{
+	const size_t texelBytes = (internalFormat == GL_RGBA32F) ? 16 : 8;
+	size_t bytes = 0;
+	if (gridTextures[0].valid())
+		bytes += 2 * texelBytes * gridTextures[0]->width * gridTextures[0]->height;
+	if (pointMesh)
+		bytes += sizeof(float) * 4 * pointMesh->width() * pointMesh->height();
+	return bytes + splatCellsTexels * 4 * sizeof(GLuint);
+}
+
+
+template <class RangePolicy, class LayoutPolicy>
+std::string GlBilateralGridT<RangePolicy, LayoutPolicy>::gridShader_(const char* source)
+{
+	// the policy and grid functions go after the version and precision lines.
+	static const char* kHeaderEnd = "precision highp int;\n";
+	std::string shader(source);
+	size_t pos = shader.find(kHeaderEnd);
+	assert(pos != std::string::npos);
+	pos += strlen(kHeaderEnd);
+	return shader.substr(0, pos) + bilateralGridGlsl<RangePolicy, LayoutPolicy>() + glsl_gridFunctions + shader.substr(pos);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+GlBilateralGridT<RangePolicy, LayoutPolicy>::GlBilateralGridT()
 	:
-	bilateralSplatRgbd_(vs_bilateralSplatRgbd, fs_bilateralSplat),
-	bilateralSlice_(vs_simpleTexture, fs_bilateralSlice),
-	bilateralSliceMerge_(vs_simpleTexture, fs_bilateralSliceMerge),
+	bilateralSplatRgbd_(gridShader_(vs_bilateralSplatRgbd).c_str(), gridShader_(fs_bilateralSplat).c_str()),
+	bilateralSlice_(vs_simpleTexture, gridShader_(fs_bilateralSlice).c_str()),
+	bilateralSliceMerge_(vs_simpleTexture, gridShader_(fs_bilateralSliceMerge).c_str()),
 	gaussianBlur_(vs_simpleTexture, fs_gaussianBlur),
-	normalizeMaterial_(vs_simpleTexture, fs_unpremultiplyAlpha)
+	decayMaterial_(vs_simpleTexture, fs_color),
+	occupancyMaterial_(gridShader_(vs_bilateralOccupancyRgbd).c_str(), fs_color),
+	accumulateMaterial_(vs_simpleTexture, fs_accumulateCells)
 {
 	gridRasterWidth = gridRasterHeight = 0;
-	gridMesh_ = 0;
+	gridInternalFormat = GL_RGBA32F;
+	arena_ = &ownArena_;
+	sliceLinear = true;
+	persistenceTime = 0;
+	maxSplatDepth = 0;
+	trackBounds = true;
+	computeSplat = false;
+	splatComputeProgram_ = splatResolveProgram_ = 0;
+	occupancyTilesX_ = occupancyTilesY_ = 0;
+	occupancyMaterial_.color = glm::vec4(1.0);
+	lastSplatTime_ = 0;
+	hasHistory_ = false;
 }
 
-GlBilateralGrid::~GlBilateralGrid()
+template <class RangePolicy, class LayoutPolicy>
+GlBilateralGridT<RangePolicy, LayoutPolicy>::~GlBilateralGridT()
 {
-	delete gridMesh_;
+	releaseComputeSplat_();
+	arena_->releaseUser(this);
 }
 
-void GlBilateralGrid::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding)
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	StorageFormat storage, GlBilateralGridArena* arena)
 {
+	arena_->releaseUser(this);
+	arena_ = arena ? arena : &ownArena_;
+	if (arena)
+		ownArena_.release();
+
 	gridInputSize[0] = std::max(1.f, inputSize[0]);
 	gridInputSize[1] = std::max(1.f, inputSize[1]);
 	gridInputSize[2] = std::max(1.f, inputSize[2]);
@@ -491,9 +751,9 @@ void GlBilateralGrid::setup(const glm::vec4& inputSize, const glm::vec4& sigma,
 	gridSize[1] = int((gridInputSize[1] - 1) / gridSigma[1]) + 1 + 2 * gridPadding[1];
 	gridSize[2] = int((gridInputSize[2] - 1) / gridSigma[2]) + 1 + 2 * gridPadding[2];
 	gridSize[3] = int((gridInputSize[3] - 1) / gridSigma[3]) + 1 + 2 * gridPadding[3];
+	defaultBlurSigma(gridSigma, blurSigma);
 
-	gridRasterWidth = gridSize[0] * gridSize[2];
-	gridRasterHeight = gridSize[1] * gridSize[3];
+	LayoutPolicy::rasterSize(gridSize, &gridRasterWidth, &gridRasterHeight);
 	/*
 	// print for debugging:
 	CT4(gridInputSize[0], gridInputSize[1], gridInputSize[2], gridInputSize[3]);
@@ -503,47 +763,300 @@ void GlBilateralGrid::setup(const glm::vec4& inputSize, const glm::vec4& sigma,
 	CT2(gridRasterWidth, gridRasterHeight);
 	*/
 
-	fbo_ = GlFramebufferPtr::create();
-	gridTextures_[0] = GlTexturePtr::create(GL_TEXTURE_2D, gridRasterWidth, gridRasterHeight, GL_RGBA32F);
-	gridTextures_[1] = GlTexturePtr::create(GL_TEXTURE_2D, gridRasterWidth, gridRasterHeight, GL_RGBA32F);
+	gridInternalFormat = storageRgbdInternalFormat(storage);
+
+	// the textures only grow, and the grid starts out empty (acquireArena_ clears whatever is in them).
+	arena_->reserve(gridRasterWidth, gridRasterHeight, gridInternalFormat, gridInputSize[0], gridInputSize[1]);
+	gridBounds_[0].setEmpty();
+	gridBounds_[1].setEmpty();
+	// created on the first persistent splat.
+	historyTexture_ = GlTexturePtr();
+	historyBounds_.setEmpty();
+	hasHistory_ = false;
+
+	occupancyTilesX_ = (gridSize[0] + kOccupancyTile - 1) / kOccupancyTile;
+	occupancyTilesY_ = (gridSize[1] + kOccupancyTile - 1) / kOccupancyTile;
+	occupancyTexture_ = GlTexturePtr::create(GL_TEXTURE_2D, occupancyTilesX_ * gridSize[2], occupancyTilesY_ * gridSize[3], GL_R8);
+	occupancyPixels_.resize(size_t(occupancyTexture_->width) * occupancyTexture_->height * 4);
+
+	// the resolve has the format of the textures.
+	releaseComputeSplat_();
+}
+
+template <class RangePolicy, class LayoutPolicy>
+bool GlBilateralGridT<RangePolicy, LayoutPolicy>::createComputeSplat_()
+{
+	if (splatComputeProgram_)
+		return true;
+
+	if (!GlUtil::LoadCompute())
+	{
+		LOGI("GlBilateralGrid: no compute shaders, splatting points");
+		return false;
+	}
+
+	const char* imageFormat = (gridInternalFormat == GL_RGBA32F) ? "rgba32f" : "rgba16f";
+	splatComputeProgram_ = GlUtil::CreateComputeProgram(gridShader_(cs_bilateralSplatRgbd).c_str());
+	splatResolveProgram_ = GlUtil::CreateComputeProgram((std::string("#version 310 es \n#define GRID_IMAGE_FORMAT ") + imageFormat + "\n" + cs_bilateralSplatResolve).c_str());
+
+	glUseProgram(splatComputeProgram_);
+	glUniform1i(glGetUniformLocation(splatComputeProgram_, "texture0"), 0);
+	glUniform1i(glGetUniformLocation(splatComputeProgram_, "texture1"), 1);
+	glUseProgram(0);
+
+	GlUtil::CheckGlError("GlBilateralGrid::createComputeSplat_");
+	return splatComputeProgram_ && splatResolveProgram_;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::releaseComputeSplat_()
+{
+	glDeleteProgram(splatComputeProgram_);
+	glDeleteProgram(splatResolveProgram_);
+	splatComputeProgram_ = splatResolveProgram_ = 0;
+}
 
-	gridMesh_ = new GlPlaneMesh(gridInputSize[0], gridInputSize[1]);
-	quad_ = new GlQuad();
+// render the material over the raster rectangles of the bounds (into the bound framebuffer).
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::renderScissored_(const GridBounds& bounds, GlMaterial& material)
+{
+	glEnable(GL_SCISSOR_TEST);
+	LayoutPolicy::forEachRasterRect(bounds, gridSize, [&](int x, int y, int width, int height)
+	{
+		glScissor(x, y, width, height);
+		arena_->quad->render(glm::mat4(1.0), glm::mat4(1.0), material);
+	});
+	glDisable(GL_SCISSOR_TEST);
 }
 
-void GlBilateralGrid::clear()
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::setRangeCurveUniforms_(GLuint program)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
+	glUniform1i(glGetUniformLocation(program, "rangeCurveEnabled"), rangeCurve.enabled ? 1 : 0);
+	if (rangeCurve.enabled)
+		glUniform1fv(glGetUniformLocation(program, "rangeCurveKnots"), 2 * kRangeCurveKnots, &rangeCurve.knots[0][0]);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::clearRegion_(const GlTexturePtr& texture, const GridBounds& bounds)
+{
+	if (bounds.empty())
+		return;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[0]->id, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->id, 0);
 	glClearColor(0, 0, 0, 0);
-	glClear(GL_COLOR_BUFFER_BIT);
+	glEnable(GL_SCISSOR_TEST);
+	LayoutPolicy::forEachRasterRect(bounds, gridSize, [&](int x, int y, int width, int height)
+	{
+		glScissor(x, y, width, height);
+		glClear(GL_COLOR_BUFFER_BIT);
+	});
+	glDisable(GL_SCISSOR_TEST);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::acquireArena_()
+{
+	// the last grid's cells were cleared, along with this grid's if it had been there before.
+	if (arena_->acquire(this))
+	{
+		gridBounds_[0].setEmpty();
+		gridBounds_[1].setEmpty();
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::markArena_()
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		LayoutPolicy::forEachRasterRect(gridBounds_[i], gridSize, [&](int x, int y, int width, int height)
+		{
+			arena_->dirty[i].include(x, y, width, height);
+		});
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::clear()
+{
+	acquireArena_();
+	if (!trackBounds)
+	{
+		gridBounds_[0].setFull(gridSize);
+		historyBounds_.setFull(gridSize);
+	}
+	clearRegion_(arena_->gridTextures[0], gridBounds_[0]);
+	gridBounds_[0].setEmpty();
+	if (historyTexture_.valid())
+		clearRegion_(historyTexture_, historyBounds_);
+	historyBounds_.setEmpty();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	hasHistory_ = false;
 }
 
-void GlBilateralGrid::splatRgbd(const GlTexturePtr& srcRgbdTexture, float inputTime, float weight)
+template <class RangePolicy, class LayoutPolicy>
+GridBounds& GlBilateralGridT<RangePolicy, LayoutPolicy>::splatTargetBounds_()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
+	return (persistenceTime <= 0) ? gridBounds_[0] : historyBounds_;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::splatOccupancy_(const GlTexturePtr& srcRgbdTexture, GridBounds& bounds)
+{
+	if (!trackBounds)
+	{
+		bounds.setFull(gridSize);
+		return;
+	}
+
+	const int width = occupancyTexture_->width;
+	const int height = occupancyTexture_->height;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, occupancyTexture_->id, 0);
+	GlUtil::checkFramebuffer();
+
+	glViewport(0, 0, width, height);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+	glUseProgram(occupancyMaterial_.shader_program_);
+	setRangeCurveUniforms_(occupancyMaterial_.shader_program_);
+
+	GLuint loc;
+	loc = glGetUniformLocation(occupancyMaterial_.shader_program_, "sigma");
+	glUniform4f(loc, gridSigma[0], gridSigma[1], gridSigma[2], gridSigma[3]);
+	loc = glGetUniformLocation(occupancyMaterial_.shader_program_, "gridPadding");
+	glUniform4f(loc, gridPadding[0], gridPadding[1], gridPadding[2], gridPadding[3]);
+	loc = glGetUniformLocation(occupancyMaterial_.shader_program_, "gridSize");
+	glUniform4f(loc, gridSize[0], gridSize[1], gridSize[2], gridSize[3]);
+	loc = glGetUniformLocation(occupancyMaterial_.shader_program_, "inputSize");
+	glUniform2f(loc, gridInputSize[0], gridInputSize[1]);
+	loc = glGetUniformLocation(occupancyMaterial_.shader_program_, "occupancySize");
+	glUniform2f(loc, width, height);
+	loc = glGetUniformLocation(occupancyMaterial_.shader_program_, "occupancyTile");
+	glUniform1f(loc, kOccupancyTile);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, srcRgbdTexture->id);
+
+	arena_->pointMesh->render(glm::mat4(1.0), glm::mat4(1.0), occupancyMaterial_, gridInputSize[0] * gridInputSize[1]);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// RGBA / UNSIGNED_BYTE is the read format every GLES 3.0 implementation takes.
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &occupancyPixels_[0]);
+
+	for (int ty = 0; ty < height; ++ty)
+	{
+		const odd::uint8* row = &occupancyPixels_[size_t(ty) * width * 4];
+		const int w = ty / occupancyTilesY_;
+		const int y0 = (ty % occupancyTilesY_) * kOccupancyTile;
+		const int y1 = std::min(y0 + kOccupancyTile, gridSize[1]);
+
+		for (int tx = 0; tx < width; ++tx)
+		{
+			if (row[tx * 4] == 0)
+				continue;
+
+			const int z = tx / occupancyTilesX_;
+			const int x0 = (tx % occupancyTilesX_) * kOccupancyTile;
+			const int x1 = std::min(x0 + kOccupancyTile, gridSize[0]);
+			bounds.include(x0, y0, z, w);
+			bounds.include(x1 - 1, y1 - 1, z, w);
+		}
+	}
+}
+
+template <class RangePolicy, class LayoutPolicy>
+const GlTexturePtr& GlBilateralGridT<RangePolicy, LayoutPolicy>::splatTarget_(float inputTime)
+{
+	if (persistenceTime <= 0)
+		return arena_->gridTextures[0];
+
+	if (!historyTexture_.valid())
+	{
+		historyTexture_ = GlTexturePtr::create(GL_TEXTURE_2D, gridRasterWidth, gridRasterHeight, gridInternalFormat);
+		historyBounds_.setFull(gridSize);
+		hasHistory_ = false;
+	}
+
+	float dt = inputTime - lastSplatTime_;
+	if (!hasHistory_ || dt < 0)
+	{
+		// nothing to keep (or the clock went backwards).
+		clearRegion_(historyTexture_, historyBounds_);
+		historyBounds_.setEmpty();
+	}
+	else if (dt > 0 && !historyBounds_.empty())
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTexture_->id, 0);
+		GlUtil::checkFramebuffer();
+
+		// fade the older splats in place: dst = dst * exp(-dt / persistenceTime)
+		float decay = expf(-dt / persistenceTime);
+		glViewport(0, 0, gridRasterWidth, gridRasterHeight);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendColor(decay, decay, decay, decay);
+		glBlendFunc(GL_ZERO, GL_CONSTANT_COLOR);
+		glBlendEquation(GL_FUNC_ADD);
+		renderScissored_(historyBounds_, decayMaterial_);
+		glDisable(GL_BLEND);
+	}
+
+	lastSplatTime_ = inputTime;
+	hasHistory_ = true;
+	return historyTexture_;
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::splatRgbd(const GlTexturePtr& srcRgbdTexture, float inputTime, float weight, const GlTexturePtr& confidenceTexture)
+{
+	acquireArena_();
+	const GlTexturePtr& targetTexture = splatTarget_(inputTime);
+	GridBounds& targetBounds = splatTargetBounds_();
+
+	if (computeSplat && !createComputeSplat_())
+		computeSplat = false;
+	if (computeSplat)
+	{
+		splatRgbdCompute_(srcRgbdTexture, weight, confidenceTexture, targetTexture, targetBounds);
+		blurAndNormalize_(targetTexture, targetBounds);
+		return;
+	}
+
+	splatOccupancy_(srcRgbdTexture, targetBounds);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
 
 	glDisable(GL_DEPTH_TEST);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[0]->id, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTexture->id, 0);
 	GlUtil::checkFramebuffer();
 
 	glViewport(0, 0, gridRasterWidth, gridRasterHeight);
 
-	// we splat high-res pixels with accumulation
+	// we splat high-res pixels with accumulation, weighted by the alpha the splat shader writes
+	// (the weight times the sample confidence): the cell gets [rgb * weight, weight] added.
 	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE, GL_ONE);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
 	glBlendEquation(GL_FUNC_ADD);
 
-	// this allows us to have non binary weights specified in the alpha channel.
-	// the shader will have to be changed to not premultiply. (see the splat shader)
-	//glBlendFunc(GL_SRC_ALPHA, GL_ONE); 
-
 	// this enables us to ensure we have 1 pixel for the splat (scatter) pass.
 	glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
 	glUseProgram(bilateralSplatRgbd_.shader_program_);
+	setRangeCurveUniforms_(bilateralSplatRgbd_.shader_program_);
 
 	// predefine some uniforms...
 	GLuint loc;
@@ -559,27 +1072,178 @@ void GlBilateralGrid::splatRgbd(const GlTexturePtr& srcRgbdTexture, float inputT
 	glUniform1f(loc, weight);
 	loc = glGetUniformLocation(bilateralSplatRgbd_.shader_program_, "inputTime");
 	glUniform1f(loc, inputTime);
+	loc = glGetUniformLocation(bilateralSplatRgbd_.shader_program_, "hasConfidence");
+	glUniform1i(loc, confidenceTexture.valid() ? 1 : 0);
+	loc = glGetUniformLocation(bilateralSplatRgbd_.shader_program_, "maxDepth");
+	glUniform1f(loc, maxSplatDepth);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, srcRgbdTexture->id);
+	if (confidenceTexture.valid())
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, confidenceTexture->id);
+	}
 
-	gridMesh_->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSplatRgbd_);
+	arena_->pointMesh->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSplatRgbd_, gridInputSize[0] * gridInputSize[1]);
 
+	if (confidenceTexture.valid())
+	{
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glDisable(GL_BLEND);
 	glDisable(GL_DEPTH_TEST);
 
-	blurAndNormalize_();
+	blurAndNormalize_(targetTexture, targetBounds);
 
 	glUseProgram(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void GlBilateralGrid::splatRgbAndDepth(GLuint srcColorTextureId, GLuint srcDepthTextureId, float inputTime, float weight)
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::splatRgbdCompute_(const GlTexturePtr& srcRgbdTexture, float weight,
+	const GlTexturePtr& confidenceTexture, const GlTexturePtr& targetTexture, GridBounds& targetBounds)
+{
+	// the cells are shared with the other grids of the arena (each splat leaves them at zero).
+	arena_->reserveSplatCells(size_t(gridRasterWidth) * gridRasterHeight);
+
+	// the bounds buffer starts out empty: lo past the grid and hi before it.
+	const GLint emptyBounds[8] = { gridSize[0], gridSize[1], gridSize[2], gridSize[3], 0, 0, 0, 0 };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, arena_->splatBoundsBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyBounds), emptyBounds);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, arena_->splatCellsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, arena_->splatBoundsBuffer);
+
+	glUseProgram(splatComputeProgram_);
+	setRangeCurveUniforms_(splatComputeProgram_);
+
+	GLuint loc;
+	loc = glGetUniformLocation(splatComputeProgram_, "sigma");
+	glUniform4f(loc, gridSigma[0], gridSigma[1], gridSigma[2], gridSigma[3]);
+	loc = glGetUniformLocation(splatComputeProgram_, "gridPadding");
+	glUniform4f(loc, gridPadding[0], gridPadding[1], gridPadding[2], gridPadding[3]);
+	loc = glGetUniformLocation(splatComputeProgram_, "gridSize");
+	glUniform4f(loc, gridSize[0], gridSize[1], gridSize[2], gridSize[3]);
+	loc = glGetUniformLocation(splatComputeProgram_, "inputSize");
+	glUniform2f(loc, gridInputSize[0], gridInputSize[1]);
+	loc = glGetUniformLocation(splatComputeProgram_, "inputWeight");
+	glUniform1f(loc, weight);
+	loc = glGetUniformLocation(splatComputeProgram_, "hasConfidence");
+	glUniform1i(loc, confidenceTexture.valid() ? 1 : 0);
+	loc = glGetUniformLocation(splatComputeProgram_, "trackBounds");
+	glUniform1i(loc, trackBounds ? 1 : 0);
+	loc = glGetUniformLocation(splatComputeProgram_, "maxDepth");
+	glUniform1f(loc, maxSplatDepth);
+	loc = glGetUniformLocation(splatComputeProgram_, "fixedScale");
+	glUniform1f(loc, kSplatFixedScale);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, srcRgbdTexture->id);
+	if (confidenceTexture.valid())
+	{
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, confidenceTexture->id);
+	}
+
+	GlUtil::DispatchCompute((gridInputSize[0] + kComputeGroupSize - 1) / kComputeGroupSize,
+		(gridInputSize[1] + kComputeGroupSize - 1) / kComputeGroupSize, 1);
+
+	if (confidenceTexture.valid())
+	{
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	GlUtil::MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	// the cells this splat reached (which waits for it, as the occupancy read-back does).
+	GridBounds splatBounds;
+	if (trackBounds)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, arena_->splatBoundsBuffer);
+		const GLint* bounds = (const GLint*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyBounds), GL_MAP_READ_BIT);
+		if (bounds)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				splatBounds.lo[i] = bounds[i];
+				splatBounds.hi[i] = bounds[4 + i];
+			}
+			glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		}
+		else
+		{
+			splatBounds.setFull(gridSize);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		if (splatBounds.empty())
+			splatBounds.setEmpty();
+	}
+	else
+	{
+		splatBounds.setFull(gridSize);
+	}
+
+	// a grid that is not persistent was cleared, so the cells go straight into it. a persistent one
+	// adds them to its history, through arena_->gridTextures[1] (which the blur overwrites next).
+	const bool accumulate = (persistenceTime > 0);
+	const GlTexturePtr& resolveTexture = accumulate ? arena_->gridTextures[1] : targetTexture;
+	if (accumulate)
+		gridBounds_[1].unite(splatBounds);
+
+	glUseProgram(splatResolveProgram_);
+	glUniform1i(glGetUniformLocation(splatResolveProgram_, "rasterWidth"), gridRasterWidth);
+	glUniform1f(glGetUniformLocation(splatResolveProgram_, "fixedScale"), kSplatFixedScale);
+	GLint rectLoc = glGetUniformLocation(splatResolveProgram_, "rect");
+	GlUtil::BindImageTexture(0, resolveTexture->id, 0, GL_FALSE, 0, GL_WRITE_ONLY, gridInternalFormat);
+	LayoutPolicy::forEachRasterRect(splatBounds, gridSize, [&](int x, int y, int width, int height)
+	{
+		glUniform4i(rectLoc, x, y, width, height);
+		GlUtil::DispatchCompute((width + kComputeGroupSize - 1) / kComputeGroupSize, (height + kComputeGroupSize - 1) / kComputeGroupSize, 1);
+	});
+	GlUtil::BindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, gridInternalFormat);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+	GlUtil::MemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+	glUseProgram(0);
+
+	if (accumulate && !splatBounds.empty())
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTexture->id, 0);
+		GlUtil::checkFramebuffer();
+
+		glViewport(0, 0, gridRasterWidth, gridRasterHeight);
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glBlendEquation(GL_FUNC_ADD);
+		glBindTexture(GL_TEXTURE_2D, arena_->gridTextures[1]->id);
+		renderScissored_(splatBounds, accumulateMaterial_);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glDisable(GL_BLEND);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	targetBounds.unite(splatBounds);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::splatRgbAndDepth(GLuint srcColorTextureId, GLuint srcDepthTextureId, float inputTime, float weight)
 {
 	assert(srcColorTextureId != 0 && srcDepthTextureId != 0);
+	acquireArena_();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
+	const GlTexturePtr& targetTexture = splatTarget_(inputTime);
+	// no occupancy pass for separate colour and depth, so the splat may reach any cell.
+	GridBounds& targetBounds = splatTargetBounds_();
+	targetBounds.setFull(gridSize);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
 
 	// splat pass...
 	// scatter the sparse, high-res range-data into the low-res bilateral-grid.
@@ -588,7 +1252,7 @@ void GlBilateralGrid::splatRgbAndDepth(GLuint srcColorTextureId, GLuint srcDepth
 	{
 		glDisable(GL_DEPTH_TEST);
 		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[0]->id, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetTexture->id, 0);
 		GlUtil::checkFramebuffer();
 
 		glViewport(0, 0, gridRasterWidth, gridRasterHeight);
@@ -622,7 +1286,7 @@ void GlBilateralGrid::splatRgbAndDepth(GLuint srcColorTextureId, GLuint srcDepth
 		glActiveTexture(GL_TEXTURE1);
 		glBindTexture(GL_TEXTURE_2D, srcDepthTextureId);
 
-		gridMesh_->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSplat_);
+		arena_->pointMesh->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSplat_, gridInputSize[0] * gridInputSize[1]);
 
 		glBindTexture(GL_TEXTURE_2D, 0);
 		glActiveTexture(GL_TEXTURE0);
@@ -633,92 +1297,88 @@ void GlBilateralGrid::splatRgbAndDepth(GLuint srcColorTextureId, GLuint srcDepth
 
 	}
 
-	blurAndNormalize_();
+	blurAndNormalize_(targetTexture, targetBounds);
 
 	glUseProgram(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void GlBilateralGrid::blurAndNormalize_()
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::blurAndNormalize_(const GlTexturePtr& srcTexture, const GridBounds& srcBounds)
 {
-	glDisable(GL_DEPTH_TEST);
+	// the blur only reaches the cells within kBlurRadius of the splats, so the passes are scissored
+	// to those. whatever an earlier splat left outside of them is cleared first.
+	const GridBounds bounds = LayoutPolicy::blurredBounds(srcBounds, gridSize);
+	if (!bounds.contains(gridBounds_[1]))
+		clearRegion_(arena_->gridTextures[1], gridBounds_[1]);
+	if (srcTexture->id != arena_->gridTextures[0]->id && !bounds.contains(gridBounds_[0]))
+		clearRegion_(arena_->gridTextures[0], gridBounds_[0]);
+	gridBounds_[0] = gridBounds_[1] = bounds;
+	markArena_();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
-
-	// blur pass...
-	if (1)
-	{
-		GLuint deltaLoc, textureSize0Loc, weightLoc;
-
-		weightLoc = glGetUniformLocation(gaussianBlur_.shader_program_, "weight");
-		deltaLoc = glGetUniformLocation(gaussianBlur_.shader_program_, "delta");
-
-		glUseProgram(gaussianBlur_.shader_program_);
-
-		
+	glDisable(GL_DEPTH_TEST);
 
-		// do passes for spatial gaussian blur
-		glUniform1f(weightLoc, 1.0);
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
+	glViewport(0, 0, gridRasterWidth, gridRasterHeight);
 
-		for (int p = 0; p < 3; ++p)
-		{
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[1]->id, 0);
-			GlUtil::checkFramebuffer();
-			glUniform2i(deltaLoc, 1, 0);
-			glBindTexture(GL_TEXTURE_2D, gridTextures_[0]->id);
-			quad_->render(glm::mat4(1.0), glm::mat4(1.0), gaussianBlur_);
-
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[0]->id, 0);
-			GlUtil::checkFramebuffer();
-			glUniform2i(deltaLoc, 0, 1);
-			glBindTexture(GL_TEXTURE_2D, gridTextures_[1]->id);
-			quad_->render(glm::mat4(1.0), glm::mat4(1.0), gaussianBlur_);
-		}
+	// each pass does all three blur iterations along one axis, so the grid is read and written
+	// four times rather than thirteen. the axes commute, so this matches alternating x/y passes.
+	// the first pass reads srcTexture (which is left untouched) and the result ends up in arena_->gridTextures[0].
+	GLuint deltaLoc, tapsLoc, normalizeLoc;
 
-		// passes across intensity are less weight, so spatial blur takes priority.
-		glUniform1f(weightLoc, 0.001);
+	tapsLoc = glGetUniformLocation(gaussianBlur_.shader_program_, "taps");
+	deltaLoc = glGetUniformLocation(gaussianBlur_.shader_program_, "delta");
+	normalizeLoc = glGetUniformLocation(gaussianBlur_.shader_program_, "normalizeOutput");
 
-		for (int p = 0; p < 3; ++p)
-		{
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[1]->id, 0);
-			GlUtil::checkFramebuffer();
-			glUniform2i(deltaLoc, gridSize[0], 0);
-			glBindTexture(GL_TEXTURE_2D, gridTextures_[0]->id);
-			quad_->render(glm::mat4(1.0), glm::mat4(1.0), gaussianBlur_);
-
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[0]->id, 0);
-			GlUtil::checkFramebuffer();
-			glUniform2i(deltaLoc, 0, gridSize[1]);
-			glBindTexture(GL_TEXTURE_2D, gridTextures_[1]->id);
-			quad_->render(glm::mat4(1.0), glm::mat4(1.0), gaussianBlur_);
-		}
+	glUseProgram(gaussianBlur_.shader_program_);
+	glUniform2i(glGetUniformLocation(gaussianBlur_.shader_program_, "rasterSize"), gridRasterWidth, gridRasterHeight);
 
-		glUseProgram(0);
+	// the passes ping-pong between the grid textures, x and z into arena_->gridTextures[1], y and w back.
+	for (int axis = 0; axis < 4; ++axis)
+	{
+		// the raster step along the axis, and the taps of its sigma (spatial or range).
+		int delta[2];
+		float taps[2];
+		LayoutPolicy::axisDelta(axis, gridSize, &delta[0], &delta[1]);
+		gridBlurTaps(gridBlurCells(blurSigma, gridSigma, axis), &taps[0], &taps[1]);
+
+		// the linear slice interpolates the homogeneous grid, otherwise normalize in the last pass.
+		glUniform1i(normalizeLoc, (axis == 3 && !sliceLinear) ? 1 : 0);
+		glUniform2i(deltaLoc, delta[0], delta[1]);
+		glUniform2f(tapsLoc, taps[0], taps[1]);
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, arena_->gridTextures[1 - (axis & 1)]->id, 0);
+		GlUtil::checkFramebuffer();
+		glBindTexture(GL_TEXTURE_2D, (axis == 0) ? srcTexture->id : arena_->gridTextures[axis & 1]->id);
+		renderScissored_(bounds, gaussianBlur_);
 	}
 
-	// normalize...
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gridTextures_[1]->id, 0);
-	GlUtil::checkFramebuffer();
-	glBindTexture(GL_TEXTURE_2D, gridTextures_[0]->id);
-	quad_->render(glm::mat4(1.0), glm::mat4(1.0), normalizeMaterial_);
-
 	glUseProgram(0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glEnable(GL_DEPTH_TEST);
 }
 
-void GlBilateralGrid::slice(GLuint referenceTextureId, const GlTexturePtr& dstTexture)
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::slice(GLuint referenceTextureId, const GlTexturePtr& dstTexture)
+{
+	sliceRects(referenceTextureId, dstTexture, 0, 0);
+}
+
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::sliceRects(GLuint referenceTextureId, const GlTexturePtr& dstTexture,
+	const SliceRect* rects, int numRects)
 {
 	glDisable(GL_DEPTH_TEST);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dstTexture->id, 0);
 	GlUtil::checkFramebuffer();
 
 	glViewport(0, 0, dstTexture->width, dstTexture->height);
 
 	glUseProgram(bilateralSlice_.shader_program_);
+	setRangeCurveUniforms_(bilateralSlice_.shader_program_);
 	GLuint loc;
 	loc = glGetUniformLocation(bilateralSlice_.shader_program_, "sigma");
 	glUniform4f(loc, gridSigma[0], gridSigma[1], gridSigma[2], gridSigma[3]);
@@ -730,13 +1390,29 @@ void GlBilateralGrid::slice(GLuint referenceTextureId, const GlTexturePtr& dstTe
 	glUniform2f(loc, gridInputSize[0], gridInputSize[1]);
 	loc = glGetUniformLocation(bilateralSlice_.shader_program_, "resolution");
 	glUniform2i(loc, dstTexture->width, dstTexture->height);
+	loc = glGetUniformLocation(bilateralSlice_.shader_program_, "sliceLinear");
+	glUniform1i(loc, sliceLinear ? 1 : 0);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, referenceTextureId);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gridTextures_[1]->id);
+	glBindTexture(GL_TEXTURE_2D, arena_->gridTextures[0]->id);
 
-	quad_->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSlice_);
+	// no rects is the whole texture.
+	if (!rects)
+		arena_->quad->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSlice_);
+	else
+	{
+		glEnable(GL_SCISSOR_TEST);
+		for (int i = 0; i < numRects; ++i)
+		{
+			if (rects[i].width <= 0 || rects[i].height <= 0)
+				continue;
+			glScissor(rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+			arena_->quad->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSlice_);
+		}
+		glDisable(GL_SCISSOR_TEST);
+	}
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glActiveTexture(GL_TEXTURE0);
@@ -746,11 +1422,12 @@ void GlBilateralGrid::slice(GLuint referenceTextureId, const GlTexturePtr& dstTe
 	glEnable(GL_DEPTH_TEST);
 }
 
-void GlBilateralGrid::sliceMerge(const GlTexturePtr& refRgbTexture, const GlTexturePtr& prevUpsampleTexture, const GlTexturePtr& rgbdTexture, const GlTexturePtr& resultRgbdTexture)
+template <class RangePolicy, class LayoutPolicy>
+void GlBilateralGridT<RangePolicy, LayoutPolicy>::sliceMerge(const GlTexturePtr& refRgbTexture, const GlTexturePtr& prevUpsampleTexture, const GlTexturePtr& rgbdTexture, const GlTexturePtr& resultRgbdTexture)
 {
 	glDisable(GL_DEPTH_TEST);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
+	glBindFramebuffer(GL_FRAMEBUFFER, arena_->fbo->id);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resultRgbdTexture->id, 0);
 	GlUtil::checkFramebuffer();
 
@@ -759,8 +1436,9 @@ void GlBilateralGrid::sliceMerge(const GlTexturePtr& refRgbTexture, const GlText
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	glUseProgram(bilateralSliceMerge_.shader_program_);
+	setRangeCurveUniforms_(bilateralSliceMerge_.shader_program_);
 	GLuint loc;
-	loc = glGetUniformLocation(bilateralSlice_.shader_program_, "sigma");
+	loc = glGetUniformLocation(bilateralSliceMerge_.shader_program_, "sigma");
 	glUniform4f(loc, gridSigma[0], gridSigma[1], gridSigma[2], gridSigma[3]);
 	loc = glGetUniformLocation(bilateralSliceMerge_.shader_program_, "gridPadding");
 	glUniform4f(loc, gridPadding[0], gridPadding[1], gridPadding[2], gridPadding[3]);
@@ -768,17 +1446,19 @@ void GlBilateralGrid::sliceMerge(const GlTexturePtr& refRgbTexture, const GlText
 	glUniform4f(loc, gridSize[0], gridSize[1], gridSize[2], gridSize[3]);
 	loc = glGetUniformLocation(bilateralSliceMerge_.shader_program_, "inputSize");
 	glUniform2f(loc, gridInputSize[0], gridInputSize[1]);
+	loc = glGetUniformLocation(bilateralSliceMerge_.shader_program_, "sliceLinear");
+	glUniform1i(loc, sliceLinear ? 1 : 0);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, refRgbTexture->id);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gridTextures_[1]->id);
+	glBindTexture(GL_TEXTURE_2D, arena_->gridTextures[0]->id);
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, rgbdTexture->id);
 	glActiveTexture(GL_TEXTURE3);
 	glBindTexture(GL_TEXTURE_2D, prevUpsampleTexture->id);
 
-	quad_->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSliceMerge_);
+	arena_->quad->render(glm::mat4(1.0), glm::mat4(1.0), bilateralSliceMerge_);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glActiveTexture(GL_TEXTURE2);
@@ -791,3 +1471,113 @@ void GlBilateralGrid::sliceMerge(const GlTexturePtr& refRgbTexture, const GlText
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glEnable(GL_DEPTH_TEST);
 }
+
+static GlTexturePtr uploadRgbaFloat_(const float* pixels, int width, int height)
+{
+	GlTexturePtr texture = GlTexturePtr::create(GL_TEXTURE_2D, width, height, GL_RGBA32F);
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, pixels);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+static void readRgbaFloat_(const GlTexturePtr& texture, std::vector<float>& pixels)
+{
+	pixels.resize(size_t(texture->width) * texture->height * 4);
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->id, 0);
+	glReadPixels(0, 0, texture->width, texture->height, GL_RGBA, GL_FLOAT, &pixels[0]);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+}
+
+GridGlCpuDifference measureGlCpuGridDifference(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, int srcWidth, int srcHeight, const float* refRgba, int refWidth, int refHeight,
+	int dstWidth, int dstHeight, bool sliceLinear, const float* confidence, bool computeSplat)
+{
+	const size_t numFloats = size_t(dstWidth) * dstHeight * 4;
+	std::vector<float> glResult(numFloats), cpuResult(numFloats);
+
+	{
+		GlTexturePtr rgbdTexture = uploadRgbaFloat_(srcRgbd, srcWidth, srcHeight);
+		GlTexturePtr refTexture = uploadRgbaFloat_(refRgba, refWidth, refHeight);
+		GlTexturePtr dstTexture = GlTexturePtr::create(GL_TEXTURE_2D, dstWidth, dstHeight, GL_RGBA32F);
+		GlTexturePtr confidenceTexture;
+		if (confidence)
+		{
+			// the gl splat takes the confidence from alpha.
+			const size_t numPixels = size_t(srcWidth) * srcHeight;
+			std::vector<float> confidenceRgba(numPixels * 4, 0.0f);
+			for (size_t i = 0; i < numPixels; ++i)
+				confidenceRgba[i * 4 + 3] = confidence[i];
+			confidenceTexture = uploadRgbaFloat_(&confidenceRgba[0], srcWidth, srcHeight);
+		}
+		GlBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.computeSplat = computeSplat;
+		grid.setup(inputSize, sigma, padding);
+		grid.splatRgbd(rgbdTexture, 0.0f, 1.0f, confidenceTexture);
+		grid.slice(refTexture->id, dstTexture);
+		readRgbaFloat_(dstTexture, glResult);
+	}
+	{
+		CpuBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.setup(inputSize, sigma, padding);
+		grid.splatRgbd(srcRgbd, srcWidth, srcHeight, 0, 0.0f, 1.0f, confidence);
+		grid.slice(refRgba, refWidth, refHeight, 0, &cpuResult[0], dstWidth, dstHeight);
+	}
+
+	GridGlCpuDifference difference;
+	difference.depthMax = difference.colorMax = 0;
+	double depthSum = 0;
+	for (size_t i = 0; i < numFloats; i += 4)
+	{
+		for (int c = 0; c < 3; ++c)
+			difference.colorMax = std::max(difference.colorMax, fabsf(glResult[i + c] - cpuResult[i + c]));
+		const float d = fabsf(glResult[i + 3] - cpuResult[i + 3]);
+		difference.depthMax = std::max(difference.depthMax, d);
+		depthSum += d;
+	}
+	difference.depthMean = depthSum / std::max<size_t>(1, numFloats / 4);
+	difference.withinTolerance = difference.depthMax <= kCpuGridTolerance && difference.colorMax <= kCpuGridTolerance;
+
+	LOGI("gl against cpu grid: depth max %g mean %g, colour max %g, %s", difference.depthMax, difference.depthMean,
+		difference.colorMax, difference.withinTolerance ? "within tolerance" : "OUT OF TOLERANCE");
+	return difference;
+}
+
+float measureGlBoundsTracking(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, bool sliceLinear)
+{
+	std::vector<float> results[2];
+	GlTexturePtr rgbdTexture = uploadRgbaFloat_(srcRgbd, width, height);
+	GlTexturePtr refTexture = uploadRgbaFloat_(refRgba, width, height);
+	GlTexturePtr dstTexture = GlTexturePtr::create(GL_TEXTURE_2D, width, height, GL_RGBA32F);
+	int gridSize[2] = { 0, 0 };
+	for (int tracked = 0; tracked < 2; ++tracked)
+	{
+		GlBilateralGrid grid;
+		grid.sliceLinear = sliceLinear;
+		grid.trackBounds = tracked != 0;
+		grid.setup(inputSize, sigma, padding);
+		grid.splatRgbd(rgbdTexture, 0.0f, 1.0f);
+		grid.slice(refTexture->id, dstTexture);
+		readRgbaFloat_(dstTexture, results[tracked]);
+		gridSize[0] = grid.gridSize[0];
+		gridSize[1] = grid.gridSize[1];
+	}
+
+	float differenceMax = 0.0f;
+	for (size_t i = 0; i < results[0].size(); ++i)
+		differenceMax = std::max(differenceMax, fabsf(results[0][i] - results[1][i]));
+	LOGI("bounds-tracked against full grid of %dx%d cells a slice: max difference %g", gridSize[0], gridSize[1], differenceMax);
+	return differenceMax;
+}
+
+template class GlBilateralGridT<RangeAverageRG, LayoutRangeTiles>;
+template class GlBilateralGridT<RangeLuma, LayoutRangeTiles>;
+template class GlBilateralGridT<RangeRedGreen, LayoutRangeTiles>;
+template class GlBilateralGridT<RangeChroma, LayoutRangeTiles>;
@@ -6,24 +6,140 @@
 #include "GlQuad.h"
 #include "GlPlaneMesh.h"
 #include "GlPointcloud.h"
+#include "BilateralGridPolicy.h"
 
-class GlBilateralGrid
+// the sized texture formats of a StorageFormat, for the grids and rgbd images, and for the colour images.
+// GLES 3.0 has no normalized 16 bit formats, and integer textures can't be filtered or blended,
+// so STORAGE_RGB8_DEPTH16 keeps depth in half floats on the gpu (11 significant bits, about as
+// fine as 16 bit fixed point near 1) and only the colour images drop to 8 bits.
+inline GLenum storageRgbdInternalFormat(StorageFormat format)
 {
+	return (format == STORAGE_RGBA32F) ? GL_RGBA32F : GL_RGBA16F;
+}
+
+inline GLenum storageColorInternalFormat(StorageFormat format)
+{
+	if (format == STORAGE_RGBA16F)
+		return GL_RGBA16F;
+	if (format == STORAGE_RGB8_DEPTH16)
+		return GL_RGBA8;
+	return GL_RGBA32F;
+}
+
+// a rectangle of raster texels, [x0, x1) x [y0, y1).
+struct GridRasterRect
+{
+	int x0, y0, x1, y1;
+
+	void setEmpty() { x0 = y0 = 0; x1 = y1 = 0; }
+	bool empty() const { return x1 <= x0 || y1 <= y0; }
+	void include(int x, int y, int width, int height)
+	{
+		if (empty())
+		{
+			x0 = x; y0 = y; x1 = x + width; y1 = y + height;
+			return;
+		}
+		x0 = std::min(x0, x); y0 = std::min(y0, y);
+		x1 = std::max(x1, x + width); y1 = std::max(y1, y + height);
+	}
+};
+
+// The textures, framebuffer, quad and point mesh of grids that are used one at a time, such as the
+// levels of GlDepthUpsampler: a pair of grid textures as large as the largest raster, in place of a
+// pair per grid. The grids keep their own history and occupancy textures. A grid's cells stay in the
+// textures until another grid of the arena splats or clears, which first clears what the last one
+// left (acquire), so slice a grid before splatting the next. A grid set up without an arena has its own.
+class GlBilateralGridArena
+{
+public:
+	GlBilateralGridArena();
+	~GlBilateralGridArena();
+
+	// grows the textures to hold a raster of rasterWidth x rasterHeight, and the point mesh to
+	// inputWidth x inputHeight points. textures of another format are replaced, which drops the cells of every grid.
+	void reserve(int rasterWidth, int rasterHeight, GLenum internalFormat, int inputWidth, int inputHeight);
+	// grows the fixed point cells of the compute splat to numTexels raster texels (GLES 3.1).
+	void reserveSplatCells(size_t numTexels);
+	// makes grid the user of the textures, and clears what the last one may have written. true if the user changed.
+	bool acquire(const void* grid);
+	// a grid that is set up again or deleted is no longer in the textures.
+	void releaseUser(const void* grid) { if (user == grid) user = 0; }
+	void release();
+	// of the textures, the point mesh and the splat cells.
+	size_t memoryBytes() const;
+
 public:
-	GlBilateralGrid();
-	~GlBilateralGrid();
 
-	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0));
+	GlTexturePtr gridTextures[2];
+	GLenum internalFormat;
+	GlFramebufferPtr fbo;
+	GlQuad* quad;
+	GlPlaneMesh* pointMesh;	// a point per input pixel, drawn up to the input size of each grid.
+	GLuint splatCellsBuffer;	// 4 fixed point uints per raster texel, zero between splats.
+	GLuint splatBoundsBuffer;	// the lo and hi cells the splat reached.
+	size_t splatCellsTexels;
+	const void* user;			// the grid whose cells are in the textures.
+	GridRasterRect dirty[2];	// the texels of each texture the user may have written.
+};
 
+// The gpu grid engine. Its shaders are generated from RangePolicy and LayoutPolicy
+// (see BilateralGridPolicy.h), so the splat, blur and slice passes agree with each other and
+// with CpuBilateralGridT of the same policies. GlBilateralGrid is the default one.
+template <class RangePolicy, class LayoutPolicy>
+class GlBilateralGridT
+{
+public:
+	GlBilateralGridT();
+	~GlBilateralGridT();
+
+	// storage selects the precision of the grid textures (see storageRgbdInternalFormat).
+	// half float grids also blend without EXT_float_blend, but the cell sums lose precision past
+	// 2048 samples (11 significant bits), so keep sigma small (the grids of GlDepthUpsampler use 1).
+	// the grid textures, framebuffer and meshes come from arena, shared with its other grids (which
+	// the caller keeps alive as long as the grid), or without one from an arena of the grid's own.
+	void setup(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding = glm::vec4(0),
+		StorageFormat storage = STORAGE_RGBA32F, GlBilateralGridArena* arena = 0);
+
+	// clears the grid, including the history of a persistent grid.
 	void clear();
-	void splatRgbd(const GlTexturePtr& srcRgbdTexture, float inputTime=0.0, float weight=1.0);
+	// confidenceTexture, if valid, scales the weight of each sample by its alpha (a per-pixel confidence
+	// of the same size as srcRgbdTexture, such as the image GlPointcloud::confidenceMaterial renders).
+	void splatRgbd(const GlTexturePtr& srcRgbdTexture, float inputTime=0.0, float weight=1.0,
+		const GlTexturePtr& confidenceTexture = GlTexturePtr());
 	void splatRgbAndDepth(GLuint srcColorTextureId, GLuint srcDepthTextureId, float inputTime=0.0, float weight=1.0);
 	void slice(GLuint srcTextureId, const GlTexturePtr& dstTexture);
+	// slices only the texels of the rects (one scissored quad each) and leaves the rest of dstTexture,
+	// for consumers that need the depth of a few regions. CpuBilateralGridT::slicePixels answers single points.
+	void sliceRects(GLuint srcTextureId, const GlTexturePtr& dstTexture, const SliceRect* rects, int numRects);
+	// one level of coarse-to-fine upsampling: slices against refRgbTexture, and merges with rgbdTexture
+	// (this level's depth samples) and prevUpsampleTexture (the coarser level's result, usually what was
+	// splatted). A valid sample of rgbdTexture (depth in (0, 1)) is kept, else the grid's depth with the
+	// reference colour, else the coarser depth, else 0. resultRgbdTexture receives [red, green, blue, depth].
 	void sliceMerge(const GlTexturePtr& refRgbTexture, const GlTexturePtr& prevUpsampleTexture, const GlTexturePtr& rgbdTexture, const GlTexturePtr& resultRgbdTexture);
 
+	// the grid textures, which hold the raster in their lower left gridRasterWidth x gridRasterHeight texels.
+	const GlTexturePtr& gridTexture(int i) const { return arena_->gridTextures[i]; }
+
 private:
 
-	void blurAndNormalize_();
+	void blurAndNormalize_(const GlTexturePtr& srcTexture, const GridBounds& srcBounds);
+	// takes over the arena's textures (an empty grid if another grid was in them), and marks what it wrote.
+	void acquireArena_();
+	void markArena_();
+	const GlTexturePtr& splatTarget_(float inputTime);
+	GridBounds& splatTargetBounds_();
+	void splatOccupancy_(const GlTexturePtr& srcRgbdTexture, GridBounds& bounds);
+	void splatRgbdCompute_(const GlTexturePtr& srcRgbdTexture, float weight, const GlTexturePtr& confidenceTexture,
+		const GlTexturePtr& targetTexture, GridBounds& targetBounds);
+	bool createComputeSplat_();
+	void releaseComputeSplat_();
+	void clearRegion_(const GlTexturePtr& texture, const GridBounds& bounds);
+	void renderScissored_(const GridBounds& bounds, GlMaterial& material);
+	// the rangeCurve uniforms of a program that maps the range (splat, occupancy and slice).
+	void setRangeCurveUniforms_(GLuint program);
+	// a shader source with the policy and grid functions inserted.
+	static std::string gridShader_(const char* source);
 
 public:
 
@@ -32,19 +148,85 @@ public:
 	int gridPadding[4];
 	int gridSize[4];
 	int gridRasterWidth, gridRasterHeight;
+	GLenum gridInternalFormat;
+	// interpolate the grid when slicing (quadrilinear), otherwise take the nearest cell.
+	// this also selects whether the blur normalizes the grid, so set it before splatting.
+	bool sliceLinear;
+	// the sigma of the gaussian blur along the spatial and the range axes, in input units (see
+	// defaultBlurSigma, which setup() applies). the 5-tap passes reach kBlurRadius cells; a recursive
+	// gaussian as in CpuBilateralGrid::recursiveBlur walks a whole line per invocation, which needs compute.
+	float blurSigma[2];
+	// time constant (in the units of inputTime) of the decay of older splats in a persistent grid.
+	// if > 0, each splat fades the previous ones by exp(-dt / persistenceTime) and adds to them,
+	// so the grid is not cleared between frames. 0 splats into an empty grid (call clear() first).
+	float persistenceTime;
+	// if > 0, splatRgbd drops the samples with depth at or beyond it (e.g. 1, the missing depth of the rgbd pyramid).
+	float maxSplatDepth;
+	// restrict clear, decay, blur and normalize to the cells the splats can reach, with scissor rects.
+	// the bounds come from a coarse occupancy texture of each splat, which is read back, so this
+	// waits for the splat to finish. it pays off when the depth covers part of the view.
+	bool trackBounds;
+	// splat with a compute shader (GLES 3.1) instead of a point per input pixel: only the valid samples
+	// are scattered, with integer atomics into a buffer of fixed point cells (kSplatFixedScale), which
+	// is then written into the grid texture. the bounds come from the same pass (a read-back of 32
+	// bytes rather than the occupancy texture). falls back to the point splat without compute.
+	bool computeSplat;
+	// the range axes through an adaptive curve (see RangeCurve), linear unless enabled.
+	RangeCurve rangeCurve;
 
-	GlTexturePtr gridTextures_[2];
-	GlPlaneMesh* gridMesh_;
-	GlQuad* quad_;
-	GlFramebufferPtr fbo_;
+	GlTexturePtr historyTexture_;	// the decayed splats of a persistent grid.
+	GridBounds gridBounds_[2];		// the cells of each texture that may be non-zero.
+	GridBounds historyBounds_;
+	// a texel per block of kOccupancyTile^2 cells of a range slice, set where a splat lands.
+	GlTexturePtr occupancyTexture_;
+	std::vector<odd::uint8> occupancyPixels_;
+	int occupancyTilesX_, occupancyTilesY_;
+	float lastSplatTime_;
+	bool hasHistory_;
+	// the grid textures, fbo, quad and point mesh (ownArena_ without a shared one).
+	GlBilateralGridArena* arena_;
+	GlBilateralGridArena ownArena_;
 
 	GlMaterial bilateralSplatRgbd_;
 	GlMaterial bilateralSplat_;
 	GlMaterial gaussianBlur_;
 	GlMaterial bilateralSlice_;
 	GlMaterial bilateralSliceMerge_;
-	GlMaterial normalizeMaterial_;
 	GlMaterial bilateralSplatPointcloud_;
+	GlMaterial decayMaterial_;
+	GlMaterial occupancyMaterial_;
+	GlMaterial accumulateMaterial_;
+	// the compute splat, created on its first use (0 until then, or if compute is missing).
+	GLuint splatComputeProgram_;
+	GLuint splatResolveProgram_;
 };
 
+typedef GlBilateralGridT<RangeAverageRG, LayoutRangeTiles> GlBilateralGrid;
+
+struct GridGlCpuDifference
+{
+	float depthMax;			// the largest difference of the sliced depth.
+	float colorMax;			// and of the sliced colour channels.
+	double depthMean;
+	bool withinTolerance;	// both within kCpuGridTolerance (CpuBilateralGrid.h).
+};
+
+// splats srcRgbd (depth in alpha) into a GlBilateralGrid and a CpuBilateralGrid set up alike, slices
+// both against refRgba into a dstWidth x dstHeight target (all packed RGBA floats), and compares the
+// results, the check of the tolerance CpuBilateralGrid states. ref and dst sizes may differ, to check
+// how the cpu slice picks the reference texel. Needs a current GLES 3 context with float render targets.
+// confidence (if given) is one float per src pixel, as CpuBilateralGrid::splatRgbd takes it. computeSplat
+// checks the compute splat (GLES 3.1), whose fixed point rounds each sample by up to 1.5e-5, so its
+// differences are larger, most of all with fractional confidences.
+GridGlCpuDifference measureGlCpuGridDifference(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, int srcWidth, int srcHeight, const float* refRgba, int refWidth, int refHeight,
+	int dstWidth, int dstHeight, bool sliceLinear = false, const float* confidence = 0, bool computeSplat = false);
+
+// splats srcRgbd into two GlBilateralGrids set up alike, one with trackBounds and one without, slices
+// both against refRgba (all width x height, packed RGBA floats), and returns the largest difference of
+// the results, which is 0 if the tracked bounds hold every cell the blur reaches. The case to check is
+// a grid of range slices under kBlurRadius cells wide or high, whose spatial passes cross several slices.
+float measureGlBoundsTracking(const glm::vec4& inputSize, const glm::vec4& sigma, const glm::vec4& padding,
+	const float* srcRgbd, const float* refRgba, int width, int height, bool sliceLinear = false);
+
 #endif  // GLBILATERALGRID_H
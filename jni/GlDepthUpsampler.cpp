@@ -1,5 +1,6 @@
 
 #include "GlDepthUpsampler.h"
+#include "CpuImageStorage.h"
 
 GlDepthUpsampler::GlDepthUpsampler()
 	:
@@ -15,11 +16,33 @@ GlDepthUpsampler::GlDepthUpsampler()
 	colorTexturePyramid_ = 0;
 	depthTexturePyramid_ = 0;
 	depthUpsampleTexture_ = 0;
+	upsampleMethod_ = UPSAMPLE_BILATERALGRID;
+	storageFormat_ = setupStorageFormat_ = STORAGE_RGBA32F;
+	permutohedralLattice_ = 0;
+	bilateralSolver_ = 0;
+	gridPersistenceTime_ = 0;
+	computeSplat_ = false;
+	adaptiveRange_ = false;
+	firstInputTime_ = lastInputTime_ = 0;
+	hasInputTime_ = false;
+}
+
+GlDepthUpsampler::~GlDepthUpsampler()
+{
+	for (size_t i = 0; i < bilateralGrids_.size(); ++i)
+		delete bilateralGrids_[i];
+	delete quad_;
+	delete[] colorTexturePyramid_;
+	delete[] depthTexturePyramid_;
+	delete[] depthUpsampleTexture_;
+	delete permutohedralLattice_;
+	delete bilateralSolver_;
 }
 
 bool GlDepthUpsampler::setup(int width, int height, int numLevels)
 {
-	if (numLevels_ == numLevels && width_ == width && height_ == height)
+	if (numLevels_ == numLevels && width_ == width && height_ == height && setupStorageFormat_ == storageFormat_ &&
+		setupGridPreset_ == gridPreset_)
 		return true;
 
 	delete[] colorTexturePyramid_;
@@ -29,9 +52,13 @@ bool GlDepthUpsampler::setup(int width, int height, int numLevels)
 	numLevels_ = numLevels;
 	width_ = width;
 	height_ = height;
+	setupStorageFormat_ = storageFormat_;
+	setupGridPreset_ = gridPreset_;
+	const GLenum rgbdFormat = storageRgbdInternalFormat(storageFormat_);
+	const GLenum colorFormat = storageColorInternalFormat(storageFormat_);
 
 	pointcloudDepthTexture_ = GlTexturePtr::create(GL_TEXTURE_2D, width_, height_, GL_DEPTH_COMPONENT32F);
-	pointcloudColorTexture_ = GlTexturePtr::create(GL_TEXTURE_2D, width_, height_, GL_RGBA32F);
+	pointcloudColorTexture_ = GlTexturePtr::create(GL_TEXTURE_2D, width_, height_, rgbdFormat);
 	colorTexturePyramid_ = new GlTexturePtr[numLevels_];
 	depthTexturePyramid_ = new GlTexturePtr[numLevels_];
 	depthUpsampleTexture_ = new GlTexturePtr[numLevels_];
@@ -39,17 +66,17 @@ bool GlDepthUpsampler::setup(int width, int height, int numLevels)
 
 	for (int l = 0; l < numLevels_; ++l)
 	{
-		depthTexturePyramid_[l] = GlTexturePtr::create(GL_TEXTURE_2D, width_ >> l, height_ >> l, GL_RGBA32F);
+		depthTexturePyramid_[l] = GlTexturePtr::create(GL_TEXTURE_2D, width_ >> l, height_ >> l, rgbdFormat);
 		//glBindTexture(GL_TEXTURE_2D, depthTexturePyramid_[l]->id);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		depthUpsampleTexture_[l] = GlTexturePtr::create(GL_TEXTURE_2D, width_ >> l, height_ >> l, GL_RGBA32F);
+		depthUpsampleTexture_[l] = GlTexturePtr::create(GL_TEXTURE_2D, width_ >> l, height_ >> l, rgbdFormat);
 		//glBindTexture(GL_TEXTURE_2D, depthUpsampleTexture_[l]->id);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		colorTexturePyramid_[l] = GlTexturePtr::create(GL_TEXTURE_2D, width_ >> l, height_ >> l, GL_RGBA32F);
+		colorTexturePyramid_[l] = GlTexturePtr::create(GL_TEXTURE_2D, width_ >> l, height_ >> l, colorFormat);
 		//glBindTexture(GL_TEXTURE_2D, colorTexturePyramid_[l]->id);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -70,16 +97,33 @@ bool GlDepthUpsampler::setup(int width, int height, int numLevels)
 	//glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	quad_ = new GlQuad();
+	if (!quad_)
+		quad_ = new GlQuad();
 
+	for (size_t i = 0; i < bilateralGrids_.size(); ++i)
+		delete bilateralGrids_[i];
 	bilateralGrids_.clear();
-	bilateralGrids_.resize(numLevels_);
+	// the level-0 grid is there even for a single level, for UPSAMPLE_BILATERALGRID.
+	bilateralGrids_.resize(std::max(numLevels_ - 1, 1));
 
-	for (int i = 0; i < numLevels_ - 1; ++i)
+	// only one level is splatted and sliced at a time, so the grids share their textures, fbo
+	// and meshes, sized for the level-0 grid (which is set up first), rather than a set per level.
+	gridArena_.release();
+	for (int i = 0; i < int(bilateralGrids_.size()); ++i)
 	{
 		bilateralGrids_[i] = new GlBilateralGrid();
-		bilateralGrids_[i]->setup(glm::vec4(width_ >> i, height_ >> i, 16, 1), glm::vec4(1, 1, 1, 1), glm::vec4(0, 0, 0, 0));
+		bilateralGrids_[i]->setup(gridPreset_.inputSize(width_ >> i, height_ >> i), gridPreset_.sigma(), gridPreset_.paddingSize(), storageFormat_, &gridArena_);
+		bilateralGrids_[i]->persistenceTime = gridPersistenceTime_;
+		bilateralGrids_[i]->computeSplat = computeSplat_;
+		bilateralGrids_[i]->rangeCurve = rangeCurve_;
 	}
+	hasInputTime_ = false;
+
+	// the cpu upsamplers are sized for the level-0 images, upsampleRgbdCpu_ recreates them as needed.
+	delete permutohedralLattice_;
+	permutohedralLattice_ = 0;
+	delete bilateralSolver_;
+	bilateralSolver_ = 0;
 
 	return true;
 }
@@ -180,30 +224,202 @@ void GlDepthUpsampler::updateColorPyramid(const GlTexturePtr& srcColorTexture, i
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
+	if (adaptiveRange_ && gridPersistenceTime_ <= 0)
+		updateRangeCurve_(numLevels - 1);
+
 	glUseProgram(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glEnable(GL_DEPTH_TEST);
 }
 
-void GlDepthUpsampler::upsampleRgbd()
+void GlDepthUpsampler::setGridPersistence(float persistenceTime)
+{
+	gridPersistenceTime_ = std::max(0.f, persistenceTime);
+	// a persistent grid keeps its range linear (see setAdaptiveRange), not the last equalized curve.
+	if (gridPersistenceTime_ > 0)
+		rangeCurve_.setIdentity();
+	for (size_t i = 0; i < bilateralGrids_.size(); ++i)
+	{
+		if (bilateralGrids_[i])
+		{
+			bilateralGrids_[i]->persistenceTime = gridPersistenceTime_;
+			bilateralGrids_[i]->rangeCurve = rangeCurve_;
+			bilateralGrids_[i]->clear();
+		}
+	}
+	hasInputTime_ = false;
+}
+
+void GlDepthUpsampler::setUpsampleMethod(UpsampleMethod method)
+{
+	upsampleMethod_ = method;
+	if (upsampleMethod_ != UPSAMPLE_PERMUTOHEDRAL)
+	{
+		delete permutohedralLattice_;
+		permutohedralLattice_ = 0;
+	}
+	if (upsampleMethod_ != UPSAMPLE_BILATERALSOLVER)
+	{
+		delete bilateralSolver_;
+		bilateralSolver_ = 0;
+	}
+}
+
+void GlDepthUpsampler::setComputeSplat(bool computeSplat)
+{
+	computeSplat_ = computeSplat;
+	for (size_t i = 0; i < bilateralGrids_.size(); ++i)
+	{
+		if (bilateralGrids_[i])
+			bilateralGrids_[i]->computeSplat = computeSplat_;
+	}
+}
+
+void GlDepthUpsampler::setAdaptiveRange(bool adaptiveRange)
+{
+	adaptiveRange_ = adaptiveRange;
+	rangeCurve_.setIdentity();
+	for (size_t i = 0; i < bilateralGrids_.size(); ++i)
+	{
+		if (bilateralGrids_[i])
+			bilateralGrids_[i]->rangeCurve = rangeCurve_;
+	}
+}
+
+void GlDepthUpsampler::updateRangeCurve_(int level)
+{
+	// a coarse level has plenty of pixels for a histogram of the range (it is box filtered, so
+	// the colours of thin edges blend, but those take few cells anyway), and reads back in microseconds.
+	// the read-back waits for the pyramid, which the splat would wait for as well.
+	static const int kHistogramBins = 64;
+	readTexture_(colorTexturePyramid_[level], cpuColor_);
+	rangeHistogram_.assign(kHistogramBins * 2, 0.0f);
+	// the range policy of GlBilateralGrid.
+	accumulateRangeHistogram<RangeAverageRG>(&cpuColor_[0], colorTexturePyramid_[level]->width, colorTexturePyramid_[level]->height, 0, 1,
+		kHistogramBins, &rangeHistogram_[0], &rangeHistogram_[kHistogramBins]);
+	rangeCurve_.equalize(&rangeHistogram_[0], &rangeHistogram_[kHistogramBins], kHistogramBins);
+	for (size_t i = 0; i < bilateralGrids_.size(); ++i)
+		bilateralGrids_[i]->rangeCurve = rangeCurve_;
+}
+
+void GlDepthUpsampler::setStorageFormat(StorageFormat format)
+{
+	storageFormat_ = format;
+}
+
+void GlDepthUpsampler::readTexture_(const GlTexturePtr& texture, std::vector<float>& pixels)
 {
-#if 1
-	// non-hierarchichal bilateral upsampling...
-	bilateralGrids_[0]->clear();
-	bilateralGrids_[0]->splatRgbd(depthTexturePyramid_[0]);
+	pixels.resize(size_t(texture->width) * texture->height * 4);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->id, 0);
+	if (texture->internalType == GL_RGBA8)
+	{
+		// normalized textures only read back as bytes.
+		// (with the rows packed, as glReadPixels writes them.)
+		readBytes_.resize(texture->width, texture->height, 4);
+		glReadPixels(0, 0, texture->width, texture->height, GL_RGBA, GL_UNSIGNED_BYTE, readBytes_.data());
+		convertRgba8ToFloat(readBytes_, odd::ImageView<float, 4>(&pixels[0], texture->width, texture->height));
+	}
+	else
+	{
+		glReadPixels(0, 0, texture->width, texture->height, GL_RGBA, GL_FLOAT, &pixels[0]);
+	}
+}
+
+void GlDepthUpsampler::upsampleRgbdCpu_(const GlTexturePtr& confidenceTexture)
+{
+	// the lattice is a hash of simplex vertices and the solver needs global reductions, neither of
+	// which map to fragment shaders, so read back the level-0 images, upsample on the cpu and upload the result...
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo_->id);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+	readTexture_(depthTexturePyramid_[0], cpuRgbd_);
+	readTexture_(colorTexturePyramid_[0], cpuColor_);
+	const float* confidence = 0;
+	if (confidenceTexture.valid() && upsampleMethod_ == UPSAMPLE_BILATERALSOLVER)
+	{
+		// the confidence is the alpha of the texture, one float per pixel for the solver.
+		readTexture_(confidenceTexture, cpuConfidence_);
+		const size_t numPixels = cpuConfidence_.size() / 4;
+		for (size_t i = 0; i < numPixels; ++i)
+			cpuConfidence_[i] = cpuConfidence_[i * 4 + 3];
+		confidence = &cpuConfidence_[0];
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	cpuResult_.resize(cpuRgbd_.size());
+	if (upsampleMethod_ == UPSAMPLE_BILATERALSOLVER)
+	{
+		if (!bilateralSolver_)
+		{
+			// the solver fills whole regions, so its grid is 4x coarser than the level-0 grid in x and y.
+			bilateralSolver_ = new CpuBilateralSolver();
+			bilateralSolver_->setup(glm::vec4(width_, height_, 16, 1), glm::vec4(4, 4, 1, 1), glm::vec4(0, 0, 0, 0));
+		}
+		bilateralSolver_->solve(&cpuColor_[0], 0, &cpuRgbd_[0], 0, confidence, 0, &cpuResult_[0]);
+	}
+	else
+	{
+		if (!permutohedralLattice_)
+		{
+			permutohedralLattice_ = new CpuPermutohedralLatticeRgb();
+			permutohedralLattice_->setup(width_, height_, 4.0f, 0.1f);
+		}
+		permutohedralLattice_->upsampleRgbd(&cpuRgbd_[0], 0, &cpuColor_[0], 0, &cpuResult_[0]);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, depthUpsampleTexture_[0]->id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_, GL_RGBA, GL_FLOAT, &cpuResult_[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GlDepthUpsampler::upsampleRgbdHierarchical_()
+{
+	// coarse to fine: the grid of each level splats the result of the next coarser level (the
+	// coarsest rgbd level to begin with), and its slice fills in the pixels between this level's
+	// own samples. The grid of a level only has to spread depth by a few of its cells, however far
+	// apart the level-0 samples are. every level is re-splatted, so the grids don't persist, and the
+	// missing depth of the rgbd pyramid (1) is not splatted.
+	const GlTexturePtr* prevTexture = &depthTexturePyramid_[numLevels_ - 1];
+	for (int i = numLevels_ - 2; i >= 0; --i)
+	{
+		GlBilateralGrid* grid = bilateralGrids_[i];
+		grid->maxSplatDepth = 1.0f;
+		grid->clear();
+		grid->splatRgbd(*prevTexture);
+		grid->sliceMerge(colorTexturePyramid_[i], *prevTexture, depthTexturePyramid_[i], depthUpsampleTexture_[i]);
+		prevTexture = &depthUpsampleTexture_[i];
+	}
+}
+
+void GlDepthUpsampler::upsampleRgbd(double inputTime, const GlTexturePtr& confidenceTexture)
+{
+	if (upsampleMethod_ == UPSAMPLE_PERMUTOHEDRAL || upsampleMethod_ == UPSAMPLE_BILATERALSOLVER)
+	{
+		upsampleRgbdCpu_(confidenceTexture);
+		return;
+	}
+	if (upsampleMethod_ == UPSAMPLE_HIERARCHICAL && numLevels_ > 1)
+	{
+		upsampleRgbdHierarchical_();
+		hasInputTime_ = false;
+		return;
+	}
+
+	// non-hierarchichal bilateral upsampling (the level-0 grid splats every depth the pyramid has)...
+	bilateralGrids_[0]->maxSplatDepth = 0;
+	if (gridPersistenceTime_ <= 0)
+	{
+		bilateralGrids_[0]->clear();
+		bilateralGrids_[0]->splatRgbd(depthTexturePyramid_[0], 0.0f, 1.0f, confidenceTexture);
+	}
+	else if (!hasInputTime_ || inputTime != lastInputTime_)
+	{
+		// a persistent grid only takes each depth frame once.
+		// the grid times are relative to the first frame so they keep their precision as floats.
+		if (!hasInputTime_)
+			firstInputTime_ = inputTime;
+		bilateralGrids_[0]->splatRgbd(depthTexturePyramid_[0], float(inputTime - firstInputTime_), 1.0f, confidenceTexture);
+		lastInputTime_ = inputTime;
+		hasInputTime_ = true;
+	}
 	bilateralGrids_[0]->slice(colorTexturePyramid_[0]->id, depthUpsampleTexture_[0]);
-#else
-	// hierarchichal bilateral upsampling (needs fix)...
-	int i = numLevels_ - 1;
-	bilateralGrids_[i - 1]->clear();
-	bilateralGrids_[i - 1]->splatRgbd(depthTexturePyramid_[i]);
-	bilateralGrids_[i - 1]->sliceMerge(colorTexturePyramid_[i - 1], depthTexturePyramid_[i], depthTexturePyramid_[i - 1], depthUpsampleTexture_[i - 1]);
-	i--;
-	for (; i >= 1; --i)
-	{
-		bilateralGrids_[i - 1]->clear();
-		bilateralGrids_[i - 1]->splatRgbd(depthUpsampleTexture_[i]);
-		bilateralGrids_[i - 1]->sliceMerge(colorTexturePyramid_[i - 1], depthUpsampleTexture_[i], depthTexturePyramid_[i - 1], depthUpsampleTexture_[i - 1]);
-	}
-#endif
 }
\ No newline at end of file
@@ -3,14 +3,49 @@
 #define GLDEPTHUPSAMPLER_H
 
 #include "GlBilateralGrid.h"
+#include "CpuPermutohedralLattice.h"
+#include "CpuBilateralSolver.h"
+#include "GridTuner.h"
+
+enum UpsampleMethod {
+	UPSAMPLE_BILATERALGRID = 0,
+	UPSAMPLE_PERMUTOHEDRAL = 1,
+	UPSAMPLE_BILATERALSOLVER = 2,
+	UPSAMPLE_HIERARCHICAL = 3,
+};
 
 class GlDepthUpsampler
 {
 public:
 	GlDepthUpsampler();
+	~GlDepthUpsampler();
 
 	bool setup(int width, int height, int numLevels);
-	void upsampleRgbd();
+	// inputTime is the timestamp (seconds) of the depth in the rgbd pyramid.
+	// confidenceTexture, if valid, weights each level-0 depth sample by its alpha (the colour
+	// GlPointcloud::confidenceMaterial renders, as pointcloudColorTexture_). The permutohedral lattice ignores it.
+	void upsampleRgbd(double inputTime = 0.0, const GlTexturePtr& confidenceTexture = GlTexturePtr());
+
+	// UPSAMPLE_PERMUTOHEDRAL uses full RGB range guidance on the cpu (the level-0 images are read back).
+	// UPSAMPLE_BILATERALSOLVER solves for the depth on a coarse grid on the cpu (also read back).
+	// UPSAMPLE_HIERARCHICAL upsamples coarse to fine through a grid per pyramid level (see upsampleRgbdHierarchical_).
+	// the cpu upsamplers are created when first used and freed when another method is selected.
+	void setUpsampleMethod(UpsampleMethod method);
+	// keep the grid between frames, fading older depth with this time constant (seconds).
+	// new depth is only splatted when inputTime changes, otherwise the grid is just re-sliced.
+	// 0 clears and re-splats the grid on every upsample.
+	void setGridPersistence(float persistenceTime);
+	// splat the grids with a compute shader where GLES 3.1 has it (see GlBilateralGrid::computeSplat).
+	void setComputeSplat(bool computeSplat);
+	// the precision of the pyramids, upsample results and grids. Takes effect on the next setup().
+	void setStorageFormat(StorageFormat format);
+	// the sigma, range cells and padding of the grids (see GridTuner). Takes effect on the next setup(),
+	// which takes the number of levels.
+	void setGridPreset(const GridPreset& preset) { gridPreset_ = preset; }
+	// equalize the range axes of the grids to the colours of each frame (see RangeCurve), from a
+	// histogram of the coarsest colour level, which updateColorPyramid reads back. Persistent grids
+	// keep their range linear, since their history was splatted through older curves.
+	void setAdaptiveRange(bool adaptiveRange);
 
 	void renderPointcloudToTexture(GlPointcloud* pointcloud, 
 		glm::mat4 viewProjectionMat, glm::mat4 worldToViewMat,
@@ -21,10 +56,18 @@ public:
 	// build an RGBD image pyramid.
 	void updateRgbdPyramid(const GlTexturePtr& srcColorTexture, const GlTexturePtr& srcDepthTexture, int numLevels=-1);
 
+private:
+
+	void upsampleRgbdCpu_(const GlTexturePtr& confidenceTexture);
+	void upsampleRgbdHierarchical_();
+	void readTexture_(const GlTexturePtr& texture, std::vector<float>& pixels);
+	void updateRangeCurve_(int level);
+
 public:
 	int width_, height_;
 	int numLevels_;
-	std::vector<GlBilateralGrid*> bilateralGrids_;
+	std::vector<GlBilateralGrid*> bilateralGrids_;	// bilateralGrids_[l] upsamples into level l.
+	GlBilateralGridArena gridArena_;	// the textures of bilateralGrids_, one level at a time.
 	GlTexturePtr* depthTexturePyramid_;
 	GlTexturePtr* colorTexturePyramid_;
 	GlTexturePtr* depthUpsampleTexture_;
@@ -36,6 +79,27 @@ public:
 	GlMaterial setColorMaterial_;
 	GlMaterial reduceRgbdMaterial_;
 	GlMaterial reduceColorMaterial_;
+
+	UpsampleMethod upsampleMethod_;
+	StorageFormat storageFormat_;
+	StorageFormat setupStorageFormat_;	// the format of the current textures.
+	GridPreset gridPreset_;
+	GridPreset setupGridPreset_;	// the preset of the current grids.
+	float gridPersistenceTime_;
+	bool computeSplat_;
+	bool adaptiveRange_;
+	RangeCurve rangeCurve_;		// of the grids.
+	double firstInputTime_;
+	double lastInputTime_;
+	bool hasInputTime_;
+	CpuPermutohedralLatticeRgb* permutohedralLattice_;	// only while UPSAMPLE_PERMUTOHEDRAL is selected.
+	CpuBilateralSolver* bilateralSolver_;	// only while UPSAMPLE_BILATERALSOLVER is selected.
+	std::vector<float> cpuRgbd_;
+	std::vector<float> cpuColor_;
+	std::vector<float> cpuConfidence_;
+	std::vector<float> cpuResult_;
+	std::vector<float> rangeHistogram_;
+	odd::Image<odd::uint8, 4> readBytes_;
 };
 
 #endif  // GLDEPTHUPSAMPLER_H
@@ -1,6 +1,7 @@
 
 #include "GlPlaneMesh.h"
 #include <vector>
+#include <algorithm>
 
 GlPlaneMesh::GlPlaneMesh(int width, int height)
 {
@@ -11,7 +12,7 @@ GlPlaneMesh::GlPlaneMesh(int width, int height)
 	glGenBuffers(1, vertex_buffers);
 
 	std::vector<float> data;
-	data.reserve(width_*height_ * 4);
+	data.resize(width_*height_ * 4, 0.0f);
 	for (int y = 0, i = 0; y < height; ++y)
 	{
 		for (int x = 0; x < width; ++x, ++i)
@@ -48,7 +49,8 @@ GlPlaneMesh::~GlPlaneMesh()
 void GlPlaneMesh::render(
 	const glm::mat4& projection_mat,
 	const glm::mat4& view_mat,
-	const GlMaterial& mat
+	const GlMaterial& mat,
+	int numPoints
 	) const
 {
 
@@ -57,8 +59,12 @@ void GlPlaneMesh::render(
 
 	// Bind vertices buffer.
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[0]);
-	glEnableVertexAttribArray(mat.attrib_vertices_);
-	glVertexAttribPointer(mat.attrib_vertices_, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	// a shader that places its points by gl_VertexID has no vPosition (its location is -1 as a GLuint).
+	if (mat.attrib_vertices_ != GLuint(-1))
+	{
+		glEnableVertexAttribArray(mat.attrib_vertices_);
+		glVertexAttribPointer(mat.attrib_vertices_, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	}
 
 	/*
 	// Bind texture coordinates buffer.
@@ -71,7 +77,7 @@ void GlPlaneMesh::render(
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
 	*/
 
-	glDrawArrays(GL_POINTS, 0, width_*height_);
+	glDrawArrays(GL_POINTS, 0, (numPoints < 0) ? width_*height_ : std::min(numPoints, width_*height_));
 	GL_CHECKERRORS("glDrawArrays");
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -12,7 +12,11 @@ public:
 	GlPlaneMesh(int width, int height);
 	virtual ~GlPlaneMesh();
 
-	void render(const glm::mat4& projection_mat, const glm::mat4& view_mat, const GlMaterial& mat) const;
+	// draws the first numPoints points (all of them if < 0).
+	void render(const glm::mat4& projection_mat, const glm::mat4& view_mat, const GlMaterial& mat, int numPoints = -1) const;
+
+	int width() const { return width_; }
+	int height() const { return height_; }
 
 private:
 	GLuint vertex_buffers[1];
@@ -33,6 +33,58 @@ void main() {
 	gl_FragColor = vec4(fColor.rgb, gl_FragCoord.z);
 });
 
+// the colour of each point, with its confidence as a depth sample in alpha.
+// the confidence is the product of three falloffs, each 1/2 at its scale (and off if the scale is 0):
+// the range from the sensor (the depth noise grows with range^2, so the weight as 1/range^4),
+// the parallax between the sensor ray and the view ray (reprojected points at grazing
+// parallax are the ones that land on the wrong side of occlusion edges),
+// and the age of the points relative to the view (the pose drifts between them).
+static const char kConfidenceVertexShader[] =
+"#version 300 es \n"
+"precision highp float;\n"
+"precision highp int;\n"
+STRINGIFY(
+in vec4 vPosition;
+in vec3 vColor;
+uniform mat4 worldToViewProjMat;
+uniform float pointSize;
+uniform vec3 viewPosition;		// the view centre, in the sensor space of vPosition.
+uniform vec3 confidenceScale;	// range (metres), parallax (radians), age (seconds).
+uniform float pointAge;
+out vec3 fColor;
+out float fConfidence;
+
+void main() 
+{
+	gl_PointSize = pointSize;
+	gl_Position = worldToViewProjMat * vec4(vPosition.xyz, 1.0);
+	fColor = vColor;
+
+	float range = length(vPosition.xyz);
+	vec3 viewRay = vPosition.xyz - viewPosition;
+	float parallax = acos(clamp(dot(vPosition.xyz, viewRay) / max(range * length(viewRay), 1e-6), -1.0, 1.0));
+
+	float confidence = 1.0;
+	if (confidenceScale.x > 0.0)
+		confidence /= 1.0 + pow(range / confidenceScale.x, 4.0);
+	if (confidenceScale.y > 0.0)
+		confidence /= 1.0 + pow(parallax / confidenceScale.y, 2.0);
+	if (confidenceScale.z > 0.0)
+		confidence *= exp2(-max(pointAge, 0.0) / confidenceScale.z);
+	fConfidence = confidence;
+});
+
+static const char kConfidenceFragmentShader[] =
+"#version 300 es \n"
+"precision highp float;\n"
+"precision highp int;\n"
+STRINGIFY(
+in vec3 fColor;
+in float fConfidence;
+void main() {
+	gl_FragColor = vec4(fColor.rgb, fConfidence);
+});
+
 static const char* fs_colorFromTexture =
 "#version 300 es \n"
 "precision highp float;\n"
@@ -93,8 +145,13 @@ GlPointcloud::GlPointcloud()
 	:
 	defaultMaterial(kVertexShader, kFragmentShader),
 	setRgbdMaterial(kVertexShader, fs_colorFromTexture),
+	confidenceMaterial(kConfidenceVertexShader, kConfidenceFragmentShader),
 	tfMaterial_(vs_colorFromTexture, kFragmentShader)
 {
+	confidenceRange = 4.0f;
+	confidenceParallax = 0.35f;
+	confidenceAge = 0.2f;
+	pointAge = 0.0f;
 
 	numPoints_ = 0;
 	glGenBuffers(2, vbos_);
@@ -187,6 +244,22 @@ void GlPointcloud::render(glm::mat4 viewProjectionMat, glm::mat4 worldToViewMat,
 	if (resolutionLoc != -1)
 		glUniform2f(resolutionLoc, width, height);
 
+	GLint viewPositionLoc = glGetUniformLocation(mat.shader_program_, "viewPosition");
+	if (viewPositionLoc != -1)
+	{
+		// the view centre in the space of the vertices.
+		glm::vec4 viewPosition = glm::inverse(worldToViewMat * viewToWorldMat_ * inverse_z_mat) * glm::vec4(0, 0, 0, 1);
+		glUniform3f(viewPositionLoc, viewPosition.x, viewPosition.y, viewPosition.z);
+	}
+
+	GLint confidenceScaleLoc = glGetUniformLocation(mat.shader_program_, "confidenceScale");
+	if (confidenceScaleLoc != -1)
+		glUniform3f(confidenceScaleLoc, confidenceRange, confidenceParallax, confidenceAge);
+
+	GLint pointAgeLoc = glGetUniformLocation(mat.shader_program_, "pointAge");
+	if (pointAgeLoc != -1)
+		glUniform1f(pointAgeLoc, pointAge);
+
 	if (mat.attrib_vertices_ != -1)
 	{
 		glBindBuffer(GL_ARRAY_BUFFER, vbos_[0]);
@@ -25,6 +25,13 @@ public:
 
 	GlMaterial defaultMaterial;		// default material to render colored pointcloud.
 	GlMaterial setRgbdMaterial;
+	GlMaterial confidenceMaterial;	// renders the colour with the confidence of each point in alpha.
+
+	// the scales at which the confidence of a point halves (0 turns a term off):
+	float confidenceRange;			// metres from the sensor.
+	float confidenceParallax;		// radians between the sensor ray and the view ray.
+	float confidenceAge;			// seconds of pointAge.
+	float pointAge;					// the age of the points relative to the view (seconds).
 
 private:
 	GlTransformFeedbackPtr tf_;		// transformfeedback object.
@@ -0,0 +1,361 @@
+
+#include "GridTuner.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+bool loadGridPreset(const char* path, GridPreset* preset)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+		return false;
+
+	GridPreset p = *preset;
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		char* comment = strchr(line, '#');
+		if (comment)
+			*comment = 0;
+
+		char name[64];
+		float value;
+		if (sscanf(line, "%63s %f", name, &value) != 2)
+			continue;
+
+		if (strcmp(name, "spatialSigma") == 0)
+			p.spatialSigma = std::max(value, 1e-3f);
+		else if (strcmp(name, "rangeSigma") == 0)
+			p.rangeSigma = std::max(value, 1e-3f);
+		else if (strcmp(name, "rangeCells") == 0)
+			p.rangeCells = std::max(int(value), 1);
+		else if (strcmp(name, "padding") == 0)
+			p.padding = std::max(int(value), 0);
+		else if (strcmp(name, "numLevels") == 0)
+			p.numLevels = std::max(int(value), 1);
+		else
+			LOGE("loadGridPreset: unknown name %s in %s", name, path);
+	}
+	fclose(file);
+
+	*preset = p;
+	return true;
+}
+
+bool saveGridPreset(const char* path, const GridPreset& preset)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	fprintf(file, "# grid preset (see GridTuner)\n");
+	fprintf(file, "spatialSigma %g\n", preset.spatialSigma);
+	fprintf(file, "rangeSigma %g\n", preset.rangeSigma);
+	fprintf(file, "rangeCells %d\n", preset.rangeCells);
+	fprintf(file, "padding %d\n", preset.padding);
+	fprintf(file, "numLevels %d\n", preset.numLevels);
+	return fclose(file) == 0;
+}
+
+GridTuner::GridTuner(ThreadPool* threadPool)
+{
+	threadPool_ = threadPool ? threadPool : &ThreadPool::shared();
+	width_ = height_ = 0;
+
+	// around the defaults of GridPreset.
+	spatialSigmas.push_back(1);
+	spatialSigmas.push_back(2);
+	spatialSigmas.push_back(4);
+	rangeSigmas.push_back(1);
+	rangeSigmas.push_back(2);
+	rangeCells.push_back(8);
+	rangeCells.push_back(16);
+	rangeCells.push_back(32);
+	paddings.push_back(0);
+	paddings.push_back(1);
+	levels.push_back(1);
+	levels.push_back(2);
+	levels.push_back(4);
+	levels.push_back(6);
+	repeats = 3;
+}
+
+void GridTuner::setup(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+	frames_.clear();
+	results.clear();
+}
+
+void GridTuner::addSyntheticFrames(int numFrames, int sampleSpacing, float depthNoise)
+{
+	// a small lcg, so the frames are the same on every platform.
+	unsigned int state = 0x2545f491u + unsigned(frames_.size());
+	auto random = [&]() -> float
+	{
+		state = state * 1664525u + 1013904223u;
+		return float(state >> 8) / float(1 << 24);
+	};
+
+	const size_t numPixels = size_t(width_) * height_;
+	sampleSpacing = std::max(sampleSpacing, 1);
+	for (int f = 0; f < numFrames; ++f)
+	{
+		// a sloped background, and a few rectangles in front of it, each a flat colour and a plane of depth.
+		const int kNumRects = 4;
+		float rect[kNumRects][4], rectColor[kNumRects][3], rectDepth[kNumRects][3];
+		for (int r = 0; r < kNumRects; ++r)
+		{
+			rect[r][0] = random() * width_ * 0.7f;
+			rect[r][1] = random() * height_ * 0.7f;
+			rect[r][2] = rect[r][0] + width_ * (0.1f + 0.3f * random());
+			rect[r][3] = rect[r][1] + height_ * (0.1f + 0.3f * random());
+			for (int c = 0; c < 3; ++c)
+				rectColor[r][c] = 0.15f + 0.7f * random();
+			rectDepth[r][0] = 0.2f + 0.3f * random();
+			rectDepth[r][1] = (random() - 0.5f) * 0.1f / width_;
+			rectDepth[r][2] = (random() - 0.5f) * 0.1f / height_;
+		}
+		const float backColor[3] = { 0.4f + 0.2f * random(), 0.4f + 0.2f * random(), 0.4f + 0.2f * random() };
+		const int offsetX = int(random() * sampleSpacing), offsetY = int(random() * sampleSpacing);
+
+		GridTuningFrame frame;
+		frame.rgbd.resize(numPixels * 4);
+		frame.color.resize(numPixels * 4);
+		frame.depth.resize(numPixels);
+		for (int y = 0; y < height_; ++y)
+		{
+			for (int x = 0; x < width_; ++x)
+			{
+				const size_t i = size_t(y) * width_ + x;
+				const float* color = backColor;
+				float depth = 0.6f + 0.2f * y / height_;
+				for (int r = kNumRects - 1; r >= 0; --r)
+				{
+					if (x >= rect[r][0] && x < rect[r][2] && y >= rect[r][1] && y < rect[r][3])
+					{
+						color = rectColor[r];
+						depth = rectDepth[r][0] + rectDepth[r][1] * (x - rect[r][0]) + rectDepth[r][2] * (y - rect[r][1]);
+						break;
+					}
+				}
+
+				float* c = &frame.color[i * 4];
+				c[0] = color[0];
+				c[1] = color[1];
+				c[2] = color[2];
+				c[3] = 1;
+				frame.depth[i] = depth;
+
+				float* d = &frame.rgbd[i * 4];
+				d[0] = c[0];
+				d[1] = c[1];
+				d[2] = c[2];
+				d[3] = 1;
+				if ((x % sampleSpacing) == offsetX && (y % sampleSpacing) == offsetY)
+					d[3] = std::min(std::max(depth + (random() - 0.5f) * 2.0f * depthNoise, 1e-3f), 0.999f);
+			}
+		}
+		frames_.push_back(frame);
+	}
+}
+
+void GridTuner::buildPyramids_(int numLevels)
+{
+	// as updateRgbdPyramid and updateColorPyramid build them: the nearest valid depth of each 2x2
+	// block (1 where there is none), and the mean colour.
+	rgbdPyramids_.resize(frames_.size());
+	colorPyramids_.resize(frames_.size());
+	CpuRgbdPyramid rgbdPyramid(threadPool_);
+	CpuColorPyramid colorPyramid(threadPool_);
+	rgbdPyramid.setup(width_, height_, numLevels);
+	colorPyramid.setup(width_, height_, numLevels);
+	for (size_t f = 0; f < frames_.size(); ++f)
+	{
+		rgbdPyramid.build(&frames_[f].rgbd[0]);
+		colorPyramid.build(&frames_[f].color[0]);
+		rgbdPyramids_[f] = rgbdPyramid.pyramid();
+		colorPyramids_[f] = colorPyramid.pyramid();
+	}
+}
+
+void GridTuner::accumulateError_(const GridTuningFrame& frame, double* squaredError, size_t* numCovered, size_t* numTruth) const
+{
+	const size_t numPixels = size_t(width_) * height_;
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		const float truth = frame.depth[i];
+		if (truth <= 0)
+			continue;
+		++*numTruth;
+
+		const float depth = result_[i * 4 + 3];
+		if (depth <= 0 || depth >= 1)
+			continue;
+		++*numCovered;
+		*squaredError += double(depth - truth) * (depth - truth);
+	}
+}
+
+GridTuningResult GridTuner::evaluate_(const GridPreset& preset)
+{
+	GridTuningResult result;
+	result.preset = preset;
+	result.seconds = 0;
+	result.bytes = 0;
+	result.pareto = false;
+
+	double squaredError = 0;
+	size_t numCovered = 0, numTruth = 0;
+	result_.resize(size_t(width_) * height_ * 4);
+
+	if (preset.numLevels <= 1)
+	{
+		// the level-0 grid alone, as UPSAMPLE_BILATERALGRID (without the missing depth).
+		CpuBilateralGrid grid(threadPool_);
+		grid.setup(preset.inputSize(width_, height_), preset.sigma(), preset.paddingSize());
+		grid.maxSplatDepth = 1.0f;
+		// its raster pair, as the levels of the upsampler below count theirs (one level has no level results).
+		result.bytes = grid.arena_->memoryBytes();
+
+		for (size_t f = 0; f < frames_.size(); ++f)
+		{
+			double best = 1e30;
+			for (int r = 0; r < std::max(repeats, 1); ++r)
+			{
+				double t0 = getTimeSeconds();
+				grid.clear();
+				grid.splatRgbd(rgbdPyramids_[f].level(0).data(), width_, height_);
+				grid.slice(colorPyramids_[f].level(0).data(), width_, height_, 0, &result_[0], width_, height_);
+				best = std::min(best, getTimeSeconds() - t0);
+			}
+			result.seconds += best;
+			accumulateError_(frames_[f], &squaredError, &numCovered, &numTruth);
+		}
+	}
+	else
+	{
+		CpuHierarchicalUpsampler upsampler(threadPool_);
+		upsampler.setup(width_, height_, preset.numLevels, preset.sigma(), preset.paddingSize(), preset.rangeCells);
+		result.bytes = upsampler.memoryBytes();
+
+		std::vector<const float*> rgbd(preset.numLevels), color(preset.numLevels);
+		for (size_t f = 0; f < frames_.size(); ++f)
+		{
+			for (int l = 0; l < preset.numLevels; ++l)
+			{
+				rgbd[l] = rgbdPyramids_[f].level(l).data();
+				color[l] = colorPyramids_[f].level(l).data();
+			}
+
+			double best = 1e30;
+			for (int r = 0; r < std::max(repeats, 1); ++r)
+			{
+				double t0 = getTimeSeconds();
+				upsampler.upsample(&rgbd[0], &color[0], &result_[0]);
+				best = std::min(best, getTimeSeconds() - t0);
+			}
+			result.seconds += best;
+			accumulateError_(frames_[f], &squaredError, &numCovered, &numTruth);
+		}
+	}
+
+	result.seconds /= std::max(size_t(1), frames_.size());
+	result.rmse = numCovered ? sqrt(squaredError / numCovered) : HUGE_VAL;
+	result.coverage = numTruth ? double(numCovered) / numTruth : 0.0;
+	return result;
+}
+
+void GridTuner::markPareto_()
+{
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		GridTuningResult& a = results[i];
+		a.pareto = true;
+		for (size_t j = 0; j < results.size() && a.pareto; ++j)
+		{
+			const GridTuningResult& b = results[j];
+			const bool noWorse = b.seconds <= a.seconds && b.bytes <= a.bytes && b.rmse <= a.rmse;
+			const bool better = b.seconds < a.seconds || b.bytes < a.bytes || b.rmse < a.rmse;
+			if (j != i && noWorse && better)
+				a.pareto = false;
+		}
+	}
+}
+
+void GridTuner::run()
+{
+	results.clear();
+	if (frames_.empty())
+	{
+		LOGE("GridTuner: no frames");
+		return;
+	}
+
+	// the levels have to halve down to at least a pixel.
+	int maxLevels = 1;
+	while (maxLevels < 16 && (width_ >> maxLevels) > 0 && (height_ >> maxLevels) > 0)
+		++maxLevels;
+	int numLevels = 1;
+	for (size_t i = 0; i < levels.size(); ++i)
+		numLevels = std::max(numLevels, std::min(levels[i], maxLevels));
+	buildPyramids_(numLevels);
+
+	for (size_t l = 0; l < levels.size(); ++l)
+	{
+		if (levels[l] < 1 || levels[l] > maxLevels)
+			continue;
+		for (size_t s = 0; s < spatialSigmas.size(); ++s)
+		for (size_t r = 0; r < rangeSigmas.size(); ++r)
+		for (size_t c = 0; c < rangeCells.size(); ++c)
+		for (size_t p = 0; p < paddings.size(); ++p)
+		{
+			GridPreset preset;
+			preset.spatialSigma = spatialSigmas[s];
+			preset.rangeSigma = rangeSigmas[r];
+			preset.rangeCells = rangeCells[c];
+			preset.padding = paddings[p];
+			preset.numLevels = levels[l];
+			results.push_back(evaluate_(preset));
+		}
+	}
+	markPareto_();
+}
+
+bool GridTuner::select(double maxRmse, double minCoverage, GridPreset* preset) const
+{
+	const GridTuningResult* best = 0;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const GridTuningResult& r = results[i];
+		if (r.rmse > maxRmse || r.coverage < minCoverage)
+			continue;
+		if (!best || r.seconds < best->seconds || (r.seconds == best->seconds && r.bytes < best->bytes))
+			best = &r;
+	}
+	if (!best)
+		return false;
+	*preset = best->preset;
+	return true;
+}
+
+void GridTuner::report() const
+{
+	std::vector<const GridTuningResult*> sorted(results.size());
+	for (size_t i = 0; i < results.size(); ++i)
+		sorted[i] = &results[i];
+	std::sort(sorted.begin(), sorted.end(), [](const GridTuningResult* a, const GridTuningResult* b)
+	{
+		return (a->pareto != b->pareto) ? a->pareto : a->seconds < b->seconds;
+	});
+
+	LOGI("GridTuner: %d presets over %d frames of %dx%d", int(results.size()), int(frames_.size()), width_, height_);
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		const GridTuningResult& r = *sorted[i];
+		LOGI("%s sigma %g/%g rangeCells %d padding %d levels %d: %.2f ms, %.1f KB, rmse %.5f, coverage %.3f",
+			r.pareto ? "*" : " ", r.preset.spatialSigma, r.preset.rangeSigma, r.preset.rangeCells, r.preset.padding,
+			r.preset.numLevels, r.seconds * 1e3, r.bytes / 1024.0, r.rmse, r.coverage);
+	}
+}
@@ -0,0 +1,111 @@
+
+#ifndef GRIDTUNER_H
+#define GRIDTUNER_H
+
+#include "CpuHierarchicalUpsampler.h"
+#include "CpuImagePyramid.h"
+
+// the grid parameters of GlDepthUpsampler (and CpuHierarchicalUpsampler). the defaults are
+// the values it has always used: a cell per pixel, 16 range cells and no padding.
+struct GridPreset
+{
+	float spatialSigma;	// input pixels per cell, in x and y.
+	float rangeSigma;		// range units per cell.
+	int rangeCells;		// the extent of the range axis (the range input is [0, rangeCells - 1]).
+	int padding;			// cells of padding on each side, in x and y.
+	int numLevels;		// of the pyramids. more than one upsamples coarse to fine (UPSAMPLE_HIERARCHICAL).
+
+	GridPreset() : spatialSigma(1), rangeSigma(1), rangeCells(16), padding(0), numLevels(6) {}
+
+	glm::vec4 inputSize(int width, int height) const { return glm::vec4(width, height, rangeCells, 1); }
+	glm::vec4 sigma() const { return glm::vec4(spatialSigma, spatialSigma, rangeSigma, 1); }
+	glm::vec4 paddingSize() const { return glm::vec4(padding, padding, 0, 0); }
+
+	bool operator==(const GridPreset& p) const
+	{
+		return spatialSigma == p.spatialSigma && rangeSigma == p.rangeSigma && rangeCells == p.rangeCells &&
+			padding == p.padding && numLevels == p.numLevels;
+	}
+	bool operator!=(const GridPreset& p) const { return !(*this == p); }
+};
+
+// a preset is a text file of "name value" lines (spatialSigma, rangeSigma, rangeCells, padding, numLevels).
+// '#' starts a comment, and a name that is missing keeps the value of preset.
+bool loadGridPreset(const char* path, GridPreset* preset);
+bool saveGridPreset(const char* path, const GridPreset& preset);
+
+// a frame to tune on, of the size given to GridTuner::setup, in packed RGBA floats.
+struct GridTuningFrame
+{
+	std::vector<float> rgbd;		// the sparse depth in alpha, 1 (or 0) where there is none, as the rgbd pyramid.
+	std::vector<float> color;		// the colour reference.
+	std::vector<float> depth;		// the ground truth, one depth per pixel (0 where unknown).
+};
+
+struct GridTuningResult
+{
+	GridPreset preset;
+	double seconds;		// the upsample time of a frame (the fastest of the repeats, averaged over the frames).
+	size_t bytes;			// of the grid rasters, a pair that the levels share (as on the gpu), and the level results.
+	double rmse;			// of the upsampled depth against the ground truth.
+	double coverage;		// the fraction of the ground truth that got an upsampled depth.
+	bool pareto;			// no other result is at least as fast, as small and as accurate.
+};
+
+// Sweeps the grid parameters over a set of frames with ground truth, for speed against error.
+//
+// Every combination of the candidate values upsamples all the frames with the cpu engines (which
+// match the gpu ones, see CpuBilateralGrid), one level through a CpuBilateralGrid and more through
+// a CpuHierarchicalUpsampler. The results on the Pareto front of latency, memory and depth RMSE
+// are marked, and select() picks the cheapest one within an accuracy bar, to save as the preset
+// that GlDepthUpsampler loads at startup. The latencies are of the cpu engines, so they rank the
+// presets rather than predict the gpu times; run the tuner on each device class.
+class GridTuner
+{
+public:
+	GridTuner(ThreadPool* threadPool = 0);
+
+	// the size of the frames, which clears them.
+	void setup(int width, int height);
+	void addFrame(const GridTuningFrame& frame) { frames_.push_back(frame); }
+	// synthetic frames: planes at different depths behind colour edges, with a depth sample every
+	// sampleSpacing pixels (as a sparse point cloud projects) and a little depth noise.
+	void addSyntheticFrames(int numFrames, int sampleSpacing = 6, float depthNoise = 0.002f);
+	void clearFrames() { frames_.clear(); }
+
+	// upsamples the frames with every combination of the candidate values.
+	void run();
+	// the fastest result with rmse <= maxRmse and coverage >= minCoverage (ties go to the smaller one).
+	// false if none is.
+	bool select(double maxRmse, double minCoverage, GridPreset* preset) const;
+	// logs the results, the front first.
+	void report() const;
+
+public:
+
+	std::vector<float> spatialSigmas;
+	std::vector<float> rangeSigmas;
+	std::vector<int> rangeCells;
+	std::vector<int> paddings;
+	std::vector<int> levels;
+	int repeats;		// upsamples of each frame, the fastest of which is timed.
+
+	std::vector<GridTuningResult> results;
+
+	ThreadPool* threadPool_;
+
+private:
+
+	void buildPyramids_(int numLevels);
+	GridTuningResult evaluate_(const GridPreset& preset);
+	void accumulateError_(const GridTuningFrame& frame, double* squaredError, size_t* numCovered, size_t* numTruth) const;
+	void markPareto_();
+
+	int width_, height_;
+	std::vector<GridTuningFrame> frames_;
+	// the rgbd and colour pyramids of each frame, levels 0 and up.
+	std::vector<odd::ImagePyramid<float, 4> > rgbdPyramids_, colorPyramids_;
+	std::vector<float> result_;
+};
+
+#endif  // GRIDTUNER_H
@@ -25,6 +25,12 @@
 #define POINTCLOUD_RESX 256
 #define POINTCLOUD_RESY 256
 #define NUM_LEVELS 6
+#define UPSAMPLE_METHOD UPSAMPLE_BILATERALGRID // or UPSAMPLE_PERMUTOHEDRAL, UPSAMPLE_BILATERALSOLVER, UPSAMPLE_HIERARCHICAL
+#define GRID_PERSISTENCE_TIME 0.0f // seconds (0 = re-splat every frame)
+#define STORAGE_FORMAT STORAGE_RGBA32F // or STORAGE_RGBA16F, STORAGE_RGB8_DEPTH16
+#define GRID_COMPUTE_SPLAT false // splat with compute shaders on GLES 3.1 (false = point rendering)
+#define GRID_ADAPTIVE_RANGE false // equalize the range cells to the colours of each frame (fewer range cells for the same edges)
+#define GRID_PRESET_PATH "/sdcard/TangoUpsample/gridPreset.txt" // saved by GridTuner (if missing, the defaults and NUM_LEVELS)
 
 const float kZero = 0.0f;
 const glm::vec3 kZeroVec3 = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -56,6 +62,7 @@ Grid* ar_grid = 0;
 Cube *cube = 0;
 
 GlDepthUpsampler* depthUpsampler = 0;
+GridPreset gridPreset;
 
 // Single finger touch positional values.
 // First element in the array is x-axis touching position.
@@ -179,6 +186,23 @@ bool setupGlResources()
 	depthData = new DepthViewData();
 
 	depthUpsampler = new GlDepthUpsampler();
+	depthUpsampler->setUpsampleMethod(UPSAMPLE_METHOD);
+	depthUpsampler->setGridPersistence(GRID_PERSISTENCE_TIME);
+	depthUpsampler->setStorageFormat(STORAGE_FORMAT);
+	depthUpsampler->setComputeSplat(GRID_COMPUTE_SPLAT);
+	depthUpsampler->setAdaptiveRange(GRID_ADAPTIVE_RANGE);
+
+	// a tuned preset also picks the grid method: more than one level was tuned coarse to fine.
+	gridPreset = GridPreset();
+	gridPreset.numLevels = NUM_LEVELS;
+	if (loadGridPreset(GRID_PRESET_PATH, &gridPreset))
+	{
+		LOGI("grid preset: sigma %g/%g, %d range cells, padding %d, %d levels", gridPreset.spatialSigma, gridPreset.rangeSigma,
+			gridPreset.rangeCells, gridPreset.padding, gridPreset.numLevels);
+		if (UPSAMPLE_METHOD == UPSAMPLE_BILATERALGRID || UPSAMPLE_METHOD == UPSAMPLE_HIERARCHICAL)
+			depthUpsampler->setUpsampleMethod(gridPreset.numLevels > 1 ? UPSAMPLE_HIERARCHICAL : UPSAMPLE_BILATERALGRID);
+	}
+	depthUpsampler->setGridPreset(gridPreset);
 
 	glDisable(GL_CULL_FACE);
 	glDisable(GL_BLEND);
@@ -213,7 +237,7 @@ bool render(int portWidth, int portHeight)
 	updateViewData();
 
 	// ensure the depthupsampler is the right format.
-	depthUpsampler->setup(POINTCLOUD_RESX, POINTCLOUD_RESY, NUM_LEVELS);
+	depthUpsampler->setup(POINTCLOUD_RESX, POINTCLOUD_RESY, gridPreset.numLevels);
 
 	if (colorData)
 	{
@@ -238,13 +262,15 @@ bool render(int portWidth, int portHeight)
 		depthData->viewProjectionMat = colorData->viewProjectionMat;
 		depthData->viewToWorldMat = colorData->viewToWorldMat;
 
+		// the points carry their confidence in alpha, which weights their samples in the grid.
+		pointCloudData->pointclouds->pointAge = float(tango.color.timestamp - tango.pointcloud.timestamp);
 		depthUpsampler->renderPointcloudToTexture(
 			pointCloudData->pointclouds, 
-			depthData->viewProjectionMat, glm::inverse(depthData->viewToWorldMat), pointCloudData->pointclouds->defaultMaterial);
+			depthData->viewProjectionMat, glm::inverse(depthData->viewToWorldMat), pointCloudData->pointclouds->confidenceMaterial);
 
 		depthUpsampler->updateRgbdPyramid(depthUpsampler->pointcloudColorTexture_, depthUpsampler->pointcloudDepthTexture_);
 
-		depthUpsampler->upsampleRgbd();
+		depthUpsampler->upsampleRgbd(tango.pointcloud.timestamp, depthUpsampler->pointcloudColorTexture_);
 	}
 
 	/*
@@ -294,7 +320,7 @@ bool render(int portWidth, int portHeight)
 		if (depthUpdated)
 		{
 			// ensure the depthupsampler is the right format.
-			depthUpsampler->setup(depthData->rgbdTexture->width, depthData->rgbdTexture->height, NUM_LEVELS);
+			depthUpsampler->setup(depthData->rgbdTexture->width, depthData->rgbdTexture->height, gridPreset.numLevels);
 			// build the downsampling pyramids
 			depthUpsampler->updateRgbdPyramid(depthData->rgbdTexture, depthData->depthTexture);
 			depthUpsampler->updateColorPyramid(colorData->texture);
@@ -457,7 +483,7 @@ bool render(int portWidth, int portHeight)
 				{
 					//depthData->renderTexture(depthUpsampler->depthTexturePyramid_[level]->id);
 					//depthData->renderTexture(depthUpsampler->depthUpsampleTexture_[level]->id);
-					//depthData->renderTexture(depthUpsampler->bilateralGrids_[0]->gridTextures_[1]->id);
+					//depthData->renderTexture(depthUpsampler->bilateralGrids_[0]->gridTexture(1)->id);
 
 					glUseProgram(depthData->showDepthMaterial_.shader_program_);
 					GLuint srcClipRangeLoc_ = glGetUniformLocation(depthData->showDepthMaterial_.shader_program_, "srcClipRange");
@@ -532,7 +558,7 @@ bool render(int portWidth, int portHeight)
 			if (depthData)
 			{
 			setupViewport(0, 0, portWidth, portHeight, 1);
-			depthData->renderTexture(bilateralGrid_->gridTextures_[1]->id);
+			depthData->renderTexture(bilateralGrid_->gridTexture(1)->id);
 			}
 			}
 			else if (camSubMode == 5)
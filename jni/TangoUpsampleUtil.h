@@ -1,15 +1,42 @@
-
 #ifndef TANGOUPSAMPLE_UTIL_H
 #define TANGOUPSAMPLE_UTIL_H
 
 #include <pthread.h>
+#include <unistd.h>
+#include <time.h>
 #include <sstream>
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
 #include "oddcore/OddTypes.h"
 
 #define SharedPtr odd::SharedPtr
 
+// logging that also works without the android runtime (e.g. headless cpu builds).
+#ifndef LOGI
+#	define LOG_TAG "tango_jni_example"
+#	if ODD_PLATFORM == ODD_PLATFORM_ANDROID
+#		include <android/log.h>
+#		define LOGI(...) __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
+#		define LOGE(...) __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
+#	else
+#		include <stdio.h>
+#		define LOGI(...) (fprintf(stdout, __VA_ARGS__), fprintf(stdout, "\n"))
+#		define LOGE(...) (fprintf(stderr, __VA_ARGS__), fprintf(stderr, "\n"))
+#	endif
+#endif
+
+// the precision of the grid and image pyramid storage (textures on the gpu, containers on the cpu).
+// STORAGE_RGBA16F halves the memory and bandwidth of every image and grid.
+// STORAGE_RGB8_DEPTH16 stores the colour at 8 bits per channel and depth at 16 bits.
+enum StorageFormat {
+	STORAGE_RGBA32F = 0,
+	STORAGE_RGBA16F = 1,
+	STORAGE_RGB8_DEPTH16 = 2,
+};
+
 class Mutex
 {
 public:
@@ -50,4 +77,164 @@ public:
 	}
 };
 
+// monotonic wall-clock time in seconds (for profiling).
+inline double getTimeSeconds()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return double(t.tv_sec) + double(t.tv_nsec) * 1e-9;
+}
+
+// A fixed pool of worker threads for data-parallel loops.
+// The calling thread also takes work, so a pool of N threads has N-1 workers.
+// parallelFor calls from inside a running parallelFor are run serially on the caller.
+class ThreadPool
+{
+public:
+	typedef std::function<void(int begin, int end)> RangeFunc;
+
+	explicit ThreadPool(int numThreads = 0)
+	{
+		if (numThreads <= 0)
+			numThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+		if (numThreads <= 0)
+			numThreads = 1;
+
+		numThreads_ = numThreads;
+		func_ = 0;
+		begin_ = end_ = grain_ = next_ = 0;
+		generation_ = 0;
+		activeWorkers_ = 0;
+		busy_ = false;
+		quit_ = false;
+		pthread_mutex_init(&mutex_, 0);
+		pthread_cond_init(&workCond_, 0);
+		pthread_cond_init(&doneCond_, 0);
+
+		workers_.resize(numThreads_ - 1);
+		for (size_t i = 0; i < workers_.size(); ++i)
+			pthread_create(&workers_[i], 0, &ThreadPool::workerMain_, this);
+	}
+
+	~ThreadPool()
+	{
+		pthread_mutex_lock(&mutex_);
+		quit_ = true;
+		pthread_cond_broadcast(&workCond_);
+		pthread_mutex_unlock(&mutex_);
+		for (size_t i = 0; i < workers_.size(); ++i)
+			pthread_join(workers_[i], 0);
+		pthread_cond_destroy(&doneCond_);
+		pthread_cond_destroy(&workCond_);
+		pthread_mutex_destroy(&mutex_);
+	}
+
+	int numThreads() const { return numThreads_; }
+
+	// run func over [begin, end) in chunks of at least grain items.
+	void parallelFor(int begin, int end, const RangeFunc& func, int grain = 1)
+	{
+		if (end <= begin)
+			return;
+		if (grain < 1)
+			grain = 1;
+
+		pthread_mutex_lock(&mutex_);
+		if (busy_ || workers_.empty() || (end - begin) <= grain)
+		{
+			pthread_mutex_unlock(&mutex_);
+			func(begin, end);
+			return;
+		}
+
+		// split into a few chunks per thread so uneven rows balance out.
+		int chunk = (end - begin + numThreads_ * 4 - 1) / (numThreads_ * 4);
+		busy_ = true;
+		func_ = &func;
+		begin_ = begin;
+		end_ = end;
+		grain_ = std::max(chunk, grain);
+		next_ = begin;
+		activeWorkers_ = int(workers_.size());
+		++generation_;
+		pthread_cond_broadcast(&workCond_);
+		pthread_mutex_unlock(&mutex_);
+
+		runChunks_();
+
+		pthread_mutex_lock(&mutex_);
+		while (activeWorkers_ > 0)
+			pthread_cond_wait(&doneCond_, &mutex_);
+		func_ = 0;
+		busy_ = false;
+		pthread_mutex_unlock(&mutex_);
+	}
+
+	// a process-wide pool sized to the number of online cores.
+	static ThreadPool& shared()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+private:
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void runChunks_()
+	{
+		for (;;)
+		{
+			pthread_mutex_lock(&mutex_);
+			int b = next_;
+			int e = std::min(b + grain_, end_);
+			next_ = e;
+			const RangeFunc* func = func_;
+			pthread_mutex_unlock(&mutex_);
+
+			if (b >= e)
+				return;
+			(*func)(b, e);
+		}
+	}
+
+	static void* workerMain_(void* arg)
+	{
+		ThreadPool* pool = (ThreadPool*)arg;
+		unsigned int seenGeneration = 0;
+
+		pthread_mutex_lock(&pool->mutex_);
+		for (;;)
+		{
+			while (!pool->quit_ && seenGeneration == pool->generation_)
+				pthread_cond_wait(&pool->workCond_, &pool->mutex_);
+			if (pool->quit_)
+				break;
+			seenGeneration = pool->generation_;
+			pthread_mutex_unlock(&pool->mutex_);
+
+			pool->runChunks_();
+
+			pthread_mutex_lock(&pool->mutex_);
+			if (--pool->activeWorkers_ == 0)
+				pthread_cond_signal(&pool->doneCond_);
+		}
+		pthread_mutex_unlock(&pool->mutex_);
+		return 0;
+	}
+
+	int numThreads_;
+	std::vector<pthread_t> workers_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t workCond_;
+	pthread_cond_t doneCond_;
+	const RangeFunc* func_;
+	int begin_, end_, grain_, next_;
+	unsigned int generation_;
+	int activeWorkers_;
+	bool busy_;
+	bool quit_;
+};
+
 #endif  // TANGOUPSAMPLE_UTIL_H
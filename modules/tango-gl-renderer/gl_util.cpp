@@ -15,6 +15,7 @@
  */
 
 #include "tango-gl-renderer/gl_util.h"
+#include <EGL/egl.h>
 
 const glm::mat4 GlUtil::ss_to_ow_mat =
 glm::mat4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
@@ -169,6 +170,54 @@ GLuint GlUtil::CreateProgram(const char* vertex_source, const char* fragment_sou
 	return program;
 }
 
+GLuint GlUtil::CreateComputeProgram(const char* compute_source)
+{
+	GLuint compute_shader = LoadShader(GL_COMPUTE_SHADER, compute_source);
+	if (!compute_shader) {
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	if (program) {
+		glAttachShader(program, compute_shader);
+		CheckGlError("glAttachShader");
+		LinkProgram(program);
+	}
+	glDeleteShader(compute_shader);
+	return program;
+}
+
+void (GL_APIENTRY* GlUtil::DispatchCompute)(GLuint, GLuint, GLuint) = 0;
+void (GL_APIENTRY* GlUtil::BindImageTexture)(GLuint, GLuint, GLint, GLboolean, GLint, GLenum, GLenum) = 0;
+void (GL_APIENTRY* GlUtil::MemoryBarrier)(GLbitfield) = 0;
+
+bool GlUtil::LoadCompute()
+{
+	static int loaded = -1;
+	if (loaded >= 0)
+		return loaded != 0;
+
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	loaded = 0;
+	if (major > 3 || (major == 3 && minor >= 1))
+	{
+		DispatchCompute = (void (GL_APIENTRY*)(GLuint, GLuint, GLuint))eglGetProcAddress("glDispatchCompute");
+		BindImageTexture = (void (GL_APIENTRY*)(GLuint, GLuint, GLint, GLboolean, GLint, GLenum, GLenum))eglGetProcAddress("glBindImageTexture");
+		MemoryBarrier = (void (GL_APIENTRY*)(GLbitfield))eglGetProcAddress("glMemoryBarrier");
+		loaded = (DispatchCompute && BindImageTexture && MemoryBarrier) ? 1 : 0;
+	}
+	if (!loaded)
+	{
+		DispatchCompute = 0;
+		BindImageTexture = 0;
+		MemoryBarrier = 0;
+		LOGI("GlUtil: no GLES 3.1 compute in GLES %d.%d", major, minor);
+	}
+	return loaded != 0;
+}
+
 bool GlUtil::LinkProgram(GLuint& program)
 {
 	glLinkProgram(program);
@@ -30,6 +30,20 @@
 #include <GLES3/gl3ext.h>
 #include <memory>
 
+// GLES 3.1 is not in the android-19 headers and libraries the project builds against: its enums are
+// defined here, and its entry points are resolved at runtime (see GlUtil::LoadCompute).
+#ifndef GL_ES_VERSION_3_1
+#define GL_COMPUTE_SHADER                   0x91B9
+#define GL_SHADER_STORAGE_BUFFER            0x90D2
+#define GL_READ_ONLY                        0x88B8
+#define GL_WRITE_ONLY                       0x88B9
+#define GL_READ_WRITE                       0x88BA
+#define GL_TEXTURE_FETCH_BARRIER_BIT        0x00000008
+#define GL_BUFFER_UPDATE_BARRIER_BIT        0x00000200
+#define GL_FRAMEBUFFER_BARRIER_BIT          0x00000400
+#define GL_SHADER_STORAGE_BARRIER_BIT       0x00002000
+#endif
+
 #ifndef GL_OES_EGL_image_external
 #define GL_OES_EGL_image_external
 #define GL_TEXTURE_EXTERNAL_OES             0x8d65     /* 36197 */
@@ -138,6 +152,15 @@ public:
 	static bool checkFramebuffer();
 	static void CheckGlError(const char* operation,const char* file=0,int line=-1);
 	static GLuint CreateProgram(const char* vertex_source, const char* fragment_source);
+	// a program of a single compute shader (GLES 3.1, after LoadCompute).
+	static GLuint CreateComputeProgram(const char* compute_source);
+	// resolves the GLES 3.1 compute entry points below through eglGetProcAddress, once per process.
+	// false (and they stay 0) if the current context is older than 3.1 or lacks any of them.
+	static bool LoadCompute();
+	static void (GL_APIENTRY* DispatchCompute)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+	static void (GL_APIENTRY* BindImageTexture)(GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer,
+		GLenum access, GLenum format);
+	static void (GL_APIENTRY* MemoryBarrier)(GLbitfield barriers);
 	static bool LinkProgram(GLuint& program);
 	static GLuint createTexture(GLenum target = GL_TEXTURE_2D, int width = 256, int height = 256, GLenum internalType = GL_RGBA8, int numMipmaps=1);
 	static glm::quat ConvertRotationToOpenGL(const glm::quat& rotation);
@@ -0,0 +1,299 @@
+
+#ifndef ODD_IMAGE_H_INCLUDED
+#define ODD_IMAGE_H_INCLUDED
+
+#include "oddcore/OddTypes.h"
+#include <type_traits>
+
+namespace odd {
+/** \addtogroup Core
+*  @{
+*/
+/** \addtogroup Util
+*  @{
+*/
+//---------------------------------------------------------------------------------------------------------------------
+// the alignment of an image allocation (a cache line), and the default of its rows (a SIMD register,
+// so the rows of four floats are never padded and such an image is also a packed one).
+enum { kImageAlignment = 64, kImageRowAlignment = 16 };
+
+//---------------------------------------------------------------------------------------------------------------------
+// A block of memory aligned to kImageAlignment, that only grows.
+class ImageMemory
+{
+public:
+	inline ImageMemory() : allocation_(0), pointer_(0), capacity_(0) {}
+	inline ~ImageMemory() { reset(); }
+
+	// returns false (and keeps nothing) if the allocation fails.
+	inline bool reserve(size_t size);
+	inline void reset() { ::free(allocation_); allocation_ = pointer_ = 0; capacity_ = 0; }
+	inline uint8* pointer() const { return pointer_; }
+	inline size_t capacity() const { return capacity_; }
+
+private:
+	ImageMemory(const ImageMemory&);
+	ImageMemory& operator=(const ImageMemory&);
+
+	uint8* allocation_;	// as malloc returned it.
+	uint8* pointer_;		// aligned.
+	size_t capacity_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+inline bool ImageMemory::reserve(size_t size)
+{
+	if (size <= capacity_)
+		return true;
+
+	reset();
+	allocation_ = (uint8*)::malloc(size + kImageAlignment - 1);
+	if (!allocation_)
+		return false;
+	pointer_ = (uint8*)((size_t(allocation_) + kImageAlignment - 1) & ~size_t(kImageAlignment - 1));
+	capacity_ = size;
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A view of width x height pixels of Channels values of T, with the rows stride values of T apart.
+// A view does not own the pixels, so it is cheap to copy, and a view of a rect (roi) or of a level
+// of an ImagePyramid shares them. ImageView<const T, Channels> only reads.
+template <class T, int Channels>
+class ImageView
+{
+public:
+	typedef T Type;
+	enum { kChannels = Channels };
+
+	inline ImageView() : data_(0), width_(0), height_(0), stride_(0) {}
+	// stride in values of T, 0 = packed rows.
+	inline ImageView(T* data, int width, int height, int stride = 0)
+		: data_(data), width_(width), height_(height), stride_(stride > 0 ? stride : width * Channels) {}
+	// the read-only view of a view (or image) of the same channels.
+	template <class Other> inline ImageView(const ImageView<Other, Channels>& other)
+		: data_(other.data()), width_(other.width()), height_(other.height()), stride_(other.stride()) {}
+
+	inline int width() const { return width_; }
+	inline int height() const { return height_; }
+	inline int stride() const { return stride_; }
+	inline bool empty() const { return width_ <= 0 || height_ <= 0; }
+	inline bool packed() const { return stride_ == width_ * Channels; }
+	// of the pixels of a row, without the padding.
+	inline size_t rowBytes() const { return sizeof(T) * Channels * width_; }
+
+	// access:
+	inline T* data() const { return data_; }
+	inline T* row(int y) const { return data_ + size_t(y) * stride_; }
+	inline T* pixel(int x, int y) const { return row(y) + x * Channels; }
+	inline T& at(int x, int y, int channel = 0) const { return pixel(x, y)[channel]; }
+
+	// the view of a rect, clipped to the image.
+	inline ImageView roi(int x, int y, int width, int height) const;
+
+protected:
+	T* data_;
+	int width_, height_;
+	int stride_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+template <class T, int Channels>
+inline ImageView<T, Channels> ImageView<T, Channels>::roi(int x, int y, int width, int height) const
+{
+	const int x0 = ODD_MIN(ODD_MAX(x, 0), width_), x1 = ODD_MIN(ODD_MAX(x + width, x0), width_);
+	const int y0 = ODD_MIN(ODD_MAX(y, 0), height_), y1 = ODD_MIN(ODD_MAX(y + height, y0), height_);
+	return ImageView(data_ ? pixel(x0, y0) : 0, x1 - x0, y1 - y0, stride_);
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// An image that owns its pixels, with the rows aligned to rowAlignment bytes and the first one to
+// kImageAlignment. resize only reallocates when the image grows, so a stage can keep one image and
+// resize it every frame. Copying an image copies the pixels, and its row alignment.
+template <class T, int Channels>
+class Image : public ImageView<T, Channels>
+{
+public:
+	inline Image() : rowAlignment_(kImageRowAlignment) {}
+	inline Image(int width, int height, int rowAlignment = kImageRowAlignment) { resize(width, height, rowAlignment); }
+	inline Image(const Image& other) : ImageView<T, Channels>(), rowAlignment_(other.rowAlignment_) { assign(other); }
+	inline Image& operator=(const Image& other) { rowAlignment_ = other.rowAlignment_; assign(other); return *this; }
+
+	// the pixels are left as they were in memory, not moved to their new place.
+	// returns false (and leaves an empty image) if the allocation fails.
+	inline bool resize(int width, int height, int rowAlignment = kImageRowAlignment);
+	// a copy of the pixels of other, with its size. The rows keep the alignment of this image (of its
+	// last resize, or of the image it was copied from), since a view, such as a roi, has only the
+	// stride of the image it is in.
+	inline void assign(const ImageView<const T, Channels>& other);
+	inline void reset() { memory_.reset(); *static_cast<ImageView<T, Channels>*>(this) = ImageView<T, Channels>(); }
+
+	inline const ImageView<T, Channels>& view() const { return *this; }
+	// of the allocation.
+	inline size_t memoryBytes() const { return memory_.capacity(); }
+	inline int rowAlignment() const { return rowAlignment_; }
+
+private:
+	ImageMemory memory_;
+	int rowAlignment_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+// the stride of a row of width pixels, in values of T, padded to rowAlignment bytes.
+template <class T, int Channels>
+inline int imageStride(int width, int rowAlignment = kImageRowAlignment)
+{
+	const size_t alignment = ODD_MAX(size_t(rowAlignment), sizeof(T));
+	const size_t bytes = (sizeof(T) * Channels * ODD_MAX(width, 0) + alignment - 1) / alignment * alignment;
+	return int(bytes / sizeof(T));
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template <class T, int Channels>
+inline bool Image<T, Channels>::resize(int width, int height, int rowAlignment)
+{
+	width = ODD_MAX(width, 0);
+	height = ODD_MAX(height, 0);
+	rowAlignment_ = rowAlignment;
+	const int stride = imageStride<T, Channels>(width, rowAlignment);
+	if (!memory_.reserve(sizeof(T) * stride * size_t(height)))
+	{
+		reset();
+		return false;
+	}
+	*static_cast<ImageView<T, Channels>*>(this) = ImageView<T, Channels>((T*)memory_.pointer(), width, height, stride);
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// A pyramid of images in one allocation: level l is (width >> l) x (height >> l), each level starts
+// on kImageAlignment and its rows are aligned as those of an Image.
+template <class T, int Channels>
+class ImagePyramid
+{
+public:
+	inline ImagePyramid() : rowAlignment_(kImageRowAlignment) {}
+	inline ImagePyramid(const ImagePyramid& other) : rowAlignment_(kImageRowAlignment) { assign(other); }
+	inline ImagePyramid& operator=(const ImagePyramid& other) { assign(other); return *this; }
+
+	// returns false (and leaves no levels) if the allocation fails.
+	inline bool resize(int width, int height, int numLevels, int rowAlignment = kImageRowAlignment);
+	// a copy of the levels of other, with its row alignment.
+	inline void assign(const ImagePyramid& other);
+
+	inline int numLevels() const { return int(levels_.size()); }
+	inline const ImageView<T, Channels>& level(int l) const { return levels_[l]; }
+	inline size_t memoryBytes() const { return memory_.capacity(); }
+	inline int rowAlignment() const { return rowAlignment_; }
+
+private:
+	ImageMemory memory_;
+	std::vector<ImageView<T, Channels> > levels_;
+	int rowAlignment_;
+};
+
+//---------------------------------------------------------------------------------------------------------------------
+template <class T, int Channels>
+inline bool ImagePyramid<T, Channels>::resize(int width, int height, int numLevels, int rowAlignment)
+{
+	rowAlignment_ = rowAlignment;
+	levels_.resize(ODD_MAX(numLevels, 0));
+	std::vector<size_t> offsets(levels_.size());
+	size_t size = 0;
+	for (size_t l = 0; l < levels_.size(); ++l)
+	{
+		offsets[l] = size;
+		const int stride = imageStride<T, Channels>(width >> l, rowAlignment);
+		size += (sizeof(T) * stride * size_t(ODD_MAX(height >> l, 0)) + kImageAlignment - 1) & ~size_t(kImageAlignment - 1);
+	}
+	if (!memory_.reserve(size))
+	{
+		levels_.clear();
+		return false;
+	}
+	for (size_t l = 0; l < levels_.size(); ++l)
+		levels_[l] = ImageView<T, Channels>((T*)(memory_.pointer() + offsets[l]), ODD_MAX(width >> l, 0), ODD_MAX(height >> l, 0),
+			imageStride<T, Channels>(width >> l, rowAlignment));
+	return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// copies the pixels of src to dst, as much of them as both have.
+template <class S, class T, int Channels>
+inline void copyImage(const ImageView<S, Channels>& src, const ImageView<T, Channels>& dst)
+{
+	static_assert(std::is_same<typename std::remove_const<S>::type, T>::value, "copyImage needs images of one type, see convertImage");
+	const int width = ODD_MIN(src.width(), dst.width()), height = ODD_MIN(src.height(), dst.height());
+	if (width <= 0)
+		return;
+	if (src.packed() && dst.packed() && width == src.width() && width == dst.width())
+		::memmove(dst.data(), src.data(), sizeof(T) * Channels * width * size_t(height));
+	else
+	{
+		for (int y = 0; y < height; ++y)
+			::memmove(dst.row(y), src.row(y), sizeof(T) * Channels * width);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// converts the values of src to the type of dst, times scale (as much of the image as both have).
+template <class S, class T, int Channels>
+inline void convertImage(const ImageView<S, Channels>& src, const ImageView<T, Channels>& dst, float scale = 1.0f)
+{
+	const int width = ODD_MIN(src.width(), dst.width()), height = ODD_MIN(src.height(), dst.height());
+	for (int y = 0; y < height; ++y)
+	{
+		const S* in = src.row(y);
+		T* out = dst.row(y);
+		for (int i = 0; i < width * Channels; ++i)
+			out[i] = T(in[i] * scale);
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+// sets every pixel of dst to value (Channels values).
+template <class T, int Channels>
+inline void fillImage(const ImageView<T, Channels>& dst, const T* value)
+{
+	for (int y = 0; y < dst.height(); ++y)
+	{
+		T* out = dst.row(y);
+		for (int x = 0; x < dst.width(); ++x, out += Channels)
+			for (int c = 0; c < Channels; ++c)
+				out[c] = value[c];
+	}
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template <class T, int Channels>
+inline void Image<T, Channels>::assign(const ImageView<const T, Channels>& other)
+{
+	if (other.data() == this->data())
+		return;
+	resize(other.width(), other.height(), rowAlignment_);
+	copyImage(other, this->view());
+}
+
+//---------------------------------------------------------------------------------------------------------------------
+template <class T, int Channels>
+inline void ImagePyramid<T, Channels>::assign(const ImagePyramid& other)
+{
+	if (&other == this)
+		return;
+	rowAlignment_ = other.rowAlignment_;
+	if (other.levels_.empty())
+	{
+		levels_.clear();
+		return;
+	}
+	resize(other.levels_[0].width(), other.levels_[0].height(), other.numLevels(), rowAlignment_);
+	for (int l = 0; l < numLevels(); ++l)
+		copyImage(other.levels_[l], levels_[l]);
+}
+
+	//---------------------------------------------------------------------------------------------------------------------
+	/** @} */
+	/** @} */
+}
+
+#endif // ODD_IMAGE_H_INCLUDED